@@ -0,0 +1,529 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* baseline.c - comparison against baseline results (see baseline.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "baseline.h"
+#include "histogram.h"
+
+#ifndef max
+ #define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+#define MAX_DEPTH 16
+#define KEY_SIZE 32
+#define NAME_WIDTH 32
+
+typedef struct {
+  char *capture;                /* NULL for the totals of the run */
+  char codec[NAME_WIDTH];
+  rfbBaselineStats stats;
+  /* While reading the results of one capture */
+  Bool detailed;
+  double sum, sum2;
+  rfbHistogram *update;
+  Bool active;
+  int pass, update_no;
+  double tUpdate;
+} baseline_entry;
+
+static baseline_entry *entries = NULL;
+static int nentries = 0, maxentries = 0;
+static Bool loaded = FALSE;
+static double maxBytes = 1.0, maxTime = 5.0, maxP99 = 10.0, alpha = 0.05;
+static Bool gateP99 = FALSE;
+static int width = 7, ncompared = 0, nregressions = 0;
+
+Bool rfbBaselineSetThresholds(const char *spec)
+{
+  char name[16];
+  double value;
+  int n;
+
+  while (*spec) {
+    if (sscanf(spec, "%15[a-z0-9]=%lf%n", name, &value, &n) != 2)
+      return FALSE;
+    if (!strcmp(name, "bytes")) maxBytes = value;
+    else if (!strcmp(name, "time")) maxTime = value;
+    else if (!strcmp(name, "p99")) {
+      maxP99 = value;
+      gateP99 = TRUE;
+    }
+    else if (!strcmp(name, "alpha") && value > 0. && value < 1.)
+      alpha = value;
+    else return FALSE;
+    spec += n;
+    if (*spec == ',') spec++;
+    else if (*spec) return FALSE;
+  }
+  return TRUE;
+}
+
+static baseline_entry *find_entry(const char *capture, const char *codec,
+                                  Bool create)
+{
+  baseline_entry *e;
+  int i;
+
+  for (i = 0; i < nentries; i++) {
+    e = &entries[i];
+    if ((capture ? e->capture && !strcmp(e->capture, capture) : !e->capture)
+        && !strcmp(e->codec, codec))
+      return e;
+  }
+  if (!create) return NULL;
+
+  if (nentries >= maxentries) {
+    baseline_entry *newEntries;
+    maxentries = maxentries ? maxentries * 2 : 64;
+    newEntries = (baseline_entry *)realloc(entries, maxentries *
+                                           sizeof(baseline_entry));
+    if (!newEntries) return NULL;
+    entries = newEntries;
+  }
+  e = &entries[nentries];
+  memset(e, 0, sizeof(baseline_entry));
+  if (capture && (e->capture = strdup(capture)) == NULL) return NULL;
+  snprintf(e->codec, NAME_WIDTH, "%s", codec);
+  nentries++;
+  return e;
+}
+
+/*
+ * The JSON parser only keeps track of the key of each container, or for the
+ * elements of an array, the key of the array.  That is enough to tell apart
+ * the few values it needs from the rest, since results.c and corpus.c never
+ * use the same key for two different things at the same level.
+ */
+
+typedef struct {
+  Bool object;
+  char ctx[KEY_SIZE];
+} json_level;
+
+typedef struct {
+  FILE *f;
+  int line;
+  Bool outOfMemory, nameTooLong;
+  json_level stack[MAX_DEPTH];
+  int depth;
+  Bool wantKey;
+  char key[KEY_SIZE];
+  /* The current pass, rectangle, and capture */
+  int pass, update_no;
+  Bool warmup;
+  char *capture;
+  /* The current codec record.  Only summaries have a pass count. */
+  char codec[NAME_WIDTH];
+  rfbBaselineStats stats;
+  Bool summary;
+} json_parser;
+
+static Bool read_string(json_parser *p, char *buf, size_t size)
+{
+  size_t n = 0;
+  int c;
+
+  while ((c = getc(p->f)) != '"') {
+    if (c == EOF || c == '\n') return FALSE;
+    if (c == '\\') {
+      char hex[5];
+      switch (c = getc(p->f)) {
+        case 'b':  c = '\b';  break;
+        case 'f':  c = '\f';  break;
+        case 'n':  c = '\n';  break;
+        case 'r':  c = '\r';  break;
+        case 't':  c = '\t';  break;
+        case 'u':
+          if (fscanf(p->f, "%4[0-9a-fA-F]", hex) != 1) return FALSE;
+          c = (int)strtol(hex, NULL, 16);
+          if (c > 127) c = '?';
+          break;
+        case EOF:
+          return FALSE;
+      }
+    }
+    if (n < size - 1) buf[n++] = (char)c;
+  }
+  buf[n] = 0;
+  return TRUE;
+}
+
+/* Copies a key or a codec name, which must fit in size bytes */
+
+static Bool copy_name(json_parser *p, char *dst, size_t size, const char *src)
+{
+  if (snprintf(dst, size, "%s", src) >= (int)size) {
+    p->nameTooLong = TRUE;
+    return FALSE;
+  }
+  return TRUE;
+}
+
+static Bool set_value(json_parser *p, const char *value)
+{
+  const char *ctx = p->stack[p->depth - 1].ctx, *key = p->key;
+
+  if (!strcmp(ctx, "passes")) {
+    if (!strcmp(key, "pass")) p->pass = atoi(value);
+    else if (!strcmp(key, "warmup")) p->warmup = !strcmp(value, "true");
+  } else if (!strcmp(ctx, "rects")) {
+    if (!strcmp(key, "update")) p->update_no = atoi(value);
+  } else if (!strcmp(ctx, "captures")) {
+    if (!strcmp(key, "capture")) {
+      free(p->capture);
+      if ((p->capture = strdup(value)) == NULL) p->outOfMemory = TRUE;
+    }
+  } else if (!strcmp(ctx, "codecs")) {
+    if (!strcmp(key, "codec"))
+      return copy_name(p, p->codec, NAME_WIDTH, value);
+    else if (!strcmp(key, "bytes"))
+      p->stats.bytes = strtoull(value, NULL, 10);
+    else if (!strcmp(key, "passes")) {
+      p->stats.passes = atoi(value);
+      p->summary = TRUE;
+    } else if (!strcmp(key, "time")) p->stats.time = atof(value);
+    else if (!strcmp(key, "stdev")) p->stats.stdev = atof(value);
+    else if (!strcmp(key, "p99")) p->stats.p99 = atof(value);
+  }
+  return TRUE;
+}
+
+/* Called at the end of each codec record.  where is the context of the
+   object that contains the record. */
+
+static Bool add_record(json_parser *p, const char *where)
+{
+  baseline_entry *e;
+
+  if (p->summary) {
+    if (!strcmp(where, "captures") && p->capture)
+      e = find_entry(p->capture, p->codec, TRUE);
+    else if (!strcmp(where, "totals"))
+      e = find_entry(NULL, p->codec, TRUE);
+    else return TRUE;
+    if (!e) goto nomem;
+    e->stats = p->stats;
+    return TRUE;
+  }
+
+  if (p->warmup || !strcmp(p->codec, "raw")) return TRUE;
+  if ((e = find_entry(NULL, p->codec, TRUE)) == NULL) goto nomem;
+  e->detailed = TRUE;
+  if (!strcmp(where, "totals")) {
+    e->stats.bytes = p->stats.bytes;
+    e->stats.passes++;
+    e->sum += p->stats.time;
+    e->sum2 += p->stats.time * p->stats.time;
+  } else if (!strcmp(where, "rects")) {
+    if (!e->update) {
+      if ((e->update = (rfbHistogram *)malloc(sizeof(rfbHistogram))) == NULL)
+        goto nomem;
+      rfbHistogramReset(e->update);
+    }
+    if (e->active && (p->pass != e->pass || p->update_no != e->update_no)) {
+      rfbHistogramRecord(e->update, e->tUpdate);
+      e->tUpdate = 0.0;
+    }
+    e->active = TRUE;
+    e->pass = p->pass;
+    e->update_no = p->update_no;
+    e->tUpdate += p->stats.time;
+  }
+  return TRUE;
+
+  nomem:
+  p->outOfMemory = TRUE;
+  return FALSE;
+}
+
+static Bool parse(json_parser *p)
+{
+  char buf[4096];
+  int c;
+
+  for (;;) {
+    if ((c = getc(p->f)) == EOF)
+      return p->depth == 0;
+    if (c == '\n') p->line++;
+    if (isspace(c) || c == ':') continue;
+
+    if (c == ',') {
+      if (p->depth > 0 && p->stack[p->depth - 1].object) p->wantKey = TRUE;
+      continue;
+    }
+    if (c == '{' || c == '[') {
+      json_level *l;
+      if (p->depth >= MAX_DEPTH) return FALSE;
+      l = &p->stack[p->depth];
+      l->object = (c == '{');
+      if (p->depth > 0 && !p->stack[p->depth - 1].object)
+        strcpy(l->ctx, p->stack[p->depth - 1].ctx);
+      else
+        snprintf(l->ctx, KEY_SIZE, "%s", p->depth > 0 ? p->key : "");
+      p->depth++;
+      if (l->object) {
+        p->wantKey = TRUE;
+        if (!strcmp(l->ctx, "codecs")) {
+          p->codec[0] = 0;
+          memset(&p->stats, 0, sizeof(p->stats));
+          p->summary = FALSE;
+        }
+      }
+      continue;
+    }
+    if (c == '}' || c == ']') {
+      if (p->depth < 1 || p->stack[p->depth - 1].object != (c == '}'))
+        return FALSE;
+      p->depth--;
+      if (c == '}' && p->depth >= 2 &&
+          !strcmp(p->stack[p->depth].ctx, "codecs") &&
+          !add_record(p, p->stack[p->depth - 2].ctx))
+        return FALSE;
+      p->wantKey = FALSE;
+      continue;
+    }
+
+    if (c == '"') {
+      if (!read_string(p, buf, sizeof(buf))) return FALSE;
+      if (p->depth > 0 && p->stack[p->depth - 1].object && p->wantKey) {
+        if (!copy_name(p, p->key, KEY_SIZE, buf)) return FALSE;
+        p->wantKey = FALSE;
+        continue;
+      }
+    } else if (c == '-' || isalnum(c)) {
+      size_t n = 0;
+      do {
+        if (n < 63) buf[n++] = (char)c;
+        c = getc(p->f);
+      } while (c == '-' || c == '+' || c == '.' || isalnum(c));
+      ungetc(c, p->f);
+      buf[n] = 0;
+    } else
+      return FALSE;
+    if (p->depth > 0 && p->stack[p->depth - 1].object &&
+        !set_value(p, buf))
+      return FALSE;
+  }
+}
+
+Bool rfbBaselineLoad(const char *file)
+{
+  json_parser p;
+  Bool ok;
+  int i;
+
+  memset(&p, 0, sizeof(p));
+  p.line = 1;
+  if ((p.f = fopen(file, "r")) == NULL) {
+    perror("Cannot open baseline file");
+    return FALSE;
+  }
+  ok = parse(&p);
+  fclose(p.f);
+  free(p.capture);
+  if (p.outOfMemory) {
+    perror("Cannot allocate baseline");
+    return FALSE;
+  }
+  if (p.nameTooLong) {
+    fprintf(stderr,
+            "Baseline file %s has a key or codec name longer than %d "
+            "characters at line %d\n", file, NAME_WIDTH - 1, p.line);
+    return FALSE;
+  }
+  if (!ok) {
+    fprintf(stderr, "Baseline file %s is malformed at line %d\n", file,
+            p.line);
+    return FALSE;
+  }
+
+  for (i = 0; i < nentries; i++) {
+    baseline_entry *e = &entries[i];
+    int n = e->stats.passes;
+    if (!e->detailed) continue;
+    if (n > 0) e->stats.time = e->sum / (double)n;
+    if (n > 1)
+      e->stats.stdev = sqrt(max(e->sum2 - e->sum * e->stats.time, 0.) /
+                            (double)(n - 1));
+    if (e->update) {
+      if (e->active)
+        rfbHistogramRecord(e->update, e->tUpdate);
+      e->stats.p99 = rfbHistogramPercentile(e->update, 99.);
+      free(e->update);
+      e->update = NULL;
+    }
+  }
+  if (nentries < 1) {
+    fprintf(stderr, "Baseline file %s has no results\n", file);
+    return FALSE;
+  }
+  loaded = TRUE;
+  return TRUE;
+}
+
+Bool rfbBaselineLoaded(void)
+{
+  return loaded;
+}
+
+/* The regularized incomplete beta function I_x(a, b), evaluated with its
+   continued fraction by the modified Lentz method */
+
+static double beta_fraction(double a, double b, double x)
+{
+  double c = 1., d = 1. - (a + b) * x / (a + 1.), h;
+  int m;
+
+  if (fabs(d) < 1e-300) d = 1e-300;
+  d = 1. / d;
+  h = d;
+  for (m = 1; m <= 200; m++) {
+    double aa, delta;
+    aa = m * (b - m) * x / ((a + 2. * m - 1.) * (a + 2. * m));
+    d = 1. + aa * d;
+    if (fabs(d) < 1e-300) d = 1e-300;
+    c = 1. + aa / c;
+    if (fabs(c) < 1e-300) c = 1e-300;
+    d = 1. / d;
+    h *= d * c;
+    aa = -(a + m) * (a + b + m) * x / ((a + 2. * m) * (a + 2. * m + 1.));
+    d = 1. + aa * d;
+    if (fabs(d) < 1e-300) d = 1e-300;
+    c = 1. + aa / c;
+    if (fabs(c) < 1e-300) c = 1e-300;
+    d = 1. / d;
+    delta = d * c;
+    h *= delta;
+    if (fabs(delta - 1.) < 1e-12) break;
+  }
+  return h;
+}
+
+static double incomplete_beta(double a, double b, double x)
+{
+  double front;
+
+  if (x <= 0.) return 0.;
+  if (x >= 1.) return 1.;
+  front = exp(lgamma(a + b) - lgamma(a) - lgamma(b) + a * log(x) +
+              b * log(1. - x));
+  if (x < (a + 1.) / (a + b + 2.))
+    return front * beta_fraction(a, b, x) / a;
+  return 1. - front * beta_fraction(b, a, 1. - x) / b;
+}
+
+/* Returns the two-sided p-value of Welch's t-test for the mean times, or -1
+   if either run made fewer than two timed passes */
+
+static double welch_test(const rfbBaselineStats *x, const rfbBaselineStats *y)
+{
+  double vx, vy, se2, t, df;
+
+  if (x->passes < 2 || y->passes < 2) return -1.;
+  vx = x->stdev * x->stdev / (double)x->passes;
+  vy = y->stdev * y->stdev / (double)y->passes;
+  se2 = vx + vy;
+  if (se2 <= 0.) return x->time == y->time ? 1. : 0.;
+  t = (x->time - y->time) / sqrt(se2);
+  df = se2 * se2 / (vx * vx / (double)(x->passes - 1) +
+                    vy * vy / (double)(y->passes - 1));
+  return incomplete_beta(df / 2., 0.5, df / (df + t * t));
+}
+
+void rfbBaselineBeginReport(int captureWidth)
+{
+  width = captureWidth;
+  ncompared = nregressions = 0;
+  printf("Changes from the baseline (regression if bytes > +%g%% or mean time "
+         "> +%g%% with p < %g", maxBytes, maxTime, alpha);
+  if (gateP99)
+    printf(",\nor p99 update latency > +%g%%", maxP99);
+  printf("):\n");
+  printf("%-*s %-12s %12s %8s %10s %8s %7s %10s %8s\n", width, "Capture",
+         "Codec", "Bytes", "Change", "Mean time", "Change", "p", "p99",
+         "Change");
+}
+
+static double change(double now, double then)
+{
+  return then > 0. ? (now - then) * 100. / then : 0.;
+}
+
+void rfbBaselineCompare(const char *capture, const char *label,
+                        const char *codec, const rfbBaselineStats *stats)
+{
+  baseline_entry *e;
+  double bytes, time, p99, p;
+  char pvalue[16], what[32] = "";
+  int len = (int)strlen(label);
+
+  if (!strcmp(codec, "raw")) return;
+  printf("%-*s %-12.12s", width, len > width ? label + len - width : label,
+         codec);
+  if ((e = find_entry(capture, codec, FALSE)) == NULL) {
+    printf(" (not in the baseline)\n");
+    return;
+  }
+
+  bytes = change((double)stats->bytes, (double)e->stats.bytes);
+  time = change(stats->time, e->stats.time);
+  p99 = change(stats->p99, e->stats.p99);
+  p = welch_test(stats, &e->stats);
+  if (p < 0.)
+    snprintf(pvalue, sizeof(pvalue), "-");
+  else
+    snprintf(pvalue, sizeof(pvalue), "%.4f", p);
+  printf(" %12llu %+7.2f%% %9.4fs %+7.2f%% %7s %8.3fms %+7.2f%%",
+         stats->bytes, bytes, stats->time, time, pvalue, stats->p99 * 1000.,
+         p99);
+
+  if (bytes > maxBytes) strcat(what, " bytes");
+  if (time > maxTime && p < alpha) strcat(what, " time");
+  if (gateP99 && p99 > maxP99) strcat(what, " p99");
+  ncompared++;
+  if (*what) {
+    nregressions++;
+    printf("  REGRESSED:%s", what);
+  }
+  printf("\n");
+}
+
+int rfbBaselineEndReport(void)
+{
+  printf("\n%d of %d codec results regressed.\n\n", nregressions, ncompared);
+  return nregressions;
+}
+
+void rfbBaselineFree(void)
+{
+  int i;
+
+  for (i = 0; i < nentries; i++) {
+    free(entries[i].capture);
+    free(entries[i].update);
+  }
+  free(entries);
+  entries = NULL;
+  nentries = maxentries = 0;
+  loaded = FALSE;
+}
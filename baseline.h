@@ -0,0 +1,84 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * baseline.h - comparison against baseline results
+ *
+ * A baseline is a JSON file written by an earlier run, either the per-
+ * rectangle results of one capture (see results.h) or the summary of a corpus
+ * or sharded run, which looks like this:
+ *
+ *   {"captures": [{"capture": "<path>", "codecs": [<codec>, ...]}, ...],
+ *    "totals": {"codecs": [<codec>, ...]}}
+ *
+ * where each <codec> is
+ *
+ *   {"codec": "<name>", "bytes": <n>, "passes": <n>, "time": <seconds>,
+ *    "stdev": <seconds>, "p99": <seconds>}
+ *
+ * The time is the mean time per timed pass and the p99 is the 99th percentile
+ * update latency over all of the timed passes.  For the results of one
+ * capture, the same statistics are computed from the pass totals and the
+ * per-rectangle records, and they are treated as the totals of the run.
+ *
+ * A codec regresses if its bytes or mean time grow by more than the threshold
+ * (a percentage) for each.  A growth in mean time only counts if it is also
+ * significant according to Welch's t-test, unless either run made fewer than
+ * two timed passes, in which case the test can't be done.  The bytes are
+ * deterministic.  The p99 latency is a single sample per run, so it can't be
+ * tested for significance, and it can change by more than 10% between two
+ * runs of the same code.  Thus, the change in p99 latency is only reported,
+ * unless a p99 threshold is set explicitly.
+ */
+
+#ifndef __BASELINE_H__
+#define __BASELINE_H__
+
+#include "rfb.h"
+
+typedef struct {
+  unsigned long long bytes;
+  int passes;                   /* Number of timed passes */
+  double time, stdev;           /* Mean and standard deviation per pass */
+  double p99;                   /* Seconds */
+} rfbBaselineStats;
+
+/* Parses a list of thresholds, such as "bytes=0.5,time=5,p99=10,alpha=0.01"
+   (alpha is the significance level of the t-test.)  The p99 latency is only
+   checked if the list sets its threshold. */
+extern Bool rfbBaselineSetThresholds(const char *spec);
+
+extern Bool rfbBaselineLoad(const char *file);
+extern Bool rfbBaselineLoaded(void);
+
+/* Prints the header of the comparison table.  width is the width of the
+   capture column. */
+extern void rfbBaselineBeginReport(int width);
+
+/* Compares the results of one codec against the baseline and prints a row of
+   the table.  capture is NULL for the totals of the run, and label is the
+   name to show in the capture column. */
+extern void rfbBaselineCompare(const char *capture, const char *label,
+                               const char *codec,
+                               const rfbBaselineStats *stats);
+
+/* Prints a summary and returns the number of regressions */
+extern int rfbBaselineEndReport(void);
+
+extern void rfbBaselineFree(void);
+
+#endif /* __BASELINE_H__ */
@@ -0,0 +1,186 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* capture.c - session capture reader (see capture.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "capture.h"
+
+#define CAPTURE_BUFFER_SIZE (1024*1024)
+
+Bool rfbCaptureOpen(rfbCapture *cap, const char *filename)
+{
+  int fd = STDIN_FILENO;
+
+  if (filename && (fd = open(filename, O_RDONLY)) < 0)
+    return FALSE;
+  if (!rfbCaptureOpenFd(cap, fd)) {
+    if (filename) close(fd);
+    return FALSE;
+  }
+  return TRUE;
+}
+
+/* The file descriptor is closed by rfbCaptureClose(), unless it is stdin. */
+Bool rfbCaptureOpenFd(rfbCapture *cap, int fd)
+{
+  struct stat st;
+
+  memset(cap, 0, sizeof(rfbCapture));
+  cap->fd = fd;
+
+  if (fstat(cap->fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0 &&
+      (off_t)(size_t)st.st_size == st.st_size) {
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                     cap->fd, 0);
+    if (map != MAP_FAILED) {
+      madvise(map, (size_t)st.st_size, MADV_SEQUENTIAL);
+      cap->mapped = TRUE;
+      cap->buf = cap->ptr = (char *)map;
+      cap->bufSize = (size_t)st.st_size;
+      cap->end = cap->buf + cap->bufSize;
+      return TRUE;
+    }
+  }
+
+  /* Fall back to streaming */
+  if ((cap->buf = (char *)malloc(CAPTURE_BUFFER_SIZE)) == NULL) {
+    errno = ENOMEM;
+    return FALSE;
+  }
+  cap->bufSize = CAPTURE_BUFFER_SIZE;
+  cap->ptr = cap->end = cap->buf;
+  return TRUE;
+}
+
+void rfbCaptureClose(rfbCapture *cap)
+{
+  if (cap->mapped)
+    munmap(cap->buf, cap->bufSize);
+  else
+    free(cap->buf);
+  if (cap->fd != STDIN_FILENO)
+    close(cap->fd);
+  cap->buf = cap->ptr = cap->end = NULL;
+}
+
+/* Returns FALSE if the capture is a pipe or another non-seekable stream */
+Bool rfbCaptureRewind(rfbCapture *cap)
+{
+  return rfbCaptureSeek(cap, 0);
+}
+
+Bool rfbCaptureSeek(rfbCapture *cap, off_t offset)
+{
+  if (cap->mapped) {
+    if (offset < 0 || (size_t)offset > cap->bufSize)
+      return FALSE;
+    cap->ptr = cap->buf + offset;
+  } else {
+    if (lseek(cap->fd, offset, SEEK_SET) != offset)
+      return FALSE;
+    cap->ptr = cap->end = cap->buf;
+    cap->bufOffset = offset;
+  }
+  cap->eof = cap->error = FALSE;
+  return TRUE;
+}
+
+char *rfbCaptureFill(rfbCapture *cap, size_t n)
+{
+  size_t avail = cap->end - cap->ptr;
+  off_t offset = rfbCaptureTell(cap);
+  char *ptr;
+
+  if (cap->mapped) {
+    cap->eof = TRUE;
+    return NULL;
+  }
+
+  /* Move the unread data to the start of the buffer, growing the buffer if
+     it can't hold n bytes. */
+  if (n > cap->bufSize) {
+    size_t newSize = cap->bufSize;
+    char *newBuf;
+    while (newSize < n) newSize *= 2;
+    if ((newBuf = (char *)malloc(newSize)) == NULL) {
+      cap->error = TRUE;
+      return NULL;
+    }
+    memcpy(newBuf, cap->ptr, avail);
+    free(cap->buf);
+    cap->buf = newBuf;
+    cap->bufSize = newSize;
+  } else if (avail > 0)
+    memmove(cap->buf, cap->ptr, avail);
+  cap->bufOffset = offset;
+  cap->ptr = cap->buf;
+  cap->end = cap->buf + avail;
+
+  while ((size_t)(cap->end - cap->ptr) < n) {
+    ssize_t bytes = read(cap->fd, cap->end,
+                         cap->bufSize - (cap->end - cap->buf));
+    if (bytes < 0) {
+      if (errno == EINTR) continue;
+      cap->error = TRUE;
+      return NULL;
+    }
+    if (bytes == 0) {
+      cap->eof = TRUE;
+      return NULL;
+    }
+    cap->end += bytes;
+  }
+
+  ptr = cap->ptr;
+  cap->ptr += n;
+  return ptr;
+}
+
+/* Like rfbCaptureRead(), but doesn't advance the read position */
+char *rfbCapturePeek(rfbCapture *cap, size_t n)
+{
+  char *ptr = rfbCaptureRead(cap, n);
+  if (ptr) cap->ptr -= n;
+  return ptr;
+}
+
+int rfbCaptureFillc(rfbCapture *cap)
+{
+  char *ptr = rfbCaptureFill(cap, 1);
+  return ptr ? (int)*(CARD8 *)ptr : EOF;
+}
+
+Bool rfbCaptureSkip(rfbCapture *cap, off_t n)
+{
+  while (n > 0) {
+    size_t chunk = (n > CAPTURE_BUFFER_SIZE) ? CAPTURE_BUFFER_SIZE : (size_t)n;
+    if ((size_t)(cap->end - cap->ptr) >= chunk)
+      cap->ptr += chunk;
+    else if (!rfbCaptureFill(cap, chunk))
+      return FALSE;
+    n -= chunk;
+  }
+  return TRUE;
+}
@@ -0,0 +1,69 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * capture.h - session capture reader
+ *
+ * A capture is memory-mapped if possible, in which case rfbCaptureRead()
+ * returns pointers straight into the mapping.  Otherwise (stdin, pipes, or
+ * files that are too large to map into a 32-bit address space), the capture
+ * is streamed through a buffer that grows as needed, and the returned pointer
+ * is only valid until the next call to rfbCaptureRead(), rfbCapturePeek(),
+ * rfbCaptureGetc(), or rfbCaptureSkip().  The data must be treated as
+ * read-only in either case.
+ */
+
+#ifndef __CAPTURE_H__
+#define __CAPTURE_H__
+
+#include <sys/types.h>
+#include "rfb.h"
+
+typedef struct {
+  int fd;
+  Bool mapped;
+  char *buf;       /* Start of the mapping or the stream buffer */
+  size_t bufSize;  /* Size of the mapping or the stream buffer */
+  char *ptr;       /* Current read position */
+  char *end;       /* End of the valid data */
+  off_t bufOffset; /* File offset of buf */
+  Bool eof, error;
+} rfbCapture;
+
+extern Bool rfbCaptureOpen(rfbCapture *cap, const char *filename);
+extern Bool rfbCaptureOpenFd(rfbCapture *cap, int fd);
+extern void rfbCaptureClose(rfbCapture *cap);
+extern Bool rfbCaptureRewind(rfbCapture *cap);
+extern Bool rfbCaptureSeek(rfbCapture *cap, off_t offset);
+extern Bool rfbCaptureSkip(rfbCapture *cap, off_t n);
+extern char *rfbCapturePeek(rfbCapture *cap, size_t n);
+extern char *rfbCaptureFill(rfbCapture *cap, size_t n);
+extern int rfbCaptureFillc(rfbCapture *cap);
+
+#define rfbCaptureTell(cap) ((cap)->bufOffset + ((cap)->ptr - (cap)->buf))
+
+/* Returns a pointer to the next n bytes, or NULL if there aren't that many */
+#define rfbCaptureRead(cap, n)                                   \
+  ((size_t)((cap)->end - (cap)->ptr) >= (size_t)(n) ?            \
+   ((cap)->ptr += (n)) - (n) : rfbCaptureFill(cap, n))
+
+/* Returns the next byte, or EOF */
+#define rfbCaptureGetc(cap)                                      \
+  ((cap)->ptr < (cap)->end ? (int)*(CARD8 *)(cap)->ptr++ :       \
+   rfbCaptureFillc(cap))
+
+#endif /* __CAPTURE_H__ */
@@ -0,0 +1,31 @@
+# Compares a run of compare-encodings against the -json results of an earlier
+# run of the same build on the same capture.  Nothing has changed, so no codec
+# may regress.  The bytes and the default p99 setting are checked as they are.
+# The mean time threshold is raised, because a shared test machine can be
+# 10-15% slower in one run than in the next, and the t-test (which compares
+# the passes of the two runs) takes that for a real change.
+#
+# Variables: COMPARE_ENCODINGS, FBS_SYNTH, WORKDIR
+
+set(CAPTURE ${WORKDIR}/testbaseline.rfb)
+set(BASELINE ${WORKDIR}/testbaseline.json)
+set(OPTIONS -24 -warmup 1 -iterations 5)
+
+execute_process(COMMAND ${FBS_SYNTH} -size 320x240 -frames 20 -o ${CAPTURE}
+  mix RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "fbs-synth failed (${status})")
+endif()
+
+execute_process(COMMAND ${COMPARE_ENCODINGS} ${OPTIONS} -json ${BASELINE}
+  ${CAPTURE} RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR "compare-encodings -json failed (${status})")
+endif()
+
+execute_process(COMMAND ${COMPARE_ENCODINGS} ${OPTIONS} -baseline ${BASELINE}
+  -threshold time=100 ${CAPTURE} RESULT_VARIABLE status)
+if(NOT status EQUAL 0)
+  message(FATAL_ERROR
+    "compare-encodings -baseline exited with status ${status} when comparing a run against its own baseline")
+endif()
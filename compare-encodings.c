@@ -26,28 +26,44 @@
  *
  */
 
+#ifdef __linux__
+#define _GNU_SOURCE
+#include <sched.h>
+#endif
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <netinet/in.h>
 #include <string.h>
 #include <limits.h>
 #include <errno.h>
-#include <sys/time.h>
+#include <time.h>
+#include <pthread.h>
 
 #include "rfb.h"
+#include "capture.h"
+#include "index.h"
+#include "histogram.h"
+#include "results.h"
+#include "baseline.h"
+#include "corpus.h"
+#include "pipeline.h"
+#include "link.h"
+#include "perf.h"
+#include "quality.h"
 
 #ifndef min
  #define min(a,b) ((a)<(b)?(a):(b))
 #endif
+#ifndef max
+ #define max(a,b) ((a)>(b)?(a):(b))
+#endif
 
 #define BUFFER_SIZE (1024*512)
 static char buffer[BUFFER_SIZE];
 
-static char *compressedData = NULL;
-static char *uncompressedData = NULL;
-
 #define GET_PIXEL8(pix, ptr) ((pix) = *(ptr)++)
 
 #define GET_PIXEL16(pix, ptr) (((CARD8*)&(pix))[0] = *(ptr)++, \
@@ -70,183 +86,179 @@ static char *raw_buffer;
 static z_stream decompStream;
 static Bool decompStreamInited = False;
 
-/*
- * Variables for the ``tight'' encoding implementation.
- */
-
-/* Separate buffer for compressed data. */
-#define ZLIB_BUFFER_SIZE 512
-static char zlib_buffer[ZLIB_BUFFER_SIZE];
-
-/* Four independent compression streams for zlib library. */
-static z_stream zlibStream[4];
-Bool zlibStreamActive[4] = {
-  False, False, False, False
-};
-
-/* Filter stuff. Should be initialized by filter initialization code. */
-static Bool cutZeros;
-static int rectWidth, rectColors;
-static char tightPalette[256*4];
-static CARD8 tightPrevRow[2048*3*sizeof(CARD16)];
-
-#ifndef TIGERD
-/* JPEG decoder state. */
-
-static Bool jpegError;
-
-#include <jpeglib.h>
-#include <turbojpeg.h>
-
-tjhandle tjhnd=NULL;
-
-#ifdef H264
-extern Bool ResetH264Encoder(rfbClientPtr);
-#endif
-
-/*
- * JPEG source manager functions for JPEG decompression in Tight decoder.
- */
-
-static struct jpeg_source_mgr jpegSrcManager;
-static JOCTET *jpegBufferPtr;
-static size_t jpegBufferLen;
-
-static void
-JpegInitSource(j_decompress_ptr cinfo)
-{
-  jpegError = False;
-}
-
-static boolean
-JpegFillInputBuffer(j_decompress_ptr cinfo)
-{
-  jpegError = True;
-  jpegSrcManager.bytes_in_buffer = jpegBufferLen;
-  jpegSrcManager.next_input_byte = (JOCTET *)jpegBufferPtr;
-
-  return TRUE;
-}
-
-static void
-JpegSkipInputData(j_decompress_ptr cinfo, long num_bytes)
-{
-  if (num_bytes < 0 || num_bytes > jpegSrcManager.bytes_in_buffer) {
-    jpegError = True;
-    jpegSrcManager.bytes_in_buffer = jpegBufferLen;
-    jpegSrcManager.next_input_byte = (JOCTET *)jpegBufferPtr;
-  } else {
-    jpegSrcManager.next_input_byte += (size_t) num_bytes;
-    jpegSrcManager.bytes_in_buffer -= (size_t) num_bytes;
-  }
-}
-
-static void
-JpegTermSource(j_decompress_ptr cinfo)
-{
-  /* No work necessary here. */
-}
-
-static void
-JpegSetSrcManager(j_decompress_ptr cinfo, CARD8 *compressedData,
-		  int compressedLen)
-{
-  jpegBufferPtr = (JOCTET *)compressedData;
-  jpegBufferLen = (size_t)compressedLen;
-
-  jpegSrcManager.init_source = JpegInitSource;
-  jpegSrcManager.fill_input_buffer = JpegFillInputBuffer;
-  jpegSrcManager.skip_input_data = JpegSkipInputData;
-  jpegSrcManager.resync_to_restart = jpeg_resync_to_restart;
-  jpegSrcManager.term_source = JpegTermSource;
-  jpegSrcManager.next_input_byte = jpegBufferPtr;
-  jpegSrcManager.bytes_in_buffer = jpegBufferLen;
-
-  cinfo->src = &jpegSrcManager;
-}
-
-#endif
+/* ZRLE rectangles are inflated in one go into a buffer that grows as needed,
+   and the tiles are then decoded from it. */
+static int zrle_buffer_size = 0;
+static char *zrle_buffer = NULL;
+static int zywrleBuf[rfbZRLETileWidth * rfbZRLETileHeight];
 
-static long
-ReadCompactLen (void)
-{
-  long len;
-  CARD8 b;
-
-  if (!ReadFromRFBServer((char *)&b, 1))
-    return -1;
-  len = (int)b & 0x7F;
-  if (b & 0x80) {
-    if (!ReadFromRFBServer((char *)&b, 1))
-      return -1;
-    len |= ((int)b & 0x7F) << 7;
-    if (b & 0x80) {
-      if (!ReadFromRFBServer((char *)&b, 1))
-	return -1;
-      len |= ((int)b & 0xFF) << 14;
-    }
-  }
-  return len;
-}
+static z_stream zrleStream;
+static Bool zrleStreamInited = False;
 
 #define myFormat rfbClient.format
 #define BPP 8
 #include "hextiled.c"
 #include "zlibd.c"
-#ifdef TIGERD
-#include "tigerd.cxx"
-#else
-#include "tightd.c"
-#endif
+#include "zrled.c"
 #undef BPP
 #define BPP 16
 #include "hextiled.c"
 #include "zlibd.c"
-#ifdef TIGERD
-#include "tigerd.cxx"
-#else
-#include "tightd.c"
-#endif
+#include "zrled.c"
 #undef BPP
 #define BPP 32
 #include "hextiled.c"
 #include "zlibd.c"
-#ifdef TIGERD
-#include "tigerd.cxx"
-#else
-#include "tightd.c"
-#endif
+#include "zrled.c"
 #undef BPP
 
 #define TIGHT_STATISTICS
-#ifdef TIGHT_STATISTICS
-extern unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect, ndxpixels, jpegrect, jpegpixels, gradrect, gradpixels, fcrect, fcpixels;
-#endif
 
 
+/* Uses the monotonic clock, so that the timings are immune to NTP and other
+   adjustments of the wall clock */
 double gettime(void)
 {
-  struct timeval tv;
-  gettimeofday(&tv, (struct timezone *)NULL);
-  return((double)tv.tv_sec+(double)tv.tv_usec*0.000001);
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return((double)ts.tv_sec+(double)ts.tv_nsec*0.000000001);
 }
 
 #define SAVE_PATH  "./ppm"
 /* #define SAVE_PPM_FILES */
-/* #define LAZY_TIGHT */
 
 static int color_depth = 16;
-static int sum_raw = 0, sum_tight = 0, sum_hextile = 0, sum_zlib = 0,
+
+/* Name of the ZRLE column (ZYWRLE if -zywrle was specified) */
+static const char *zrle_name = "ZRLE";
+
+/* Framebuffer size to use if the capture doesn't start with a ServerInit
+   message */
+static int fb_width = 1280, fb_height = 1024;
+static unsigned long long sum_raw = 0, sum_hextile = 0, sum_zlib = 0,
   sum_zrle = 0;
-static double t0, ttight[2]={0.,0.}, thextile[2]={0.,0.}, tzlib[2]={0.,0.},
-  tzrle[2]={0.,0.};
+
+/* Each pass over the capture is timed separately.  The first warmup passes
+   are excluded from the statistics. */
+static int warmup = 0, iterations = 2;
+static double t0, *thextile, *tzlib, *tzrle;
 static int tndx = 0;
 
-static void show_usage (char *program_name);
-static int do_convert (FILE *in);
-static int parse_fb_update (FILE *in);
+/*
+ * The totals above hide the tail latency, which is what shows up as frame
+ * stutter, so each call to send_rectangle() and each whole framebuffer update
+ * is also timed separately for each codec.
+ */
+
+typedef struct {
+  rfbHistogram rect, update;
+  rfbHistogram timed;      /* Update latency over all timed passes */
+  double tUpdate;          /* Time spent on the current update so far */
+  unsigned long long pixels;
+  rfbLink *link;           /* One for each -link profile */
+  rfbPerfCounts perf;      /* Hardware counters, with -perf */
+} codec_latency;
+
+static codec_latency lat_hextile, lat_zlib, lat_zrle;
+
+/* Emulated network links (see link.h) */
+
+#define MAX_LINKS 8
 
-static int parse_rectangle (FILE *in, int xpos, int ypos,
+static rfbLinkProfile links[MAX_LINKS];
+static int nlinks = 0;
+
+/* With -perf, the hardware counters are read around the same sections of
+   send_rectangle() as the encoding/decoding time (see perf.h.) */
+static int use_perf = 0;
+static Bool perf = FALSE;
+static rfbPerfCounts perf_before;
+
+/*
+ * Each selected Tight encoder variant gets its own client record, so that
+ * the variants don't share zlib stream state, and its own totals.  In
+ * decoding mode, each is paired with a decoder variant.
+ */
+
+#define MAX_VARIANTS 16
+
+typedef struct {
+  const rfbTightEncoderVariant *enc;
+  const rfbTightDecoderVariant *dec;
+  rfbClientRec client;
+  unsigned long long sum;
+  double *t;
+  codec_latency lat;
+  rfbQuality quality;
+} tight_variant;
+
+static tight_variant variants[MAX_VARIANTS];
+static int nvariants = 0;
+
+/*
+ * Encoder levels (see setLevels in rfb.h.)  Each of -cl, -ql, and -samp takes
+ * a list of levels, and an empty list leaves that level at each variant's
+ * default.  With -sweep, every combination of the levels in the lists is
+ * benchmarked in turn over the same capture, and the size, time, and quality
+ * of each combination are tabulated at the end.  Otherwise, each list can
+ * contain only one level.
+ */
+
+#define MAX_LEVELS 16
+
+enum { LEVEL_COMPRESS, LEVEL_QUALITY, LEVEL_SUBSAMP, NLEVELS };
+
+static int levels[NLEVELS][MAX_LEVELS];
+static int nlevels[NLEVELS];
+static int npoints = 1;
+static Bool sweep = FALSE;
+
+typedef struct {
+  int level[NLEVELS];
+  unsigned long long bytes;
+  double time;                  /* Mean over the timed passes */
+  Bool hasQuality;
+  double psnr, ssim;
+} sweep_point;
+
+/* Indexed by point * nvariants + variant */
+static sweep_point *sweep_points;
+
+static int select_variants (char *encoders, char *decoders);
+
+static void show_usage (char *program_name);
+static void print_centered (const char *s, int width);
+static void print_totals (void);
+static void print_latency (void);
+static void print_statistics (int npasses);
+static void set_result (rfbCodecResult *r, const char *codec,
+                        unsigned long long bytes, double t);
+static void write_totals (void);
+static void reset_latency (codec_latency *lat);
+static void add_timed_latency (Bool reset);
+static void record_rect (codec_latency *lat, double t, int pixels);
+static void record_update (codec_latency *lat);
+static int parse_levels (int which, const char *s);
+static void set_levels (int point);
+static void record_sweep_point (int point, int npasses);
+static void print_sweep (void);
+static int parse_links (const char *s);
+static int alloc_links (codec_latency *lat);
+static void record_link (codec_latency *lat, unsigned long long bytes,
+                         double te, double td);
+static void print_links (void);
+static void perf_begin (void);
+static void perf_end (codec_latency *lat);
+static void print_perf (void);
+static void print_phases (void);
+static void print_quality (void);
+static int run_passes (rfbCapture *in, int npasses, Bool restart);
+static int do_convert (rfbCapture *in);
+static int read_server_init (rfbCapture *in, int *width, int *height);
+static int resize_framebuffer (int width, int height);
+static int parse_fb_update (rfbCapture *in);
+
+static int parse_rectangle (rfbCapture *in, int xpos, int ypos,
                             int width, int height, int rect_no, int enc);
 static int send_rectangle (int xpos, int ypos, int width, int height,
                            int rect_no, int pixel_bytes);
@@ -255,15 +267,15 @@ static int send_rectangle (int xpos, int ypos, int width, int height,
 static int save_rectangle (FILE *ppm, int width, int height, int depth);
 #endif
 
-static int handle_hextile8 (FILE *in, int x, int y, int width, int height);
-static int handle_hextile16 (FILE *in, int x, int y, int width, int height);
-static int handle_hextile32 (FILE *in, int x, int y, int width, int height);
+static int handle_hextile8 (rfbCapture *in, int x, int y, int width, int height);
+static int handle_hextile16 (rfbCapture *in, int x, int y, int width, int height);
+static int handle_hextile32 (rfbCapture *in, int x, int y, int width, int height);
 
-static int handle_raw8 (FILE *in, int x, int y, int width, int height);
-static int handle_raw16 (FILE *in, int x, int y, int width, int height);
-static int handle_raw32 (FILE *in, int x, int y, int width, int height);
+static int handle_raw8 (rfbCapture *in, int x, int y, int width, int height);
+static int handle_raw16 (rfbCapture *in, int x, int y, int width, int height);
+static int handle_raw32 (rfbCapture *in, int x, int y, int width, int height);
 
-static void copy_data (char *data, int x, int y, int w, int h, int bpp);
+static void copy_data (const char *data, int x, int y, int w, int h, int bpp);
 
 static CARD32 get_CARD32 (char *ptr);
 static CARD16 get_CARD16 (char *ptr);
@@ -271,7 +283,7 @@ static CARD16 get_CARD16 (char *ptr);
 
 static int total_updates;
 static int total_rects;
-static unsigned long total_pixels;
+static unsigned long long total_pixels;
 static int tightonly = 0;
 static int verbose = 0;
 static int flip_rgb = 0;
@@ -282,20 +294,109 @@ static int rfbICEBlockSize = 256;
 int decompress = 0;
 FILE *out = NULL;
 char *outfilename = NULL;
+static Bool results = FALSE;
+extern XImage *image;           /* The decoded framebuffer (see misc.c) */
+
+/*
+ * With -cache, the first pass also writes each decoded rectangle, in the
+ * framebuffer's pixel format, to a raw-encoded capture in an unlinked spill
+ * file.  The remaining passes read the spill file (which is memory-mapped, so
+ * it stays in the page cache if there is enough memory) instead of the
+ * original capture, so the hextile decoding and red/blue swapping are done
+ * only once and replaying an update is just a memcpy() per row.
+ */
+static int use_cache = 0;
+static FILE *cache = NULL;
+
+static FILE *open_cache (void);
+static int replay_cache (rfbCapture *in);
+static int write_cache (const void *buf, size_t len);
+static int cache_server_init (int width, int height);
+static int cache_rectangle (int x, int y, int width, int height,
+                            int pixel_bytes);
+
+/*
+ * With -pipeline or -socket, the decoder runs in its own thread and decodes
+ * the output of the encoder while the encoder is still producing it, through
+ * a ring of pipeline_chunks chunks or through a socket (see pipeline.h.)  The
+ * end-to-end latency of an update is measured from the start of the first
+ * encoder call for the update to the end of the decoding of its last
+ * rectangle.  The decoder thread owns the decoding times and latencies of the
+ * Tight variant while it is running.
+ */
+static Bool pipeline = FALSE;
+static int pipeline_chunks = 0, pipeline_cpu = -1;
+static int pipeline_socket = -1, pipeline_flush = rfbPipelineFlushChunk;
+static pthread_t pipeline_thread;
+static Bool pipeline_running = FALSE, pipeline_failed = FALSE;
+static double pipeline_tUpdate = -1.0;
+static double pipeline_tStart, pipeline_tEnd;
+static int pipeline_updates;
+static rfbHistogram lat_pipeline;
+static rfbPipelineStatistics pipeline_stats;
+
+static int start_pipeline (void);
+static int stop_pipeline (Bool abort);
+
+/*
+ * With -range, only the updates from range_first to range_last - 1 are
+ * benchmarked.  The framebuffer is restored from the last checkpoint in the
+ * capture index (see index.h) before the first of them.  The updates between
+ * the checkpoint and the prefix are only decoded, and the prefix_updates
+ * updates just before range_first are encoded, to warm up the encoders' zlib
+ * streams, but not counted.  With -shards, the capture is split into
+ * contiguous ranges of about the same size, which are benchmarked by worker
+ * processes in the same way as the captures in a corpus (see corpus.h.)
+ *
+ * With -sample, only every sample_interval'th update of the range is encoded.
+ * The others are only decoded, so that the framebuffer is still up to date.
+ */
+static long long range_first = 0, range_last = -1;  /* -1 = to the end */
+static int prefix_updates = 32, checkpoint_interval = 1000;
+static int nshards = 0, sample_interval = 1;
+static rfbCaptureIndex capture_index;
+static Bool have_index = FALSE;
+
+static long long update_no;     /* Number of the current update in the capture */
+static Bool encoding = TRUE;    /* Whether the current update is encoded */
+static Bool warming = FALSE;    /* Whether it is part of the prefix */
+static Bool indexing = FALSE;   /* Whether the index is being built */
+
+static int load_index (rfbCapture *in, const char *filename);
+static int seek_range (rfbCapture *in);
+static void begin_update (void);
+static void reset_totals (void);
+static int skip_message (rfbCapture *in, int msg_type);
+static int run_shards (const char *program, const char *filename,
+                       const char *jsonfilename, int jobs, int cpu,
+                       char **args, int nargs);
+static int compare_baseline (const char *filename);
 
 int main (int argc, char *argv[])
 {
-  FILE *in;
+  rfbCapture in;
   int i;
   char *filename = NULL;
-  int err;
+  char *encoders = NULL, *decoders = NULL;
+  char *jsonfilename = NULL, *csvfilename = NULL, *baseline = NULL;
+  char *corpus = NULL, **worker_args;
+  int regressions = 0, err = 0, cpu = -1, npasses, jobs, nworker_args = 0, point;
 
   if (argc < 2) {
     show_usage (argv[0]);
     return 1;
   }
 
-  for (i = 0; i < argc; i++) {
+  /* In corpus mode, the options (other than those that control the corpus
+     runner itself) are passed on to the workers. */
+  if ((worker_args = (char **)malloc (argc * sizeof(char *))) == NULL) {
+    perror ("Cannot allocate argument list");
+    return 1;
+  }
+  jobs = (int)sysconf (_SC_NPROCESSORS_ONLN);
+
+  for (i = 1; i < argc; i++) {
+    int first = i, pass_on = 1;
     if (strcmp (argv[i], "-8") == 0) {
       color_depth = 8;
     } else if (strcmp (argv[i], "-16") == 0) {
@@ -311,22 +412,302 @@ int main (int argc, char *argv[])
         outfilename = argv[++i];
         tightonly = 1;
       }
+    } else if (strcmp (argv[i], "-size") == 0) {
+      if (i < argc - 1 &&
+          sscanf (argv[++i], "%dx%d", &fb_width, &fb_height) != 2) {
+        show_usage (argv[0]);
+        return 1;
+      }
     } else if (strcmp (argv[i], "-r") == 0) {
       flip_rgb = 1;
     } else if (strcmp (argv[i], "-v") == 0) {
       verbose = 1;
+    } else if (strcmp (argv[i], "-cache") == 0) {
+      use_cache = 1;
+    } else if (strcmp (argv[i], "-perf") == 0) {
+      use_perf = 1;
+    } else if (strcmp (argv[i], "-pipeline") == 0) {
+      if (i < argc - 1) {
+        if ((pipeline_chunks = atoi (argv[++i])) < 2)
+          pipeline_chunks = 2;
+        pipeline = TRUE;
+        decompress = 1;
+        tightonly = 1;
+      }
+    } else if (strcmp (argv[i], "-socket") == 0) {
+      if (i < argc - 1) {
+        i++;
+        if (strcmp (argv[i], "tcp") == 0)
+          pipeline_socket = rfbPipelineTCP;
+        else if (strcmp (argv[i], "unix") == 0)
+          pipeline_socket = rfbPipelineUnix;
+        else {
+          show_usage (argv[0]);
+          return 1;
+        }
+        pipeline = TRUE;
+        decompress = 1;
+        tightonly = 1;
+      }
+    } else if (strcmp (argv[i], "-flush") == 0) {
+      if (i < argc - 1) {
+        i++;
+        if (strcmp (argv[i], "chunk") == 0)
+          pipeline_flush = rfbPipelineFlushChunk;
+        else if (strcmp (argv[i], "rect") == 0)
+          pipeline_flush = rfbPipelineFlushRect;
+        else if (strcmp (argv[i], "update") == 0)
+          pipeline_flush = rfbPipelineFlushUpdate;
+        else {
+          show_usage (argv[0]);
+          return 1;
+        }
+      }
+    } else if (strcmp (argv[i], "-link") == 0) {
+      if (i < argc - 1 && parse_links (argv[++i]) != 0) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-cl") == 0) {
+      if (i < argc - 1 && parse_levels (LEVEL_COMPRESS, argv[++i]) != 0) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-ql") == 0) {
+      if (i < argc - 1 && parse_levels (LEVEL_QUALITY, argv[++i]) != 0) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-samp") == 0) {
+      if (i < argc - 1 && parse_levels (LEVEL_SUBSAMP, argv[++i]) != 0) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-sweep") == 0) {
+      sweep = TRUE;
+      use_cache = 1;
+      tightonly = 1;
+    } else if (strcmp (argv[i], "-zywrle") == 0) {
+      if (i < argc - 1) {
+        rfbZRLEPreferredEncoding = rfbEncodingZYWRLE;
+        rfbZRLEQualityLevel = atoi (argv[++i]);
+        zrle_name = "ZYWRLE";
+      }
+    } else if (strcmp (argv[i], "-json") == 0) {
+      if (i < argc - 1) jsonfilename = argv[++i];
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-csv") == 0) {
+      if (i < argc - 1) csvfilename = argv[++i];
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-baseline") == 0) {
+      if (i < argc - 1) baseline = argv[++i];
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-threshold") == 0) {
+      if (i < argc - 1 && !rfbBaselineSetThresholds (argv[++i])) {
+        show_usage (argv[0]);
+        return 1;
+      }
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-corpus") == 0) {
+      if (i < argc - 1) corpus = argv[++i];
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-jobs") == 0) {
+      if (i < argc - 1) jobs = atoi (argv[++i]);
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-shards") == 0) {
+      if (i < argc - 1 && (nshards = atoi (argv[++i])) < 1) {
+        show_usage (argv[0]);
+        return 1;
+      }
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-range") == 0) {
+      if (i < argc - 1) {
+        i++;
+        if (sscanf (argv[i], "%lld-%lld", &range_first, &range_last) < 1 ||
+            range_first < 0 ||
+            (range_last >= 0 && range_last <= range_first)) {
+          show_usage (argv[0]);
+          return 1;
+        }
+        if (argv[i][strlen (argv[i]) - 1] == '-')
+          range_last = -1;
+      }
+      pass_on = 0;
+    } else if (strcmp (argv[i], "-prefix") == 0) {
+      if (i < argc - 1 && (prefix_updates = atoi (argv[++i])) < 0)
+        prefix_updates = 0;
+    } else if (strcmp (argv[i], "-checkpoint") == 0) {
+      if (i < argc - 1 && (checkpoint_interval = atoi (argv[++i])) < 1)
+        checkpoint_interval = 1;
+    } else if (strcmp (argv[i], "-sample") == 0) {
+      if (i < argc - 1 && (sample_interval = atoi (argv[++i])) < 1)
+        sample_interval = 1;
+    } else if (strcmp (argv[i], "-warmup") == 0) {
+      if (i < argc - 1 && (warmup = atoi (argv[++i])) < 0)
+        warmup = 0;
+    } else if (strcmp (argv[i], "-iterations") == 0) {
+      if (i < argc - 1 && (iterations = atoi (argv[++i])) < 1)
+        iterations = 1;
+#ifdef __linux__
+    } else if (strcmp (argv[i], "-cpu") == 0) {
+      if (i < argc - 1) cpu = atoi (argv[++i]);
+      pass_on = 0;
+#endif
+    } else if (strcmp (argv[i], "-enc") == 0) {
+      if (i < argc - 1) encoders = argv[++i];
+    } else if (strcmp (argv[i], "-dec") == 0) {
+      if (i < argc - 1) decoders = argv[++i];
 #ifdef ICE_SUPPORTED
     } else if (strcmp (argv[i], "-ice") == 0) {
       interframe = 1;
 #endif
-    } else filename = argv[i];
+    } else {
+      filename = argv[i];
+      pass_on = 0;
+    }
+    if (pass_on) {
+      for (; first <= i; first++)
+        worker_args[nworker_args++] = argv[first];
+    }
+  }
+
+  if (pipeline && (outfilename || jsonfilename || csvfilename ||
+                   corpus || nlinks || use_perf)) {
+    fprintf (stderr, "The -pipeline and -socket options can't be used with -o, -json, -csv,\n-corpus, -link, or -perf.\n");
+    return 1;
+  }
+
+  if (sweep && (outfilename || jsonfilename || csvfilename || corpus ||
+                pipeline)) {
+    fprintf (stderr, "The -sweep option can't be used with -o, -json, -csv, -corpus, -pipeline,\nor -socket.\n");
+    return 1;
+  }
+  if (!sweep && (nlevels[LEVEL_COMPRESS] > 1 || nlevels[LEVEL_QUALITY] > 1 ||
+                 nlevels[LEVEL_SUBSAMP] > 1)) {
+    fprintf (stderr, "The -cl, -ql, and -samp options take a list of levels only with -sweep.\n");
+    return 1;
+  }
+
+  if ((nshards || range_first > 0 || range_last >= 0) &&
+      (outfilename || use_cache || pipeline || corpus)) {
+    fprintf (stderr, "The -shards and -range options can't be used with -o, -cache, -sweep,\n-pipeline, -socket, or -corpus.\n");
+    return 1;
+  }
+  if (nshards && (range_first > 0 || range_last >= 0 || csvfilename)) {
+    fprintf (stderr, "The -shards option can't be used with -range or -csv.\n");
+    return 1;
+  }
+  if (baseline && (sweep || outfilename)) {
+    fprintf (stderr, "The -baseline option can't be used with -sweep or -o.\n");
+    return 1;
+  }
+  if (sample_interval > 1 && outfilename) {
+    fprintf (stderr, "The -sample option can't be used with -o.\n");
+    return 1;
+  }
+  if ((nshards || range_first > 0 || range_last >= 0) && !filename) {
+    fprintf (stderr, "The -shards and -range options require an input file.\n");
+    return 1;
+  }
+
+  if (baseline && !rfbBaselineLoad (baseline))
+    return 1;
+
+  if (nshards)
+    return run_shards (access ("/proc/self/exe", X_OK) == 0 ?
+                       "/proc/self/exe" : argv[0], filename, jsonfilename,
+                       jobs, cpu, worker_args, nworker_args);
+
+  if (corpus) {
+    if (outfilename || csvfilename) {
+      fprintf (stderr, "The -o and -csv options can't be used with -corpus.\n");
+      return 1;
+    }
+    return rfbRunCorpus (access ("/proc/self/exe", X_OK) == 0 ?
+                         "/proc/self/exe" : argv[0], corpus, jsonfilename,
+                         jobs, cpu, worker_args, nworker_args);
+  }
+
+  if (select_variants (encoders, decoders) != 0)
+    return 1;
+
+  /* By default, sweep the JPEG quality, with JPEG disabled as the first
+     point */
+  if (sweep && !nlevels[LEVEL_COMPRESS] && !nlevels[LEVEL_QUALITY] &&
+      !nlevels[LEVEL_SUBSAMP])
+    parse_levels (LEVEL_QUALITY, "-1,15,30,50,70,80,90,95");
+  for (i = 0; i < NLEVELS; i++)
+    npoints *= max (nlevels[i], 1);
+  if (nlevels[LEVEL_COMPRESS] || nlevels[LEVEL_QUALITY] ||
+      nlevels[LEVEL_SUBSAMP]) {
+    for (i = 0; i < nvariants; i++) {
+      if (!variants[i].enc->setLevels)
+        fprintf (stderr, "WARNING: The levels of encoder %s can't be changed.  Using its defaults.\n",
+                 variants[i].enc->name);
+    }
+  }
+  if (sweep && (sweep_points = (sweep_point *)
+                calloc (npoints * nvariants, sizeof(sweep_point))) == NULL) {
+    perror ("Cannot allocate sweep results");
+    return 1;
   }
 
-  in = filename ? fopen (filename, "r") : stdin;
-  if (in == NULL) {
+  npasses = warmup + iterations;
+  thextile = (double *)calloc (npasses, sizeof(double));
+  tzlib = (double *)calloc (npasses, sizeof(double));
+  tzrle = (double *)calloc (npasses, sizeof(double));
+  for (i = 0; i < nvariants; i++)
+    variants[i].t = (double *)calloc (npasses, sizeof(double));
+  if (!thextile || !tzlib || !tzrle || (nvariants && !variants[nvariants - 1].t)) {
+    perror ("Cannot allocate timing buffers");
+    return 1;
+  }
+  if (nlinks) {
+    int ret = alloc_links (&lat_hextile) | alloc_links (&lat_zlib) |
+      alloc_links (&lat_zrle);
+    for (i = 0; i < nvariants; i++)
+      ret |= alloc_links (&variants[i].lat);
+    if (ret != 0) {
+      perror ("Cannot allocate link models");
+      return 1;
+    }
+  }
+
+  pipeline_cpu = cpu;
+
+  if (use_perf)
+    perf = rfbPerfOpen ();
+
+#ifdef __linux__
+  /* Keep the scheduler from migrating the benchmark between CPUs (and their
+     caches) in the middle of a pass */
+  if (cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO (&cpus);
+    CPU_SET (cpu, &cpus);
+    if (sched_setaffinity (0, sizeof(cpus), &cpus) != 0) {
+      perror ("Cannot pin the benchmark to the specified CPU");
+      return 1;
+    }
+  }
+#endif
+
+  if (!rfbCaptureOpen (&in, filename)) {
     perror ("Cannot open input file");
     return 1;
   }
+  if ((range_first > 0 || range_last >= 0) && load_index (&in, filename) != 0)
+    return 1;
+
+  if (jsonfilename || csvfilename) {
+    if (!rfbResultsOpen (jsonfilename, csvfilename))
+      return 1;
+    results = TRUE;
+  }
+
+  if (use_cache && (npasses > 1 || npoints > 1) && !outfilename &&
+      (cache = open_cache ()) == NULL)
+    return 1;
 
   #ifndef H264
   if (outfilename) {
@@ -339,35 +720,82 @@ int main (int argc, char *argv[])
   }
   #endif
 
-  err = (do_convert (in) != 0);
-  #ifdef H264
-  err |= (ResetH264Encoder(&rfbClient) != TRUE);
-  #endif
-  if (outfilename) goto done;
-  sleep(5);
-  fseek(in, 0, SEEK_SET);
-  sum_raw = sum_hextile = sum_zlib = sum_zrle = sum_tight = 0;
-	#ifdef TIGHT_STATISTICS
-  fcrect = ndxrect = jpegrect = monorect = solidrect = 0;
-  fcpixels = ndxpixels = jpegpixels = monopixels = solidpixels = 0;
-  #endif
-  decompStreamInited = False;
-  for(i = 0; i < 4; i++) zlibStreamActive[i] = False;
-  err |= (do_convert (in) != 0);
+  for (point = 0; point < npoints; point++) {
+    set_levels (point);
+    if (run_passes (&in, npasses, point > 0) != 0) {
+      err = 1;
+      break;
+    }
+    if (tndx < 1)
+      break;
+    print_statistics (tndx);
+    if (sweep)
+      record_sweep_point (point, tndx);
+  }
+  if (!err && sweep && point == npoints)
+    print_sweep ();
+  if (!err && rfbBaselineLoaded ())
+    regressions = compare_baseline (filename);
 
-  done:
-  if (in != stdin)
-    fclose (in);
+  rfbCaptureClose (&in);
+  if (have_index) rfbIndexClose (&capture_index);
+  rfbPerfClose ();
 
   if (out != NULL)
     fclose (out);
 
+  if (results && !rfbResultsClose ())
+    err = 1;
+
+  if (!err && regressions) {
+    fprintf (stderr, "Regressed from the baseline.\n");
+    return 2;
+  }
   fprintf (stderr, (err) ? "Fatal error has occured.\n" : "Succeeded.\n");
   return err;
 }
 
+/*
+ * Make npasses passes over the capture, rewinding it first if restart is TRUE.
+ * Returns -1 on error.  Otherwise, tndx is set to the number of passes made,
+ * which is less than npasses if the input isn't seekable.
+ */
+
+static int run_passes (rfbCapture *in, int npasses, Bool restart)
+{
+  int i;
+
+  add_timed_latency (TRUE);
+  for (tndx = 0; tndx < npasses; tndx++) {
+    if (tndx > 0 || restart) {
+      if (outfilename) break;
+      if (!rfbCaptureRewind (in)) {
+        fprintf (stderr, "Input is not seekable.  Skipping the remaining passes.\n");
+        break;
+      }
+      reset_totals ();
+      for (i = 0; i < nvariants; i++)
+        if (variants[i].dec) variants[i].dec->reset();
+      decompStreamInited = False;
+    }
+    /* With -sweep, the passes for each point reuse the same slots */
+    thextile[tndx] = tzlib[tndx] = tzrle[tndx] = 0.;
+    for (i = 0; i < nvariants; i++)
+      variants[i].t[tndx] = 0.;
+    if (do_convert (in) != 0) {
+      stop_pipeline (TRUE);
+      return -1;
+    }
+    if (cache && replay_cache (in) != 0)
+      return -1;
+  }
+  return 0;
+}
+
 static void show_usage (char *program_name)
 {
+  int i;
+
   fprintf (stderr, "\n");
   fprintf (stderr, "USAGE: %s <-8|-16|-24> [options] [INPUT_FILE]\n\n", program_name);
   fprintf (stderr, "If INPUT_FILE is not specified, then standard input is used.\n\n");
@@ -375,23 +803,231 @@ static void show_usage (char *program_name)
   fprintf (stderr, "             or passed via stdin\n\n");
   fprintf (stderr, "Options:\n");
   fprintf (stderr, "-to = Only benchmark Tight encoding/decoding\n");
-  fprintf (stderr, "-d = Benchmark decoding instead of encoding\n");
+  fprintf (stderr, "-d = Benchmark decoding instead of encoding, and measure the PSNR and SSIM of\n");
+  fprintf (stderr, "     the decoded output (with the TigerVNC and TurboVNC 0.5 and later decoders)\n");
   fprintf (stderr, "-o <filename> = Store Tight-encoded session in <filename>\n");
   fprintf (stderr, "                (for later playback in the TurboVNC Viewer)\n");
   fprintf (stderr, "-r = Reverse red/blue channels when reading the RFB session capture\n");
+  fprintf (stderr, "-size <w>x<h> = Framebuffer size of the RFB session capture (default: read it\n");
+  fprintf (stderr, "                from the ServerInit message, if the capture was extracted\n");
+  fprintf (stderr, "                with fbs-dump -i, or else 1280x1024)\n");
   fprintf (stderr, "-v = Verbose mode (show the size and ID of each encoded rectangle)\n");
+  fprintf (stderr, "-zywrle <q> = Use ZYWRLE with JPEG quality level <q> (0-9) instead of ZRLE\n");
+  fprintf (stderr, "-pipeline <n> = Benchmark decoding with the encoder and the decoder running\n");
+  fprintf (stderr, "                concurrently, in separate threads connected by a ring of <n>\n");
+  fprintf (stderr, "                %d-byte chunks, and report the end-to-end latency of each\n", UPDATE_BUF_SIZE);
+  fprintf (stderr, "                update and the sustained update rate (implies -d and -to, and\n");
+  fprintf (stderr, "                requires a single encoder)\n");
+  fprintf (stderr, "-socket <tcp|unix> = Same as -pipeline, but connect the encoder and the\n");
+  fprintf (stderr, "                     decoder with a loopback TCP connection or a Unix-domain\n");
+  fprintf (stderr, "                     socket pair, and report the number of system calls\n");
+  fprintf (stderr, "                     and the CPU time spent in the kernel\n");
+  fprintf (stderr, "-flush <chunk|rect|update> = With -socket, call send() after each %d-byte\n", UPDATE_BUF_SIZE);
+  fprintf (stderr, "                             output buffer flush (default), after each\n");
+  fprintf (stderr, "                             rectangle, or after each framebuffer update\n");
+  fprintf (stderr, "-link <b1/r1,b2/r2,...> = Replay the size and encoding/decoding time of each\n");
+  fprintf (stderr, "                          rectangle through an emulated network link with\n");
+  fprintf (stderr, "                          bandwidth <b> bits/s (k, M, or G suffix allowed)\n");
+  fprintf (stderr, "                          and round-trip time <r> ms, and report the update\n");
+  fprintf (stderr, "                          rate and update latency that a viewer would see on\n");
+  fprintf (stderr, "                          each link (for instance, -link 20M/50,1G/1).  The\n");
+  fprintf (stderr, "                          decoding time is only included with -d.\n");
+  fprintf (stderr, "-perf = Count CPU cycles, instructions, last-level cache misses, and branch\n");
+  fprintf (stderr, "        misses for each codec, using the Linux perf_event interface, and\n");
+  fprintf (stderr, "        report the cycles per pixel, IPC, and misses per megapixel\n");
+  fprintf (stderr, "-cache = Decode the capture once, during the first pass, and replay the decoded\n");
+  fprintf (stderr, "         updates from a temporary file during the remaining passes\n");
+  fprintf (stderr, "-corpus <dir|manifest> = Benchmark every capture in the specified directory, or\n");
+  fprintf (stderr, "                          every capture listed in the specified manifest (one\n");
+  fprintf (stderr, "                          capture per line, optionally followed by options for\n");
+  fprintf (stderr, "                          that capture), in parallel worker processes, and\n");
+  fprintf (stderr, "                          print an aggregate report\n");
+  fprintf (stderr, "-jobs <n> = Run <n> workers at a time in corpus mode (default: number of CPUs)\n");
+  fprintf (stderr, "-range <first>-<last> = Only benchmark updates <first> to <last> - 1 (or to the\n");
+  fprintf (stderr, "                        end, if <last> is omitted) of INPUT_FILE, starting from\n");
+  fprintf (stderr, "                        the nearest checkpoint in the capture index.  The index\n");
+  fprintf (stderr, "                        is built on first use and cached in INPUT_FILE.index.\n");
+  fprintf (stderr, "-prefix <n> = With -range, encode the <n> updates before <first> to warm up\n");
+  fprintf (stderr, "              the encoders, without counting them (default: 32)\n");
+  fprintf (stderr, "-checkpoint <n> = Store a checkpoint of the framebuffer every <n> updates in\n");
+  fprintf (stderr, "                  the capture index (default: 1000)\n");
+  fprintf (stderr, "-shards <n> = Split INPUT_FILE into <n> ranges of about the same size,\n");
+  fprintf (stderr, "              benchmark them with -range in parallel worker processes (see\n");
+  fprintf (stderr, "              -jobs), and print an aggregate report\n");
+  fprintf (stderr, "-sample <n> = Only encode every <n>th update (the others are decoded but not\n");
+  fprintf (stderr, "              benchmarked), for quick smoke tests\n");
+  fprintf (stderr, "-json <filename> = Write the size and encoding/decoding time of each\n");
+  fprintf (stderr, "                   rectangle, and the grand totals, to <filename> in\n");
+  fprintf (stderr, "                   JSON format\n");
+  fprintf (stderr, "-csv <filename> = Same as -json, but in CSV format\n");
+  fprintf (stderr, "                  (with -corpus or -shards, -json writes the bytes, the\n");
+  fprintf (stderr, "                  mean and standard deviation of the time per pass, and\n");
+  fprintf (stderr, "                  the p99 update latency of each codec on each capture)\n");
+  fprintf (stderr, "-baseline <filename> = Compare the bytes, mean time per pass, and p99 update\n");
+  fprintf (stderr, "                       latency of each codec (and with -corpus or -shards,\n");
+  fprintf (stderr, "                       on each capture) against the results in <filename>,\n");
+  fprintf (stderr, "                       which were written by -json in an earlier run with\n");
+  fprintf (stderr, "                       the same options, and exit with status 2 if any of\n");
+  fprintf (stderr, "                       them regressed.  A growth in mean time only counts\n");
+  fprintf (stderr, "                       if Welch's t-test finds it significant.  A growth\n");
+  fprintf (stderr, "                       in p99 latency only counts if -threshold sets p99.\n");
+  fprintf (stderr, "-threshold <bytes=b,time=t,p99=l,alpha=a> = With -baseline, the growth (in\n");
+  fprintf (stderr, "                       percent) of the bytes, mean time, and p99 latency\n");
+  fprintf (stderr, "                       that counts as a regression, and the significance\n");
+  fprintf (stderr, "                       level of the t-test (default:\n");
+  fprintf (stderr, "                       bytes=1,time=5,alpha=0.05, and p99 isn't checked)\n");
+  fprintf (stderr, "-warmup <k> = Make <k> passes over the capture before the timed passes\n");
+  fprintf (stderr, "              (default: 0)\n");
+  fprintf (stderr, "-iterations <n> = Make <n> timed passes over the capture, and report the\n");
+  fprintf (stderr, "                  mean, standard deviation, minimum, and 95%% confidence\n");
+  fprintf (stderr, "                  interval of the encoding/decoding time (default: 2)\n");
+  fprintf (stderr, "-cl <c1,c2,...> = Set the compression level (0-9) of the Tight encoders\n");
+  fprintf (stderr, "-ql <q1,q2,...> = Set the JPEG quality (1-100, or -1 to disable JPEG) of the\n");
+  fprintf (stderr, "                  Tight encoders.  Encoders that only have quality levels use\n");
+  fprintf (stderr, "                  the highest level whose JPEG quality doesn't exceed <q>.\n");
+  fprintf (stderr, "-samp <s1,s2,...> = Set the JPEG chroma subsampling (444, 420, 422, or gray)\n");
+  fprintf (stderr, "                    of the Tight encoders\n");
+  fprintf (stderr, "-sweep = Benchmark every combination of the -cl, -ql, and -samp levels over\n");
+  fprintf (stderr, "         the same capture (default: -ql -1,15,30,50,70,80,90,95), and report\n");
+  fprintf (stderr, "         the size, time, and (with -d) PSNR and SSIM of each, with the\n");
+  fprintf (stderr, "         Pareto-optimal combinations marked (implies -to and -cache.)  Without\n");
+  fprintf (stderr, "         -sweep, -cl, -ql, and -samp each take a single level.\n");
+#ifdef __linux__
+  fprintf (stderr, "-cpu <c> = Pin the benchmark to CPU <c> (in corpus mode, pin worker <n> to CPU\n");
+  fprintf (stderr, "           <c> + <n>)\n");
+#endif
 #ifdef ICE_SUPPORTED
   fprintf (stderr, "-ice = Enable interframe comparison engine\n");
 #endif
+  fprintf (stderr, "-enc <e1,e2,...> = Benchmark the specified Tight encoder variants (default:\n");
+  fprintf (stderr, "                   all of them, or with -d, all of them that have a decoder\n");
+  fprintf (stderr, "                   of the same name.)  The variants are run interleaved on\n");
+  fprintf (stderr, "                   each rectangle.\n");
+  fprintf (stderr, "-dec <d1,d2,...> = Decode the output of each encoder variant with the\n");
+  fprintf (stderr, "                   corresponding decoder variant in this list (default: the\n");
+  fprintf (stderr, "                   decoder with the same name as the encoder, if any, or the\n");
+  fprintf (stderr, "                   next unused decoder)\n");
   fprintf (stderr, "\n");
+  fprintf (stderr, "Available encoders:");
+  for (i = 0; rfbTightEncoders[i]; i++)
+    fprintf (stderr, " %s", rfbTightEncoders[i]->name);
+  fprintf (stderr, "\nAvailable decoders:");
+  for (i = 0; rfbTightDecoders[i]; i++)
+    fprintf (stderr, " %s", rfbTightDecoders[i]->name);
+  fprintf (stderr, "\n\n");
 }
 
-static int do_convert (FILE *in)
+static int select_variants (char *encoders, char *decoders)
 {
-  int msg_type, n;
-  char buf[8];
+  char *name;
+  int i, j, ndecoders = 0;
+
+  if (encoders) {
+    for (name = strtok (encoders, ","); name; name = strtok (NULL, ",")) {
+      if (nvariants >= MAX_VARIANTS) {
+        fprintf (stderr, "Too many encoders specified.\n");
+        return -1;
+      }
+      if ((variants[nvariants].enc = rfbFindTightEncoder (name)) == NULL) {
+        fprintf (stderr, "Unknown encoder: %s\n", name);
+        return -1;
+      }
+      nvariants++;
+    }
+  } else {
+    /* When benchmarking decoding, the default is to run each decoder on the
+       output of its own encoder. */
+    for (i = 0; rfbTightEncoders[i] && nvariants < MAX_VARIANTS; i++) {
+      if (!decompress || rfbFindTightDecoder (rfbTightEncoders[i]->name))
+        variants[nvariants++].enc = rfbTightEncoders[i];
+    }
+    if (nvariants < 1 && rfbTightEncoders[0])
+      variants[nvariants++].enc = rfbTightEncoders[0];
+  }
+  if (nvariants < 1) {
+    fprintf (stderr, "No encoders selected.\n");
+    return -1;
+  }
+
+  if (outfilename && nvariants > 1) {
+    fprintf (stderr, "The -o option requires a single encoder (use -enc).\n");
+    return -1;
+  }
+
+  if (pipeline && nvariants > 1) {
+    fprintf (stderr, "The -pipeline and -socket options require a single encoder (use -enc).\n");
+    return -1;
+  }
 
-  InitEverything (color_depth);
+  if (!decompress) return 0;
+
+  /* A decoder variant keeps its zlib stream state in static variables, so
+     it can only decode the output of one encoder variant. */
+  if (decoders) {
+    for (name = strtok (decoders, ","); name; name = strtok (NULL, ",")) {
+      if (ndecoders >= nvariants) {
+        fprintf (stderr, "More decoders than encoders specified.\n");
+        return -1;
+      }
+      if ((variants[ndecoders].dec = rfbFindTightDecoder (name)) == NULL) {
+        fprintf (stderr, "Unknown decoder: %s\n", name);
+        return -1;
+      }
+      ndecoders++;
+    }
+    if (ndecoders != nvariants) {
+      fprintf (stderr, "The -dec option must specify one decoder per encoder.\n");
+      return -1;
+    }
+  } else {
+    for (i = 0; i < nvariants; i++) {
+      const rfbTightDecoderVariant *dec =
+        rfbFindTightDecoder (variants[i].enc->name);
+      for (j = 0; j < i && dec; j++)
+        if (variants[j].dec == dec) dec = NULL;
+      for (j = 0; !dec && rfbTightDecoders[j]; j++) {
+        int k;
+        dec = rfbTightDecoders[j];
+        for (k = 0; k < nvariants; k++) {
+          if (variants[k].dec == dec ||
+              (k > i && rfbFindTightDecoder (variants[k].enc->name) == dec))
+            dec = NULL;
+          if (!dec) break;
+        }
+      }
+      if (!dec) {
+        fprintf (stderr, "Not enough decoders to decode the output of %d encoders.\n",
+                 nvariants);
+        return -1;
+      }
+      variants[i].dec = dec;
+    }
+  }
+  for (i = 0; i < nvariants; i++) {
+    for (j = 0; j < i; j++) {
+      if (variants[j].dec == variants[i].dec) {
+        fprintf (stderr, "Decoder %s can only be used once.\n",
+                 variants[i].dec->name);
+        return -1;
+      }
+    }
+  }
+
+  return 0;
+}
+
+static int do_convert (rfbCapture *in)
+{
+  int msg_type, n, i;
+
+  int width = fb_width, height = fb_height;
+
+  if (read_server_init (in, &width, &height) != 0)
+    return -1;
+  if (cache && cache_server_init (width, height) != 0)
+    return -1;
+
+  InitEverything (color_depth, width, height);
 #ifdef ICE_SUPPORTED
   if (interframe) {
     if (!InterframeOn(&rfbClient))
@@ -400,107 +1036,973 @@ static int do_convert (FILE *in)
 #endif
   rfbClient.fb = rfbScreen.pfbMemory;
 
-#ifdef LAZY_TIGHT
-  rfbTightDisableGradient = TRUE;
-#endif
+  for (i = 0; i < nvariants; i++) {
+    variants[i].client = rfbClient;
+    reset_latency (&variants[i].lat);
+    rfbQualityReset (&variants[i].quality);
+  }
+  reset_latency (&lat_hextile);
+  reset_latency (&lat_zlib);
+  reset_latency (&lat_zrle);
+
+  update_no = 0;
+  if (have_index && seek_range (in) != 0)
+    return -1;
+
+  if (pipeline && start_pipeline () != 0)
+    return -1;
+
+  if (results)
+    rfbResultsBeginPass (tndx + 1, tndx < warmup);
 
   total_updates = 0;
   total_rects = 0;
   total_pixels = 0;
 
-  if (verbose)
+  if (verbose) {
     printf ("upd.no -                              Bytes per rectangle:\n"
-            "   rect.no   coords     size       raw |hextile| zlib | ZRLE | tight\n"
-            "---------- -------------------- -------+-------+------+------+------\n");
+            "   rect.no   coords     size       raw |hextile| zlib |");
+    print_centered (zrle_name, 6);
+    if (nvariants == 1)
+      printf ("| tight");
+    else {
+      for (i = 0; i < nvariants; i++)
+        printf ("|%6s", variants[i].enc->name);
+    }
+    printf ("\n---------- -------------------- -------+-------+------+------");
+    for (i = 0; i < nvariants; i++) {
+      n = (nvariants == 1) ? 6 : max (6, (int)strlen (variants[i].enc->name));
+      printf ("+%.*s", n, "----------------");
+    }
+    printf ("\n");
+  }
 
-  msg_type = getc (in);
+  msg_type = rfbCaptureGetc (in);
   while (msg_type != EOF) {
-    switch (msg_type) {
-    case rfbFramebufferUpdate:
+    if (msg_type == rfbFramebufferUpdate) {
+      if (range_last >= 0 && update_no >= range_last)
+        break;
       if (parse_fb_update (in) != 0)
         return -1;
-      break;
+    } else if (skip_message (in, msg_type) != 0)
+      return -1;
+    msg_type = rfbCaptureGetc (in);
+  }
 
-    case rfbSetColourMapEntries:
-      fprintf (stderr, "> SetColourMap...\n");
-      if (fread (buf + 1, 1, 5, in) != 5) {
-        fprintf (stderr, "Read error.\n");
-        return -1;
+  for (i = 0; i < nvariants; i++) {
+    if (variants[i].enc->finish &&
+        !variants[i].enc->finish(&variants[i].client))
+      return -1;
+  }
+
+  if (stop_pipeline (FALSE) != 0)
+    return -1;
+
+  if (results)
+    write_totals ();
+  if (tndx >= warmup)
+    add_timed_latency (FALSE);
+
+  if(tightonly) sum_raw=sum_hextile=sum_zlib=sum_zrle=INT_MAX;
+
+  print_totals ();
+
+  return (in->error) ? -1 : 0;
+}
+
+/* Skips a server message other than a FramebufferUpdate */
+
+static int skip_message (rfbCapture *in, int msg_type)
+{
+  char *buf;
+  int n;
+
+  switch (msg_type) {
+  case rfbSetColourMapEntries:
+    fprintf (stderr, "> SetColourMap...\n");
+    if ((buf = rfbCaptureRead (in, 5)) == NULL) {
+      fprintf (stderr, "Read error.\n");
+      return -1;
+    }
+    n = (int) get_CARD16 (buf + 3);
+    if (!rfbCaptureSkip (in, (off_t)n * 6)) {
+      fprintf (stderr, "Read error.\n");
+      return -1;
+    }
+    break;
+
+  case rfbBell:
+    fprintf (stderr, "> Bell...\n");
+    break;
+
+  case rfbServerCutText:
+    fprintf (stderr, "> ServerCutText...\n");
+    if ((buf = rfbCaptureRead (in, 7)) == NULL) {
+      fprintf (stderr, "Read error.\n");
+      return -1;
+    }
+    if (!rfbCaptureSkip (in, (off_t) get_CARD32 (buf + 3))) {
+      fprintf (stderr, "Read error.\n");
+      return -1;
+    }
+    break;
+
+  default:
+    fprintf (stderr, "Unknown server message: 0x%X\n", msg_type);
+    return -1;                /* Unknown server message */
+  }
+  return 0;
+}
+
+static void print_centered (const char *s, int width)
+{
+  int left = (width - (int)strlen (s) + 1) / 2;
+  printf ("%*s%-*s", left, "", width - left, s);
+}
+
+static int column_width (int i)
+{
+  return (nvariants == 1) ? 8 : max (8, (int)strlen (variants[i].enc->name));
+}
+
+static void print_totals (void)
+{
+  int i;
+
+  printf ("\nGrand totals%s:\n"
+          "                          raw    |  hextile  |   zlib   |",
+          tndx < warmup ? " (warm-up pass)" : "");
+  print_centered (zrle_name, 10);
+  if (nvariants == 1)
+    printf ("|  tight  \n");
+  else {
+    for (i = 0; i < nvariants; i++)
+      printf ("| %*s", column_width (i), variants[i].enc->name);
+    printf ("\n");
+  }
+  printf ("                       ----------+-----------+----------+----------");
+  for (i = 0; i < nvariants; i++)
+    printf ("+%.*s", column_width (i) + 1, "--------------------------------");
+  printf ("\nBytes in all rects:    %9llu | %9llu | %8llu | %8llu",
+          sum_raw, sum_hextile, sum_zlib, sum_zrle);
+  for (i = 0; i < nvariants; i++)
+    printf (" | %*llu", column_width (i), variants[i].sum);
+  printf ("\n");
+  for (i = 0; i < nvariants; i++) {
+    double sum_tight = (double)variants[i].sum;
+    if (nvariants == 1)
+      printf ("Tight/XXX B/W saving:  ");
+    else
+      printf ("%-21.21s  ", variants[i].enc->name);
+    printf ("%8.2f%% | %8.2f%% | %7.2f%% | %7.2f%% |\n",
+            ((double)sum_raw - sum_tight) * 100 / (double) sum_raw,
+            ((double)sum_hextile - sum_tight) * 100 / (double) sum_hextile,
+            ((double)sum_zlib - sum_tight) * 100 / (double) sum_zlib,
+            ((double)sum_zrle - sum_tight) * 100 / (double) sum_zrle);
+  }
+  printf ("%scoding time:         ......... | %8.4fs | %7.4fs | %7.4fs",
+          decompress? "De":"En", thextile[tndx], tzlib[tndx], tzrle[tndx]);
+  for (i = 0; i < nvariants; i++)
+    printf (" | %*.4fs", column_width (i) - 1, variants[i].t[tndx]);
+  printf ("\n");
+
+  #ifdef TIGHT_STATISTICS
+  for (i = 0; i < nvariants; i++) {
+    const rfbTightStatistics *stats = variants[i].enc->stats;
+    if (!stats) continue;
+    if (nvariants > 1)
+      printf("%s:\n", variants[i].enc->name);
+    printf("Solid rectangles = %llu, pixels = %f mil\n", *stats->solidrect, (double)*stats->solidpixels/1000000.);
+    printf("Mono rectangles  = %llu, pixels = %f mil\n", *stats->monorect, (double)*stats->monopixels/1000000.);
+    printf("Index rectangles = %llu, pixels = %f mil\n", *stats->ndxrect, (double)*stats->ndxpixels/1000000.);
+    printf("JPEG rectangles  = %llu, pixels = %f mil\n", *stats->jpegrect, (double)*stats->jpegpixels/1000000.);
+    printf("Grad rectangles  = %llu, pixels = %f mil\n", *stats->gradrect, (double)*stats->gradpixels/1000000.);
+    printf("Raw rectangles   = %llu, pixels = %f mil\n", *stats->fcrect, (double)*stats->fcpixels/1000000.);
+  }
+  #endif
+
+  printf("Avg. pixel count for %d FB updates:  %f\n", total_rects,
+	 (double)total_pixels/(double)total_rects);
+  printf("\n");
+  print_latency ();
+  print_quality ();
+  print_phases ();
+  if (perf) print_perf ();
+  if (nlinks) print_links ();
+}
+
+static void set_result (rfbCodecResult *r, const char *codec,
+                        unsigned long long bytes, double t)
+{
+  r->codec = codec;
+  r->bytes = bytes;
+  r->time = t;
+  r->hasStats = FALSE;
+  r->hasQuality = FALSE;
+}
+
+static void write_totals (void)
+{
+  rfbCodecResult codecs[4 + MAX_VARIANTS];
+  int i, n = 0;
+
+  set_result (&codecs[n++], "raw", sum_raw, 0.0);
+  if (!tightonly) {
+    set_result (&codecs[n++], "hextile", sum_hextile, thextile[tndx]);
+    set_result (&codecs[n++], "zlib", sum_zlib, tzlib[tndx]);
+    set_result (&codecs[n++], zrle_name, sum_zrle, tzrle[tndx]);
+  }
+  for (i = 0; i < nvariants; i++) {
+    set_result (&codecs[n], variants[i].enc->name, variants[i].sum,
+                variants[i].t[tndx]);
+    if (variants[i].enc->stats)
+      rfbResultsGetStatistics (&codecs[n], variants[i].enc->stats);
+    if (variants[i].quality.updates > 0) {
+      codecs[n].hasQuality = TRUE;
+      codecs[n].psnr = rfbQualityPSNR (&variants[i].quality.total);
+      codecs[n].ssim = rfbQualitySSIM (&variants[i].quality.total);
+    }
+    n++;
+  }
+  rfbResultsEndPass (total_updates, total_rects, total_pixels, codecs, n);
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+/* Two-sided 95% critical values of Student's t distribution for 1-30
+   degrees of freedom */
+static const double t95[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042
+};
+
+/*
+ * A run is flagged as an outlier if its modified z-score (based on the median
+ * absolute deviation, which unlike the standard deviation isn't inflated by
+ * the outliers themselves) exceeds 3.5.
+ */
+
+static void print_time_statistics (const char *name, const double *t, int n)
+{
+  double mean = 0., var = 0., min = t[0], ci = 0., median, mad;
+  double *sorted;
+  int i;
+
+  for (i = 0; i < n; i++) {
+    mean += t[i];
+    min = min (min, t[i]);
+  }
+  mean /= (double)n;
+  if (n > 1) {
+    for (i = 0; i < n; i++)
+      var += (t[i] - mean) * (t[i] - mean);
+    var /= (double)(n - 1);
+    ci = (n - 1 <= 30 ? t95[n - 2] : 1.960) * sqrt (var / (double)n);
+  }
+  printf ("%-12.12s %9.4fs %9.4fs %9.4fs  +/-%7.4fs\n", name, mean, sqrt (var),
+          min, ci);
+
+  if (n < 3 || (sorted = (double *)malloc (n * sizeof(double))) == NULL)
+    return;
+  memcpy (sorted, t, n * sizeof(double));
+  qsort (sorted, n, sizeof(double), compare_doubles);
+  median = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2.;
+  for (i = 0; i < n; i++)
+    sorted[i] = fabs (t[i] - median);
+  qsort (sorted, n, sizeof(double), compare_doubles);
+  mad = (sorted[(n - 1) / 2] + sorted[n / 2]) / 2.;
+  free (sorted);
+  for (i = 0; i < n; i++) {
+    if (mad > 0. && 0.6745 * fabs (t[i] - median) / mad > 3.5)
+      printf ("             Outlier: iteration %d (%.4fs)\n", i + 1, t[i]);
+  }
+}
+
+static void print_statistics (int npasses)
+{
+  int i, n = npasses - warmup;
+
+  if (n < 2) return;
+
+  printf ("%scoding time over %d iterations:\n"
+          "                   mean      stdev        min      95%% CI\n",
+          decompress? "De":"En", n);
+  if (!tightonly) {
+    print_time_statistics ("hextile", thextile + warmup, n);
+    print_time_statistics ("zlib", tzlib + warmup, n);
+    print_time_statistics (zrle_name, tzrle + warmup, n);
+  }
+  for (i = 0; i < nvariants; i++)
+    print_time_statistics (nvariants == 1 ? "tight" : variants[i].enc->name,
+                           variants[i].t + warmup, n);
+  printf ("\n");
+}
+
+static void get_baseline_stats (rfbBaselineStats *s, unsigned long long bytes,
+                                const double *t, const codec_latency *lat)
+{
+  double sum = 0., sum2 = 0.;
+  int i, n = tndx - warmup;
+
+  for (i = warmup; i < tndx; i++) {
+    sum += t[i];
+    sum2 += t[i] * t[i];
+  }
+  s->bytes = bytes;
+  s->passes = max (n, 0);
+  s->time = n > 0 ? sum / (double)n : 0.;
+  s->stdev = n > 1 ? sqrt (max (sum2 - sum * s->time, 0.) / (double)(n - 1))
+    : 0.;
+  s->p99 = rfbHistogramPercentile (&lat->timed, 99.);
+}
+
+/* Returns the number of codecs that regressed from the baseline */
+
+static int compare_baseline (const char *filename)
+{
+  rfbBaselineStats s;
+  const char *label = filename ? filename : "stdin";
+  int i;
+
+  rfbBaselineBeginReport (min (max ((int)strlen (label), 7), 40));
+  if (!tightonly) {
+    get_baseline_stats (&s, sum_hextile, thextile, &lat_hextile);
+    rfbBaselineCompare (NULL, label, "hextile", &s);
+    get_baseline_stats (&s, sum_zlib, tzlib, &lat_zlib);
+    rfbBaselineCompare (NULL, label, "zlib", &s);
+    get_baseline_stats (&s, sum_zrle, tzrle, &lat_zrle);
+    rfbBaselineCompare (NULL, label, zrle_name, &s);
+  }
+  for (i = 0; i < nvariants; i++) {
+    get_baseline_stats (&s, variants[i].sum, variants[i].t,
+                        &variants[i].lat);
+    rfbBaselineCompare (NULL, label, variants[i].enc->name, &s);
+  }
+  return rfbBaselineEndReport ();
+}
+
+static void print_codec_latency (const char *name, const codec_latency *lat)
+{
+  if (lat->rect.count < 1) return;
+  rfbHistogramPrintRow (name, "rect", &lat->rect, lat->rect.sum > 0. ?
+                        (double)lat->pixels / lat->rect.sum / 1000000. : 0.);
+  rfbHistogramPrintRow ("", "update", &lat->update, -1.);
+}
+
+static void print_latency (void)
+{
+  int i;
+
+  printf ("%scoding latency (ms):   p50      p90      p99    p99.9      max"
+          "  Mpixels/s\n", decompress? "De":"En");
+  print_codec_latency ("hextile", &lat_hextile);
+  print_codec_latency ("zlib", &lat_zlib);
+  print_codec_latency (zrle_name, &lat_zrle);
+  for (i = 0; i < nvariants; i++)
+    print_codec_latency (nvariants == 1 ? "tight" : variants[i].enc->name,
+                         &variants[i].lat);
+  if (pipeline && lat_pipeline.count > 0) {
+    double elapsed = pipeline_tEnd - pipeline_tStart;
+    rfbHistogramPrintRow ("", "e2e", &lat_pipeline, elapsed > 0. ?
+                          (double)total_pixels / elapsed / 1000000. : 0.);
+    if (pipeline_socket >= 0) {
+      static const char *flush_names[] = { "chunk", "rectangle", "update" };
+      double updates = pipeline_updates > 0 ? (double)pipeline_updates : 1.;
+      printf ("\nPipeline (%s socket, send() per %s):  %.2f updates/s sustained\n",
+              pipeline_socket == rfbPipelineTCP ? "TCP" : "Unix-domain",
+              flush_names[pipeline_flush],
+              elapsed > 0. ? pipeline_updates / elapsed : 0.);
+      printf ("Encoder: %llu send() calls (%.2f/update, %.0f bytes/call), %.4fs in send()\n",
+              pipeline_stats.writes, (double)pipeline_stats.writes / updates,
+              pipeline_stats.writes ?
+                (double)pipeline_stats.bytes / pipeline_stats.writes : 0.,
+              pipeline_stats.writerWait);
+      printf ("Decoder: %llu read() calls (%.2f/update, %.0f bytes/call), %.4fs in read()\n",
+              pipeline_stats.reads, (double)pipeline_stats.reads / updates,
+              pipeline_stats.reads ?
+                (double)pipeline_stats.bytes / pipeline_stats.reads : 0.,
+              pipeline_stats.readerWait);
+    } else {
+      printf ("\nPipeline (%d chunks):  %.2f updates/s sustained\n",
+              pipeline_chunks, elapsed > 0. ? pipeline_updates / elapsed : 0.);
+      printf ("Encoder waited for the decoder %llu times (%.4fs)\n",
+              pipeline_stats.writerStalls, pipeline_stats.writerWait);
+      printf ("Decoder waited for the encoder %llu times (%.4fs)\n",
+              pipeline_stats.readerStalls, pipeline_stats.readerWait);
+    }
+    printf ("Kernel CPU time: encoder %.4fs, decoder %.4fs\n",
+            pipeline_stats.writerSystem, pipeline_stats.readerSystem);
+  }
+  printf ("\n");
+}
+
+static void reset_latency (codec_latency *lat)
+{
+  rfbHistogramReset (&lat->rect);
+  rfbHistogramReset (&lat->update);
+  lat->tUpdate = 0.0;
+  lat->pixels = 0;
+  memset (&lat->perf, 0, sizeof(rfbPerfCounts));
+  if (lat->link) {
+    int i;
+    for (i = 0; i < nlinks; i++)
+      rfbLinkReset (&lat->link[i], &links[i]);
+  }
+}
+
+/* Adds the update latency of the pass to the totals over the timed passes,
+   or resets those totals */
+
+static void add_timed_latency (Bool reset)
+{
+  codec_latency *lat[3 + MAX_VARIANTS] = { &lat_hextile, &lat_zlib, &lat_zrle };
+  int i, n = 3;
+
+  for (i = 0; i < nvariants; i++)
+    lat[n++] = &variants[i].lat;
+  for (i = 0; i < n; i++) {
+    if (reset)
+      rfbHistogramReset (&lat[i]->timed);
+    else
+      rfbHistogramAdd (&lat[i]->timed, &lat[i]->update);
+  }
+}
+
+static void record_rect (codec_latency *lat, double t, int pixels)
+{
+  rfbHistogramRecord (&lat->rect, t);
+  lat->tUpdate += t;
+  lat->pixels += pixels;
+}
+
+/* Codecs that aren't being benchmarked never record a rectangle, so they
+   don't record any updates either. */
+static void record_update (codec_latency *lat)
+{
+  if (lat->rect.count < 1) return;
+  rfbHistogramRecord (&lat->update, lat->tUpdate);
+  lat->tUpdate = 0.0;
+  if (lat->link) {
+    int i;
+    for (i = 0; i < nlinks; i++)
+      rfbLinkEndUpdate (&lat->link[i]);
+  }
+}
+
+static const char *level_names[NLEVELS] = {
+  "compression", "JPEG quality", "subsampling"
+};
+
+static const char *subsamp_names[rfbTightSubsampLevels] = {
+  "444", "420", "422", "gray"
+};
+
+static int parse_levels (int which, const char *s)
+{
+  char level[16];
+  const char *end;
+
+  do {
+    size_t len;
+    char *endptr;
+    int value;
+    Bool valid;
+    if ((end = strchr (s, ',')) == NULL)
+      end = s + strlen (s);
+    len = min ((size_t)(end - s), sizeof(level) - 1);
+    memcpy (level, s, len);
+    level[len] = '\0';
+    if (nlevels[which] >= MAX_LEVELS) {
+      fprintf (stderr, "Too many %s levels (max. %d)\n", level_names[which],
+               MAX_LEVELS);
+      return -1;
+    }
+    if (which == LEVEL_SUBSAMP) {
+      for (value = 0; value < rfbTightSubsampLevels; value++) {
+        if (!strcmp (level, subsamp_names[value])) break;
       }
-      n = (int) get_CARD16 (buf + 4);
-      while (n--) {
-        if (fread (buf, 1, 6, in) != 6) {
-          fprintf (stderr, "Read error.\n");
-          return -1;
-        }
+      valid = value < rfbTightSubsampLevels;
+    } else {
+      value = (int)strtol (level, &endptr, 10);
+      valid = *level && !*endptr &&
+        ((which == LEVEL_COMPRESS && value >= 0 && value <= 9) ||
+         (which == LEVEL_QUALITY && (value == -1 ||
+                                     (value >= 1 && value <= 100))));
+    }
+    if (!valid) {
+      fprintf (stderr, "Invalid %s level: %s\n", level_names[which], level);
+      return -1;
+    }
+    levels[which][nlevels[which]++] = value;
+    s = end + 1;
+  } while (*end);
+  return 0;
+}
+
+/* The subsampling level varies fastest from one point to the next, and the
+   compression level slowest. */
+static void get_levels (int point, int *level)
+{
+  int i;
+
+  for (i = NLEVELS - 1; i >= 0; i--) {
+    if (nlevels[i]) {
+      level[i] = levels[i][point % nlevels[i]];
+      point /= nlevels[i];
+    } else
+      level[i] = rfbTightLevelDefault;
+  }
+}
+
+static const char *format_level (int which, int level, char *buf)
+{
+  if (level == rfbTightLevelDefault)
+    return "-";
+  if (which == LEVEL_SUBSAMP)
+    return subsamp_names[level];
+  if (which == LEVEL_QUALITY && level < 0)
+    return "off";
+  sprintf (buf, "%d", level);
+  return buf;
+}
+
+static void set_levels (int point)
+{
+  int level[NLEVELS], i;
+  char buf[NLEVELS][16];
+
+  if (!sweep && !nlevels[LEVEL_COMPRESS] && !nlevels[LEVEL_QUALITY] &&
+      !nlevels[LEVEL_SUBSAMP])
+    return;
+
+  get_levels (point, level);
+  for (i = 0; i < nvariants; i++) {
+    if (variants[i].enc->setLevels)
+      variants[i].enc->setLevels (level[LEVEL_COMPRESS], level[LEVEL_QUALITY],
+                                  level[LEVEL_SUBSAMP]);
+  }
+  if (sweep)
+    printf ("\n==== Sweep point %d/%d:  compression %s, JPEG quality %s, subsampling %s ====\n",
+            point + 1, npoints,
+            format_level (LEVEL_COMPRESS, level[LEVEL_COMPRESS], buf[0]),
+            format_level (LEVEL_QUALITY, level[LEVEL_QUALITY], buf[1]),
+            format_level (LEVEL_SUBSAMP, level[LEVEL_SUBSAMP], buf[2]));
+}
+
+/* The size and the quality are the same in every pass, so they are taken
+   from the last one. */
+static void record_sweep_point (int point, int npasses)
+{
+  int i, j, first = npasses > warmup ? warmup : 0;
+
+  for (i = 0; i < nvariants; i++) {
+    sweep_point *p = &sweep_points[point * nvariants + i];
+    get_levels (point, p->level);
+    p->bytes = variants[i].sum;
+    p->time = 0.;
+    for (j = first; j < npasses; j++)
+      p->time += variants[i].t[j];
+    p->time /= (double)(npasses - first);
+    if ((p->hasQuality = variants[i].quality.updates > 0)) {
+      p->psnr = rfbQualityPSNR (&variants[i].quality.total);
+      p->ssim = rfbQualitySSIM (&variants[i].quality.total);
+    }
+  }
+}
+
+/* A point is Pareto-optimal if no other point is at least as good in every
+   respect and better in at least one. */
+static Bool dominates (const sweep_point *a, const sweep_point *b)
+{
+  Bool quality = a->hasQuality && b->hasQuality;
+
+  if (a->bytes > b->bytes || a->time > b->time ||
+      (quality && a->psnr < b->psnr))
+    return FALSE;
+  return a->bytes < b->bytes || a->time < b->time ||
+    (quality && a->psnr > b->psnr);
+}
+
+static void print_sweep (void)
+{
+  int i, j, k;
+  char buf[NLEVELS][16];
+
+  for (i = 0; i < nvariants; i++) {
+    Bool quality = sweep_points[i].hasQuality;
+
+    printf ("\nSweep results for %s (* = Pareto-optimal in size, %scoding time%s):\n"
+            "   compress  quality   subsamp          bytes     time (s)%s\n",
+            variants[i].enc->name, decompress ? "de" : "en",
+            quality ? ", and PSNR" : "", quality ? "   PSNR (dB)     SSIM" : "");
+    for (j = 0; j < npoints; j++) {
+      const sweep_point *p = &sweep_points[j * nvariants + i];
+      Bool optimal = TRUE;
+      for (k = 0; k < npoints && optimal; k++) {
+        if (k != j && dominates (&sweep_points[k * nvariants + i], p))
+          optimal = FALSE;
+      }
+      printf ("%c  %8s %8s %9s %14llu %12.4f", optimal ? '*' : ' ',
+              format_level (LEVEL_COMPRESS, p->level[LEVEL_COMPRESS], buf[0]),
+              format_level (LEVEL_QUALITY, p->level[LEVEL_QUALITY], buf[1]),
+              format_level (LEVEL_SUBSAMP, p->level[LEVEL_SUBSAMP], buf[2]),
+              p->bytes, p->time);
+      if (p->hasQuality)
+        printf (" %11.2f %8.4f", p->psnr, p->ssim);
+      printf ("\n");
+    }
+  }
+  printf ("\n");
+}
+
+static int parse_links (const char *s)
+{
+  char profile[80];
+  const char *end;
+
+  do {
+    size_t len;
+    if ((end = strchr (s, ',')) == NULL)
+      end = s + strlen (s);
+    len = min ((size_t)(end - s), sizeof(profile) - 1);
+    memcpy (profile, s, len);
+    profile[len] = '\0';
+    if (nlinks >= MAX_LINKS) {
+      fprintf (stderr, "Too many link profiles (max. %d)\n", MAX_LINKS);
+      return -1;
+    }
+    if (!rfbLinkParseProfile (&links[nlinks++], profile)) {
+      fprintf (stderr, "Invalid link profile: %s\n", profile);
+      return -1;
+    }
+    s = end + 1;
+  } while (*end);
+  return 0;
+}
+
+static int alloc_links (codec_latency *lat)
+{
+  lat->link = (rfbLink *)calloc (nlinks, sizeof(rfbLink));
+  return lat->link ? 0 : -1;
+}
+
+/* te is the encoding time, and td is the decoding time (0 unless -d) */
+static void record_link (codec_latency *lat, unsigned long long bytes,
+                         double te, double td)
+{
+  int i;
+  for (i = 0; i < nlinks; i++)
+    rfbLinkRect (&lat->link[i], bytes, te, td);
+}
+
+static void perf_begin (void)
+{
+  if (perf) rfbPerfRead (&perf_before);
+}
+
+static void perf_end (codec_latency *lat)
+{
+  rfbPerfCounts after;
+
+  if (!perf) return;
+  rfbPerfRead (&after);
+  rfbPerfAdd (&lat->perf, &perf_before, &after);
+}
+
+static void print_perf (void)
+{
+  int i;
+
+  printf ("%scoding counters:\n%-12s %13s %13s %13s %13s\n",
+          decompress? "De":"En", "", "cycles/pixel", "IPC", "LLC miss/Mpx",
+          "br. miss/Mpx");
+  if (lat_hextile.rect.count > 0)
+    rfbPerfPrintRow ("hextile", &lat_hextile.perf, lat_hextile.pixels);
+  if (lat_zlib.rect.count > 0)
+    rfbPerfPrintRow ("zlib", &lat_zlib.perf, lat_zlib.pixels);
+  if (lat_zrle.rect.count > 0)
+    rfbPerfPrintRow (zrle_name, &lat_zrle.perf, lat_zrle.pixels);
+  for (i = 0; i < nvariants; i++)
+    rfbPerfPrintRow (nvariants == 1 ? "tight" : variants[i].enc->name,
+                     &variants[i].lat.perf, variants[i].lat.pixels);
+  printf ("\n");
+}
+
+/* Breaks down the encoding time of the variants that were built with phase
+   timers (see TIGHT_PHASE_TIMERS in CMakeLists.txt) */
+static void print_phases (void)
+{
+  rfbTightPhase phases[rfbTightMaxPhases];
+  int i, p, j, nphases, nthreads;
+
+  for (i = 0; i < nvariants; i++) {
+    double total;
+
+    if (!variants[i].enc->getPhases) continue;
+    nphases = variants[i].enc->getPhases (phases, rfbTightMaxPhases);
+
+    /* Only break down the time by thread if more than one thread did any
+       work */
+    nthreads = 1;
+    for (p = 0; p < nphases; p++)
+      for (j = nthreads; j < rfbTightMaxPhaseThreads; j++)
+        if (phases[p].seconds[j] > 0.0) nthreads = j + 1;
+
+    printf ("Encoder phases (%s):\n%-18s %10s %10s %6s %10s %10s %9s",
+            variants[i].enc->name, "", "calls", "time (s)", "% enc",
+            "MB in", "MB out", "MB/s in");
+    if (nthreads > 1)
+      for (j = 0; j < nthreads; j++)
+        printf ("  thread %d", j);
+    printf ("\n");
+    for (p = 0; p < nphases; p++) {
+      total = 0.0;
+      for (j = 0; j < nthreads; j++) total += phases[p].seconds[j];
+      printf ("%-18s %10llu %10.4f ", phases[p].name, phases[p].calls, total);
+      if (!decompress && variants[i].t[tndx] > 0.0)
+        printf ("%5.1f%%", total * 100. / variants[i].t[tndx]);
+      else
+        printf ("%6s", "-");
+      printf (" %10.2f %10.2f %9.1f", (double)phases[p].bytesIn / 1000000.,
+              (double)phases[p].bytesOut / 1000000.,
+              total > 0.0 ? (double)phases[p].bytesIn / 1000000. / total : 0.);
+      if (nthreads > 1)
+        for (j = 0; j < nthreads; j++)
+          printf (" %9.4f", phases[p].seconds[j]);
+      printf ("\n");
+    }
+    printf ("\n");
+  }
+}
+
+/* The PSNR and SSIM are reported over all of the pixels in the pass, as the
+   mean of the per-update values, and for the worst update. */
+static void print_quality (void)
+{
+  int i, header = 0;
+
+  for (i = 0; i < nvariants; i++) {
+    const rfbQuality *q = &variants[i].quality;
+    if (q->updates == 0) continue;
+    if (!header++)
+      printf ("%-24s %15s %6s %6s | %9s %8s %8s\n", "Decoded quality",
+              "PSNR (dB): all", "mean", "worst", "SSIM: all", "mean",
+              "worst");
+    printf ("%-24.24s %15.2f %6.2f %6.2f | %9.5f %8.5f %8.5f\n",
+            nvariants == 1 ? "tight" : variants[i].enc->name,
+            rfbQualityPSNR (&q->total), q->psnrSum / q->updates, q->minPSNR,
+            rfbQualitySSIM (&q->total), q->ssimSum / q->updates, q->minSSIM);
+  }
+  if (header) printf ("\n");
+}
+
+static void print_links (void)
+{
+  int i, j;
+
+  printf ("Emulated link  codec        updates/s  p50 (ms)  p99 (ms)"
+          "  max (ms) link busy\n");
+  for (i = 0; i < nlinks; i++) {
+    const char *name = links[i].name;
+    if (lat_hextile.rect.count > 0) {
+      rfbLinkPrintRow (name, "hextile", &lat_hextile.link[i]);
+      name = "";
+    }
+    if (lat_zlib.rect.count > 0) {
+      rfbLinkPrintRow (name, "zlib", &lat_zlib.link[i]);
+      name = "";
+    }
+    if (lat_zrle.rect.count > 0) {
+      rfbLinkPrintRow (name, zrle_name, &lat_zrle.link[i]);
+      name = "";
+    }
+    for (j = 0; j < nvariants; j++) {
+      rfbLinkPrintRow (name, nvariants == 1 ? "tight" : variants[j].enc->name,
+                       &variants[j].lat.link[i]);
+      name = "";
+    }
+  }
+  printf ("\n");
+}
+
+static void *decode_pipeline (void *arg)
+{
+  tight_variant *v = &variants[0];
+  rfbPipelineStatistics before, after;
+  double tUpdate;
+  int type;
+
+#ifdef __linux__
+  /* Run the decoder on the CPU after the encoder's, like a viewer on another
+     machine */
+  if (pipeline_cpu >= 0) {
+    cpu_set_t cpus;
+    CPU_ZERO (&cpus);
+    CPU_SET ((pipeline_cpu + 1) % (int)sysconf (_SC_NPROCESSORS_ONLN), &cpus);
+    sched_setaffinity (0, sizeof(cpus), &cpus);
+  }
+#endif
+
+  if (!v->dec->begin ())
+    goto bailout;
+
+  while ((type = rfbPipelineNext (&tUpdate)) != rfbPipelineEnd) {
+    if (type == rfbPipelineData) {
+      rfbFramebufferUpdateRectHeader rect;
+      double t0, t;
+      Bool ok;
+
+      if (!ReadFromRFBServer((char *)&rect, sz_rfbFramebufferUpdateRectHeader)) {
+        fprintf(stderr, "Could not read rectangle header.\n");
+        goto bailout;
+      }
+      rect.encoding = Swap32IfLE(rect.encoding);
+      rect.r.x = Swap16IfLE(rect.r.x);
+      rect.r.y = Swap16IfLE(rect.r.y);
+      rect.r.w = Swap16IfLE(rect.r.w);
+      rect.r.h = Swap16IfLE(rect.r.h);
+      if (rect.encoding != rfbEncodingTight) {
+        printf("Non-tight rectangle encountered!\n");
+        goto bailout;
+      }
+
+      /* Time spent waiting for the rest of the rectangle isn't decoding
+         time */
+      rfbPipelineGetStatistics (&before);
+      t0 = gettime ();
+      ok = v->dec->handleRect[color_depth == 8 ? 0 : color_depth == 16 ? 1 : 2]
+             (rect.r.x, rect.r.y, rect.r.w, rect.r.h);
+      t = gettime () - t0;
+      if (!ok) {
+        fprintf (stderr, "Error in %s decoder!\n", v->dec->name);
+        goto bailout;
       }
-      break;
+      rfbPipelineGetStatistics (&after);
+      t -= after.readerWait - before.readerWait;
+      v->t[tndx] += t;
+      record_rect (&v->lat, t, rect.r.w * rect.r.h);
+
+    } else if (type == rfbPipelineEndUpdate) {
+      double now;
+
+      v->dec->end ();
+      now = gettime ();
+      record_update (&v->lat);
+      rfbHistogramRecord (&lat_pipeline, now - tUpdate);
+      if (pipeline_updates++ == 0)
+        pipeline_tStart = tUpdate;
+      pipeline_tEnd = now;
+      if (!v->dec->begin ())
+        goto bailout;
+
+    } else
+      goto bailout;
+  }
 
-    case rfbBell:
-      fprintf (stderr, "> Bell...\n");
-      break;
+  v->dec->end ();
+  return NULL;
 
-    case rfbServerCutText:
-      fprintf (stderr, "> ServerCutText...\n");
-      if (fread (buf + 1, 1, 7, in) != 7) {
-        fprintf (stderr, "Read error.\n");
-        return -1;
-      }
-      n = (size_t) get_CARD32 (buf + 4);
-      while (n--) {
-        if (getc (in) == EOF) {
-          fprintf (stderr, "Read error.\n");
-          return -1;
-        }
-      }
-      break;
+  bailout:
+  pipeline_failed = TRUE;
+  rfbPipelineAbort ();
+  return NULL;
+}
 
-    default:
-      fprintf (stderr, "Unknown server message: 0x%X\n", msg_type);
-      return -1;                /* Unknown server message */
-    }
-    msg_type = getc (in);
+static int start_pipeline (void)
+{
+  int err;
+
+  if (pipeline_socket >= 0) {
+    if (!rfbPipelineOpenSocket (pipeline_socket, pipeline_flush))
+      return -1;
+  } else if (!rfbPipelineOpen (pipeline_chunks))
+    return -1;
+  rfbHistogramReset (&lat_pipeline);
+  pipeline_tUpdate = -1.0;
+  pipeline_tStart = pipeline_tEnd = 0.0;
+  pipeline_updates = 0;
+  pipeline_failed = FALSE;
+  if ((err = pthread_create (&pipeline_thread, NULL, decode_pipeline,
+                             NULL)) != 0) {
+    fprintf (stderr, "Cannot create decoder thread: %s\n", strerror (err));
+    rfbPipelineClose ();
+    return -1;
   }
+  pipeline_running = TRUE;
+  return 0;
+}
 
-  if(tightonly) sum_raw=sum_hextile=sum_zlib=sum_zrle=INT_MAX;
+/* Waits for the decoder thread to finish the pass, or with abort, makes it
+   stop right away */
+static int stop_pipeline (Bool abort)
+{
+  if (!pipeline_running) return 0;
+  if (abort || !rfbPipelineMark (rfbPipelineEnd, 0.0))
+    rfbPipelineAbort ();
+  pthread_join (pipeline_thread, NULL);
+  pipeline_running = FALSE;
+  rfbPipelineGetStatistics (&pipeline_stats);
+  rfbPipelineClose ();
+  return pipeline_failed ? -1 : 0;
+}
+
+/*
+ * fbs-dump -i keeps the ProtocolVersion and ServerInit messages at the start
+ * of the capture, so the framebuffer size is known.  "R" isn't a valid server
+ * message type, so such a capture is easy to tell apart from one that starts
+ * with the first server message.
+ */
 
-  printf ("\nGrand totals:\n"
-          "                          raw    |  hextile  |   zlib   |   ZRLE   |  tight  \n"
-          "                       ----------+-----------+----------+----------+---------\n"
-          "Bytes in all rects:    %9d | %9d | %8d | %8d | %8d\n"
-          "Tight/XXX B/W saving:  %8.2f%% | %8.2f%% | %7.2f%% | %7.2f%% |\n",
-          sum_raw, sum_hextile, sum_zlib, sum_zrle, sum_tight,
-          (double)(sum_raw - sum_tight) * 100 / (double) sum_raw,
-          (double)(sum_hextile - sum_tight) * 100 / (double) sum_hextile,
-          (double)(sum_zlib - sum_tight) * 100 / (double) sum_zlib,
-          (double)(sum_zrle - sum_tight) * 100 / (double) sum_zrle);
-  printf ("%scoding time:         ......... | %8.4fs | %7.4fs | %7.4fs | %7.4fs\n",
-          decompress? "De":"En", thextile[tndx], tzlib[tndx], tzrle[tndx],
-          ttight[tndx]);
+static int read_server_init (rfbCapture *in, int *width, int *height)
+{
+  rfbServerInitMsg si;
+  char *ptr;
 
-  #ifdef TIGHT_STATISTICS
-  printf("Solid rectangles = %lu, pixels = %f mil\n", solidrect, (double)solidpixels/1000000.);
-  printf("Mono rectangles  = %lu, pixels = %f mil\n", monorect, (double)monopixels/1000000.);
-  printf("Index rectangles = %lu, pixels = %f mil\n", ndxrect, (double)ndxpixels/1000000.);
-  printf("JPEG rectangles  = %lu, pixels = %f mil\n", jpegrect, (double)jpegpixels/1000000.);
-  printf("Grad rectangles  = %lu, pixels = %f mil\n", gradrect, (double)gradpixels/1000000.);
-  printf("Raw rectangles   = %lu, pixels = %f mil\n", fcrect, (double)fcpixels/1000000.);
-  #endif
+  if ((ptr = rfbCapturePeek (in, sz_rfbProtocolVersionMsg)) == NULL ||
+      strncmp (ptr, "RFB ", 4) != 0)
+    return 0;
 
-  printf("Avg. pixel count for %d FB updates:  %f\n", total_rects,
-	 (double)total_pixels/(double)total_rects);
-  printf("\n");
-  if(tndx==1)
-  printf ("Avg. %scoding time:    ......... | %8.4fs | %7.4fs | %7.4fs | %7.4fs\n\n",
-          decompress? "De":"En", (thextile[0]+thextile[1])/2.,
-          (tzlib[0]+tzlib[1])/2., (tzrle[0]+tzrle[1])/2.,
-          (ttight[0]+ttight[1])/2.);
-  tndx++;
+  if (!rfbCaptureSkip (in, sz_rfbProtocolVersionMsg) ||
+      (ptr = rfbCaptureRead (in, sz_rfbServerInitMsg)) == NULL) {
+    fprintf (stderr, "Read error.\n");
+    return -1;
+  }
+  memcpy (&si, ptr, sz_rfbServerInitMsg);
+  *width = get_CARD16 ((char *)&si.framebufferWidth);
+  *height = get_CARD16 ((char *)&si.framebufferHeight);
+  if (!rfbCaptureSkip (in, (off_t) get_CARD32 ((char *)&si.nameLength))) {
+    fprintf (stderr, "Read error.\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int resize_framebuffer (int width, int height)
+{
+  int i;
+
+  /* The decoder thread writes into the framebuffer. */
+  if (pipeline_running && !rfbPipelineDrain ())
+    return -1;
+  if (!rfbResizeFramebuffer (width, height))
+    return -1;
 
-  return (ferror (in)) ? -1 : 0;
+  for (i = 0; i < nvariants; i++) {
+    variants[i].client.fb = rfbClient.fb;
+#ifdef ICE_SUPPORTED
+    variants[i].client.compareFB = rfbClient.compareFB;
+    variants[i].client.firstCompare = rfbClient.firstCompare;
+#endif
+  }
+  return 0;
 }
 
-static int parse_fb_update (FILE *in)
+static int parse_fb_update (rfbCapture *in)
 {
   rfbFramebufferUpdateMsg msg;
   rfbFramebufferUpdateRectHeader rh;
@@ -508,14 +2010,20 @@ static int parse_fb_update (FILE *in)
   CARD16 xpos, ypos, width, height;
   int i, update_rects = 0;
   CARD32 enc;
+  char *ptr;
 
   memset(&msg, 0, sz_rfbFramebufferUpdateMsg);
-  if (fread (&msg.pad, 1, 3, in) != 3) {
+  if ((ptr = rfbCaptureRead (in, 3)) == NULL) {
     fprintf (stderr, "Read error.\n");
     return -1;
   }
+  memcpy (&msg.pad, ptr, 3);
 
   rect_count = get_CARD16 ((char *)&msg.nRects);
+  begin_update ();
+
+  if (cache && write_cache (&msg, sz_rfbFramebufferUpdateMsg) != 0)
+    return -1;
 
   if (out) msg.nRects = 0xFFFF;
   if (!WriteToSessionCapture((char *)&msg, sz_rfbFramebufferUpdateMsg))
@@ -523,24 +2031,50 @@ static int parse_fb_update (FILE *in)
 
   for (i = 0; i < rect_count; i++) {
     int ret;
-    if (fread (&rh, 1, sz_rfbFramebufferUpdateRectHeader, in)
-        != sz_rfbFramebufferUpdateRectHeader) {
+    if ((ptr = rfbCaptureRead (in, sz_rfbFramebufferUpdateRectHeader))
+        == NULL) {
       fprintf (stderr, "Read error.\n");
       return -1;
     }
+    memcpy (&rh, ptr, sz_rfbFramebufferUpdateRectHeader);
     xpos = get_CARD16 ((char *)&rh.r.x);
     ypos = get_CARD16 ((char *)&rh.r.y);
     width = get_CARD16 ((char *)&rh.r.w);
     height = get_CARD16 ((char *)&rh.r.h);
-    total_pixels += width * height;
-
     enc = get_CARD32 ((char *)&rh.encoding);
 
+    if (enc == rfbEncodingNewFBSize) {
+      if (verbose)
+        printf ("New framebuffer size: %d*%d\n", width, height);
+      if (resize_framebuffer (width, height) != 0)
+        return -1;
+      if (cache && write_cache (&rh, sz_rfbFramebufferUpdateRectHeader) != 0)
+        return -1;
+      if (!WriteToSessionCapture((char *)&rh,
+                                 sz_rfbFramebufferUpdateRectHeader))
+        return -1;
+      continue;
+    }
+
+    if (xpos + width > rfbScreen.width || ypos + height > rfbScreen.height) {
+      fprintf (stderr, "Rectangle (%d,%d %d*%d) is outside of the %d*%d "
+               "framebuffer.  Use -size.\n", xpos, ypos, width, height,
+               rfbScreen.width, rfbScreen.height);
+      return -1;
+    }
+
     ret = parse_rectangle(in, xpos, ypos, width, height, i, enc);
     if (ret < 0) return -1;
     else update_rects += (1 - ret);
 
-    total_rects++;
+    if (encoding) {
+      total_pixels += width * height;
+      total_rects++;
+    }
+  }
+  if (!encoding) {
+    update_no++;
+    return 0;
   }
 #ifdef ICE_SUPPORTED
   rfbClient.firstCompare = FALSE;
@@ -558,6 +2092,23 @@ static int parse_fb_update (FILE *in)
       return -1;
   }
 
+  record_update (&lat_hextile);
+  record_update (&lat_zlib);
+  record_update (&lat_zrle);
+  if (pipeline) {
+    /* The decoder thread records the update when it gets to this marker */
+    if (!rfbPipelineMark (rfbPipelineEndUpdate, pipeline_tUpdate)) {
+      fprintf (stderr, "Decoder thread failed.\n");
+      return -1;
+    }
+    pipeline_tUpdate = -1.0;
+  } else {
+    for (i = 0; i < nvariants; i++) {
+      record_update (&variants[i].lat);
+      rfbQualityEndUpdate (&variants[i].quality);
+    }
+  }
+
   if (out) {
     rh.encoding = Swap32IfLE(rfbEncodingLastRect);
     rh.r.x = rh.r.y = rh.r.w = rh.r.h = 0;
@@ -566,11 +2117,12 @@ static int parse_fb_update (FILE *in)
   }
 
   total_updates++;
+  update_no++;
 
   return 0;
 }
 
-static int parse_rectangle (FILE *in, int xpos, int ypos,
+static int parse_rectangle (rfbCapture *in, int xpos, int ypos,
                             int width, int height, int rect_no, int enc)
 {
   int err;
@@ -617,6 +2169,15 @@ static int parse_rectangle (FILE *in, int xpos, int ypos,
     return -1;
   }
 
+  if (cache &&
+      cache_rectangle (xpos, ypos, width, height, pixel_bytes) != 0)
+    return -1;
+
+  /* Updates that aren't encoded (see begin_update()) only change the
+     framebuffer. */
+  if (!encoding)
+    return 0;
+
 #ifdef SAVE_PPM_FILES
   sprintf (fname, "%.40s/%05d-%04d.ppm", SAVE_PATH, total_updates, rect_no);
   ppm = fopen (fname, "w");
@@ -690,10 +2251,12 @@ static int parse_rectangle (FILE *in, int xpos, int ypos,
 
     if (!decompress) {
       double tCompare = gettime() - tCompare0 - tEncode;
+      int i;
       thextile[tndx] += tCompare;
       tzlib[tndx] += tCompare;
       tzrle[tndx] += tCompare;
-      ttight[tndx] += tCompare;
+      for (i = 0; i < nvariants; i++)
+        variants[i].t[tndx] += tCompare;
     }
 
     if (empty) return 1;
@@ -707,7 +2270,9 @@ static int parse_rectangle (FILE *in, int xpos, int ypos,
 static int send_rectangle (int xpos, int ypos,
                            int width, int height, int rect_no, int pixel_bytes)
 {
-  int err, i;
+  int err, i, j, ncodecs = 0;
+  double t, te;
+  rfbCodecResult codecs[4 + MAX_VARIANTS], tight[MAX_VARIANTS];
 
   rfbClient.rfbBytesSent[rfbEncodingHextile] = 0;
   rfbClient.rfbRectanglesSent[rfbEncodingHextile] = 0;
@@ -715,13 +2280,13 @@ static int send_rectangle (int xpos, int ypos,
   rfbClient.rfbRectanglesSent[rfbEncodingZlib] = 0;
   rfbClient.rfbBytesSent[rfbEncodingZRLE] = 0;
   rfbClient.rfbRectanglesSent[rfbEncodingZRLE] = 0;
-  rfbClient.rfbBytesSent[rfbEncodingTight] = 0;
-  rfbClient.rfbRectanglesSent[rfbEncodingTight] = 0;
 
   if(!tightonly) {
 
   sblen = sbptr = 0;
-  if(!decompress) t0 = gettime();
+  t = 0.0;
+  if(!decompress) perf_begin ();
+  t0 = gettime();
   if (!rfbSendRectEncodingHextile(&rfbClient, xpos, ypos, width, height)) {
       fprintf (stderr, "Error in hextile encoder!\n");
       return -1;
@@ -730,7 +2295,9 @@ static int send_rectangle (int xpos, int ypos,
     fprintf(stderr, "Could not flush output buffer\n");
     return -1;
   }
-  if(!decompress) thextile[tndx] += gettime() - t0;
+  te = gettime() - t0;
+  if(!decompress) t = te;
+  if(!decompress) perf_end (&lat_hextile);
   if(decompress) {
     for (i = 0; i < rfbClient.rfbRectanglesSent[rfbEncodingHextile]; i++) {
       rfbFramebufferUpdateRectHeader rect;
@@ -744,6 +2311,7 @@ static int send_rectangle (int xpos, int ypos,
       rect.r.w = Swap16IfLE(rect.r.w);
       rect.r.h = Swap16IfLE(rect.r.h);
       if (rect.encoding == rfbEncodingHextile) {
+        perf_begin ();
         t0 = gettime();
         switch (color_depth) {
         case 8:
@@ -757,7 +2325,8 @@ static int send_rectangle (int xpos, int ypos,
           fprintf (stderr, "Error in hextile decoder!\n");
           return -1;
         }
-        thextile[tndx] += gettime() - t0;
+        t += gettime() - t0;
+        perf_end (&lat_hextile);
       }
 			else {
         printf("Non-hextile rectangle encountered!\n");
@@ -769,9 +2338,19 @@ static int send_rectangle (int xpos, int ypos,
       return -1;
     }
   }
+  thextile[tndx] += t;
+  record_rect (&lat_hextile, t, width * height);
+  if (nlinks)
+    record_link (&lat_hextile, rfbClient.rfbBytesSent[rfbEncodingHextile], te,
+                 decompress ? t : 0.0);
+  if (results)
+    set_result (&codecs[ncodecs++], "hextile",
+                rfbClient.rfbBytesSent[rfbEncodingHextile], t);
 
   sblen = sbptr = 0;
-  if(!decompress) t0 = gettime();
+  t = 0.0;
+  if(!decompress) perf_begin ();
+  t0 = gettime();
   if (!rfbSendRectEncodingZlib(&rfbClient, xpos, ypos, width, height)) {
       fprintf (stderr, "Error in zlib encoder!.\n");
       return -1;
@@ -780,7 +2359,9 @@ static int send_rectangle (int xpos, int ypos,
     fprintf(stderr, "Could not flush output buffer\n");
     return -1;
   }
-  if(!decompress) tzlib[tndx] += gettime() - t0;
+  te = gettime() - t0;
+  if(!decompress) t = te;
+  if(!decompress) perf_end (&lat_zlib);
   if(decompress) {
     for (i = 0; i < rfbClient.rfbRectanglesSent[rfbEncodingZlib]; i++) {
       rfbFramebufferUpdateRectHeader rect;
@@ -794,6 +2375,7 @@ static int send_rectangle (int xpos, int ypos,
       rect.r.w = Swap16IfLE(rect.r.w);
       rect.r.h = Swap16IfLE(rect.r.h);
       if (rect.encoding == rfbEncodingZlib) {
+        perf_begin ();
         t0 = gettime();
         switch (color_depth) {
         case 8:
@@ -807,7 +2389,8 @@ static int send_rectangle (int xpos, int ypos,
           fprintf (stderr, "Error in zlib decoder!\n");
           return -1;
         }
-        tzlib[tndx] += gettime() - t0;
+        t += gettime() - t0;
+        perf_end (&lat_zlib);
       }
 			else {
         printf("Non-zlib rectangle encountered!\n");
@@ -819,44 +2402,32 @@ static int send_rectangle (int xpos, int ypos,
       return -1;
     }
   }
+  tzlib[tndx] += t;
+  record_rect (&lat_zlib, t, width * height);
+  if (nlinks)
+    record_link (&lat_zlib, rfbClient.rfbBytesSent[rfbEncodingZlib], te,
+                 decompress ? t : 0.0);
+  if (results)
+    set_result (&codecs[ncodecs++], "zlib",
+                rfbClient.rfbBytesSent[rfbEncodingZlib], t);
 
   sblen = sbptr = 0;
-  if (!decompress) {
-    sblen = sbptr = 0;
-    t0 = gettime();
-    if (!rfbSendRectEncodingZRLE(&rfbClient, xpos, ypos, width, height)) {
-      fprintf (stderr, "Error in ZRLE encoder!.\n");
-      return -1;
-    }
-    if(!rfbSendUpdateBuf(&rfbClient)) {
-      fprintf(stderr, "Could not flush output buffer\n");
-      return -1;
-    }
-    tzrle[tndx] += gettime() - t0;
-    rfbFreeZrleData(&rfbClient);
-  }
-
-  }
-
-  sblen = sbptr = 0;
-  if(!decompress) t0 = gettime();
-  if (!rfbSendRectEncodingTight(&rfbClient, xpos, ypos, width, height)) {
-      fprintf (stderr, "Error in tight encoder!.\n");
+  t = 0.0;
+  if(!decompress) perf_begin ();
+  t0 = gettime();
+  if (!rfbSendRectEncodingZRLE(&rfbClient, xpos, ypos, width, height)) {
+      fprintf (stderr, "Error in %s encoder!.\n", zrle_name);
       return -1;
   }
   if(!rfbSendUpdateBuf(&rfbClient)) {
     fprintf(stderr, "Could not flush output buffer\n");
     return -1;
   }
-  if(!decompress) ttight[tndx] += gettime() - t0;
+  te = gettime() - t0;
+  if(!decompress) t = te;
+  if(!decompress) perf_end (&lat_zrle);
   if(decompress) {
-    #ifdef __TURBOD_MT__
-    if (!threadInit) {
-      InitThreads();
-      if (!threadInit) return False;
-    }
-    #endif
-    for (i = 0; i < rfbClient.rfbRectanglesSent[rfbEncodingTight]; i++) {
+    for (i = 0; i < rfbClient.rfbRectanglesSent[rfbEncodingZRLE]; i++) {
       rfbFramebufferUpdateRectHeader rect;
       if (!ReadFromRFBServer((char *)&rect, sz_rfbFramebufferUpdateRectHeader)) {
         fprintf(stderr, "Could not read rectangle header.\n");
@@ -867,54 +2438,185 @@ static int send_rectangle (int xpos, int ypos,
       rect.r.y = Swap16IfLE(rect.r.y);
       rect.r.w = Swap16IfLE(rect.r.w);
       rect.r.h = Swap16IfLE(rect.r.h);
-      if (rect.encoding == rfbEncodingTight) {
+      if (rect.encoding == rfbZRLEPreferredEncoding) {
+        perf_begin ();
         t0 = gettime();
         switch (color_depth) {
         case 8:
-          err = HandleTight8 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
+          err = HandleZRLE8 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
         case 16:
-          err = HandleTight16 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
+          err = HandleZRLE16 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
         default:
-          err = HandleTight32 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
+          err = HandleZRLE32 (rect.r.x, rect.r.y, rect.r.w, rect.r.h);  break;
         }
         if (!err) {
-          fprintf (stderr, "Error in tight decoder!\n");
+          fprintf (stderr, "Error in %s decoder!\n", zrle_name);
           return -1;
         }
-        ttight[tndx] += gettime() - t0;
+        t += gettime() - t0;
+        perf_end (&lat_zrle);
       }
-			else {
-        printf("Non-tight rectangle encountered!\n");
+      else {
+        printf("Non-%s rectangle encountered!\n", zrle_name);
         return -1;
       }
     }
     if(sbptr != sblen) {
-      printf("ERROR: incomplete decode of tight-encoded data.\n");
+      printf("ERROR: incomplete decode of %s-encoded data.\n", zrle_name);
+      return -1;
+    }
+  }
+  tzrle[tndx] += t;
+  record_rect (&lat_zrle, t, width * height);
+  if (nlinks)
+    record_link (&lat_zrle, rfbClient.rfbBytesSent[rfbEncodingZRLE], te,
+                 decompress ? t : 0.0);
+  if (results)
+    set_result (&codecs[ncodecs++], zrle_name,
+                rfbClient.rfbBytesSent[rfbEncodingZRLE], t);
+  /* The encoder starts a new zlib stream for each rectangle, so the decoder
+     has to as well. */
+  rfbFreeZrleData(&rfbClient);
+  if (zrleStreamInited) inflateReset(&zrleStream);
+
+  }
+
+  for (j = 0; j < nvariants; j++) {
+    /* Rotate the order in which the variants run, so that none of them
+       consistently benefits from (or pays for) the cache state left by the
+       others. */
+    tight_variant *v = &variants[(j + total_updates) % nvariants];
+    rfbClientPtr cl = &v->client;
+    rfbCodecResult *r = &tight[v - variants], before;
+    rfbQualitySum rect_quality;
+
+    cl->rfbBytesSent[rfbEncodingTight] = 0;
+    cl->rfbRectanglesSent[rfbEncodingTight] = 0;
+
+    if (results && v->enc->stats)
+      rfbResultsGetStatistics (&before, v->enc->stats);
+
+    sblen = sbptr = 0;
+    t = 0.0;
+    if (pipeline && pipeline_tUpdate < 0.0)
+      pipeline_tUpdate = gettime();
+    if(!decompress) perf_begin ();
+    t0 = gettime();
+    if (!v->enc->sendRect(cl, xpos, ypos, width, height)) {
+        fprintf (stderr, "Error in %s encoder!.\n", v->enc->name);
+        return -1;
+    }
+    if(!rfbSendUpdateBuf(cl)) {
+      fprintf(stderr, "Could not flush output buffer\n");
+      return -1;
+    }
+    if (pipeline && !rfbPipelineMark (rfbPipelineEndRect, 0.0)) {
+      fprintf (stderr, "Decoder thread failed.\n");
       return -1;
     }
+    te = gettime() - t0;
+    if(!decompress) t = te;
+    if(!decompress) perf_end (&v->lat);
+    if(decompress && !pipeline) {
+      if (!v->dec->begin()) return -1;
+      for (i = 0; i < cl->rfbRectanglesSent[rfbEncodingTight]; i++) {
+        rfbFramebufferUpdateRectHeader rect;
+        if (!ReadFromRFBServer((char *)&rect, sz_rfbFramebufferUpdateRectHeader)) {
+          fprintf(stderr, "Could not read rectangle header.\n");
+          return -1;
+        }
+        rect.encoding = Swap32IfLE(rect.encoding);
+        rect.r.x = Swap16IfLE(rect.r.x);
+        rect.r.y = Swap16IfLE(rect.r.y);
+        rect.r.w = Swap16IfLE(rect.r.w);
+        rect.r.h = Swap16IfLE(rect.r.h);
+        if (rect.encoding == rfbEncodingTight) {
+          perf_begin ();
+          t0 = gettime();
+          err = v->dec->handleRect[color_depth == 8 ? 0 :
+                                   color_depth == 16 ? 1 : 2]
+                  (rect.r.x, rect.r.y, rect.r.w, rect.r.h);
+          if (!err) {
+            fprintf (stderr, "Error in %s decoder!\n", v->dec->name);
+            return -1;
+          }
+          t += gettime() - t0;
+          perf_end (&v->lat);
+        }
+        else {
+          printf("Non-tight rectangle encountered!\n");
+          return -1;
+        }
+      }
+      if(sbptr != sblen) {
+        printf("ERROR: incomplete decode of tight-encoded data.\n");
+        return -1;
+      }
+      v->dec->end();
+      if (v->dec->writesImage) {
+        int ps = rfbScreen.bitsPerPixel / 8;
+        size_t offset = (size_t)ypos * rfbScreen.paddedWidthInBytes + xpos * ps;
+        if (!rfbQualityCompareRect (&v->quality, &rect_quality,
+                                    &rfbScreen.pfbMemory[offset],
+                                    &rfbServerFormat, &image->data[offset],
+                                    &cl->format, rfbScreen.paddedWidthInBytes,
+                                    width, height))
+          return -1;
+      }
+    }
+    if (!pipeline) {
+      v->t[tndx] += t;
+      record_rect (&v->lat, t, width * height);
+      if (nlinks)
+        record_link (&v->lat, cl->rfbBytesSent[rfbEncodingTight], te,
+                     decompress ? t : 0.0);
+    }
 
-    #ifdef __TURBOD_MT__
-    for (i = 1; i < nt; i++) {
-      pthread_mutex_lock(&tparam[i].done);
-      pthread_mutex_unlock(&tparam[i].done);
+    if (results) {
+      set_result (r, v->enc->name, cl->rfbBytesSent[rfbEncodingTight], t);
+      if (v->enc->stats) {
+        rfbResultsGetStatistics (r, v->enc->stats);
+        for (i = 0; i < rfbResultSubencodings; i++) {
+          r->subrects[i] -= before.subrects[i];
+          r->subpixels[i] -= before.subpixels[i];
+        }
+      }
+      if (decompress && !pipeline && v->dec->writesImage) {
+        r->hasQuality = TRUE;
+        r->psnr = rfbQualityPSNR (&rect_quality);
+        r->ssim = rfbQualitySSIM (&rect_quality);
+      }
     }
-    #endif
   }
 
-  if (verbose)
-    printf ("%05d-%04d (%4d,%3d %4d*%3d): %7d|%7d|%6d|%6d|%6d\n",
+  if (results && !warming) {
+    memmove (&codecs[1], codecs, ncodecs * sizeof(rfbCodecResult));
+    set_result (&codecs[0], "raw", width * height * pixel_bytes + 12, 0.0);
+    memcpy (&codecs[ncodecs + 1], tight, nvariants * sizeof(rfbCodecResult));
+    rfbResultsWriteRect (total_updates, rect_no, xpos, ypos, width, height,
+                         codecs, ncodecs + 1 + nvariants);
+  }
+
+  if (verbose) {
+    printf ("%05d-%04d (%4d,%3d %4d*%3d): %7d|%7d|%6d|%6d",
             total_updates, rect_no, xpos, ypos, width, height,
             width * height * pixel_bytes + 12,
             rfbClient.rfbBytesSent[rfbEncodingHextile],
             rfbClient.rfbBytesSent[rfbEncodingZlib],
-            rfbClient.rfbBytesSent[rfbEncodingZRLE],
-            rfbClient.rfbBytesSent[rfbEncodingTight]);
+            rfbClient.rfbBytesSent[rfbEncodingZRLE]);
+    for (j = 0; j < nvariants; j++)
+      printf ("|%*d", nvariants == 1 ? 6 :
+              max (6, (int)strlen (variants[j].enc->name)),
+              variants[j].client.rfbBytesSent[rfbEncodingTight]);
+    printf ("\n");
+  }
 
   sum_raw += width * height * pixel_bytes + 12;
   sum_hextile += rfbClient.rfbBytesSent[rfbEncodingHextile];
-  sum_tight += rfbClient.rfbBytesSent[rfbEncodingTight];
   sum_zrle += rfbClient.rfbBytesSent[rfbEncodingZRLE];
   sum_zlib += rfbClient.rfbBytesSent[rfbEncodingZlib];
+  for (j = 0; j < nvariants; j++)
+    variants[j].sum += variants[j].client.rfbBytesSent[rfbEncodingTight];
 
   return 0;
 }
@@ -981,23 +2683,18 @@ static int save_rectangle (FILE *ppm, int width, int height, int depth)
 
 #define DEFINE_HANDLE_RAW(bpp)                                             \
                                                                            \
-static int handle_raw##bpp (FILE *in, int x, int y, int width, int height) \
+static int handle_raw##bpp (rfbCapture *in, int x, int y, int width,       \
+                            int height)                                    \
 {                                                                          \
-  char *data = NULL;                                                       \
-                                                                           \
-  if ((data = (char *)malloc(width * height * (bpp / 8))) == NULL) {       \
-    fprintf (stderr, "Memory allocation error.\n");                        \
-    return -1;                                                             \
-  }                                                                        \
+  char *data;                                                              \
                                                                            \
-  if ((int)fread (data, 1, width * height * (bpp / 8), in)                 \
-    != width * height * (bpp / 8)) {                                       \
+  if ((data = rfbCaptureRead (in, (size_t)width * height * (bpp / 8)))     \
+      == NULL) {                                                           \
     fprintf (stderr, "Read error.\n");                                     \
     return -1;                                                             \
   }                                                                        \
                                                                            \
-  copy_data ((char *)data, x, y, width, height, bpp);                      \
-  free(data);                                                              \
+  copy_data (data, x, y, width, height, bpp);                              \
   return 0;                                                                \
 }
 
@@ -1017,15 +2714,16 @@ DEFINE_HANDLE_RAW(32)
 
 #define DEFINE_HANDLE_HEXTILE(bpp)                                         \
                                                                            \
-static int handle_hextile##bpp (FILE *in, int xpos, int ypos, int width,   \
-                                int height)                                \
+static int handle_hextile##bpp (rfbCapture *in, int xpos, int ypos,        \
+                                int width, int height)                     \
 {                                                                          \
   CARD##bpp bg = 0, fg = 0;                                                \
   int x, y, w, h;                                                          \
   int sx, sy, sw, sh;                                                      \
   int jx, jy;                                                              \
-  int subencoding, n_subrects, coord_pair;                                 \
+  int subencoding, n_subrects, subrect_size;                               \
   CARD##bpp data[16*16];                                                   \
+  char *ptr;                                                               \
   int i;                                                                   \
                                                                            \
   for (y = 0; y < height; y += 16) {                                       \
@@ -1036,38 +2734,39 @@ static int handle_hextile##bpp (FILE *in, int xpos, int ypos, int width,   \
       if (height - y < 16)                                                 \
         h = height - y;                                                    \
                                                                            \
-      subencoding = getc (in);                                             \
+      subencoding = rfbCaptureGetc (in);                                   \
       if (subencoding == EOF) {                                            \
         fprintf (stderr, "Read error.\n");                                 \
         return -1;                                                         \
       }                                                                    \
                                                                            \
       if (subencoding & rfbHextileRaw) {                                   \
-        if ((int)fread (data, 1, w * h * (bpp / 8), in)                    \
-          != w * h * (bpp / 8)) {                                          \
+        if ((ptr = rfbCaptureRead (in, w * h * (bpp / 8))) == NULL) {      \
           fprintf (stderr, "Read error.\n");                               \
           return -1;                                                       \
         }                                                                  \
                                                                            \
-        copy_data ((char *)data, xpos + x, ypos + y, w, h, bpp);           \
+        copy_data (ptr, xpos + x, ypos + y, w, h, bpp);                    \
         continue;                                                          \
       }                                                                    \
                                                                            \
       if (subencoding & rfbHextileBackgroundSpecified) {                   \
-        if (fread (&bg, 1, (bpp / 8), in) != (bpp / 8)) {                  \
+        if ((ptr = rfbCaptureRead (in, (bpp / 8))) == NULL) {              \
           fprintf (stderr, "Read error.\n");                               \
           return -1;                                                       \
         }                                                                  \
+        memcpy (&bg, ptr, (bpp / 8));                                      \
       }                                                                    \
                                                                            \
       for (i = 0; i < w * h; i++)                                          \
         data[i] = bg;                                                      \
                                                                            \
       if (subencoding & rfbHextileForegroundSpecified) {                   \
-        if (fread (&fg, 1, (bpp / 8), in) != (bpp / 8)) {                  \
+        if ((ptr = rfbCaptureRead (in, (bpp / 8))) == NULL) {              \
           fprintf (stderr, "Read error.\n");                               \
           return -1;                                                       \
         }                                                                  \
+        memcpy (&fg, ptr, (bpp / 8));                                      \
       }                                                                    \
                                                                            \
       if (!(subencoding & rfbHextileAnySubrects)) {                        \
@@ -1075,30 +2774,30 @@ static int handle_hextile##bpp (FILE *in, int xpos, int ypos, int width,   \
         continue;                                                          \
       }                                                                    \
                                                                            \
-      if ((n_subrects = getc (in)) == EOF) {                               \
+      if ((n_subrects = rfbCaptureGetc (in)) == EOF) {                     \
+        fprintf (stderr, "Read error.\n");                                 \
+        return -1;                                                         \
+      }                                                                    \
+                                                                           \
+      /* Read all of the subrectangles at once */                          \
+      subrect_size = 2;                                                    \
+      if (subencoding & rfbHextileSubrectsColoured)                        \
+        subrect_size += (bpp / 8);                                         \
+      if ((ptr = rfbCaptureRead (in, n_subrects * subrect_size)) == NULL) { \
         fprintf (stderr, "Read error.\n");                                 \
         return -1;                                                         \
       }                                                                    \
                                                                            \
       for (i = 0; i < n_subrects; i++) {                                   \
         if (subencoding & rfbHextileSubrectsColoured) {                    \
-          if (fread (&fg, 1, (bpp / 8), in) != (bpp / 8)) {                \
-            fprintf (stderr, "Read error.\n");                             \
-            return -1;                                                     \
-          }                                                                \
-        }                                                                  \
-        if ((coord_pair = getc (in)) == EOF) {                             \
-          fprintf (stderr, "Read error.\n");                               \
-          return -1;                                                       \
-        }                                                                  \
-        sx = rfbHextileExtractX (coord_pair);                              \
-        sy = rfbHextileExtractY (coord_pair);                              \
-        if ((coord_pair = getc (in)) == EOF) {                             \
-          fprintf (stderr, "Read error.\n");                               \
-          return -1;                                                       \
+          memcpy (&fg, ptr, (bpp / 8));                                    \
+          ptr += (bpp / 8);                                                \
         }                                                                  \
-        sw = rfbHextileExtractW (coord_pair);                              \
-        sh = rfbHextileExtractH (coord_pair);                              \
+        sx = rfbHextileExtractX ((CARD8)ptr[0]);                           \
+        sy = rfbHextileExtractY ((CARD8)ptr[0]);                           \
+        sw = rfbHextileExtractW ((CARD8)ptr[1]);                           \
+        sh = rfbHextileExtractH ((CARD8)ptr[1]);                           \
+        ptr += 2;                                                          \
         if (sx + sw > w || sy + sh > h) {                                  \
           fprintf (stderr, "Wrong hextile data, please use"                \
                            " appropriate -8/-16/-24 option.\n");           \
@@ -1120,7 +2819,341 @@ DEFINE_HANDLE_HEXTILE(8)
 DEFINE_HANDLE_HEXTILE(16)
 DEFINE_HANDLE_HEXTILE(32)
 
-static void copy_data (char *data, int x, int y, int w, int h, int bpp)
+/*
+ * Capture index, ranges, and shards (see range_first above)
+ */
+
+static int build_index (rfbCapture *in, const char *filename,
+                        const rfbIndexKey *key)
+{
+  int width = fb_width, height = fb_height, msg_type;
+  double t = gettime ();
+
+  fprintf (stderr, "Indexing %s...\n", filename);
+  if (!rfbIndexCreate (&capture_index, filename, key))
+    return -1;
+  if (!rfbCaptureRewind (in) ||
+      read_server_init (in, &width, &height) != 0)
+    goto bailout;
+  InitEverything (color_depth, width, height);
+  rfbClient.fb = rfbScreen.pfbMemory;
+
+  /* Decode every update, and take a checkpoint before every
+     checkpoint_interval'th one */
+  indexing = TRUE;
+  update_no = 0;
+  msg_type = rfbCaptureGetc (in);
+  while (msg_type != EOF) {
+    if (msg_type == rfbFramebufferUpdate) {
+      off_t offset = rfbCaptureTell (in) - 1;
+      if (update_no % checkpoint_interval == 0 &&
+          !rfbIndexAddCheckpoint (&capture_index, offset, rfbScreen.pfbMemory,
+                                  rfbScreen.paddedWidthInBytes,
+                                  rfbScreen.width, rfbScreen.height,
+                                  rfbScreen.bitsPerPixel / 8))
+        goto bailout;
+      if (!rfbIndexAddUpdate (&capture_index, offset) ||
+          parse_fb_update (in) != 0)
+        goto bailout;
+    } else if (skip_message (in, msg_type) != 0)
+      goto bailout;
+    msg_type = rfbCaptureGetc (in);
+  }
+  if (in->error) {
+    fprintf (stderr, "Read error.\n");
+    goto bailout;
+  }
+  if (!rfbIndexFinish (&capture_index))
+    goto bailout;
+  indexing = FALSE;
+
+  fprintf (stderr, "Indexed %llu updates with %llu checkpoints in %.1fs\n",
+           capture_index.nUpdates, capture_index.nCheckpoints,
+           gettime () - t);
+  return 0;
+
+  bailout:
+  indexing = FALSE;
+  rfbIndexClose (&capture_index);
+  return -1;
+}
+
+/* Opens the cached index of the capture, or builds it if there is none or
+   if the capture or the options that affect the checkpoints have changed */
+
+static int load_index (rfbCapture *in, const char *filename)
+{
+  rfbIndexKey key;
+
+  memset (&key, 0, sizeof(key));
+  if (!rfbIndexGetKey (&key, filename)) {
+    fprintf (stderr, "The -shards and -range options require a regular input file.\n");
+    return -1;
+  }
+  key.depth = color_depth;
+  key.flip = flip_rgb;
+  key.width = fb_width;
+  key.height = fb_height;
+  key.interval = checkpoint_interval;
+
+  if (!rfbIndexOpen (&capture_index, filename, &key) &&
+      build_index (in, filename, &key) != 0)
+    return -1;
+  have_index = TRUE;
+  return 0;
+}
+
+/* Restores the framebuffer from the last checkpoint before the prefix and
+   moves to the update after the checkpoint */
+
+static int seek_range (rfbCapture *in)
+{
+  long long first = max (range_first - prefix_updates, 0);
+  const rfbCheckpoint *cp;
+
+  if ((unsigned long long)range_first >= capture_index.nUpdates) {
+    fprintf (stderr, "The capture has only %llu updates.\n",
+             capture_index.nUpdates);
+    return -1;
+  }
+  if ((cp = rfbIndexFindCheckpoint (&capture_index, first)) == NULL)
+    return -1;
+
+  if ((cp->width != (unsigned long long)rfbScreen.width ||
+       cp->height != (unsigned long long)rfbScreen.height) &&
+      resize_framebuffer ((int)cp->width, (int)cp->height) != 0)
+    return -1;
+  if (!rfbIndexRestore (&capture_index, cp, rfbScreen.pfbMemory,
+                        rfbScreen.paddedWidthInBytes,
+                        rfbScreen.bitsPerPixel / 8))
+    return -1;
+  if (!rfbCaptureSeek (in, (off_t)cp->offset)) {
+    fprintf (stderr, "Cannot seek to update %llu.\n", cp->update);
+    return -1;
+  }
+  update_no = (long long)cp->update;
+  warming = FALSE;
+
+  if (tndx == 0)
+    fprintf (stderr, "Updates %lld-%lld (from the checkpoint at update %llu, %lld warm-up updates)\n",
+             range_first, range_last >= 0 ? range_last - 1 :
+             (long long)capture_index.nUpdates - 1, cp->update,
+             range_first - first);
+  return 0;
+}
+
+/* Decides whether the current update is encoded and counted.  When the
+   first update of the range follows the prefix, everything that was counted
+   during the prefix is discarded. */
+
+static void begin_update (void)
+{
+  long long first = max (range_first - prefix_updates, 0);
+
+  if (indexing) {
+    encoding = FALSE;
+    return;
+  }
+
+  if (warming && update_no == range_first) {
+    int i;
+    reset_totals ();
+    thextile[tndx] = tzlib[tndx] = tzrle[tndx] = 0.;
+    for (i = 0; i < nvariants; i++) {
+      variants[i].t[tndx] = 0.;
+      reset_latency (&variants[i].lat);
+      rfbQualityReset (&variants[i].quality);
+    }
+    reset_latency (&lat_hextile);
+    reset_latency (&lat_zlib);
+    reset_latency (&lat_zrle);
+    total_updates = 0;
+    total_rects = 0;
+    total_pixels = 0;
+  }
+
+  warming = update_no >= first && update_no < range_first;
+  encoding = warming || (update_no >= range_first &&
+                         (update_no - range_first) % sample_interval == 0);
+}
+
+static void reset_totals (void)
+{
+  int i;
+
+  sum_raw = sum_hextile = sum_zlib = sum_zrle = 0;
+  for (i = 0; i < nvariants; i++) {
+    const rfbTightStatistics *stats = variants[i].enc->stats;
+    variants[i].sum = 0;
+    #ifdef TIGHT_STATISTICS
+    if (stats) {
+      *stats->fcrect = *stats->ndxrect = *stats->jpegrect =
+        *stats->monorect = *stats->solidrect = 0;
+      *stats->fcpixels = *stats->ndxpixels = *stats->jpegpixels =
+        *stats->monopixels = *stats->solidpixels = 0;
+    }
+    #endif
+    if (variants[i].enc->resetPhases) variants[i].enc->resetPhases();
+  }
+}
+
+/* Splits the capture into nshards ranges with about the same number of bytes
+   and runs a worker process on each */
+
+static int run_shards (const char *program, const char *filename,
+                       const char *jsonfilename, int jobs, int cpu,
+                       char **args, int nargs)
+{
+  rfbCapture in;
+  unsigned long long n, first, next;
+  off_t start, size, *sizes;
+  char **options;
+  int i;
+
+  if (!rfbCaptureOpen (&in, filename)) {
+    perror ("Cannot open input file");
+    return 1;
+  }
+  if (load_index (&in, filename) != 0)
+    return 1;
+  rfbCaptureClose (&in);
+
+  if ((n = capture_index.nUpdates) < 1) {
+    fprintf (stderr, "The capture has no updates.\n");
+    return 1;
+  }
+  if ((unsigned long long)nshards > n)
+    nshards = (int)n;
+  options = (char **)malloc (nshards * sizeof(char *));
+  sizes = (off_t *)malloc (nshards * sizeof(off_t));
+  if (!options || !sizes) {
+    perror ("Cannot allocate shards");
+    return 1;
+  }
+
+  start = capture_index.updates[0];
+  size = (off_t)capture_index.key.captureSize;
+  for (i = 0, first = 0; i < nshards; i++, first = next) {
+    off_t end = start + (size - start) / nshards * (i + 1);
+    /* Each shard gets at least one update. */
+    for (next = first + 1; next < n && capture_index.updates[next] < end;
+         next++);
+    next = min (next, n - (nshards - 1 - i));
+    if (i == nshards - 1) next = n;
+    sizes[i] = (next < n ? capture_index.updates[next] : size) -
+      capture_index.updates[first];
+    if ((options[i] = (char *)malloc (64)) == NULL) {
+      perror ("Cannot allocate shards");
+      return 1;
+    }
+    snprintf (options[i], 64, "-range %llu-%llu", first, next);
+  }
+  rfbIndexClose (&capture_index);
+
+  return rfbRunShards (program, filename, nshards, options, sizes,
+                       jsonfilename, jobs, cpu, args, nargs);
+}
+
+/*
+ * Replay cache (see use_cache above)
+ */
+
+static FILE *open_cache (void)
+{
+  const char *dir = getenv ("TMPDIR");
+  char path[PATH_MAX];
+  FILE *file;
+  int fd;
+
+  snprintf (path, sizeof(path), "%s/compare-encodings-XXXXXX",
+            dir && *dir ? dir : "/tmp");
+  if ((fd = mkstemp (path)) < 0) {
+    perror ("Cannot create replay cache");
+    return NULL;
+  }
+  unlink (path);
+  if ((file = fdopen (fd, "w+b")) == NULL) {
+    perror ("Cannot create replay cache");
+    close (fd);
+  }
+  return file;
+}
+
+/* Switches from the original capture to the cache after the first pass */
+
+static int replay_cache (rfbCapture *in)
+{
+  int fd;
+
+  if (fflush (cache) != 0 || (fd = dup (fileno (cache))) < 0) {
+    perror ("Cannot write replay cache");
+    return -1;
+  }
+  fclose (cache);
+  cache = NULL;
+
+  rfbCaptureClose (in);
+  if (!rfbCaptureOpenFd (in, fd)) {
+    perror ("Cannot open replay cache");
+    close (fd);
+    return -1;
+  }
+
+  /* The cached pixels have already been swapped. */
+  flip_rgb = 0;
+  return 0;
+}
+
+static int write_cache (const void *buf, size_t len)
+{
+  if (fwrite (buf, 1, len, cache) != len) {
+    perror ("Cannot write replay cache");
+    return -1;
+  }
+  return 0;
+}
+
+/* The cache starts with the same messages that fbs-dump -i keeps, so that
+   read_server_init() knows the initial framebuffer size. */
+
+static int cache_server_init (int width, int height)
+{
+  rfbServerInitMsg si;
+
+  memset (&si, 0, sz_rfbServerInitMsg);
+  si.framebufferWidth = Swap16IfLE (width);
+  si.framebufferHeight = Swap16IfLE (height);
+  if (write_cache ("RFB 003.003\n", sz_rfbProtocolVersionMsg) != 0)
+    return -1;
+  return write_cache (&si, sz_rfbServerInitMsg);
+}
+
+static int cache_rectangle (int x, int y, int width, int height,
+                            int pixel_bytes)
+{
+  rfbFramebufferUpdateRectHeader rh;
+  int row;
+
+  rh.r.x = Swap16IfLE (x);
+  rh.r.y = Swap16IfLE (y);
+  rh.r.w = Swap16IfLE (width);
+  rh.r.h = Swap16IfLE (height);
+  rh.encoding = Swap32IfLE (rfbEncodingRaw);
+  if (write_cache (&rh, sz_rfbFramebufferUpdateRectHeader) != 0)
+    return -1;
+  for (row = y; row < y + height; row++) {
+    if (write_cache (&rfbScreen.pfbMemory[row * rfbScreen.paddedWidthInBytes +
+                                          x * pixel_bytes],
+                     (size_t)width * pixel_bytes) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/* The source data may point into the memory-mapped capture, so it must not
+   be modified.  The red/blue swap is therefore done on the destination. */
+
+static void copy_data (const char *data, int x, int y, int w, int h, int bpp)
 {
   int py;
   int pixel_bytes;
@@ -1128,26 +3161,27 @@ static void copy_data (char *data, int x, int y, int w, int h, int bpp)
   pixel_bytes = bpp / 8;
 
   for (py = y; py < y + h; py++) {
+    char *dst = &rfbScreen.pfbMemory[py * rfbScreen.paddedWidthInBytes +
+                                     x * pixel_bytes];
+    memcpy (dst, data, w * pixel_bytes);
     if (flip_rgb && pixel_bytes >= 3) {
       char *ptr;
-      for (ptr = data; ptr < data + w * pixel_bytes; ptr += pixel_bytes) {
+      for (ptr = dst; ptr < dst + w * pixel_bytes; ptr += pixel_bytes) {
         CARD8 temp = ptr[2];
         ptr[2] = ptr[0];
         ptr[0] = temp;
       }
     }
-    memcpy (&rfbScreen.pfbMemory[py * rfbScreen.paddedWidthInBytes +
-                                 x * pixel_bytes], data, w * pixel_bytes);
     data += w * pixel_bytes;
   }
 }
 
 static CARD32 get_CARD32 (char *ptr)
 {
-  return (CARD32) ntohl (*(unsigned long *)ptr);
+  return (CARD32) ntohl (*(CARD32 *)ptr);
 }
 
 static CARD16 get_CARD16 (char *ptr)
 {
-  return (CARD16) ntohs (*(unsigned short *)ptr);
+  return (CARD16) ntohs (*(CARD16 *)ptr);
 }
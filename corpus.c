@@ -0,0 +1,694 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/* corpus.c - parallel corpus runner (see corpus.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <math.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include "rfb.h"
+#include "corpus.h"
+#include "histogram.h"
+#include "baseline.h"
+
+#ifndef min
+ #define min(a,b) ((a)<(b)?(a):(b))
+#endif
+#ifndef max
+ #define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+#define MAX_CODECS 32
+#define NAME_WIDTH 32
+
+/* Room for the name of a worker's results or log file in tmpdir */
+#define WORKER_FILE_SIZE (PATH_MAX + 32)
+
+extern double gettime(void);
+
+typedef struct {
+  char *path;
+  char *label;                 /* Shown instead of the path, if not NULL */
+  char **options;              /* Per-capture options from the manifest */
+  int noptions;
+  off_t size;
+  pid_t pid;
+  int slot, status;
+  Bool ok;
+  double start, wall;
+  /* Results.  The time is the mean over the timed passes, and the latency is
+     the 99th percentile update latency. */
+  unsigned long long bytes[MAX_CODECS];
+  double time[MAX_CODECS], stdev[MAX_CODECS], p99[MAX_CODECS];
+  int passes[MAX_CODECS];
+} corpus_entry;
+
+typedef struct {
+  unsigned long long bytes, pixels;
+  double time, time2;
+  int passes;
+  rfbHistogram rect, update;
+  /* The update currently being accumulated from the per-rectangle records */
+  Bool active;
+  int pass, update_no;
+  double tUpdate;
+} codec_stats;
+
+static corpus_entry *entries = NULL;
+static int nentries = 0;
+static char codecs[MAX_CODECS][NAME_WIDTH];
+static int ncodecs = 0;
+static codec_stats totals[MAX_CODECS];
+static char tmpdir[PATH_MAX];
+static const char *title = "Corpus", *noun = "captures";
+
+static int add_entry(const char *path, char *options)
+{
+  static int maxentries = 0;
+  corpus_entry *e;
+  struct stat st;
+  char *opt;
+
+  if (nentries >= maxentries) {
+    corpus_entry *newEntries;
+    maxentries = maxentries ? maxentries * 2 : 64;
+    newEntries = (corpus_entry *)realloc(entries,
+                                         maxentries * sizeof(corpus_entry));
+    if (!newEntries) {
+      perror("Cannot allocate corpus");
+      return -1;
+    }
+    entries = newEntries;
+  }
+  e = &entries[nentries++];
+  memset(e, 0, sizeof(corpus_entry));
+  e->path = strdup(path);
+  e->options = (char **)malloc((strlen(options) / 2 + 1) * sizeof(char *));
+  if (!e->path || !e->options) {
+    perror("Cannot allocate corpus");
+    return -1;
+  }
+  for (opt = strtok(options, " \t"); opt; opt = strtok(NULL, " \t"))
+    e->options[e->noptions++] = strdup(opt);
+  if (stat(path, &st) == 0)
+    e->size = st.st_size;
+  return 0;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+  return strcmp(((const corpus_entry *)a)->path,
+                ((const corpus_entry *)b)->path);
+}
+
+static int read_directory(const char *dir)
+{
+  DIR *d;
+  struct dirent *ent;
+  char path[PATH_MAX], none[1] = "";
+  struct stat st;
+
+  if ((d = opendir(dir)) == NULL) {
+    perror("Cannot open corpus directory");
+    return -1;
+  }
+  while ((ent = readdir(d)) != NULL) {
+    if (ent->d_name[0] == '.') continue;
+    if (snprintf(path, sizeof(path), "%s/%s", dir, ent->d_name)
+        >= (int)sizeof(path)) {
+      fprintf(stderr, "Corpus path too long: %s/%s\n", dir, ent->d_name);
+      closedir(d);
+      return -1;
+    }
+    if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) continue;
+    if (add_entry(path, none) != 0) {
+      closedir(d);
+      return -1;
+    }
+  }
+  closedir(d);
+  qsort(entries, nentries, sizeof(corpus_entry), compare_paths);
+  return 0;
+}
+
+static int read_manifest(const char *manifest)
+{
+  FILE *f;
+  char line[PATH_MAX + 1024], path[PATH_MAX], dir[PATH_MAX], *ptr, *end;
+  int dirlen = 0, len;
+
+  if ((f = fopen(manifest, "r")) == NULL) {
+    perror("Cannot open corpus manifest");
+    return -1;
+  }
+  if ((ptr = strrchr(manifest, '/')) != NULL) {
+    dirlen = (int)(ptr - manifest);
+    if (dirlen >= PATH_MAX) {
+      fprintf(stderr, "Corpus manifest path too long: %s\n", manifest);
+      fclose(f);
+      return -1;
+    }
+    memcpy(dir, manifest, dirlen);
+  }
+  dir[dirlen] = 0;
+
+  while (fgets(line, sizeof(line), f)) {
+    for (ptr = line; isspace((unsigned char)*ptr); ptr++);
+    if (*ptr == 0 || *ptr == '#') continue;
+    for (end = ptr; *end && !isspace((unsigned char)*end); end++);
+    if (*end) *end++ = 0;
+    end[strcspn(end, "\r\n")] = 0;
+    if (*ptr != '/' && dirlen)
+      len = snprintf(path, sizeof(path), "%s/%s", dir, ptr);
+    else
+      len = snprintf(path, sizeof(path), "%s", ptr);
+    if (len >= (int)sizeof(path)) {
+      fprintf(stderr, "Corpus path too long: %s\n", ptr);
+      fclose(f);
+      return -1;
+    }
+    if (add_entry(path, end) != 0) {
+      fclose(f);
+      return -1;
+    }
+  }
+  fclose(f);
+  return 0;
+}
+
+static const char *entry_name(const corpus_entry *e)
+{
+  return e->label ? e->label : e->path;
+}
+
+static int codec_index(const char *name)
+{
+  int i;
+
+  for (i = 0; i < ncodecs; i++)
+    if (!strcmp(codecs[i], name)) return i;
+  if (ncodecs >= MAX_CODECS) return -1;
+  snprintf(codecs[ncodecs], NAME_WIDTH, "%s", name);
+  return ncodecs++;
+}
+
+/* Reads the -csv output of a worker (see results.h) */
+
+static int parse_results(corpus_entry *e, const char *csvfile)
+{
+  codec_stats *stats;
+  FILE *f;
+  char line[1024], *field[13], *ptr;
+  int i, n;
+
+  if ((f = fopen(csvfile, "r")) == NULL)
+    return -1;
+  if ((stats = (codec_stats *)calloc(MAX_CODECS, sizeof(codec_stats)))
+      == NULL) {
+    fclose(f);
+    return -1;
+  }
+
+  if (!fgets(line, sizeof(line), f)) {    /* Header */
+    free(stats);
+    fclose(f);
+    return -1;
+  }
+  while (fgets(line, sizeof(line), f)) {
+    codec_stats *c;
+    int pass, update_no;
+    double t;
+
+    for (n = 0, ptr = line; n < 13; n++) {
+      field[n] = ptr;
+      if ((ptr = strchr(ptr, ',')) == NULL) break;
+      *ptr++ = 0;
+    }
+    if (n < 13 || atoi(field[1]) != 0)    /* Warm-up pass */
+      continue;
+    if ((i = codec_index(field[10])) < 0) continue;
+    c = &stats[i];
+    pass = atoi(field[0]);
+    update_no = atoi(field[3]);
+    t = atof(field[12]);
+
+    if (!strcmp(field[2], "rect")) {
+      if (!strcmp(field[10], "raw")) continue;
+      rfbHistogramRecord(&c->rect, t);
+      c->pixels += strtoull(field[9], NULL, 10);
+      if (c->active && (pass != c->pass || update_no != c->update_no)) {
+        rfbHistogramRecord(&c->update, c->tUpdate);
+        c->tUpdate = 0.0;
+      }
+      c->active = TRUE;
+      c->pass = pass;
+      c->update_no = update_no;
+      c->tUpdate += t;
+    } else {
+      c->bytes = strtoull(field[11], NULL, 10);
+      c->time += t;
+      c->time2 += t * t;
+      c->passes++;
+    }
+  }
+  fclose(f);
+
+  for (i = 0; i < ncodecs; i++) {
+    codec_stats *c = &stats[i], *total = &totals[i];
+    if (c->active)
+      rfbHistogramRecord(&c->update, c->tUpdate);
+    e->bytes[i] = c->bytes;
+    e->time[i] = c->passes ? c->time / (double)c->passes : 0.0;
+    e->stdev[i] = c->passes > 1 ?
+      sqrt(max(c->time2 - c->time * e->time[i], 0.) /
+           (double)(c->passes - 1)) : 0.0;
+    e->passes[i] = c->passes;
+    e->p99[i] = rfbHistogramPercentile(&c->update, 99.);
+    total->bytes += c->bytes;
+    total->time += e->time[i];
+    total->pixels += c->pixels;
+    rfbHistogramAdd(&total->rect, &c->rect);
+    rfbHistogramAdd(&total->update, &c->update);
+  }
+  free(stats);
+  return 0;
+}
+
+static void print_log_tail(const char *logfile)
+{
+  FILE *f;
+  char buf[2048];
+  long size;
+  size_t n;
+
+  if ((f = fopen(logfile, "r")) == NULL) return;
+  fseek(f, 0, SEEK_END);
+  size = ftell(f);
+  if (size > (long)sizeof(buf)) {
+    fseek(f, size - (long)sizeof(buf), SEEK_SET);
+    fprintf(stderr, "  ...\n");
+  } else
+    fseek(f, 0, SEEK_SET);
+  while ((n = fread(buf, 1, sizeof(buf), f)) > 0)
+    fwrite(buf, 1, n, stderr);
+  fclose(f);
+}
+
+static pid_t start_worker(const char *program, int index, int cpu,
+                          char **args, int nargs)
+{
+  corpus_entry *e = &entries[index];
+  char csvfile[WORKER_FILE_SIZE], logfile[WORKER_FILE_SIZE], cpustr[16];
+  char **argv;
+  pid_t pid;
+  int argc = 0, i, fd;
+
+  snprintf(csvfile, sizeof(csvfile), "%s/%d.csv", tmpdir, index);
+  snprintf(logfile, sizeof(logfile), "%s/%d.log", tmpdir, index);
+
+  argv = (char **)malloc((nargs + e->noptions + 7) * sizeof(char *));
+  if (!argv) return -1;
+  argv[argc++] = (char *)program;
+  for (i = 0; i < nargs; i++) argv[argc++] = args[i];
+  for (i = 0; i < e->noptions; i++) argv[argc++] = e->options[i];
+  if (cpu >= 0) {
+    long ncpus = sysconf(_SC_NPROCESSORS_ONLN);
+    snprintf(cpustr, sizeof(cpustr), "%ld",
+             ncpus > 0 ? (cpu + e->slot) % ncpus : (long)cpu);
+    argv[argc++] = "-cpu";
+    argv[argc++] = cpustr;
+  }
+  argv[argc++] = "-csv";
+  argv[argc++] = csvfile;
+  argv[argc++] = e->path;
+  argv[argc] = NULL;
+
+  fflush(stdout);
+  fflush(stderr);
+  if ((pid = fork()) == 0) {
+    if ((fd = open(logfile, O_WRONLY | O_CREAT | O_TRUNC, 0600)) >= 0) {
+      dup2(fd, STDOUT_FILENO);
+      dup2(fd, STDERR_FILENO);
+      close(fd);
+    }
+    execv(program, argv);
+    perror("Cannot run worker");
+    _exit(127);
+  }
+  free(argv);
+  return pid;
+}
+
+static void finish_worker(int index, int ndone)
+{
+  corpus_entry *e = &entries[index];
+  char csvfile[WORKER_FILE_SIZE], logfile[WORKER_FILE_SIZE];
+
+  snprintf(csvfile, sizeof(csvfile), "%s/%d.csv", tmpdir, index);
+  snprintf(logfile, sizeof(logfile), "%s/%d.log", tmpdir, index);
+
+  e->wall = gettime() - e->start;
+  e->ok = WIFEXITED(e->status) && WEXITSTATUS(e->status) == 0 &&
+          parse_results(e, csvfile) == 0;
+
+  fprintf(stderr, "[%d/%d] %s: ", ndone, nentries, entry_name(e));
+  if (e->ok)
+    fprintf(stderr, "done in %.1fs\n", e->wall);
+  else {
+    if (WIFSIGNALED(e->status))
+      fprintf(stderr, "FAILED (killed by signal %d)\n", WTERMSIG(e->status));
+    else if (WIFEXITED(e->status) && WEXITSTATUS(e->status) != 0)
+      fprintf(stderr, "FAILED (exit status %d)\n", WEXITSTATUS(e->status));
+    else
+      fprintf(stderr, "FAILED (no results)\n");
+    print_log_tail(logfile);
+  }
+  unlink(csvfile);
+  unlink(logfile);
+}
+
+static int compare_sizes(const void *a, const void *b)
+{
+  off_t x = entries[*(const int *)a].size, y = entries[*(const int *)b].size;
+  return (x < y) - (x > y);
+}
+
+static void print_report(int jobs, double wall)
+{
+  int i, j, nfailed = 0, width = 7;
+
+  for (i = 0; i < nentries; i++) {
+    width = max(width, (int)strlen(entry_name(&entries[i])));
+    if (!entries[i].ok) nfailed++;
+  }
+  width = min(width, 40);
+
+  printf("\n%s: %d %s, %d succeeded, %d failed, %.1fs elapsed with %d jobs"
+         "\n\n", title, nentries, noun, nentries - nfailed, nfailed, wall,
+         jobs);
+  printf("Bytes, mean time per pass, and p99 update latency:\n%-*s", width,
+         "Capture");
+  for (j = 0; j < ncodecs; j++)
+    printf(" | %31s", codecs[j]);
+  printf("\n");
+  for (i = 0; i < nentries; i++) {
+    corpus_entry *e = &entries[i];
+    const char *name = entry_name(e);
+    int len = (int)strlen(name);
+    printf("%-*s", width, len > width ? name + len - width : name);
+    if (!e->ok) {
+      printf(" | FAILED\n");
+      continue;
+    }
+    for (j = 0; j < ncodecs; j++) {
+      if (!strcmp(codecs[j], "raw"))
+        printf(" | %12llu %18s", e->bytes[j], "");
+      else
+        printf(" | %12llu %8.4fs %7.3fms", e->bytes[j], e->time[j],
+               e->p99[j] * 1000.);
+    }
+    printf("\n");
+  }
+  printf("%-*s", width, "Total");
+  for (j = 0; j < ncodecs; j++) {
+    if (!strcmp(codecs[j], "raw"))
+      printf(" | %12llu %18s", totals[j].bytes, "");
+    else
+      printf(" | %12llu %8.4fs %7.3fms", totals[j].bytes, totals[j].time,
+             rfbHistogramPercentile(&totals[j].update, 99.) * 1000.);
+  }
+  printf("\n\n%s latency (ms):     p50      p90      p99    p99.9      max"
+         "  Mpixels/s\n", title);
+  for (j = 0; j < ncodecs; j++) {
+    codec_stats *c = &totals[j];
+    if (c->rect.count < 1) continue;
+    rfbHistogramPrintRow(codecs[j], "rect", &c->rect, c->rect.sum > 0. ?
+                         (double)c->pixels / c->rect.sum / 1000000. : 0.);
+    rfbHistogramPrintRow("", "update", &c->update, -1.);
+  }
+  printf("\n");
+}
+
+static void get_stats(rfbBaselineStats *s, const corpus_entry *e, int j)
+{
+  s->bytes = e->bytes[j];
+  s->passes = e->passes[j];
+  s->time = e->time[j];
+  s->stdev = e->stdev[j];
+  s->p99 = e->p99[j];
+}
+
+/* The captures are benchmarked independently, so the variance of the total
+   time is the sum of their variances. */
+
+static void get_total_stats(rfbBaselineStats *s, int j)
+{
+  double var = 0.;
+  int i;
+
+  memset(s, 0, sizeof(rfbBaselineStats));
+  for (i = 0; i < nentries; i++) {
+    corpus_entry *e = &entries[i];
+    if (!e->ok) continue;
+    if (s->passes == 0 || e->passes[j] < s->passes) s->passes = e->passes[j];
+    var += e->stdev[j] * e->stdev[j];
+  }
+  s->bytes = totals[j].bytes;
+  s->time = totals[j].time;
+  s->stdev = sqrt(var);
+  s->p99 = rfbHistogramPercentile(&totals[j].update, 99.);
+}
+
+static void write_json_string(FILE *f, const char *s)
+{
+  fputc('"', f);
+  for (; *s; s++) {
+    if (*s == '"' || *s == '\\')
+      fprintf(f, "\\%c", *s);
+    else if ((unsigned char)*s < ' ')
+      fprintf(f, "\\u%04x", (unsigned char)*s);
+    else
+      fputc(*s, f);
+  }
+  fputc('"', f);
+}
+
+static void write_json_codec(FILE *f, int j, const rfbBaselineStats *s)
+{
+  fprintf(f, "%s\n      {\"codec\": ", j ? "," : "");
+  write_json_string(f, codecs[j]);
+  fprintf(f, ", \"bytes\": %llu, \"passes\": %d, \"time\": %.9f, "
+          "\"stdev\": %.9f, \"p99\": %.9f}", s->bytes, s->passes, s->time,
+          s->stdev, s->p99);
+}
+
+/* Writes the summary that rfbBaselineLoad() reads (see baseline.h) */
+
+static int write_summary(const char *jsonFile)
+{
+  rfbBaselineStats s;
+  FILE *f;
+  int i, j, n = 0;
+
+  if ((f = fopen(jsonFile, "w")) == NULL) {
+    perror("Cannot open JSON output file");
+    return -1;
+  }
+  fprintf(f, "{\n  \"captures\": [");
+  for (i = 0; i < nentries; i++) {
+    corpus_entry *e = &entries[i];
+    if (!e->ok) continue;
+    fprintf(f, "%s\n    {\"capture\": ", n++ ? "," : "");
+    write_json_string(f, entry_name(e));
+    fprintf(f, ", \"codecs\": [");
+    for (j = 0; j < ncodecs; j++) {
+      get_stats(&s, e, j);
+      write_json_codec(f, j, &s);
+    }
+    fprintf(f, "\n    ]}");
+  }
+  fprintf(f, "\n  ],\n  \"totals\": {\"codecs\": [");
+  for (j = 0; j < ncodecs; j++) {
+    get_total_stats(&s, j);
+    write_json_codec(f, j, &s);
+  }
+  fprintf(f, "\n  ]}\n}\n");
+  if (ferror(f) || fclose(f) != 0) {
+    fprintf(stderr, "Could not write results file\n");
+    return -1;
+  }
+  return 0;
+}
+
+static int compare_baseline(void)
+{
+  rfbBaselineStats s;
+  int i, j, width = 7;
+
+  for (i = 0; i < nentries; i++)
+    width = max(width, (int)strlen(entry_name(&entries[i])));
+  width = min(width, 40);
+
+  rfbBaselineBeginReport(width);
+  for (i = 0; i < nentries; i++) {
+    corpus_entry *e = &entries[i];
+    if (!e->ok) continue;
+    for (j = 0; j < ncodecs; j++) {
+      get_stats(&s, e, j);
+      rfbBaselineCompare(entry_name(e), entry_name(e), codecs[j], &s);
+    }
+  }
+  for (j = 0; j < ncodecs; j++) {
+    get_total_stats(&s, j);
+    rfbBaselineCompare(NULL, "Total", codecs[j], &s);
+  }
+  return rfbBaselineEndReport();
+}
+
+static int run_entries(const char *program, const char *jsonFile, int jobs,
+                       int cpu, char **args, int nargs)
+{
+  const char *dir = getenv("TMPDIR");
+  pid_t *slots;
+  int *order, i, next = 0, running = 0, ndone = 0, nfailed = 0;
+  double start = gettime();
+
+  if (jobs < 1) jobs = 1;
+
+  if (snprintf(tmpdir, sizeof(tmpdir), "%s/compare-encodings-XXXXXX",
+               dir && *dir ? dir : "/tmp") >= (int)sizeof(tmpdir)) {
+    fprintf(stderr, "TMPDIR is too long\n");
+    return 1;
+  }
+  if (mkdtemp(tmpdir) == NULL) {
+    perror("Cannot create temporary directory");
+    return 1;
+  }
+
+  /* Start the largest captures first, so that one of them doesn't end up
+     running alone at the end. */
+  order = (int *)malloc(nentries * sizeof(int));
+  slots = (pid_t *)calloc(jobs, sizeof(pid_t));
+  if (!order || !slots) {
+    perror("Cannot allocate corpus");
+    return 1;
+  }
+  for (i = 0; i < nentries; i++) order[i] = i;
+  qsort(order, nentries, sizeof(int), compare_sizes);
+
+  while (next < nentries || running > 0) {
+    pid_t pid;
+    int status;
+
+    while (running < jobs && next < nentries) {
+      corpus_entry *e = &entries[order[next++]];
+      for (e->slot = 0; slots[e->slot]; e->slot++);
+      e->start = gettime();
+      if ((e->pid = start_worker(program, (int)(e - entries), cpu, args,
+                                 nargs)) < 0) {
+        perror("Cannot start worker");
+        e->pid = 0;
+        e->status = 127 << 8;           /* Same as a failed exec */
+        finish_worker((int)(e - entries), ++ndone);
+        continue;
+      }
+      slots[e->slot] = e->pid;
+      running++;
+    }
+
+    if ((pid = wait(&status)) < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    for (i = 0; i < nentries; i++) {
+      corpus_entry *e = &entries[i];
+      if (e->pid != pid) continue;
+      e->status = status;
+      e->pid = 0;
+      slots[e->slot] = 0;
+      running--;
+      finish_worker(i, ++ndone);
+      break;
+    }
+  }
+  rmdir(tmpdir);
+
+  print_report(jobs, gettime() - start);
+
+  for (i = 0; i < nentries; i++)
+    if (!entries[i].ok) nfailed++;
+  free(order);
+  free(slots);
+  if (jsonFile && write_summary(jsonFile) != 0)
+    return 1;
+  if (rfbBaselineLoaded() && compare_baseline() > 0 && !nfailed)
+    return 2;
+  return nfailed ? 1 : 0;
+}
+
+int rfbRunCorpus(const char *program, const char *corpus,
+                 const char *jsonFile, int jobs, int cpu, char **args,
+                 int nargs)
+{
+  struct stat st;
+
+  if (stat(corpus, &st) != 0) {
+    perror("Cannot open corpus");
+    return 1;
+  }
+  if ((S_ISDIR(st.st_mode) ? read_directory(corpus) : read_manifest(corpus))
+      != 0)
+    return 1;
+  if (nentries < 1) {
+    fprintf(stderr, "The corpus is empty.\n");
+    return 1;
+  }
+  return run_entries(program, jsonFile, jobs, cpu, args, nargs);
+}
+
+int rfbRunShards(const char *program, const char *capture, int nshards,
+                 char **shardOptions, const off_t *sizes,
+                 const char *jsonFile, int jobs, int cpu, char **args,
+                 int nargs)
+{
+  int i;
+
+  for (i = 0; i < nshards; i++) {
+    char *options = strdup(shardOptions[i]);
+    if (!options || add_entry(capture, options) != 0) {
+      perror("Cannot allocate shards");
+      return 1;
+    }
+    free(options);
+    entries[i].label = shardOptions[i];
+    entries[i].size = sizes[i];
+  }
+  title = "Shards";
+  noun = "shards";
+  return run_entries(program, jsonFile, jobs, cpu, args, nargs);
+}
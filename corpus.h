@@ -0,0 +1,60 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/*
+ * corpus.h - parallel corpus runner
+ *
+ * A corpus is either a directory, in which case every regular file in it is
+ * a capture, or a manifest listing one capture per line, optionally followed
+ * by options (for instance, -16 or -size) that apply only to that capture.
+ * Blank lines and lines starting with # are ignored, and relative paths are
+ * relative to the directory containing the manifest.
+ *
+ * Each capture is benchmarked by a separate compare-encodings process, so the
+ * workers don't share encoder state and a crash only fails one capture.  The
+ * workers write their results with -csv, and those are merged into one
+ * report.  The report can also be written as JSON, in the format of a
+ * baseline (see baseline.h), and if a baseline has been loaded, the results
+ * are compared against it.
+ */
+
+#ifndef __CORPUS_H__
+#define __CORPUS_H__
+
+#include <sys/types.h>
+
+/* args are the options to pass to every worker.  If cpu >= 0, then worker
+   slot n is pinned to CPU cpu + n (modulo the number of CPUs).  If jsonFile
+   is not NULL, then the summary is written to it.  Returns 0 if every capture
+   succeeded, 1 if any failed, and 2 if none failed but the results regressed
+   from the baseline. */
+extern int rfbRunCorpus(const char *program, const char *corpus,
+                        const char *jsonFile, int jobs, int cpu, char **args,
+                        int nargs);
+
+/* Benchmarks one capture in nshards workers, each of which is passed args
+   followed by its own options (for instance, -range) from shardOptions, and
+   merges their results into one report in the same way.  sizes[n] is the
+   number of bytes in shard n, so that the largest shards can be started
+   first. */
+extern int rfbRunShards(const char *program, const char *capture, int nshards,
+                        char **shardOptions, const off_t *sizes,
+                        const char *jsonFile, int jobs, int cpu, char **args,
+                        int nargs);
+
+#endif /* __CORPUS_H__ */
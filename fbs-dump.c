@@ -22,7 +22,10 @@
  * A bit of documentation: this utility parses ``framebuffer stream''
  * files saved by rfbproxy. It removes all control information and
  * prints raw data which were received from VNC server (to stdout).
- * Initial handshaking data is also removed from the ouptut. This tool
+ * Initial handshaking data is also removed from the ouptut, unless the -i
+ * option is given, in which case the protocol version and ServerInit
+ * messages (including the desktop name) are kept so that the framebuffer
+ * size is known to the next-level parser. This tool
  * makes it easy to write next-level parsers for server messages stored
  * sequentially in such raw files.
  *
@@ -33,6 +36,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <netinet/in.h>
@@ -40,18 +44,25 @@
 static void show_usage (char *program_name);
 static int dump_messages (FILE *in);
 
+static int keep_init = 0;
+
 int main (int argc, char *argv[])
 {
   FILE *in;
   char buf[12];
-  int err;
+  int err, argi = 1;
+
+  if (argc > 1 && strcmp (argv[1], "-i") == 0) {
+    keep_init = 1;
+    argi++;
+  }
 
-  if (argc > 2) {
+  if (argc > argi + 1) {
     show_usage (argv[0]);
     return 1;
   }
 
-  in = (argc == 2) ? fopen (argv[1], "r") : stdin;
+  in = (argc == argi + 1) ? fopen (argv[argi], "r") : stdin;
   if (in == NULL) {
     perror ("Cannot open input file");
     return 1;
@@ -73,10 +84,12 @@ int main (int argc, char *argv[])
 static void show_usage (char *program_name)
 {
   fprintf (stderr,
-           "Usage: %s [INPUT_FILE]\n"
+           "Usage: %s [-i] [INPUT_FILE]\n"
            "\n"
            "If the INPUT_FILE name is not provided, standard input is used.\n"
-           "Destination is always the standard output.\n",
+           "Destination is always the standard output.\n"
+           "\n"
+           "-i = Keep the protocol version and ServerInit messages in the output\n",
            program_name);
 }
 
@@ -110,12 +123,20 @@ static int dump_messages (FILE *in)
 
       if (!hsh_bytes) {
         /* Set the desktop name length */
-        name_bytes = ntohl (*((unsigned long *)(hsh + 36)));
+        name_bytes = ntohl (*((u_int32_t *)(hsh + 36)));
         /* Print some information */
         fprintf (stderr, "Protocol version: %.11s\n", hsh);
         fprintf (stderr, "Framebuffer size: %hu * %hu\n",
                  ntohs (*((unsigned short *)(hsh + 16))),
                  ntohs (*((unsigned short *)(hsh + 18))));
+        /* Keep the protocol version and the ServerInit message, but not the
+           security type in between */
+        if (keep_init &&
+            (fwrite (hsh, 1, 12, stdout) != 12 ||
+             fwrite (hsh + 16, 1, 24, stdout) != 24)) {
+          fprintf (stderr, "Write error.\n");
+          return -1;
+        }
       }
     }
 
@@ -138,7 +159,12 @@ static int dump_messages (FILE *in)
           free (buf);
           return -1;
         }
-        fprintf (stderr, "Desktop name: %.*s\n", name_bytes, buf);
+        fprintf (stderr, "Desktop name: %.*s\n", (int)name_bytes, buf);
+        if (keep_init && fwrite (buf, 1, data_len, stdout) != data_len) {
+          fprintf (stderr, "Write error.\n");
+          free (buf);
+          return -1;
+        }
         name_bytes = 0;
       } else {
         if (fwrite (buf, 1, data_len, stdout) != data_len) {
@@ -0,0 +1,854 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * fbs-import.c - converts image sequences to session captures
+ *
+ * Reads a directory of PPM images or a YUV4MPEG2 (Y4M) stream and writes a
+ * session capture in the same format as the output of fbs-dump -i, so that
+ * recordings of real applications can be fed to compare-encodings.  Each
+ * frame is converted to the pixel format that compare-encodings assumes for
+ * -8, -16, or -24 and compared with the previous frame one tile at a time.
+ * The changed tiles are merged into rectangles, which are written as raw or
+ * hextile rectangles.  Frames that don't change anything are dropped, as a
+ * VNC server would send nothing for them.
+ *
+ * The conversion and comparison are split across threads by bands of tile
+ * rows.  Reading and writing are done by the main thread.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "fbswrite.h"
+
+/* From rfbproto.h */
+#define MSG_FRAMEBUFFER_UPDATE 0
+#define ENCODING_RAW 0
+#define ENCODING_HEXTILE 5
+#define HEXTILE_RAW (1 << 0)
+#define HEXTILE_BACKGROUND_SPECIFIED (1 << 1)
+#define HEXTILE_FOREGROUND_SPECIFIED (1 << 2)
+#define HEXTILE_ANY_SUBRECTS (1 << 3)
+#define MAX_RECTS 65535         /* The rectangle count is a CARD16. */
+
+#define MAX_THREADS 256
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+typedef struct {
+  int x, y, w, h;
+} rect;
+
+enum { INPUT_PPM, INPUT_Y4M };
+
+typedef struct {
+  pthread_t thread;
+  int first_row, end_row;       /* Tile rows */
+} worker;
+
+static void show_usage (char *program_name);
+static int open_ppm_dir (const char *dirname);
+static int read_ppm (const char *filename, int first);
+static int open_y4m (const char *filename);
+static int read_y4m (void);
+static void *compare_frame (void *arg);
+static int merge_tiles (void);
+static int write_update (int nrects);
+static int write_raw (const rect *r);
+static int write_hextile (const rect *r);
+
+static int depth = 24, bpp = 4, tile = 16, hextile = 0, nthreads;
+static int max_frames = 0;
+static int input_type;
+static FILE *in, *out;
+
+static int width, height;
+static int tiles_x, tiles_y;
+
+/* PPM input */
+static char **ppm_files = NULL;
+static int nppm_files = 0;
+
+/* Y4M input.  The chroma planes are subsampled by chroma_x and chroma_y, or
+   absent if chroma_x is 0. */
+static int chroma_x, chroma_y, chroma_w, chroma_h;
+
+/* The current input frame: interleaved RGB for PPM, or planar YCbCr */
+static unsigned char *in_buf;
+static size_t in_size;
+
+/* The current and previous frames, in the output pixel format */
+static unsigned char *cur_fb, *prev_fb;
+static int first_frame;
+
+static unsigned char *dirty;    /* One per tile */
+static rect *rects;
+static int *active, *next_active;
+
+/* One hextile tile, which is never larger than a raw tile */
+static unsigned char out_buf[1 + 16 * 16 * 4 * 2];
+
+static unsigned long long total_rects = 0, total_pixels = 0;
+static unsigned long long total_bytes = 0;
+static int total_frames = 0, total_updates = 0;
+
+int main (int argc, char *argv[])
+{
+  char *outfilename = NULL, *infilename = NULL;
+  worker workers[MAX_THREADS];
+  struct stat st;
+  int i, err = 0, nworkers, rows_per_worker, nrects;
+  long n;
+
+  nthreads = (int)sysconf (_SC_NPROCESSORS_ONLN);
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp (argv[i], "-8") == 0) {
+      depth = 8;
+    } else if (strcmp (argv[i], "-16") == 0) {
+      depth = 16;
+    } else if (strcmp (argv[i], "-24") == 0) {
+      depth = 24;
+    } else if (strcmp (argv[i], "-hextile") == 0) {
+      hextile = 1;
+    } else if (strcmp (argv[i], "-tile") == 0 && i < argc - 1) {
+      if ((tile = atoi (argv[++i])) < 1) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-threads") == 0 && i < argc - 1) {
+      if ((nthreads = atoi (argv[++i])) < 1) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-frames") == 0 && i < argc - 1) {
+      if ((max_frames = atoi (argv[++i])) < 1) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-o") == 0 && i < argc - 1) {
+      outfilename = argv[++i];
+    } else if ((argv[i][0] != '-' || strcmp (argv[i], "-") == 0) &&
+               !infilename) {
+      infilename = argv[i];
+    } else {
+      show_usage (argv[0]);
+      return 1;
+    }
+  }
+  if (!infilename) {
+    show_usage (argv[0]);
+    return 1;
+  }
+  bpp = depth == 24 ? 4 : depth / 8;
+  if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+
+  if (strcmp (infilename, "-") != 0 && stat (infilename, &st) == 0 &&
+      S_ISDIR (st.st_mode)) {
+    input_type = INPUT_PPM;
+    if (open_ppm_dir (infilename) != 0)
+      return 1;
+  } else {
+    input_type = INPUT_Y4M;
+    if (open_y4m (infilename) != 0)
+      return 1;
+  }
+  if (width > 65535 || height > 65535) {
+    fprintf (stderr, "Frames are %d*%d (max. 65535*65535)\n", width, height);
+    return 1;
+  }
+
+  tiles_x = (width + tile - 1) / tile;
+  tiles_y = (height + tile - 1) / tile;
+  cur_fb = (unsigned char *)malloc ((size_t)width * height * bpp);
+  prev_fb = (unsigned char *)malloc ((size_t)width * height * bpp);
+  dirty = (unsigned char *)malloc ((size_t)tiles_x * tiles_y);
+  rects = (rect *)malloc (MAX_RECTS * sizeof(rect));
+  active = (int *)malloc (tiles_x * sizeof(int));
+  next_active = (int *)malloc (tiles_x * sizeof(int));
+  if (!cur_fb || !prev_fb || !dirty || !rects || !active || !next_active) {
+    perror ("Cannot allocate frame buffers");
+    return 1;
+  }
+
+  out = outfilename ? fopen (outfilename, "wb") : stdout;
+  if (out == NULL) {
+    perror ("Cannot open output file");
+    return 1;
+  }
+
+  /* Bands of tile rows, one per thread */
+  nworkers = min (nthreads, tiles_y);
+  rows_per_worker = (tiles_y + nworkers - 1) / nworkers;
+  nworkers = (tiles_y + rows_per_worker - 1) / rows_per_worker;
+  for (i = 0; i < nworkers; i++) {
+    workers[i].first_row = i * rows_per_worker;
+    workers[i].end_row = min ((i + 1) * rows_per_worker, tiles_y);
+  }
+
+  if ((n = fbsWriteServerInit (out, width, height, depth, "fbs-import")) < 0)
+    err = 1;
+  else
+    total_bytes += n;
+  first_frame = 1;
+  while (!err && (!max_frames || total_frames < max_frames)) {
+    int ret;
+    unsigned char *tmp;
+
+    if (input_type == INPUT_PPM)
+      ret = total_frames < nppm_files ?
+        read_ppm (ppm_files[total_frames], 0) : 1;
+    else
+      ret = read_y4m ();
+    if (ret != 0) {
+      if (ret < 0) err = 1;
+      break;
+    }
+
+    if (nworkers > 1) {
+      for (i = 0; i < nworkers; i++) {
+        if ((ret = pthread_create (&workers[i].thread, NULL, compare_frame,
+                                   &workers[i])) != 0) {
+          fprintf (stderr, "Cannot create thread: %s\n", strerror (ret));
+          exit (1);
+        }
+      }
+      for (i = 0; i < nworkers; i++)
+        pthread_join (workers[i].thread, NULL);
+    } else {
+      compare_frame (&workers[0]);
+    }
+
+    nrects = merge_tiles ();
+    if (nrects > 0 && write_update (nrects) != 0)
+      err = 1;
+
+    tmp = prev_fb;
+    prev_fb = cur_fb;
+    cur_fb = tmp;
+    first_frame = 0;
+    total_frames++;
+  }
+
+  if (!err && total_frames == 0) {
+    fprintf (stderr, "No frames in %s\n", infilename);
+    err = 1;
+  }
+  if (!err && fflush (out) != 0) {
+    perror ("Cannot write output file");
+    err = 1;
+  }
+  if (out != stdout)
+    fclose (out);
+  if (in && in != stdin)
+    fclose (in);
+
+  if (!err) {
+    fprintf (stderr, "%d*%d, depth %d: %d frames, %d updates, %llu rectangles, "
+             "%.1f Mpixels (%.1f%% of frames), %.1f MB\n", width, height,
+             depth, total_frames, total_updates, total_rects,
+             (double)total_pixels / 1000000.,
+             (double)total_pixels * 100. / ((double)width * height *
+                                            total_frames),
+             (double)total_bytes / 1000000.);
+  }
+  fprintf (stderr, (err) ? "Fatal error has occured.\n" : "Succeeded.\n");
+  return err;
+}
+
+static void show_usage (char *program_name)
+{
+  fprintf (stderr,
+           "\nUSAGE: %s [options] <directory | y4m file>\n\n"
+           "Converts a directory of PPM images (in file name order) or a YUV4MPEG2 stream\n"
+           "(\"-\" for standard input) to a session capture for compare-encodings.\n\n"
+           "Options:\n"
+           "-8/-16/-24 = Bit depth of the capture (default: 24.)  Pass the same option\n"
+           "             to compare-encodings.\n"
+           "-hextile = Write hextile rectangles instead of raw rectangles\n"
+           "-tile <n> = Compare frames in tiles of <n>x<n> pixels (default: 16)\n"
+           "-threads <n> = Number of threads that convert and compare frames\n"
+           "               (default: number of CPUs)\n"
+           "-frames <n> = Convert at most <n> frames\n"
+           "-o <filename> = Write the capture to <filename> instead of standard output\n\n",
+           program_name);
+}
+
+/*
+ * Input
+ */
+
+static int compare_names (const void *a, const void *b)
+{
+  return strcmp (*(char * const *)a, *(char * const *)b);
+}
+
+static int open_ppm_dir (const char *dirname)
+{
+  DIR *dir;
+  struct dirent *ent;
+  int max_files = 0;
+
+  if ((dir = opendir (dirname)) == NULL) {
+    perror ("Cannot open input directory");
+    return -1;
+  }
+  while ((ent = readdir (dir)) != NULL) {
+    size_t len = strlen (ent->d_name);
+    if (len < 5 || (strcmp (ent->d_name + len - 4, ".ppm") != 0 &&
+                    strcmp (ent->d_name + len - 4, ".pnm") != 0))
+      continue;
+    if (nppm_files >= max_files) {
+      max_files = max_files ? max_files * 2 : 256;
+      if ((ppm_files = (char **)realloc (ppm_files,
+                                         max_files * sizeof(char *))) == NULL) {
+        perror ("Cannot allocate file list");
+        exit (1);
+      }
+    }
+    if ((ppm_files[nppm_files] = (char *)malloc (strlen (dirname) + len + 2))
+        == NULL) {
+      perror ("Cannot allocate file list");
+      exit (1);
+    }
+    sprintf (ppm_files[nppm_files++], "%s/%s", dirname, ent->d_name);
+  }
+  closedir (dir);
+
+  if (nppm_files == 0) {
+    fprintf (stderr, "No .ppm or .pnm files in %s\n", dirname);
+    return -1;
+  }
+  qsort (ppm_files, nppm_files, sizeof(char *), compare_names);
+
+  /* The first image sets the frame size. */
+  return read_ppm (ppm_files[0], 1);
+}
+
+/* Reads a number from a PPM header, skipping white space and comments */
+static int read_ppm_number (FILE *f)
+{
+  int c, v = 0, digits = 0;
+
+  do {
+    if ((c = getc (f)) == '#') {
+      while (c != '\n' && c != EOF) c = getc (f);
+    }
+  } while (c == ' ' || c == '\t' || c == '\r' || c == '\n');
+  while (c >= '0' && c <= '9' && digits < 9) {
+    v = v * 10 + c - '0';
+    digits++;
+    c = getc (f);
+  }
+  /* A single white space character ends the header. */
+  return (digits > 0 && (c == ' ' || c == '\t' || c == '\r' || c == '\n')) ?
+    v : -1;
+}
+
+/* Reads a binary (P6) PPM image into in_buf.  The first image allocates
+   in_buf and sets the frame size, and the rest must match it. */
+static int read_ppm (const char *filename, int first)
+{
+  FILE *f;
+  int w, h, maxval, ret = 0;
+
+  if ((f = fopen (filename, "rb")) == NULL) {
+    fprintf (stderr, "Cannot open %s\n", filename);
+    return -1;
+  }
+  if (getc (f) != 'P' || getc (f) != '6' || (w = read_ppm_number (f)) < 1 ||
+      (h = read_ppm_number (f)) < 1 || (maxval = read_ppm_number (f)) < 1 ||
+      maxval > 65535) {
+    fprintf (stderr, "%s is not a binary (P6) PPM image\n", filename);
+    fclose (f);
+    return -1;
+  }
+
+  if (first) {
+    width = w;
+    height = h;
+    in_size = (size_t)width * height * 3;
+    if ((in_buf = (unsigned char *)malloc (in_size)) == NULL) {
+      perror ("Cannot allocate input buffer");
+      exit (1);
+    }
+    fclose (f);
+    return 0;
+  }
+  if (w != width || h != height) {
+    fprintf (stderr, "%s is %d*%d, but the first image is %d*%d\n",
+             filename, w, h, width, height);
+    fclose (f);
+    return -1;
+  }
+
+  if (maxval == 255) {
+    if (fread (in_buf, 1, in_size, f) != in_size)
+      ret = -1;
+  } else {
+    /* Scale each sample (two bytes, big endian, if maxval > 255) to 0-255 */
+    size_t i;
+    for (i = 0; i < in_size && ret == 0; i++) {
+      int v = getc (f);
+      if (maxval > 255 && v != EOF) {
+        int lo = getc (f);
+        v = lo == EOF ? EOF : (v << 8) | lo;
+      }
+      if (v == EOF)
+        ret = -1;
+      else
+        in_buf[i] = (unsigned char)((min (v, maxval) * 255 + maxval / 2) /
+                                    maxval);
+    }
+  }
+  if (ret != 0)
+    fprintf (stderr, "%s is truncated\n", filename);
+  fclose (f);
+  return ret;
+}
+
+/* Reads a line (without the newline) from a Y4M header.  Returns -1 if the
+   line is too long, or on EOF. */
+static int read_y4m_line (char *buf, int size)
+{
+  int c, n = 0;
+
+  while ((c = getc (in)) != '\n') {
+    if (c == EOF || n >= size - 1) return -1;
+    buf[n++] = (char)c;
+  }
+  buf[n] = '\0';
+  return n;
+}
+
+static int open_y4m (const char *filename)
+{
+  char header[1024], *token;
+  const char *colorspace = "420";
+
+  if (strcmp (filename, "-") == 0)
+    in = stdin;
+  else if ((in = fopen (filename, "rb")) == NULL) {
+    perror ("Cannot open input file");
+    return -1;
+  }
+
+  if (read_y4m_line (header, sizeof(header)) < 0 ||
+      strncmp (header, "YUV4MPEG2 ", 10) != 0) {
+    fprintf (stderr, "%s is not a directory or a YUV4MPEG2 stream\n",
+             filename);
+    return -1;
+  }
+  width = height = 0;
+  for (token = strtok (header + 10, " "); token; token = strtok (NULL, " ")) {
+    switch (token[0]) {
+    case 'W':  width = atoi (token + 1);  break;
+    case 'H':  height = atoi (token + 1);  break;
+    case 'C':  colorspace = token + 1;  break;
+    }
+  }
+  if (width < 1 || height < 1) {
+    fprintf (stderr, "%s has no frame size\n", filename);
+    return -1;
+  }
+
+  /* 4:2:0 chroma siting (jpeg, mpeg2, paldv) is ignored. */
+  if (strncmp (colorspace, "420", 3) == 0 &&
+      (colorspace[3] == '\0' || colorspace[3] == 'j' || colorspace[3] == 'm' ||
+       colorspace[3] == 'p')) {
+    chroma_x = chroma_y = 2;
+  } else if (strcmp (colorspace, "422") == 0) {
+    chroma_x = 2;  chroma_y = 1;
+  } else if (strcmp (colorspace, "444") == 0) {
+    chroma_x = chroma_y = 1;
+  } else if (strcmp (colorspace, "mono") == 0) {
+    chroma_x = chroma_y = 0;
+  } else {
+    fprintf (stderr, "Unsupported Y4M colorspace: %s\n", colorspace);
+    return -1;
+  }
+  chroma_w = chroma_x ? (width + chroma_x - 1) / chroma_x : 0;
+  chroma_h = chroma_y ? (height + chroma_y - 1) / chroma_y : 0;
+
+  in_size = (size_t)width * height + (size_t)chroma_w * chroma_h * 2;
+  if ((in_buf = (unsigned char *)malloc (in_size)) == NULL) {
+    perror ("Cannot allocate input buffer");
+    exit (1);
+  }
+  return 0;
+}
+
+/* Returns 1 at the end of the stream */
+static int read_y4m (void)
+{
+  char header[1024];
+  int c;
+
+  if ((c = getc (in)) == EOF)
+    return 1;
+  ungetc (c, in);
+  if (read_y4m_line (header, sizeof(header)) < 0 ||
+      strncmp (header, "FRAME", 5) != 0) {
+    fprintf (stderr, "Bad Y4M frame header at frame %d\n", total_frames + 1);
+    return -1;
+  }
+  if (fread (in_buf, 1, in_size, in) != in_size) {
+    fprintf (stderr, "Y4M frame %d is truncated\n", total_frames + 1);
+    return -1;
+  }
+  return 0;
+}
+
+/*
+ * Conversion and comparison
+ */
+
+static unsigned char clamp (int v)
+{
+  return (unsigned char)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+/* Converts a row of the input frame to 8-bit RGB, using BT.601 limited-range
+   coefficients for Y4M */
+static void get_row_rgb (int y, unsigned char *rgb)
+{
+  const unsigned char *py, *pu, *pv;
+  int x;
+
+  if (input_type == INPUT_PPM) {
+    memcpy (rgb, &in_buf[(size_t)y * width * 3], (size_t)width * 3);
+    return;
+  }
+
+  py = &in_buf[(size_t)y * width];
+  if (!chroma_x) {
+    for (x = 0; x < width; x++) {
+      unsigned char v = clamp ((298 * (py[x] - 16) + 128) >> 8);
+      rgb[x * 3] = rgb[x * 3 + 1] = rgb[x * 3 + 2] = v;
+    }
+    return;
+  }
+  pu = &in_buf[(size_t)width * height + (size_t)(y / chroma_y) * chroma_w];
+  pv = pu + (size_t)chroma_w * chroma_h;
+  for (x = 0; x < width; x++) {
+    int c = 298 * (py[x] - 16), d = pu[x / chroma_x] - 128,
+      e = pv[x / chroma_x] - 128;
+    rgb[x * 3] = clamp ((c + 409 * e + 128) >> 8);
+    rgb[x * 3 + 1] = clamp ((c - 100 * d - 208 * e + 128) >> 8);
+    rgb[x * 3 + 2] = clamp ((c + 516 * d + 128) >> 8);
+  }
+}
+
+/* The pixel format is the one that compare-encodings sets up for each depth
+   (see InitEverything() in misc.c), little endian. */
+static void convert_row (const unsigned char *rgb, unsigned char *dst)
+{
+  int x;
+
+  for (x = 0; x < width; x++, rgb += 3) {
+    unsigned int r = rgb[0], g = rgb[1], b = rgb[2], p;
+    switch (depth) {
+    case 8:
+      *dst++ = (unsigned char)((r >> 5) | ((g >> 5) << 3) | ((b >> 6) << 6));
+      break;
+    case 16:
+      p = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+      *dst++ = (unsigned char)p;
+      *dst++ = (unsigned char)(p >> 8);
+      break;
+    default:
+      *dst++ = (unsigned char)b;
+      *dst++ = (unsigned char)g;
+      *dst++ = (unsigned char)r;
+      *dst++ = 0;
+    }
+  }
+}
+
+/* Converts the tile rows from w->first_row to w->end_row - 1 into cur_fb and
+   marks the tiles in them that differ from prev_fb.  The comparison is done
+   in the output pixel format, so changes that are lost at -8 or -16 don't
+   count. */
+static void *compare_frame (void *arg)
+{
+  const worker *w = (const worker *)arg;
+  unsigned char *rgb = (unsigned char *)malloc ((size_t)width * 3);
+  size_t stride = (size_t)width * bpp;
+  int ty, tx, y;
+
+  if (!rgb) {
+    perror ("Cannot allocate row buffer");
+    exit (1);
+  }
+
+  for (ty = w->first_row; ty < w->end_row; ty++) {
+    int y0 = ty * tile, y1 = min (y0 + tile, height);
+    unsigned char *row_dirty = &dirty[(size_t)ty * tiles_x];
+
+    for (y = y0; y < y1; y++) {
+      get_row_rgb (y, rgb);
+      convert_row (rgb, &cur_fb[y * stride]);
+    }
+
+    if (first_frame) {
+      memset (row_dirty, 1, tiles_x);
+      continue;
+    }
+    memset (row_dirty, 0, tiles_x);
+    for (y = y0; y < y1; y++) {
+      const unsigned char *cur = &cur_fb[y * stride],
+        *prev = &prev_fb[y * stride];
+      if (memcmp (cur, prev, stride) == 0) continue;
+      for (tx = 0; tx < tiles_x; tx++) {
+        size_t offset = (size_t)tx * tile * bpp;
+        if (!row_dirty[tx] &&
+            memcmp (cur + offset, prev + offset,
+                    (size_t)min (tile, width - tx * tile) * bpp) != 0)
+          row_dirty[tx] = 1;
+      }
+    }
+  }
+  free (rgb);
+  return NULL;
+}
+
+/* Merges the dirty tiles into rectangles: horizontal runs of dirty tiles in
+   each tile row, extended downward while the rows below have a run with the
+   same extent.  Returns the number of rectangles. */
+static int merge_tiles (void)
+{
+  int nrects = 0, nactive = 0, ty, tx;
+
+  for (ty = 0; ty < tiles_y; ty++) {
+    const unsigned char *row_dirty = &dirty[(size_t)ty * tiles_x];
+    int nnext = 0, a = 0, *tmp;
+
+    for (tx = 0; tx < tiles_x; tx++) {
+      int x0 = tx, r;
+      if (!row_dirty[tx]) continue;
+      while (tx < tiles_x && row_dirty[tx]) tx++;
+
+      /* Both the runs and the active rectangles are sorted by x. */
+      while (a < nactive && rects[active[a]].x < x0 * tile) a++;
+      if (a < nactive && rects[active[a]].x == x0 * tile &&
+          rects[active[a]].w == (tx - x0) * tile) {
+        r = active[a++];
+        rects[r].h += tile;
+      } else {
+        if (nrects >= MAX_RECTS) goto overflow;
+        r = nrects++;
+        rects[r].x = x0 * tile;
+        rects[r].y = ty * tile;
+        rects[r].w = (tx - x0) * tile;
+        rects[r].h = tile;
+      }
+      next_active[nnext++] = r;
+    }
+    tmp = active;
+    active = next_active;
+    next_active = tmp;
+    nactive = nnext;
+  }
+
+  /* Clip the rectangles in the last tile column and row */
+  for (tx = 0; tx < nrects; tx++) {
+    rects[tx].w = min (rects[tx].w, width - rects[tx].x);
+    rects[tx].h = min (rects[tx].h, height - rects[tx].y);
+  }
+  return nrects;
+
+  overflow:
+  /* Too many rectangles for one update, so send the bounding box of the
+     changed tiles */
+  {
+    int x0 = tiles_x, y0 = tiles_y, x1 = 0, y1 = 0;
+    for (ty = 0; ty < tiles_y; ty++) {
+      for (tx = 0; tx < tiles_x; tx++) {
+        if (!dirty[(size_t)ty * tiles_x + tx]) continue;
+        x0 = min (x0, tx);  x1 = max (x1, tx + 1);
+        y0 = min (y0, ty);  y1 = max (y1, ty + 1);
+      }
+    }
+    rects[0].x = x0 * tile;
+    rects[0].y = y0 * tile;
+    rects[0].w = min (x1 * tile, width) - rects[0].x;
+    rects[0].h = min (y1 * tile, height) - rects[0].y;
+    return 1;
+  }
+}
+
+/*
+ * Output
+ */
+
+static int write_bytes (const void *buf, size_t size)
+{
+  if (fwrite (buf, 1, size, out) != size) {
+    perror ("Cannot write output file");
+    return -1;
+  }
+  total_bytes += size;
+  return 0;
+}
+
+static int write_update (int nrects)
+{
+  unsigned char msg[4];
+  int i;
+
+  msg[0] = MSG_FRAMEBUFFER_UPDATE;
+  msg[1] = 0;
+  fbsPut16 (msg + 2, nrects);
+  if (write_bytes (msg, 4) != 0)
+    return -1;
+
+  for (i = 0; i < nrects; i++) {
+    unsigned char hdr[12];
+    fbsPut16 (hdr, rects[i].x);
+    fbsPut16 (hdr + 2, rects[i].y);
+    fbsPut16 (hdr + 4, rects[i].w);
+    fbsPut16 (hdr + 6, rects[i].h);
+    fbsPut32 (hdr + 8, hextile ? ENCODING_HEXTILE : ENCODING_RAW);
+    if (write_bytes (hdr, 12) != 0 ||
+        (hextile ? write_hextile (&rects[i]) : write_raw (&rects[i])) != 0)
+      return -1;
+    total_pixels += (unsigned long long)rects[i].w * rects[i].h;
+  }
+  total_rects += nrects;
+  total_updates++;
+  return 0;
+}
+
+static int write_raw (const rect *r)
+{
+  int y;
+
+  for (y = r->y; y < r->y + r->h; y++) {
+    if (write_bytes (&cur_fb[((size_t)y * width + r->x) * bpp],
+                     (size_t)r->w * bpp) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+static unsigned int get_pixel (const unsigned char *p)
+{
+  switch (bpp) {
+  case 1:  return p[0];
+  case 2:  return p[0] | (p[1] << 8);
+  default:  return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned int)p[3] << 24);
+  }
+}
+
+static unsigned char *put_pixel (unsigned char *dst, unsigned int p)
+{
+  int i;
+
+  for (i = 0; i < bpp; i++, p >>= 8)
+    *dst++ = (unsigned char)p;
+  return dst;
+}
+
+/* Encodes each 16x16 tile as a solid tile, a two-color tile with one
+   subrectangle per run of foreground pixels in each row, or a raw tile,
+   whichever is smallest.  The background is carried over from the previous
+   tile when it is unchanged, but not across a raw tile. */
+static int write_hextile (const rect *r)
+{
+  int tx, ty, x, y, bg_valid = 0;
+  unsigned int bg = 0;
+
+  for (ty = r->y; ty < r->y + r->h; ty += 16) {
+    for (tx = r->x; tx < r->x + r->w; tx += 16) {
+      int tw = min (16, r->x + r->w - tx), th = min (16, r->y + r->h - ty);
+      unsigned int c0 = get_pixel (&cur_fb[((size_t)ty * width + tx) * bpp]),
+        c1 = c0, n0 = 0, n1 = 0, tile_bg, fg;
+      unsigned char *dst = out_buf, *count;
+      int two_color = 1, nsubrects = 0;
+
+      for (y = ty; y < ty + th && two_color; y++) {
+        const unsigned char *p = &cur_fb[((size_t)y * width + tx) * bpp];
+        for (x = 0; x < tw; x++, p += bpp) {
+          unsigned int c = get_pixel (p);
+          if (c == c0) n0++;
+          else if (n1 == 0 || c == c1) { c1 = c;  n1++; }
+          else { two_color = 0;  break; }
+        }
+      }
+
+      if (two_color && n1 == 0) {
+        if (bg_valid && c0 == bg) {
+          *dst++ = 0;
+        } else {
+          *dst++ = HEXTILE_BACKGROUND_SPECIFIED;
+          dst = put_pixel (dst, c0);
+        }
+        bg = c0;
+        bg_valid = 1;
+      } else if (two_color) {
+        tile_bg = n0 >= n1 ? c0 : c1;
+        fg = n0 >= n1 ? c1 : c0;
+        *dst = HEXTILE_FOREGROUND_SPECIFIED | HEXTILE_ANY_SUBRECTS;
+        if (!bg_valid || tile_bg != bg) {
+          *dst++ |= HEXTILE_BACKGROUND_SPECIFIED;
+          dst = put_pixel (dst, tile_bg);
+        } else {
+          dst++;
+        }
+        dst = put_pixel (dst, fg);
+        count = dst++;
+        for (y = 0; y < th; y++) {
+          const unsigned char *p = &cur_fb[((size_t)(ty + y) * width + tx) *
+                                           bpp];
+          for (x = 0; x < tw; x++) {
+            int x0 = x;
+            if (get_pixel (p + x * bpp) != fg) continue;
+            while (x < tw && get_pixel (p + x * bpp) == fg) x++;
+            *dst++ = (unsigned char)((x0 << 4) | y);
+            *dst++ = (unsigned char)(((x - x0 - 1) << 4));
+            nsubrects++;
+          }
+        }
+        *count = (unsigned char)nsubrects;
+        bg = tile_bg;
+        bg_valid = 1;
+      }
+
+      /* A subrectangle count over 255 can't happen in a 16x16 tile, since
+         runs in a row are separated by at least one background pixel. */
+      if (!two_color || dst - out_buf > 1 + tw * th * bpp) {
+        dst = out_buf;
+        *dst++ = HEXTILE_RAW;
+        for (y = ty; y < ty + th; y++) {
+          memcpy (dst, &cur_fb[((size_t)y * width + tx) * bpp],
+                  (size_t)tw * bpp);
+          dst += tw * bpp;
+        }
+        bg_valid = 0;
+      }
+      if (write_bytes (out_buf, dst - out_buf) != 0)
+        return -1;
+    }
+  }
+  return 0;
+}
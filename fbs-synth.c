@@ -0,0 +1,942 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * fbs-synth.c - synthetic session capture generator
+ *
+ * Writes a session capture in the same format as the output of fbs-dump -i
+ * (a protocol version message and a ServerInit message, followed by one
+ * FramebufferUpdate message per frame), so that compare-encodings can read it
+ * at any framebuffer size.  Each scenario draws its frames into a 24-bit
+ * shadow framebuffer and records the areas that it changed, and those areas
+ * are written as raw rectangles in the pixel format that compare-encodings
+ * assumes for -8, -16, or -24.  The first frame of each scenario is a full
+ * update.  The output depends only on the options, so a capture can be
+ * regenerated from its command line instead of being shared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "fbswrite.h"
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+/* From rfbproto.h */
+#define MSG_FRAMEBUFFER_UPDATE 0
+#define ENCODING_RAW 0
+#define MAX_RECTS 65535         /* The rectangle count is a CARD16. */
+
+#define MAX_SCENARIOS 16
+
+/* Character cell size of the text in the terminal and window scenarios */
+#define CELL_W 8
+#define CELL_H 16
+
+#define min(a, b) ((a) < (b) ? (a) : (b))
+#define max(a, b) ((a) > (b) ? (a) : (b))
+
+#define RGB(r, g, b) (((unsigned int)(r) << 16) | ((unsigned int)(g) << 8) | \
+                      (unsigned int)(b))
+
+typedef struct {
+  int x, y, w, h;
+} rect;
+
+typedef struct {
+  const char *name, *description;
+  void (*init) (void);          /* Draws the first frame */
+  void (*frame) (int n);        /* Draws frame n (>= 1) */
+} scenario;
+
+static void show_usage (char *program_name);
+static void seed_random (unsigned long long s);
+static int parse_scenarios (char *list);
+static void make_glyphs (void);
+static int write_update (void);
+static int write_rect (int x, int y, int w, int h);
+
+static void terminal_init (void);
+static void terminal_frame (int n);
+static void drag_init (void);
+static void drag_frame (int n);
+static void video_init (void);
+static void video_frame (int n);
+static void cad_init (void);
+static void cad_frame (int n);
+static void blink_init (void);
+static void blink_frame (int n);
+
+static const scenario scenarios[] = {
+  { "terminal", "full-screen text terminal scrolling one line per frame",
+    terminal_init, terminal_frame },
+  { "drag", "window dragged across a gradient wallpaper",
+    drag_init, drag_frame },
+  { "video", "full-screen video (smooth moving pattern with film grain)",
+    video_init, video_frame },
+  { "cad", "CAD viewport with shaded, rotating solids under a moving light",
+    cad_init, cad_frame },
+  { "blink", "blinking text cursors (one per 640x480 pixels) and typing",
+    blink_init, blink_frame },
+  { NULL, NULL, NULL, NULL }
+};
+
+static const scenario *selected[MAX_SCENARIOS];
+static int nselected = 0;
+
+static int width = 1280, height = 1024, depth = 24;
+static int frames = 100, tile = 0;
+static unsigned long long seed = 1;
+static FILE *out;
+
+static unsigned int *fb;        /* 0xRRGGBB */
+static unsigned char *row_buf;
+
+/* Areas changed by the current frame */
+static rect *damage = NULL;
+static int ndamage = 0, max_damage = 0;
+
+static unsigned long long total_rects = 0, total_pixels = 0;
+static unsigned long long total_bytes = 0;
+static int total_updates = 0;
+
+int main (int argc, char *argv[])
+{
+  char *outfilename = NULL, *list = NULL;
+  int i, err = 0;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp (argv[i], "-8") == 0) {
+      depth = 8;
+    } else if (strcmp (argv[i], "-16") == 0) {
+      depth = 16;
+    } else if (strcmp (argv[i], "-24") == 0) {
+      depth = 24;
+    } else if (strcmp (argv[i], "-size") == 0 && i < argc - 1) {
+      if (sscanf (argv[++i], "%dx%d", &width, &height) != 2 ||
+          width < 1 || height < 1 || width > 65535 || height > 65535) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-frames") == 0 && i < argc - 1) {
+      if ((frames = atoi (argv[++i])) < 1) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-tile") == 0 && i < argc - 1) {
+      if ((tile = atoi (argv[++i])) < 0) {
+        show_usage (argv[0]);
+        return 1;
+      }
+    } else if (strcmp (argv[i], "-seed") == 0 && i < argc - 1) {
+      seed = strtoull (argv[++i], NULL, 0);
+    } else if (strcmp (argv[i], "-o") == 0 && i < argc - 1) {
+      outfilename = argv[++i];
+    } else if (argv[i][0] != '-' && !list) {
+      list = argv[i];
+    } else {
+      show_usage (argv[0]);
+      return 1;
+    }
+  }
+  if (!list || parse_scenarios (list) != 0) {
+    show_usage (argv[0]);
+    return 1;
+  }
+  if (frames < nselected) {
+    fprintf (stderr, "At least one frame per scenario is required.\n");
+    return 1;
+  }
+
+  fb = (unsigned int *)malloc ((size_t)width * height * sizeof(unsigned int));
+  row_buf = (unsigned char *)malloc ((size_t)width * 4);
+  if (!fb || !row_buf) {
+    perror ("Cannot allocate framebuffer");
+    return 1;
+  }
+
+  out = outfilename ? fopen (outfilename, "wb") : stdout;
+  if (out == NULL) {
+    perror ("Cannot open output file");
+    return 1;
+  }
+
+  make_glyphs ();
+
+  /* The frames are divided evenly among the scenarios, in the order given,
+     and each scenario starts from the same seed wherever it appears. */
+  if (fbsWriteServerInit (out, width, height, depth, "fbs-synth") < 0)
+    err = 1;
+  for (i = 0; i < nselected && !err; i++) {
+    int f, nframes = frames / nselected + (i < frames % nselected);
+    seed_random (seed);
+    ndamage = 0;
+    selected[i]->init ();
+    if (write_update () != 0) {
+      err = 1;
+      break;
+    }
+    for (f = 1; f < nframes; f++) {
+      ndamage = 0;
+      selected[i]->frame (f);
+      if (write_update () != 0) {
+        err = 1;
+        break;
+      }
+    }
+  }
+
+  if (!err && fflush (out) != 0) {
+    perror ("Cannot write output file");
+    err = 1;
+  }
+  if (out != stdout)
+    fclose (out);
+
+  if (!err) {
+    fprintf (stderr, "%d*%d, depth %d: %d updates, %llu rectangles, "
+             "%.1f Mpixels, %.1f MB\n", width, height, depth, total_updates,
+             total_rects, (double)total_pixels / 1000000.,
+             (double)total_bytes / 1000000.);
+  }
+  fprintf (stderr, (err) ? "Fatal error has occured.\n" : "Succeeded.\n");
+  return err;
+}
+
+static void show_usage (char *program_name)
+{
+  int i;
+
+  fprintf (stderr,
+           "\nUSAGE: %s [options] <scenario>[,<scenario>...]\n\n"
+           "Writes a synthetic session capture for compare-encodings to standard output.\n"
+           "The frames are divided evenly among the scenarios, in the order given.\n\n"
+           "Options:\n"
+           "-8/-16/-24 = Bit depth of the capture (default: 24.)  Pass the same option\n"
+           "             to compare-encodings.\n"
+           "-size <w>x<h> = Framebuffer size (default: 1280x1024)\n"
+           "-frames <n> = Number of framebuffer updates (default: 100)\n"
+           "-tile <n> = Split each changed area into rectangles of at most <n>x<n>\n"
+           "            pixels (default: one rectangle per changed area)\n"
+           "-seed <s> = Seed for the random content and motion (default: 1)\n"
+           "-o <filename> = Write the capture to <filename> instead of standard output\n\n"
+           "Scenarios (\"mix\" selects all of them):\n", program_name);
+  for (i = 0; scenarios[i].name; i++)
+    fprintf (stderr, "%-8s = %s\n", scenarios[i].name,
+             scenarios[i].description);
+  fprintf (stderr, "\n");
+}
+
+static int parse_scenarios (char *list)
+{
+  char *name;
+  int i;
+
+  for (name = strtok (list, ","); name; name = strtok (NULL, ",")) {
+    if (strcmp (name, "mix") == 0) {
+      for (i = 0; scenarios[i].name && nselected < MAX_SCENARIOS; i++)
+        selected[nselected++] = &scenarios[i];
+      continue;
+    }
+    for (i = 0; scenarios[i].name; i++) {
+      if (strcmp (scenarios[i].name, name) == 0) break;
+    }
+    if (!scenarios[i].name) {
+      fprintf (stderr, "Unknown scenario: %s\n", name);
+      return -1;
+    }
+    if (nselected >= MAX_SCENARIOS) {
+      fprintf (stderr, "Too many scenarios (max. %d)\n", MAX_SCENARIOS);
+      return -1;
+    }
+    selected[nselected++] = &scenarios[i];
+  }
+  return nselected > 0 ? 0 : -1;
+}
+
+/*
+ * Random numbers (xorshift64*), so that the output doesn't depend on the C
+ * library's rand()
+ */
+
+static unsigned long long rng_state;
+
+static void seed_random (unsigned long long s)
+{
+  rng_state = s * 0x9E3779B97F4A7C15ULL + 0x6A09E667F3BCC909ULL;
+  if (!rng_state) rng_state = 1;
+}
+
+static unsigned int random32 (void)
+{
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  return (unsigned int)((rng_state * 0x2545F4914F6CDD1DULL) >> 32);
+}
+
+/* Returns 0 to n - 1 */
+static int random_int (int n)
+{
+  return (int)(((unsigned long long)random32 () * (unsigned int)n) >> 32);
+}
+
+/*
+ * Output
+ */
+
+static void add_damage (int x, int y, int w, int h)
+{
+  if (x < 0) { w += x;  x = 0; }
+  if (y < 0) { h += y;  y = 0; }
+  if (x + w > width) w = width - x;
+  if (y + h > height) h = height - y;
+  if (w <= 0 || h <= 0) return;
+
+  if (ndamage >= max_damage) {
+    max_damage = max_damage ? max_damage * 2 : 64;
+    if ((damage = (rect *)realloc (damage, max_damage * sizeof(rect)))
+        == NULL) {
+      perror ("Cannot allocate damage list");
+      exit (1);
+    }
+  }
+  damage[ndamage].x = x;
+  damage[ndamage].y = y;
+  damage[ndamage].w = w;
+  damage[ndamage].h = h;
+  ndamage++;
+}
+
+static int write_update (void)
+{
+  unsigned char msg[4];
+  unsigned long long nrects = 0;
+  int i, x, y, tw, th;
+
+  if (ndamage < 1) return 0;
+
+  for (i = 0; i < ndamage; i++) {
+    if (tile)
+      nrects += (unsigned long long)((damage[i].w + tile - 1) / tile) *
+        ((damage[i].h + tile - 1) / tile);
+    else
+      nrects++;
+  }
+  if (nrects > MAX_RECTS) {
+    fprintf (stderr, "Update %d has %llu rectangles (max. %d).  Use a larger -tile.\n",
+             total_updates + 1, nrects, MAX_RECTS);
+    return -1;
+  }
+
+  msg[0] = MSG_FRAMEBUFFER_UPDATE;
+  msg[1] = 0;
+  fbsPut16 (msg + 2, (int)nrects);
+  if (fwrite (msg, 1, 4, out) != 4) {
+    perror ("Cannot write output file");
+    return -1;
+  }
+  total_bytes += 4;
+
+  for (i = 0; i < ndamage; i++) {
+    const rect *r = &damage[i];
+    tw = tile ? tile : r->w;
+    th = tile ? tile : r->h;
+    for (y = r->y; y < r->y + r->h; y += th) {
+      for (x = r->x; x < r->x + r->w; x += tw) {
+        if (write_rect (x, y, x + tw > r->x + r->w ? r->x + r->w - x : tw,
+                        y + th > r->y + r->h ? r->y + r->h - y : th) != 0)
+          return -1;
+      }
+    }
+  }
+  total_rects += nrects;
+  total_updates++;
+  return 0;
+}
+
+static int write_rect (int x, int y, int w, int h)
+{
+  unsigned char hdr[12];
+  int i, j, bytes = depth == 24 ? 4 : depth / 8;
+
+  fbsPut16 (hdr, x);
+  fbsPut16 (hdr + 2, y);
+  fbsPut16 (hdr + 4, w);
+  fbsPut16 (hdr + 6, h);
+  fbsPut32 (hdr + 8, ENCODING_RAW);
+  if (fwrite (hdr, 1, 12, out) != 12) {
+    perror ("Cannot write output file");
+    return -1;
+  }
+
+  for (j = y; j < y + h; j++) {
+    const unsigned int *src = &fb[(size_t)j * width + x];
+    unsigned char *dst = row_buf;
+    for (i = 0; i < w; i++) {
+      unsigned int p = src[i], r = p >> 16, g = (p >> 8) & 0xFF, b = p & 0xFF;
+      switch (depth) {
+      case 8:
+        *dst++ = (unsigned char)((r >> 5) | ((g >> 5) << 3) | ((b >> 6) << 6));
+        break;
+      case 16:
+        p = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+        *dst++ = (unsigned char)p;
+        *dst++ = (unsigned char)(p >> 8);
+        break;
+      default:
+        *dst++ = (unsigned char)p;
+        *dst++ = (unsigned char)(p >> 8);
+        *dst++ = (unsigned char)(p >> 16);
+        *dst++ = 0;
+      }
+    }
+    if (fwrite (row_buf, bytes, w, out) != (size_t)w) {
+      perror ("Cannot write output file");
+      return -1;
+    }
+  }
+  total_bytes += 12 + (unsigned long long)w * h * bytes;
+  total_pixels += (unsigned long long)w * h;
+  return 0;
+}
+
+/*
+ * Drawing.  Everything is drawn onto the canvas, which is normally the
+ * framebuffer, and clipped to it.
+ */
+
+static unsigned int *canvas;
+static int canvas_w, canvas_h;
+
+static void set_canvas (unsigned int *buf, int w, int h)
+{
+  canvas = buf;
+  canvas_w = w;
+  canvas_h = h;
+}
+
+static void fill_rect (int x, int y, int w, int h, unsigned int color)
+{
+  int i, j;
+
+  if (x < 0) { w += x;  x = 0; }
+  if (y < 0) { h += y;  y = 0; }
+  if (x + w > canvas_w) w = canvas_w - x;
+  if (y + h > canvas_h) h = canvas_h - y;
+  for (j = y; j < y + h; j++) {
+    unsigned int *p = &canvas[(size_t)j * canvas_w + x];
+    for (i = 0; i < w; i++)
+      p[i] = color;
+  }
+}
+
+static unsigned int blend (unsigned int c0, unsigned int c1, int i, int n)
+{
+  int r0 = c0 >> 16, g0 = (c0 >> 8) & 0xFF, b0 = c0 & 0xFF;
+  int r1 = c1 >> 16, g1 = (c1 >> 8) & 0xFF, b1 = c1 & 0xFF;
+
+  if (n < 1) return c0;
+  return RGB (r0 + (r1 - r0) * i / n, g0 + (g1 - g0) * i / n,
+              b0 + (b1 - b0) * i / n);
+}
+
+/* Horizontal (vertical = 0) or vertical gradient */
+static void fill_gradient (int x, int y, int w, int h, unsigned int c0,
+                           unsigned int c1, int vertical)
+{
+  int i;
+
+  if (vertical) {
+    for (i = 0; i < h; i++)
+      fill_rect (x, y + i, w, 1, blend (c0, c1, i, h - 1));
+  } else {
+    for (i = 0; i < w; i++)
+      fill_rect (x + i, y, 1, h, blend (c0, c1, i, w - 1));
+  }
+}
+
+/*
+ * Text.  The glyphs are made up, but like real text, they have one-pixel
+ * stems and bars on a plain background, and each line uses only a few colors.
+ */
+
+static unsigned char glyphs[95][CELL_H];        /* ' ' to '~', MSB = left */
+
+static void make_glyphs (void)
+{
+  unsigned int lcg = 1;
+  int c, y, i;
+
+  for (c = 1; c < 95; c++) {
+    int top = (c % 4 == 0) ? 2 : 5, bottom = (c % 7 == 0) ? 14 : 12;
+    unsigned char stems = 0;
+    lcg = lcg * 1103515245 + 12345;
+    if (lcg & 0x10000) stems |= 0x40;
+    if (lcg & 0x20000) stems |= 0x10;
+    if ((lcg & 0x40000) || !stems) stems |= 0x04;
+    for (y = top; y <= bottom; y++)
+      glyphs[c][y] = stems;
+    for (i = 0; i < 1 + (int)((lcg >> 19) % 3); i++) {
+      lcg = lcg * 1103515245 + 12345;
+      glyphs[c][top + (lcg >> 16) % (bottom - top + 1)] |= 0x7C;
+    }
+  }
+}
+
+static void draw_char (int x, int y, int c, unsigned int fg, unsigned int bg)
+{
+  int i, j;
+
+  if (c < ' ' || c > '~') c = ' ';
+  for (j = 0; j < CELL_H; j++) {
+    unsigned char bits = glyphs[c - ' '][j];
+    if (y + j < 0 || y + j >= canvas_h) continue;
+    for (i = 0; i < CELL_W; i++) {
+      if (x + i < 0 || x + i >= canvas_w) continue;
+      canvas[(size_t)(y + j) * canvas_w + x + i] =
+        (bits & (0x80 >> i)) ? fg : bg;
+    }
+  }
+}
+
+/* Draws a line of random words, up to cols characters long.  Most words are
+   in colors[0]. */
+static void draw_words (int x, int y, int cols, const unsigned int *colors,
+                        int ncolors, unsigned int bg)
+{
+  int col = 0, i;
+
+  while (col < cols) {
+    int len = 1 + random_int (10);
+    unsigned int fg = random_int (5) ? colors[0] :
+      colors[random_int (ncolors)];
+    for (i = 0; i < len && col < cols; i++, col++)
+      draw_char (x + col * CELL_W, y, random_int (4) ? 'a' + random_int (26) :
+                 '!' + random_int (94), fg, bg);
+    col++;
+  }
+}
+
+/*
+ * Desktop wallpaper: a diagonal gradient with a column of icons on the left
+ */
+
+static unsigned int wallpaper (int x, int y)
+{
+  int i = y / 96;
+  if (x >= 24 && x < 72 && y % 96 >= 24 && y % 96 < 72 &&
+      (i + 1) * 96 <= height)
+    return RGB (64 + (i * 53) % 192, 64 + (i * 97) % 192, 64 + (i * 31) % 192);
+  return RGB (30 + 50 * y / height, 70 + 60 * x / width,
+              120 + 80 * (x + y) / (width + height));
+}
+
+static void fill_wallpaper (int x, int y, int w, int h)
+{
+  int i, j;
+
+  if (x < 0) { w += x;  x = 0; }
+  if (y < 0) { h += y;  y = 0; }
+  if (x + w > width) w = width - x;
+  if (y + h > height) h = height - y;
+  for (j = y; j < y + h; j++) {
+    for (i = x; i < x + w; i++)
+      fb[(size_t)j * width + i] = wallpaper (i, j);
+  }
+}
+
+/* Draws an application window with a title bar and a few lines of text */
+static void draw_window (int x, int y, int w, int h)
+{
+  static const unsigned int text[] = {
+    RGB (0, 0, 0), RGB (0, 0, 160), RGB (160, 0, 0)
+  };
+  static const unsigned int title[] = { RGB (255, 255, 255) };
+  int row;
+
+  fill_rect (x, y, w, h, RGB (128, 128, 128));
+  fill_gradient (x + 1, y + 1, w - 2, 22, RGB (40, 80, 160),
+                 RGB (100, 150, 230), 0);
+  draw_words (x + 8, y + 4, min (16, (w - 16) / CELL_W), title, 1,
+              RGB (40, 80, 160));
+  fill_rect (x + 1, y + 23, w - 2, h - 24, RGB (255, 255, 255));
+  for (row = 0; (row + 1) * CELL_H <= h - 28; row++) {
+    if (random_int (4))
+      draw_words (x + 4, y + 26 + row * CELL_H,
+                  random_int ((w - 8) / CELL_W + 1), text, 3,
+                  RGB (255, 255, 255));
+  }
+}
+
+/*
+ * terminal: A full-screen terminal scrolling one line per frame, as when
+ * tailing a log.  Without CopyRect, the whole terminal changes every frame.
+ */
+
+static const unsigned int term_colors[] = {
+  RGB (204, 204, 204), RGB (78, 154, 6), RGB (52, 101, 164),
+  RGB (196, 160, 0), RGB (204, 0, 0)
+};
+
+static int term_rows;
+
+static void terminal_line (int row)
+{
+  fill_rect (0, row * CELL_H, width, CELL_H, RGB (0, 0, 0));
+  draw_words (0, row * CELL_H, random_int (width / CELL_W + 1), term_colors,
+              sizeof(term_colors) / sizeof(term_colors[0]), RGB (0, 0, 0));
+}
+
+static void terminal_init (void)
+{
+  int row;
+
+  set_canvas (fb, width, height);
+  fill_rect (0, 0, width, height, RGB (0, 0, 0));
+  term_rows = max (height / CELL_H, 1);
+  for (row = 0; row < term_rows; row++)
+    terminal_line (row);
+  add_damage (0, 0, width, height);
+}
+
+static void terminal_frame (int n)
+{
+  if (term_rows > 1)
+    memmove (fb, fb + (size_t)width * CELL_H,
+             (size_t)width * CELL_H * (term_rows - 1) * sizeof(unsigned int));
+  terminal_line (term_rows - 1);
+  add_damage (0, 0, width, term_rows * CELL_H);
+}
+
+/*
+ * drag: A window, half the width and height of the screen, dragged along a
+ * figure-eight path across the wallpaper.  Each frame changes the bounding
+ * box of the old and new window positions.
+ */
+
+#define DRAG_PERIOD 120         /* Frames per loop */
+
+static unsigned int *win_buf = NULL;
+static int win_w, win_h, win_x, win_y, drag_phase;
+
+static void drag_position (int n, int *x, int *y)
+{
+  double t = 2. * M_PI * (n + drag_phase) / DRAG_PERIOD;
+  *x = (int)((width - win_w) * (0.5 + 0.5 * sin (t)));
+  *y = (int)((height - win_h) * (0.5 + 0.5 * sin (2. * t)));
+}
+
+static void blit_window (int x, int y)
+{
+  int j;
+
+  for (j = 0; j < win_h; j++)
+    memcpy (&fb[(size_t)(y + j) * width + x], &win_buf[(size_t)j * win_w],
+            win_w * sizeof(unsigned int));
+}
+
+static void drag_init (void)
+{
+  win_w = max (width / 2, 1);
+  win_h = max (height / 2, 1);
+  free (win_buf);
+  if ((win_buf = (unsigned int *)malloc ((size_t)win_w * win_h *
+                                         sizeof(unsigned int))) == NULL) {
+    perror ("Cannot allocate window");
+    exit (1);
+  }
+  set_canvas (win_buf, win_w, win_h);
+  draw_window (0, 0, win_w, win_h);
+  set_canvas (fb, width, height);
+
+  drag_phase = random_int (DRAG_PERIOD);
+  fill_wallpaper (0, 0, width, height);
+  drag_position (0, &win_x, &win_y);
+  blit_window (win_x, win_y);
+  add_damage (0, 0, width, height);
+}
+
+static void drag_frame (int n)
+{
+  int x, y;
+
+  drag_position (n, &x, &y);
+  fill_wallpaper (win_x, win_y, win_w, win_h);
+  blit_window (x, y);
+  add_damage (min (x, win_x), min (y, win_y), abs (x - win_x) + win_w,
+              abs (y - win_y) + win_h);
+  win_x = x;
+  win_y = y;
+}
+
+/*
+ * video: Full-screen video.  The picture is a smooth interference pattern
+ * that moves every frame, with film grain, so nothing repeats and there are
+ * no solid areas.
+ */
+
+static unsigned char sine[1024];
+static int *video_x = NULL, *video_y = NULL;
+
+static void video_draw (int n)
+{
+  int x, y;
+
+  for (y = 0; y < height; y++) {
+    unsigned int *p = &fb[(size_t)y * width];
+    int b = sine[(video_y[y] + n * 5) & 1023];
+    for (x = 0; x < width; x++) {
+      int a = sine[(video_x[x] + n * 7) & 1023];
+      int c = sine[(video_x[x] * 2 / 3 + video_y[y] - n * 3) & 1023];
+      int grain = (int)(random32 () & 15) - 8;
+      int r = (a + b) / 2 + grain, g = (b + c) / 2 + grain,
+        bl = (a + c) / 2 + grain;
+      p[x] = RGB (min (max (r, 0), 255), min (max (g, 0), 255),
+                  min (max (bl, 0), 255));
+    }
+  }
+  add_damage (0, 0, width, height);
+}
+
+static void video_init (void)
+{
+  int i;
+
+  for (i = 0; i < 1024; i++)
+    sine[i] = (unsigned char)(128. + 127. * sin (2. * M_PI * i / 1024.));
+  free (video_x);
+  free (video_y);
+  video_x = (int *)malloc (width * sizeof(int));
+  video_y = (int *)malloc (height * sizeof(int));
+  if (!video_x || !video_y) {
+    perror ("Cannot allocate video tables");
+    exit (1);
+  }
+  /* Three periods across the screen and two down it */
+  for (i = 0; i < width; i++)
+    video_x[i] = (int)((long long)i * 3072 / width);
+  for (i = 0; i < height; i++)
+    video_y[i] = (int)((long long)i * 2048 / height);
+
+  set_canvas (fb, width, height);
+  video_draw (0);
+}
+
+static void video_frame (int n)
+{
+  video_draw (n);
+}
+
+/*
+ * cad: A CAD application with a toolbar, a side panel, and a viewport that
+ * shows shaded spheres orbiting the center under a rotating light, on a
+ * gradient background.  The whole viewport changes every frame, and most of
+ * it is smooth gradients.
+ */
+
+#define NSOLIDS 7
+
+static struct {
+  double radius, orbit, angle, speed;
+  unsigned int color;
+} solids[NSOLIDS];
+
+static int cad_x, cad_y, cad_w, cad_h;
+
+static void draw_sphere (int cx, int cy, double radius, unsigned int color,
+                         const double *light, const double *half)
+{
+  int x, y, r0 = color >> 16, g0 = (color >> 8) & 0xFF, b0 = color & 0xFF;
+  int ir = (int)radius + 1;
+  double edge = (1. - 1.5 / radius) * (1. - 1.5 / radius);
+
+  for (y = max (cy - ir, cad_y); y < min (cy + ir, cad_y + cad_h); y++) {
+    for (x = max (cx - ir, cad_x); x < min (cx + ir, cad_x + cad_w); x++) {
+      double dx = (x - cx) / radius, dy = (y - cy) / radius;
+      double d2 = dx * dx + dy * dy, nz, diffuse, spec;
+      int i;
+      if (d2 > 1.) continue;
+      if (d2 > edge) {
+        fb[(size_t)y * width + x] = RGB (24, 24, 24);
+        continue;
+      }
+      nz = sqrt (1. - d2);
+      diffuse = dx * light[0] + dy * light[1] + nz * light[2];
+      if (diffuse < 0.) diffuse = 0.;
+      spec = dx * half[0] + dy * half[1] + nz * half[2];
+      if (spec < 0.) spec = 0.;
+      for (i = 0; i < 5; i++)
+        spec *= spec;           /* Shininess 32 */
+      diffuse = 0.12 + 0.88 * diffuse;
+      spec *= 160.;
+      fb[(size_t)y * width + x] =
+        RGB (min ((int)(r0 * diffuse + spec), 255),
+             min ((int)(g0 * diffuse + spec), 255),
+             min ((int)(b0 * diffuse + spec), 255));
+    }
+  }
+}
+
+static void cad_draw (int n)
+{
+  double theta = 0.05 * n, light[3], half[3], len;
+  int order[NSOLIDS], cx[NSOLIDS], cy[NSOLIDS], i, j;
+
+  light[0] = 0.6 * cos (theta);
+  light[1] = -0.5;
+  light[2] = sqrt (1. - light[0] * light[0] - light[1] * light[1]);
+  len = sqrt (light[0] * light[0] + light[1] * light[1] +
+              (light[2] + 1.) * (light[2] + 1.));
+  half[0] = light[0] / len;
+  half[1] = light[1] / len;
+  half[2] = (light[2] + 1.) / len;
+
+  set_canvas (fb, width, height);
+  fill_gradient (cad_x, cad_y, cad_w, cad_h, RGB (40, 44, 52),
+                 RGB (160, 170, 185), 1);
+
+  /* Draw the spheres from the back (top) to the front (bottom) */
+  for (i = 0; i < NSOLIDS; i++) {
+    double a = solids[i].angle + solids[i].speed * n;
+    cx[i] = cad_x + cad_w / 2 + (int)(solids[i].orbit * cos (a));
+    cy[i] = cad_y + cad_h / 2 + (int)(solids[i].orbit * 0.5 * sin (a));
+    for (j = i; j > 0 && cy[order[j - 1]] > cy[i]; j--)
+      order[j] = order[j - 1];
+    order[j] = i;
+  }
+  for (i = 0; i < NSOLIDS; i++)
+    draw_sphere (cx[order[i]], cy[order[i]], solids[order[i]].radius,
+                 solids[order[i]].color, light, half);
+  add_damage (cad_x, cad_y, cad_w, cad_h);
+}
+
+static void cad_init (void)
+{
+  static const unsigned int colors[] = {
+    RGB (200, 60, 50), RGB (60, 140, 200), RGB (220, 180, 60),
+    RGB (90, 170, 90), RGB (170, 170, 170), RGB (150, 90, 190)
+  };
+  static const unsigned int text[] = { RGB (0, 0, 0), RGB (0, 0, 160) };
+  int i, panel_w = width / 6, toolbar_h = min (32, height / 8), size;
+
+  set_canvas (fb, width, height);
+  fill_rect (0, 0, width, toolbar_h, RGB (220, 220, 220));
+  for (i = 0; (i + 1) * 32 <= width && toolbar_h >= 28; i++)
+    fill_rect (i * 32 + 4, 4, 24, 24, colors[i % 6]);
+  fill_rect (width - panel_w, toolbar_h, panel_w, height - toolbar_h,
+             RGB (236, 236, 236));
+  for (i = 0; toolbar_h + (i + 1) * CELL_H <= height; i++)
+    draw_words (width - panel_w + 4 + (i % 3) * CELL_W,
+                toolbar_h + i * CELL_H, random_int (16) + 4, text, 2,
+                RGB (236, 236, 236));
+
+  cad_x = 0;
+  cad_y = toolbar_h;
+  cad_w = width - panel_w;
+  cad_h = height - toolbar_h;
+  size = min (cad_w, cad_h);
+  for (i = 0; i < NSOLIDS; i++) {
+    solids[i].radius = size * (0.05 + 0.1 * random_int (1000) / 1000.) + 1.;
+    solids[i].orbit = size * 0.4 * random_int (1000) / 1000.;
+    solids[i].angle = 2. * M_PI * random_int (1000) / 1000.;
+    solids[i].speed = (0.01 + 0.04 * random_int (1000) / 1000.) *
+      (random_int (2) ? 1. : -1.);
+    solids[i].color = colors[random_int (6)];
+  }
+
+  cad_draw (0);
+  add_damage (0, 0, width, height);
+}
+
+static void cad_frame (int n)
+{
+  cad_draw (n);
+}
+
+/*
+ * blink: A desktop with one small text window per 640x480 pixels, each with
+ * a blinking cursor.  Every frame, each cursor blinks, and the user types a
+ * character into one window in eight on average.  This is the many-small-
+ * rectangles regime: the changed areas are tiny and scattered.
+ */
+
+typedef struct {
+  int wx, wy, ww, wh;           /* Window */
+  int x, y;                     /* Cursor */
+  int on;
+} caret;
+
+static caret *carets = NULL;
+static int ncarets;
+
+static void blink_init (void)
+{
+  int i;
+
+  ncarets = max ((int)((long long)width * height / (640 * 480)), 1);
+  free (carets);
+  if ((carets = (caret *)calloc (ncarets, sizeof(caret))) == NULL) {
+    perror ("Cannot allocate cursors");
+    exit (1);
+  }
+
+  set_canvas (fb, width, height);
+  fill_wallpaper (0, 0, width, height);
+  for (i = 0; i < ncarets; i++) {
+    caret *c = &carets[i];
+    c->ww = min (40 * CELL_W + 8, width);
+    c->wh = min (10 * CELL_H + 28, height);
+    c->wx = random_int (width - c->ww + 1);
+    c->wy = random_int (height - c->wh + 1);
+    draw_window (c->wx, c->wy, c->ww, c->wh);
+    /* Start at a blank line, so that the cursor doesn't overwrite text */
+    c->x = c->wx + 4;
+    c->y = c->wy + 26 + max ((c->wh - 28) / CELL_H - 1, 0) * CELL_H;
+    fill_rect (c->wx + 1, c->y, c->ww - 2, CELL_H, RGB (255, 255, 255));
+  }
+  add_damage (0, 0, width, height);
+}
+
+static void blink_frame (int n)
+{
+  int i;
+
+  for (i = 0; i < ncarets; i++) {
+    caret *c = &carets[i];
+    int x = c->x, y = c->y;
+    if (random_int (8) == 0) {
+      draw_char (c->x, c->y, 'a' + random_int (26), RGB (0, 0, 0),
+                 RGB (255, 255, 255));
+      c->x += CELL_W;
+      if (c->x + CELL_W > c->wx + c->ww - 4) {
+        /* Start the line over */
+        c->x = c->wx + 4;
+        fill_rect (c->wx + 1, c->y, c->ww - 2, CELL_H, RGB (255, 255, 255));
+        x = c->wx + 1;
+      }
+    }
+    c->on = !c->on;
+    fill_rect (c->x, c->y, 2, CELL_H,
+               c->on ? RGB (0, 0, 0) : RGB (255, 255, 255));
+    add_damage (min (x, c->x), y, max (abs (c->x - x) + 2, c->x + 2 - x),
+                CELL_H);
+  }
+}
@@ -0,0 +1,72 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* fbswrite.c - session capture writer (see fbswrite.h) */
+
+#include <stdio.h>
+#include <string.h>
+#include "fbswrite.h"
+
+void fbsPut16(unsigned char *buf, int v)
+{
+  buf[0] = (unsigned char)(v >> 8);
+  buf[1] = (unsigned char)v;
+}
+
+void fbsPut32(unsigned char *buf, unsigned int v)
+{
+  buf[0] = (unsigned char)(v >> 24);
+  buf[1] = (unsigned char)(v >> 16);
+  buf[2] = (unsigned char)(v >> 8);
+  buf[3] = (unsigned char)v;
+}
+
+long fbsWriteServerInit(FILE *f, int width, int height, int depth,
+                        const char *name)
+{
+  unsigned char si[24];
+  size_t len = strlen(name);
+
+  memset(si, 0, sizeof(si));
+  fbsPut16(si, width);
+  fbsPut16(si + 2, height);
+  si[4] = depth == 24 ? 32 : depth;       /* bitsPerPixel */
+  si[5] = depth;
+  si[7] = 1;                              /* trueColour */
+  switch (depth) {
+  case 8:
+    fbsPut16(si + 8, 7);  fbsPut16(si + 10, 7);  fbsPut16(si + 12, 3);
+    si[14] = 0;  si[15] = 3;  si[16] = 6;
+    break;
+  case 16:
+    fbsPut16(si + 8, 31);  fbsPut16(si + 10, 63);  fbsPut16(si + 12, 31);
+    si[14] = 11;  si[15] = 5;  si[16] = 0;
+    break;
+  default:
+    fbsPut16(si + 8, 255);  fbsPut16(si + 10, 255);  fbsPut16(si + 12, 255);
+    si[14] = 16;  si[15] = 8;  si[16] = 0;
+  }
+  fbsPut32(si + 20, (unsigned int)len);
+
+  if (fwrite("RFB 003.008\n", 1, 12, f) != 12 ||
+      fwrite(si, 1, sizeof(si), f) != sizeof(si) ||
+      fwrite(name, 1, len, f) != len) {
+    perror("Cannot write output file");
+    return -1;
+  }
+  return (long)(12 + sizeof(si) + len);
+}
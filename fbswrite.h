@@ -0,0 +1,43 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * fbswrite.h - session capture writer
+ *
+ * The parts of a session capture that fbs-synth and fbs-import write in the
+ * same way.  A capture has the same format as the output of fbs-dump -i: a
+ * protocol version message and a ServerInit message, followed by the
+ * FramebufferUpdate messages.
+ */
+
+#ifndef __FBSWRITE_H__
+#define __FBSWRITE_H__
+
+#include <stdio.h>
+
+/* Store a big endian 16-bit or 32-bit value */
+extern void fbsPut16(unsigned char *buf, int v);
+extern void fbsPut32(unsigned char *buf, unsigned int v);
+
+/* Writes the protocol version message and a ServerInit message with the given
+   desktop name.  The pixel format is the one that compare-encodings sets up
+   for depth (8, 16, or 24; see InitEverything() in misc.c), little endian.
+   Returns the number of bytes written, or -1 if the write failed. */
+extern long fbsWriteServerInit(FILE *f, int width, int height, int depth,
+                               const char *name);
+
+#endif
@@ -46,9 +46,9 @@ x264_picture_t pic_in;
 Bool pic_init = FALSE;
 x264_t *encoder = NULL;
 unsigned char *yuvImage = NULL;
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 tjhandle tj = NULL;
 hnd_t output_handle = 0;
 int frames = 0;
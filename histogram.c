@@ -0,0 +1,115 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/* histogram.c - latency histograms (see histogram.h) */
+
+#include <stdio.h>
+#include <string.h>
+#include "histogram.h"
+
+static int bucket_index(unsigned long long value)
+{
+  int msb = 0, shift;
+
+  if (value < 2 * HISTOGRAM_SUB_BUCKETS)
+    return (int)value;
+  while (value >> (msb + 1)) msb++;
+  shift = msb - HISTOGRAM_SUB_BITS;
+  return (shift + 1) * HISTOGRAM_SUB_BUCKETS +
+    (int)(value >> shift) - HISTOGRAM_SUB_BUCKETS;
+}
+
+/* Returns the highest value that falls into the given bucket */
+static unsigned long long bucket_value(int index)
+{
+  int shift;
+  unsigned long long sub;
+
+  if (index < 2 * HISTOGRAM_SUB_BUCKETS)
+    return (unsigned long long)index;
+  shift = index / HISTOGRAM_SUB_BUCKETS - 1;
+  sub = index % HISTOGRAM_SUB_BUCKETS + HISTOGRAM_SUB_BUCKETS;
+  return ((sub + 1) << shift) - 1;
+}
+
+void rfbHistogramReset(rfbHistogram *h)
+{
+  memset(h, 0, sizeof(rfbHistogram));
+}
+
+void rfbHistogramRecord(rfbHistogram *h, double seconds)
+{
+  unsigned long long ns =
+    seconds > 0.0 ? (unsigned long long)(seconds * 1.0e9 + 0.5) : 0;
+
+  if (h->count == 0 || ns < h->min) h->min = ns;
+  if (ns > h->max) h->max = ns;
+  h->sum += seconds;
+  h->count++;
+  h->buckets[bucket_index(ns)]++;
+}
+
+void rfbHistogramAdd(rfbHistogram *h, const rfbHistogram *from)
+{
+  int i;
+
+  if (from->count == 0)
+    return;
+  if (h->count == 0 || from->min < h->min) h->min = from->min;
+  if (from->max > h->max) h->max = from->max;
+  h->sum += from->sum;
+  h->count += from->count;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++)
+    h->buckets[i] += from->buckets[i];
+}
+
+double rfbHistogramPercentile(const rfbHistogram *h, double percent)
+{
+  unsigned long target, seen = 0;
+  unsigned long long value;
+  int i;
+
+  if (h->count == 0)
+    return 0.0;
+  if (percent >= 100.0)
+    return (double)h->max * 1.0e-9;
+
+  target = (unsigned long)(percent / 100.0 * (double)h->count + 0.999999);
+  if (target < 1) target = 1;
+  for (i = 0; i < HISTOGRAM_BUCKETS; i++) {
+    seen += h->buckets[i];
+    if (seen >= target) break;
+  }
+  value = bucket_value(i);
+  if (value > h->max) value = h->max;
+  if (value < h->min) value = h->min;
+  return (double)value * 1.0e-9;
+}
+
+void rfbHistogramPrintRow(const char *name, const char *what,
+                          const rfbHistogram *h, double mpps)
+{
+  printf("%-12.12s %-6s %8.3f %8.3f %8.3f %8.3f %8.3f", name, what,
+         rfbHistogramPercentile(h, 50.) * 1000.,
+         rfbHistogramPercentile(h, 90.) * 1000.,
+         rfbHistogramPercentile(h, 99.) * 1000.,
+         rfbHistogramPercentile(h, 99.9) * 1000.,
+         rfbHistogramPercentile(h, 100.) * 1000.);
+  if (mpps >= 0.) printf(" %10.2f", mpps);
+  printf("\n");
+}
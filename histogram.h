@@ -0,0 +1,56 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/*
+ * histogram.h - latency histograms
+ *
+ * Values are recorded in nanoseconds into log-linear buckets, in the style of
+ * HdrHistogram: each power of two is split into 64 linear sub-buckets, so a
+ * reported percentile is within 1/64 of the recorded value over the whole
+ * range while the histogram stays a fixed size.
+ */
+
+#ifndef __HISTOGRAM_H__
+#define __HISTOGRAM_H__
+
+#define HISTOGRAM_SUB_BITS 6
+#define HISTOGRAM_SUB_BUCKETS (1 << HISTOGRAM_SUB_BITS)
+#define HISTOGRAM_BUCKETS \
+  ((64 - HISTOGRAM_SUB_BITS + 1) * HISTOGRAM_SUB_BUCKETS)
+
+typedef struct {
+  unsigned long count;
+  unsigned long long min, max;   /* Nanoseconds */
+  double sum;                    /* Seconds */
+  unsigned long buckets[HISTOGRAM_BUCKETS];
+} rfbHistogram;
+
+extern void rfbHistogramReset(rfbHistogram *h);
+extern void rfbHistogramRecord(rfbHistogram *h, double seconds);
+extern void rfbHistogramAdd(rfbHistogram *h, const rfbHistogram *from);
+
+/* Returns the value (in seconds) at or below which the given percentage of
+   the recorded values fall */
+extern double rfbHistogramPercentile(const rfbHistogram *h, double percent);
+
+/* Prints one row of a latency table: the p50/p90/p99/p99.9/max values in
+   milliseconds, followed by the throughput if mpps >= 0 */
+extern void rfbHistogramPrintRow(const char *name, const char *what,
+                                 const rfbHistogram *h, double mpps);
+
+#endif /* __HISTOGRAM_H__ */
@@ -0,0 +1,306 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* index.c - session capture index (see index.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include "index.h"
+
+/*
+ * The file starts with a header, followed by the compressed checkpoints in
+ * the order in which they were added, followed by the update offsets and the
+ * checkpoint table.  The header is written last, so a file that was cut short
+ * is never mistaken for a complete index.
+ */
+
+#define INDEX_MAGIC "RFBIDX01"
+#define INDEX_SUFFIX ".index"
+
+typedef struct {
+  char magic[8];
+  rfbIndexKey key;
+  unsigned long long nUpdates, nCheckpoints;
+  unsigned long long tableOffset;
+} index_header;
+
+Bool rfbIndexGetKey(rfbIndexKey *key, const char *capture)
+{
+  struct stat st;
+
+  if (stat(capture, &st) != 0 || !S_ISREG(st.st_mode))
+    return FALSE;
+  key->captureSize = (unsigned long long)st.st_size;
+  key->captureTime = (unsigned long long)st.st_mtime;
+  return TRUE;
+}
+
+static Bool set_path(rfbCaptureIndex *idx, const char *capture)
+{
+  memset(idx, 0, sizeof(rfbCaptureIndex));
+  if ((idx->path = (char *)malloc(strlen(capture) +
+                                  sizeof(INDEX_SUFFIX))) == NULL)
+    return FALSE;
+  sprintf(idx->path, "%s%s", capture, INDEX_SUFFIX);
+  return TRUE;
+}
+
+Bool rfbIndexOpen(rfbCaptureIndex *idx, const char *capture,
+                  const rfbIndexKey *key)
+{
+  index_header hdr;
+  unsigned long long i, *updates = NULL;
+
+  if (!set_path(idx, capture))
+    return FALSE;
+  if ((idx->file = fopen(idx->path, "rb")) == NULL)
+    goto bailout;
+  if (fread(&hdr, sizeof(hdr), 1, idx->file) != 1 ||
+      memcmp(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic)) != 0 ||
+      memcmp(&hdr.key, key, sizeof(rfbIndexKey)) != 0)
+    goto bailout;
+
+  idx->key = hdr.key;
+  idx->nUpdates = idx->maxUpdates = hdr.nUpdates;
+  idx->nCheckpoints = idx->maxCheckpoints = hdr.nCheckpoints;
+  idx->updates = (off_t *)malloc((hdr.nUpdates + 1) * sizeof(off_t));
+  updates = (unsigned long long *)malloc((hdr.nUpdates + 1) *
+                                         sizeof(unsigned long long));
+  idx->checkpoints = (rfbCheckpoint *)malloc((hdr.nCheckpoints + 1) *
+                                             sizeof(rfbCheckpoint));
+  if (!idx->updates || !updates || !idx->checkpoints ||
+      fseeko(idx->file, (off_t)hdr.tableOffset, SEEK_SET) != 0 ||
+      fread(updates, sizeof(unsigned long long), hdr.nUpdates, idx->file)
+        != hdr.nUpdates ||
+      fread(idx->checkpoints, sizeof(rfbCheckpoint), hdr.nCheckpoints,
+            idx->file) != hdr.nCheckpoints)
+    goto bailout;
+  for (i = 0; i < hdr.nUpdates; i++)
+    idx->updates[i] = (off_t)updates[i];
+  free(updates);
+  return TRUE;
+
+  bailout:
+  free(updates);
+  rfbIndexClose(idx);
+  return FALSE;
+}
+
+Bool rfbIndexCreate(rfbCaptureIndex *idx, const char *capture,
+                    const rfbIndexKey *key)
+{
+  index_header hdr;
+
+  if (!set_path(idx, capture))
+    return FALSE;
+  idx->key = *key;
+
+  /* Concurrent builders each write their own temporary file, and the last
+     one to finish wins. */
+  if ((idx->tmpPath = (char *)malloc(strlen(idx->path) + 32)) == NULL)
+    goto bailout;
+  sprintf(idx->tmpPath, "%s.%d.tmp", idx->path, (int)getpid());
+  if ((idx->file = fopen(idx->tmpPath, "w+b")) == NULL)
+    goto bailout;
+
+  memset(&hdr, 0, sizeof(hdr));
+  if (fwrite(&hdr, sizeof(hdr), 1, idx->file) != 1)
+    goto bailout;
+  return TRUE;
+
+  bailout:
+  perror("Cannot create capture index");
+  rfbIndexClose(idx);
+  return FALSE;
+}
+
+Bool rfbIndexAddUpdate(rfbCaptureIndex *idx, off_t offset)
+{
+  if (idx->nUpdates >= idx->maxUpdates) {
+    unsigned long long newMax = idx->maxUpdates ? idx->maxUpdates * 2 : 4096;
+    off_t *newUpdates = (off_t *)realloc(idx->updates,
+                                         newMax * sizeof(off_t));
+    if (!newUpdates) {
+      perror("Cannot allocate capture index");
+      return FALSE;
+    }
+    idx->updates = newUpdates;
+    idx->maxUpdates = newMax;
+  }
+  idx->updates[idx->nUpdates++] = offset;
+  return TRUE;
+}
+
+/* The checkpoint is taken before the update at the given offset, which is
+   added next. */
+Bool rfbIndexAddCheckpoint(rfbCaptureIndex *idx, off_t offset,
+                           const char *fb, int pitch, int width, int height,
+                           int pixelBytes)
+{
+  rfbCheckpoint *cp;
+  size_t rowSize = (size_t)width * pixelBytes;
+  uLongf size = compressBound((uLong)(rowSize * height));
+  char *packed = (char *)malloc(rowSize * height);
+  Bytef *data = (Bytef *)malloc(size);
+  int y;
+
+  if (!packed || !data) {
+    perror("Cannot allocate checkpoint");
+    goto bailout;
+  }
+  if (idx->nCheckpoints >= idx->maxCheckpoints) {
+    unsigned long long newMax =
+      idx->maxCheckpoints ? idx->maxCheckpoints * 2 : 64;
+    rfbCheckpoint *newCheckpoints =
+      (rfbCheckpoint *)realloc(idx->checkpoints,
+                               newMax * sizeof(rfbCheckpoint));
+    if (!newCheckpoints) {
+      perror("Cannot allocate capture index");
+      goto bailout;
+    }
+    idx->checkpoints = newCheckpoints;
+    idx->maxCheckpoints = newMax;
+  }
+
+  /* Speed matters more than size here, since the checkpoints are far apart
+     and mostly restored from the page cache. */
+  for (y = 0; y < height; y++)
+    memcpy(&packed[rowSize * y], &fb[(size_t)pitch * y], rowSize);
+  if (compress2(data, &size, (const Bytef *)packed, (uLong)(rowSize * height),
+                Z_BEST_SPEED) != Z_OK) {
+    fprintf(stderr, "Cannot compress checkpoint\n");
+    goto bailout;
+  }
+
+  cp = &idx->checkpoints[idx->nCheckpoints];
+  cp->update = idx->nUpdates;
+  cp->offset = (unsigned long long)offset;
+  cp->width = width;
+  cp->height = height;
+  cp->dataOffset = (unsigned long long)ftello(idx->file);
+  cp->dataSize = size;
+  if (fwrite(data, 1, size, idx->file) != size) {
+    perror("Cannot write capture index");
+    goto bailout;
+  }
+  idx->nCheckpoints++;
+  free(packed);
+  free(data);
+  return TRUE;
+
+  bailout:
+  free(packed);
+  free(data);
+  return FALSE;
+}
+
+Bool rfbIndexFinish(rfbCaptureIndex *idx)
+{
+  index_header hdr;
+  unsigned long long i;
+
+  memcpy(hdr.magic, INDEX_MAGIC, sizeof(hdr.magic));
+  hdr.key = idx->key;
+  hdr.nUpdates = idx->nUpdates;
+  hdr.nCheckpoints = idx->nCheckpoints;
+  hdr.tableOffset = (unsigned long long)ftello(idx->file);
+
+  for (i = 0; i < idx->nUpdates; i++) {
+    unsigned long long offset = (unsigned long long)idx->updates[i];
+    if (fwrite(&offset, sizeof(offset), 1, idx->file) != 1)
+      goto bailout;
+  }
+  if (fwrite(idx->checkpoints, sizeof(rfbCheckpoint), idx->nCheckpoints,
+             idx->file) != idx->nCheckpoints ||
+      fseeko(idx->file, 0, SEEK_SET) != 0 ||
+      fwrite(&hdr, sizeof(hdr), 1, idx->file) != 1 ||
+      fflush(idx->file) != 0)
+    goto bailout;
+  if (rename(idx->tmpPath, idx->path) != 0)
+    goto bailout;
+  free(idx->tmpPath);
+  idx->tmpPath = NULL;
+  return TRUE;
+
+  bailout:
+  perror("Cannot write capture index");
+  return FALSE;
+}
+
+const rfbCheckpoint *rfbIndexFindCheckpoint(rfbCaptureIndex *idx,
+                                            unsigned long long update)
+{
+  unsigned long long lo = 0, hi = idx->nCheckpoints;
+
+  if (hi < 1 || idx->checkpoints[0].update > update)
+    return NULL;
+  while (hi - lo > 1) {
+    unsigned long long mid = (lo + hi) / 2;
+    if (idx->checkpoints[mid].update <= update) lo = mid;
+    else hi = mid;
+  }
+  return &idx->checkpoints[lo];
+}
+
+Bool rfbIndexRestore(rfbCaptureIndex *idx, const rfbCheckpoint *cp, char *fb,
+                     int pitch, int pixelBytes)
+{
+  size_t rowSize = (size_t)cp->width * pixelBytes;
+  uLongf size = (uLongf)(rowSize * cp->height);
+  Bytef *data = (Bytef *)malloc((size_t)cp->dataSize);
+  char *packed = (char *)malloc(rowSize * cp->height);
+  Bool status = FALSE;
+  unsigned long long y;
+
+  if (!data || !packed) {
+    perror("Cannot allocate checkpoint");
+    goto bailout;
+  }
+  if (fseeko(idx->file, (off_t)cp->dataOffset, SEEK_SET) != 0 ||
+      fread(data, 1, (size_t)cp->dataSize, idx->file) != cp->dataSize) {
+    perror("Cannot read capture index");
+    goto bailout;
+  }
+  if (uncompress((Bytef *)packed, &size, data, (uLong)cp->dataSize) != Z_OK ||
+      size != rowSize * cp->height) {
+    fprintf(stderr, "Checkpoint at update %llu is corrupt\n", cp->update);
+    goto bailout;
+  }
+  for (y = 0; y < cp->height; y++)
+    memcpy(&fb[(size_t)pitch * y], &packed[rowSize * y], rowSize);
+  status = TRUE;
+
+  bailout:
+  free(data);
+  free(packed);
+  return status;
+}
+
+void rfbIndexClose(rfbCaptureIndex *idx)
+{
+  if (idx->file) fclose(idx->file);
+  if (idx->tmpPath) unlink(idx->tmpPath);
+  free(idx->tmpPath);
+  free(idx->path);
+  free(idx->updates);
+  free(idx->checkpoints);
+  memset(idx, 0, sizeof(rfbCaptureIndex));
+}
@@ -0,0 +1,94 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * index.h - session capture index
+ *
+ * The index of a capture holds the file offset of each FramebufferUpdate
+ * message and, every so many updates, a checkpoint: a zlib-compressed copy of
+ * the whole framebuffer as it was before that update.  Restoring the nearest
+ * checkpoint and replaying the updates after it reproduces the framebuffer at
+ * any update without decoding the capture from the start.
+ *
+ * The index is built by one pass over the capture and cached in a file next
+ * to it.  The cache is only used if it was built from a capture of the same
+ * size and modification time, with the same key (the framebuffer pixels
+ * depend on the pixel format and on -r, among other things.)  It is written
+ * in host byte order, since it is only meant to be read on the machine that
+ * wrote it.
+ */
+
+#ifndef __INDEX_H__
+#define __INDEX_H__
+
+#include <stdio.h>
+#include <sys/types.h>
+#include "rfb.h"
+
+typedef struct {
+  unsigned long long captureSize, captureTime;
+  unsigned long long depth, flip;       /* -8/-16/-24 and -r */
+  unsigned long long width, height;     /* Default framebuffer size */
+  unsigned long long interval;          /* Updates between checkpoints */
+} rfbIndexKey;
+
+typedef struct {
+  unsigned long long update;            /* The update that follows */
+  unsigned long long offset;            /* File offset of that update */
+  unsigned long long width, height;
+  unsigned long long dataOffset, dataSize;
+} rfbCheckpoint;
+
+typedef struct {
+  FILE *file;
+  char *path, *tmpPath;                 /* tmpPath is set while building */
+  rfbIndexKey key;
+  unsigned long long nUpdates, maxUpdates;
+  off_t *updates;
+  unsigned long long nCheckpoints, maxCheckpoints;
+  rfbCheckpoint *checkpoints;
+} rfbCaptureIndex;
+
+/* Fills in the capture size and modification time of the key */
+extern Bool rfbIndexGetKey(rfbIndexKey *key, const char *capture);
+
+/* Opens the cached index of the capture.  Returns FALSE if there is none or
+   if it doesn't match the key. */
+extern Bool rfbIndexOpen(rfbCaptureIndex *idx, const char *capture,
+                         const rfbIndexKey *key);
+
+/* Starts building a new index.  The updates and checkpoints must be added in
+   order, and the index is cached by rfbIndexFinish(). */
+extern Bool rfbIndexCreate(rfbCaptureIndex *idx, const char *capture,
+                           const rfbIndexKey *key);
+extern Bool rfbIndexAddUpdate(rfbCaptureIndex *idx, off_t offset);
+extern Bool rfbIndexAddCheckpoint(rfbCaptureIndex *idx, off_t offset,
+                                  const char *fb, int pitch, int width,
+                                  int height, int pixelBytes);
+extern Bool rfbIndexFinish(rfbCaptureIndex *idx);
+
+/* Returns the last checkpoint at or before the given update */
+extern const rfbCheckpoint *rfbIndexFindCheckpoint(rfbCaptureIndex *idx,
+                                                   unsigned long long update);
+
+/* Decompresses a checkpoint into a framebuffer of its size */
+extern Bool rfbIndexRestore(rfbCaptureIndex *idx, const rfbCheckpoint *cp,
+                            char *fb, int pitch, int pixelBytes);
+
+extern void rfbIndexClose(rfbCaptureIndex *idx);
+
+#endif /* __INDEX_H__ */
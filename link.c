@@ -0,0 +1,114 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* link.c - emulated network link (see link.h) */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "link.h"
+
+#ifndef max
+ #define max(a,b) ((a)>(b)?(a):(b))
+#endif
+
+/* Size of a FramebufferUpdate message header */
+#define UPDATE_HEADER_SIZE 4
+
+int rfbLinkParseProfile(rfbLinkProfile *profile, const char *s)
+{
+  const char *spec = s;
+  char *end;
+  double bandwidth, rtt;
+
+  bandwidth = strtod(s, &end);
+  switch (*end) {
+  case 'k':  case 'K':  bandwidth *= 1000.;  end++;  break;
+  case 'm':  case 'M':  bandwidth *= 1000000.;  end++;  break;
+  case 'g':  case 'G':  bandwidth *= 1000000000.;  end++;  break;
+  }
+  if (end == s || *end != '/' || bandwidth <= 0.)
+    return 0;
+  s = end + 1;
+  rtt = strtod(s, &end);
+  if (end == s || (*end != '\0' && strcmp(end, "ms")) || rtt < 0.)
+    return 0;
+
+  snprintf(profile->name, sizeof(profile->name), "%.*s/%gms",
+           (int)(s - 1 - spec), spec, rtt);
+  profile->bandwidth = bandwidth;
+  profile->rtt = rtt / 1000.;
+  return 1;
+}
+
+void rfbLinkReset(rfbLink *link, const rfbLinkProfile *profile)
+{
+  memset(link, 0, sizeof(rfbLink));
+  link->profile = profile;
+  /* The first request is sent at time 0. */
+  link->tRequest = profile->rtt / 2.;
+  rfbHistogramReset(&link->latency);
+}
+
+static void transmit(rfbLink *link, unsigned long long bytes)
+{
+  double t = (double)bytes * 8. / link->profile->bandwidth;
+
+  link->tLink = max(link->tEncode, link->tLink) + t;
+  link->tBusy += t;
+  link->bytes += bytes;
+}
+
+void rfbLinkRect(rfbLink *link, unsigned long long bytes, double tEncode,
+                 double tDecode)
+{
+  double tArrive;
+
+  if (!link->inUpdate) {
+    /* The server can't start encoding the update until it has received the
+       request and finished encoding the previous update. */
+    link->tStart = link->tEncode = max(link->tRequest, link->tEncode);
+    transmit(link, UPDATE_HEADER_SIZE);
+    link->inUpdate = 1;
+  }
+  link->tEncode += tEncode;
+  transmit(link, bytes);
+  tArrive = link->tLink + link->profile->rtt / 2.;
+  link->tDecode = max(tArrive, link->tDecode) + tDecode;
+}
+
+void rfbLinkEndUpdate(rfbLink *link)
+{
+  if (!link->inUpdate) return;
+  rfbHistogramRecord(&link->latency, link->tDecode - link->tStart);
+  link->tRequest = link->tDecode + link->profile->rtt / 2.;
+  link->updates++;
+  link->inUpdate = 0;
+}
+
+void rfbLinkPrintRow(const char *name, const char *codec,
+                     const rfbLink *link)
+{
+  double elapsed = link->tDecode;
+
+  printf("%-14.14s %-12.12s %9.2f %9.3f %9.3f %9.3f %8.1f%%\n", name, codec,
+         elapsed > 0. ? (double)link->updates / elapsed : 0.,
+         rfbHistogramPercentile(&link->latency, 50.) * 1000.,
+         rfbHistogramPercentile(&link->latency, 99.) * 1000.,
+         rfbHistogramPercentile(&link->latency, 100.) * 1000.,
+         elapsed > 0. ? link->tBusy * 100. / elapsed : 0.);
+}
@@ -0,0 +1,88 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * link.h - emulated network link
+ *
+ * The per-rectangle byte counts and encoding/decoding times are replayed
+ * through a model of a viewer connected to the server by a link with a given
+ * bandwidth and round-trip time, in order to estimate the update rate and the
+ * update latency that a user would see.  The model assumes that the screen
+ * always has something new to send, so the update rate is the best that the
+ * codec can achieve on that link.
+ *
+ * As with most RFB viewers, there is one FramebufferUpdateRequest outstanding
+ * at a time, and the viewer requests the next update once it has finished
+ * decoding the current one.  The request takes half of the round-trip time to
+ * reach the server.  The server then encodes the rectangles one at a time,
+ * and each rectangle is transmitted as soon as it has been encoded and the
+ * link is free, so encoding overlaps with transmission.  Each rectangle
+ * reaches the viewer half of the round-trip time after it has been
+ * transmitted, and the viewer decodes the rectangles in order as they arrive.
+ * The latency of an update is the time from when the server starts encoding
+ * it to when the viewer has decoded it.
+ */
+
+#ifndef __LINK_H__
+#define __LINK_H__
+
+#include "histogram.h"
+
+typedef struct {
+  char name[32];
+  double bandwidth;  /* Bits per second */
+  double rtt;        /* Seconds */
+} rfbLinkProfile;
+
+typedef struct {
+  const rfbLinkProfile *profile;
+  int inUpdate;
+  double tRequest;   /* When the request for the next update reaches the
+                        server */
+  double tStart;     /* When the server started encoding the current update */
+  double tEncode;    /* When the server finishes encoding the last rectangle */
+  double tLink;      /* When the link finishes transmitting the last
+                        rectangle */
+  double tDecode;    /* When the viewer finishes decoding the last
+                        rectangle */
+  double tBusy;      /* Total time that the link has spent transmitting */
+  unsigned long long bytes;
+  unsigned long updates;
+  rfbHistogram latency;
+} rfbLink;
+
+/* Parses a profile of the form <bandwidth>/<RTT>, where the bandwidth is in
+   bits/second with an optional k, M, or G suffix, and the RTT is in
+   milliseconds (for instance, 20M/50).  Returns 0 if the profile is
+   invalid. */
+extern int rfbLinkParseProfile(rfbLinkProfile *profile, const char *s);
+
+extern void rfbLinkReset(rfbLink *link, const rfbLinkProfile *profile);
+
+/* Adds a rectangle of the given size to the current update */
+extern void rfbLinkRect(rfbLink *link, unsigned long long bytes,
+                        double tEncode, double tDecode);
+
+extern void rfbLinkEndUpdate(rfbLink *link);
+
+/* Prints one row of the link table: the update rate, the p50/p99/max update
+   latency in milliseconds, and the fraction of the time that the link was
+   busy */
+extern void rfbLinkPrintRow(const char *name, const char *codec,
+                            const rfbLink *link);
+
+#endif /* __LINK_H__ */
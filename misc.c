@@ -23,13 +23,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdarg.h>
+#include <limits.h>
 #include "rfb.h"
+#include "pipeline.h"
 
 extern Bool rfbSetTranslateFunction(rfbClientPtr cl);
 extern FILE *out;
 
 char updateBuf[UPDATE_BUF_SIZE], *sendBuf=NULL;
-int ublen, sblen=0, sbptr=0;
+int ublen, sblen=0, sbptr=0, sendBufSize=0;
 
 rfbClientRec rfbClient;
 rfbScreenInfo rfbScreen;
@@ -37,16 +39,35 @@ rfbPixelFormat rfbServerFormat;
 
 XImage _image, *image=&_image;
 
+int rfbFramebufferGeneration = 0;
+
+/*
+ * Framebuffer rows are padded to a multiple of the cache line size, and the
+ * framebuffers are page-aligned, so that a row never starts in the middle of
+ * a cache line.
+ */
+
+#define FB_ROW_ALIGN 64
+#define FB_ALIGN 4096
+
+static char *AllocFramebuffer(char *buf, size_t size)
+{
+  void *ptr = NULL;
+  free(buf);
+  if (posix_memalign(&ptr, FB_ALIGN, size) != 0)
+    return NULL;
+  return (char *)ptr;
+}
+
 #ifdef ICE_SUPPORTED
 Bool InterframeOn(rfbClientPtr cl)
 {
   if (!cl->compareFB) {
-    if (!(cl->compareFB = (char *)malloc(rfbScreen.paddedWidthInBytes *
-                                         rfbScreen.height))) {
+    if (!(cl->compareFB = AllocFramebuffer(NULL, rfbScreen.sizeInBytes))) {
       rfbLogPerror("InterframeOn: couldn't allocate comparison buffer");
       return FALSE;
     }
-    memset(cl->compareFB, 0, rfbScreen.paddedWidthInBytes * rfbScreen.height);
+    memset(cl->compareFB, 0, rfbScreen.sizeInBytes);
     cl->firstCompare = TRUE;
     rfbLog("Interframe comparison enabled\n");
   }
@@ -55,7 +76,89 @@ Bool InterframeOn(rfbClientPtr cl)
 }
 #endif
 
-void InitEverything (int color_depth)
+/*
+ * (Re)allocate the framebuffer, the decoded framebuffer (image), the send
+ * buffer, and the interframe comparison buffer for the given framebuffer
+ * size.  This is a no-op if the size hasn't changed.  Otherwise, all of the
+ * buffers move, so rfbFramebufferGeneration is incremented to tell the
+ * encoders and decoders that cache pointers to them.  Fails if a buffer would
+ * be larger than INT_MAX bytes.
+ */
+
+Bool rfbResizeFramebuffer(int width, int height)
+{
+  int ps = rfbServerFormat.bitsPerPixel / 8;
+  size_t pitch, size, pixels, sendSize;
+
+  if (width < 1 || height < 1) {
+    rfbLog("Invalid framebuffer size %dx%d\n", width, height);
+    return FALSE;
+  }
+  if (rfbScreen.pfbMemory && width == rfbScreen.width &&
+      height == rfbScreen.height && rfbScreen.bitsPerPixel == ps * 8)
+    return TRUE;
+
+  /* The sizes of the framebuffer and the send buffer are stored in ints, so
+     each product is checked before it is computed. */
+  if (width > (INT_MAX - (FB_ROW_ALIGN - 1)) / ps)
+    goto tooLarge;
+  pitch = ((size_t)width * ps + FB_ROW_ALIGN - 1) &
+          ~(size_t)(FB_ROW_ALIGN - 1);
+  if ((size_t)height > INT_MAX / pitch)
+    goto tooLarge;
+  size = pitch * height;
+
+  /* The send buffer must be big enough to hold a full-screen rectangle,
+     encoded using the worst case (raw) */
+  pixels = (size_t)width * height;
+  if (pixels > (INT_MAX - pixels / 4) / 4)
+    goto tooLarge;
+  sendSize = pixels * 4 + pixels / 4;
+  if (sendSize < SEND_BUF_SIZE) sendSize = SEND_BUF_SIZE;
+
+  rfbScreen.width = width;
+  rfbScreen.height = height;
+  rfbScreen.bitsPerPixel = ps * 8;
+  rfbScreen.paddedWidthInBytes = (int)pitch;
+  rfbScreen.sizeInBytes = (int)size;
+  sendBufSize = (int)sendSize;
+
+  image->width = width;
+  image->height = height;
+  image->bits_per_pixel = rfbScreen.bitsPerPixel;
+  image->bytes_per_line = rfbScreen.paddedWidthInBytes;
+
+  if (!(rfbScreen.pfbMemory = AllocFramebuffer(rfbScreen.pfbMemory, size)) ||
+      !(image->data = AllocFramebuffer(image->data, size)) ||
+      !(sendBuf = AllocFramebuffer(sendBuf, sendBufSize))) {
+    rfbLogPerror("rfbResizeFramebuffer: couldn't allocate framebuffer");
+    return FALSE;
+  }
+  memset(rfbScreen.pfbMemory, 0, size);
+  memset(image->data, 0, size);
+
+#ifdef ICE_SUPPORTED
+  if (rfbClient.compareFB) {
+    if (!(rfbClient.compareFB = AllocFramebuffer(rfbClient.compareFB, size))) {
+      rfbLogPerror("rfbResizeFramebuffer: couldn't allocate comparison buffer");
+      return FALSE;
+    }
+    memset(rfbClient.compareFB, 0, size);
+    rfbClient.firstCompare = TRUE;
+    rfbClient.fb = rfbClient.compareFB;
+  } else
+#endif
+  rfbClient.fb = rfbScreen.pfbMemory;
+
+  rfbFramebufferGeneration++;
+  return TRUE;
+
+  tooLarge:
+  rfbLog("Framebuffer size %dx%d is too large\n", width, height);
+  return FALSE;
+}
+
+void InitEverything (int color_depth, int width, int height)
 {
   memset(&rfbClient, 0, sizeof(rfbClient));
 
@@ -74,7 +177,6 @@ void InitEverything (int color_depth)
   rfbServerFormat.bigEndian = 0;
   #endif
   rfbServerFormat.trueColour = 1;
-  rfbScreen.bitsPerPixel = rfbClient.format.bitsPerPixel;
 
   switch (color_depth) {
   case 8:
@@ -136,25 +238,11 @@ void InitEverything (int color_depth)
 
   rfbSetTranslateFunction(&rfbClient);
 
-  sendBuf = (char *)malloc(SEND_BUF_SIZE);
-  if (!sendBuf) {
-    printf("ERROR: Could not allocate send buffer.\n");
+  if (!rfbResizeFramebuffer(width, height))
     exit(1);
-  }
 
   ublen = 0;
 
-  image->width = 1280;
-  image->height = 1024;
-  image->bits_per_pixel = rfbServerFormat.bitsPerPixel;
-  image->bytes_per_line = ((image->width * image->bits_per_pixel / 8) + 3) & (~3);
-  image->data = (char *)malloc(image->width * image->bytes_per_line);
-
-  rfbScreen.width = image->width;
-  rfbScreen.height = image->height;
-  rfbScreen.paddedWidthInBytes = image->bytes_per_line;
-  rfbScreen.sizeInBytes = image->height * image->bytes_per_line;
-
   if (out) {
     rfbServerInitMsg si;
     char *name = "TurboVNC Benchmark";
@@ -174,8 +262,11 @@ extern int decompress;
 
 BOOL rfbSendUpdateBuf(rfbClientPtr cl)
 {
-  if(decompress) {
-    if (sblen + ublen > SEND_BUF_SIZE) {
+  if (rfbPipelineActive) {
+    if (!rfbPipelineWrite(updateBuf, ublen))
+      return False;
+  } else if(decompress) {
+    if (sblen + ublen > sendBufSize) {
       printf("ERROR: Send buffer overrun.\n");
       return False;
     }
@@ -190,8 +281,10 @@ BOOL rfbSendUpdateBuf(rfbClientPtr cl)
 Bool
 ReadFromRFBServer(char *out, unsigned int n)
 {
-  if (sbptr + n > SEND_BUF_SIZE) {
-    printf("ERROR: Send buffer overrun. %d %d %d\n", sbptr, n, SEND_BUF_SIZE);
+  if (rfbPipelineActive)
+    return rfbPipelineRead(out, n);
+  if (sbptr + n > sendBufSize) {
+    printf("ERROR: Send buffer overrun. %d %d %d\n", sbptr, n, sendBufSize);
     return False;
   }
   memcpy(out, &sendBuf[sbptr], n);
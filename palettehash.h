@@ -0,0 +1,167 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * palettehash.h - palette tables shared by the Tight and ZRLE encoders
+ *
+ * rfbPaletteHash maps up to 256 pixel values to 8-bit indices.  It is a flat
+ * open-addressing table with RFB_PALETTE_SLOTS slots (twice the largest
+ * palette), so it is never more than half full.  A pixel value hashes
+ * straight to a slot, and a lookup walks forward from there until it finds
+ * the value or an empty slot, which usually takes one or two compares within
+ * the same cache line.  Nothing is ever removed, so resetting the table only
+ * clears the flags that mark slots as in use.  The table must be zeroed
+ * before it is first used.
+ *
+ * rfbPalette adds the bookkeeping that the Tight encoders need on top of
+ * that:  the number of pixels of each color, with the entries sorted so that
+ * index 0 is the most common color.
+ */
+
+#ifndef __PALETTEHASH_H__
+#define __PALETTEHASH_H__
+
+#include <string.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RFB_PALETTE_MAX_COLORS 256
+#define RFB_PALETTE_HASH_BITS  9
+#define RFB_PALETTE_SLOTS      (1 << RFB_PALETTE_HASH_BITS)
+
+typedef struct {
+  unsigned int key[RFB_PALETTE_SLOTS];
+  unsigned char index[RFB_PALETTE_SLOTS];
+  unsigned char used[RFB_PALETTE_SLOTS];
+} rfbPaletteHash;
+
+typedef struct {
+  unsigned int color;
+  int numPixels;
+  int slot;                     /* Where the color is in the hash table */
+} rfbPaletteEntry;
+
+typedef struct {
+  rfbPaletteHash hash;
+  rfbPaletteEntry entry[RFB_PALETTE_MAX_COLORS];
+  int numColors;
+} rfbPalette;
+
+
+static inline void rfbPaletteHashReset(rfbPaletteHash *h)
+{
+  memset(h->used, 0, sizeof(h->used));
+}
+
+/* Returns the slot that holds the key, or -1 minus the free slot where the
+   key would go if it isn't in the table */
+
+static inline int rfbPaletteHashFind(const rfbPaletteHash *h, unsigned int key)
+{
+  unsigned int slot = (key * 0x9E3779B1U) >> (32 - RFB_PALETTE_HASH_BITS);
+
+  while (h->used[slot]) {
+    if (h->key[slot] == key) return slot;
+    slot = (slot + 1) & (RFB_PALETTE_SLOTS - 1);
+  }
+  return -1 - (int)slot;
+}
+
+/* Stores a key that rfbPaletteHashFind() didn't find, given the (negative)
+   value that it returned */
+
+static inline int rfbPaletteHashAdd(rfbPaletteHash *h, int found,
+                                    unsigned int key, int index)
+{
+  int slot = -1 - found;
+
+  h->key[slot] = key;
+  h->index[slot] = (unsigned char)index;
+  h->used[slot] = 1;
+  return slot;
+}
+
+/* Returns the index of the key, or -1 if it isn't in the table */
+
+static inline int rfbPaletteHashLookup(const rfbPaletteHash *h,
+                                       unsigned int key)
+{
+  int slot = rfbPaletteHashFind(h, key);
+
+  return slot >= 0 ? h->index[slot] : -1;
+}
+
+
+static inline void rfbPaletteReset(rfbPalette *p)
+{
+  rfbPaletteHashReset(&p->hash);
+  p->numColors = 0;
+}
+
+/* Adds numPixels pixels of the given color and returns the number of colors
+   in the palette.  If the color is new and the palette already has maxColors
+   (or 256) colors, then the palette is left alone and 0 is returned. */
+
+static inline int rfbPaletteInsert(rfbPalette *p, unsigned int color,
+                                   int numPixels, int maxColors)
+{
+  rfbPaletteHash *h = &p->hash;
+  int slot = rfbPaletteHashFind(h, color), idx;
+
+  if (slot >= 0) {
+    idx = h->index[slot];
+    numPixels += p->entry[idx].numPixels;
+    /* Most of the time, the extra pixels don't move the color up the list. */
+    if (idx == 0 || p->entry[idx - 1].numPixels >= numPixels) {
+      p->entry[idx].numPixels = numPixels;
+      return p->numColors;
+    }
+  } else {
+    if (p->numColors >= maxColors || p->numColors >= RFB_PALETTE_MAX_COLORS)
+      return 0;
+    idx = p->numColors++;
+    slot = rfbPaletteHashAdd(h, slot, color, idx);
+  }
+
+  /* Move the entries with lesser pixel counts down, and put the color into
+     the freed slot.  Colors with equal counts stay in the order in which
+     they got there. */
+  while (idx > 0 && p->entry[idx - 1].numPixels < numPixels) {
+    p->entry[idx] = p->entry[idx - 1];
+    h->index[p->entry[idx].slot] = (unsigned char)idx;
+    idx--;
+  }
+  p->entry[idx].color = color;
+  p->entry[idx].numPixels = numPixels;
+  p->entry[idx].slot = slot;
+  h->index[slot] = (unsigned char)idx;
+
+  return p->numColors;
+}
+
+static inline int rfbPaletteLookup(const rfbPalette *p, unsigned int color)
+{
+  return rfbPaletteHashLookup(&p->hash, color);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PALETTEHASH_H__ */
@@ -0,0 +1,191 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* perf.c - hardware performance counters (see perf.h) */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include "perf.h"
+
+#ifdef __linux__
+
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+static const struct {
+  const char *name;
+  unsigned long long config;
+} events[rfbPerfNumCounters] = {
+  { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+  { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+  { "LLC misses", PERF_COUNT_HW_CACHE_MISSES },
+  { "branch misses", PERF_COUNT_HW_BRANCH_MISSES }
+};
+
+static int fd[rfbPerfNumCounters] = { -1, -1, -1, -1 };
+static int leader = -1;
+
+/* Position of each counter in a group reading, or -1 if unavailable */
+static int slot[rfbPerfNumCounters];
+static int nslots = 0;
+
+static int perf_event_open(struct perf_event_attr *attr, int group_fd)
+{
+  return (int)syscall(SYS_perf_event_open, attr, 0, -1, group_fd, 0);
+}
+
+Bool rfbPerfOpen(void)
+{
+  int i, err[rfbPerfNumCounters];
+
+  rfbPerfClose();
+  for (i = 0; i < rfbPerfNumCounters; i++) {
+    struct perf_event_attr attr;
+
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = events[i].config;
+    attr.read_format = PERF_FORMAT_GROUP;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.disabled = (leader < 0);
+    slot[i] = -1;
+    if ((fd[i] = perf_event_open(&attr, leader)) < 0) {
+      err[i] = errno;
+      continue;
+    }
+    if (leader < 0) leader = fd[i];
+    slot[i] = nslots++;
+  }
+
+  if (leader < 0) {
+    fprintf(stderr, "WARNING: hardware performance counters are not available (%s)%s\n",
+            strerror(err[0]), err[0] == EACCES || err[0] == EPERM ?
+            ".  Check /proc/sys/kernel/perf_event_paranoid." : "");
+    return FALSE;
+  }
+  for (i = 0; i < rfbPerfNumCounters; i++) {
+    if (slot[i] < 0)
+      fprintf(stderr, "WARNING: %s counter is not available (%s)\n",
+              events[i].name, strerror(err[i]));
+  }
+  if (ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP) < 0 ||
+      ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP) < 0) {
+    fprintf(stderr, "WARNING: could not enable performance counters (%s)\n",
+            strerror(errno));
+    rfbPerfClose();
+    return FALSE;
+  }
+  return TRUE;
+}
+
+void rfbPerfClose(void)
+{
+  int i;
+  for (i = 0; i < rfbPerfNumCounters; i++) {
+    if (fd[i] >= 0) close(fd[i]);
+    fd[i] = -1;
+    slot[i] = -1;
+  }
+  leader = -1;
+  nslots = 0;
+}
+
+Bool rfbPerfAvailable(int counter)
+{
+  return slot[counter] >= 0;
+}
+
+void rfbPerfRead(rfbPerfCounts *counts)
+{
+  /* nr, followed by one value for each counter in the group */
+  unsigned long long buf[1 + rfbPerfNumCounters];
+  int i;
+
+  memset(counts, 0, sizeof(rfbPerfCounts));
+  if (leader < 0 || read(leader, buf, sizeof(buf)) < (ssize_t)sizeof(buf[0]))
+    return;
+  for (i = 0; i < rfbPerfNumCounters; i++) {
+    if (slot[i] >= 0 && (unsigned long long)slot[i] < buf[0])
+      counts->value[i] = buf[1 + slot[i]];
+  }
+}
+
+#else
+
+Bool rfbPerfOpen(void)
+{
+  fprintf(stderr, "WARNING: hardware performance counters are only supported on Linux\n");
+  return FALSE;
+}
+
+void rfbPerfClose(void)
+{
+}
+
+Bool rfbPerfAvailable(int counter)
+{
+  return FALSE;
+}
+
+void rfbPerfRead(rfbPerfCounts *counts)
+{
+  memset(counts, 0, sizeof(rfbPerfCounts));
+}
+
+#endif
+
+void rfbPerfAdd(rfbPerfCounts *sum, const rfbPerfCounts *before,
+                const rfbPerfCounts *after)
+{
+  int i;
+  for (i = 0; i < rfbPerfNumCounters; i++)
+    sum->value[i] += after->value[i] - before->value[i];
+}
+
+static void print_ratio(Bool available, double num, double den,
+                        const char *format)
+{
+  if (available && den > 0.)
+    printf(format, num / den);
+  else
+    printf(" %13s", "n/a");
+}
+
+void rfbPerfPrintRow(const char *name, const rfbPerfCounts *counts,
+                     unsigned long long pixels)
+{
+  const unsigned long long *v = counts->value;
+  double mpixels = (double)pixels / 1000000.;
+
+  printf("%-12.12s", name);
+  print_ratio(rfbPerfAvailable(rfbPerfCycles), (double)v[rfbPerfCycles],
+              (double)pixels, " %13.2f");
+  print_ratio(rfbPerfAvailable(rfbPerfCycles) &&
+              rfbPerfAvailable(rfbPerfInstructions),
+              (double)v[rfbPerfInstructions], (double)v[rfbPerfCycles],
+              " %13.2f");
+  print_ratio(rfbPerfAvailable(rfbPerfCacheMisses),
+              (double)v[rfbPerfCacheMisses], mpixels, " %13.0f");
+  print_ratio(rfbPerfAvailable(rfbPerfBranchMisses),
+              (double)v[rfbPerfBranchMisses], mpixels, " %13.0f");
+  printf("\n");
+}
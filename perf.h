@@ -0,0 +1,67 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * perf.h - hardware performance counters
+ *
+ * With -perf, the CPU cycles, instructions retired, last-level cache misses,
+ * and branch misses of the benchmark thread are counted around each codec's
+ * timed section, using the Linux perf_event interface.  The counters are
+ * opened as a group, so that they are scheduled onto the PMU together and the
+ * ratios between them are meaningful.  Only user-space events are counted,
+ * which is all that an unprivileged process (with the default
+ * perf_event_paranoid setting of 2) is allowed to count.
+ *
+ * Containers and virtual machines often don't expose some or all of the
+ * counters.  Each counter that can't be opened is reported as unavailable,
+ * and if none can be opened, rfbPerfOpen() says why and returns FALSE.
+ */
+
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include "rfb.h"
+
+enum {
+  rfbPerfCycles,
+  rfbPerfInstructions,
+  rfbPerfCacheMisses,
+  rfbPerfBranchMisses,
+  rfbPerfNumCounters
+};
+
+typedef struct {
+  unsigned long long value[rfbPerfNumCounters];
+} rfbPerfCounts;
+
+extern Bool rfbPerfOpen(void);
+extern void rfbPerfClose(void);
+extern Bool rfbPerfAvailable(int counter);
+
+/* Reads the current values of all of the counters (0 if unavailable) */
+extern void rfbPerfRead(rfbPerfCounts *counts);
+
+/* Adds the difference between two readings to sum */
+extern void rfbPerfAdd(rfbPerfCounts *sum, const rfbPerfCounts *before,
+                       const rfbPerfCounts *after);
+
+/* Prints one row of the counter table: cycles per pixel, instructions per
+   cycle, and LLC misses and branch misses per megapixel */
+extern void rfbPerfPrintRow(const char *name, const rfbPerfCounts *counts,
+                            unsigned long long pixels);
+
+#endif /* __PERF_H__ */
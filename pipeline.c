@@ -0,0 +1,604 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* pipeline.c - transport between the encoder and the decoder (see
+   pipeline.h) */
+
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "pipeline.h"
+
+extern double gettime(void);
+
+typedef struct {
+  int type;
+  int len;
+  double time;
+  char data[UPDATE_BUF_SIZE];
+} rfbPipelineChunk;
+
+Bool rfbPipelineActive = FALSE;
+
+static rfbPipelineChunk *ring = NULL;
+static int nchunks = 0;
+static int head = 0, count = 0;   /* Protected by mutex */
+static int tail = 0;              /* Owned by the writer */
+static Bool aborted = FALSE;      /* Protected by mutex */
+static Bool idle = FALSE;         /* Protected by mutex */
+static rfbPipelineStatistics stats;  /* Protected by mutex */
+
+/* The chunk that the reader is reading, if any, or with the socket
+   transport, the unread part of the receive buffer */
+static Bool reading = FALSE;
+static const char *rptr = NULL, *rend = NULL;
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t notFull = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t notEmpty = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+
+/* Socket transport */
+
+#define RECEIVE_BUFFER_SIZE 65536
+
+static int wfd = -1, rfd = -1;
+static int flush = rfbPipelineFlushChunk;
+static char *wbuf = NULL;          /* Owned by the writer */
+static size_t wlen = 0, wsize = 0;
+static Bool writerInUpdate = FALSE;
+static char *rbuf = NULL;          /* Owned by the reader */
+static Bool readerInUpdate = FALSE, readerStarted = FALSE;
+static unsigned long long bytesWritten = 0, bytesRead = 0;
+                                   /* Protected by mutex */
+static double *times = NULL;       /* Protected by mutex */
+static int ntimes = 0, timesSize = 0, timesRead = 0;
+static double writerSystem0 = 0.0, readerSystem0 = 0.0;
+
+/* CPU time that the calling thread has spent in the kernel */
+static double SystemTime(void)
+{
+#ifdef RUSAGE_THREAD
+  struct rusage ru;
+  if (getrusage(RUSAGE_THREAD, &ru) == 0)
+    return (double)ru.ru_stime.tv_sec + (double)ru.ru_stime.tv_usec * 1.0e-6;
+#endif
+  return 0.0;
+}
+
+static void Reset(void)
+{
+  head = count = tail = 0;
+  aborted = idle = FALSE;
+  memset(&stats, 0, sizeof(stats));
+  reading = FALSE;
+  rptr = rend = NULL;
+  wlen = 0;
+  writerInUpdate = readerInUpdate = readerStarted = FALSE;
+  bytesWritten = bytesRead = 0;
+  ntimes = timesRead = 0;
+  writerSystem0 = SystemTime();
+}
+
+Bool rfbPipelineOpen(int n)
+{
+  rfbPipelineClose();
+  if ((ring = (rfbPipelineChunk *)malloc(n * sizeof(rfbPipelineChunk)))
+      == NULL) {
+    fprintf(stderr, "Could not allocate a %d-chunk pipeline\n", n);
+    return FALSE;
+  }
+  nchunks = n;
+  Reset();
+  rfbPipelineActive = TRUE;
+  return TRUE;
+}
+
+static Bool Connect(int transport)
+{
+  int fds[2], one = 1;
+
+  if (transport == rfbPipelineUnix) {
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0) {
+      perror("Could not create Unix-domain socket pair");
+      return FALSE;
+    }
+    wfd = fds[0];
+    rfd = fds[1];
+  } else {
+    struct sockaddr_in addr;
+    socklen_t addrlen = sizeof(addr);
+    int lfd;
+
+    if ((lfd = socket(AF_INET, SOCK_STREAM, 0)) < 0) {
+      perror("Could not create TCP socket");
+      return FALSE;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;
+    if (bind(lfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        listen(lfd, 1) < 0 ||
+        getsockname(lfd, (struct sockaddr *)&addr, &addrlen) < 0 ||
+        (rfd = socket(AF_INET, SOCK_STREAM, 0)) < 0 ||
+        connect(rfd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        (wfd = accept(lfd, NULL, NULL)) < 0) {
+      perror("Could not connect TCP loopback socket");
+      close(lfd);
+      return FALSE;
+    }
+    close(lfd);
+    /* Like a VNC server, don't let Nagle's algorithm hold back the end of an
+       update */
+    setsockopt(wfd, IPPROTO_TCP, TCP_NODELAY, (char *)&one, sizeof(one));
+  }
+  return TRUE;
+}
+
+Bool rfbPipelineOpenSocket(int transport, int flushPolicy)
+{
+  rfbPipelineClose();
+  if ((rbuf = (char *)malloc(RECEIVE_BUFFER_SIZE)) == NULL) {
+    fprintf(stderr, "Could not allocate socket receive buffer\n");
+    return FALSE;
+  }
+  if (!Connect(transport)) {
+    rfbPipelineClose();
+    return FALSE;
+  }
+  flush = flushPolicy;
+  Reset();
+  rptr = rend = rbuf;
+  rfbPipelineActive = TRUE;
+  return TRUE;
+}
+
+void rfbPipelineClose(void)
+{
+  free(ring);
+  ring = NULL;
+  nchunks = 0;
+  if (wfd >= 0) close(wfd);
+  if (rfd >= 0) close(rfd);
+  wfd = rfd = -1;
+  free(wbuf);
+  wbuf = NULL;
+  wsize = 0;
+  free(rbuf);
+  rbuf = NULL;
+  free(times);
+  times = NULL;
+  timesSize = 0;
+  rfbPipelineActive = FALSE;
+}
+
+/* Waits for a free chunk and fills it in.  Only the writer adds chunks, so
+   the chunk at the tail stays free after the lock is released. */
+static Bool Put(int type, const char *buf, int len, double time)
+{
+  rfbPipelineChunk *chunk;
+
+  pthread_mutex_lock(&mutex);
+  if (count == nchunks && !aborted) {
+    double t0 = gettime();
+    while (count == nchunks && !aborted)
+      pthread_cond_wait(&notFull, &mutex);
+    stats.writerStalls++;
+    stats.writerWait += gettime() - t0;
+  }
+  if (aborted) {
+    pthread_mutex_unlock(&mutex);
+    return FALSE;
+  }
+  pthread_mutex_unlock(&mutex);
+
+  chunk = &ring[tail];
+  chunk->type = type;
+  chunk->len = len;
+  chunk->time = time;
+  if (len > 0) memcpy(chunk->data, buf, len);
+  tail = (tail + 1) % nchunks;
+
+  pthread_mutex_lock(&mutex);
+  count++;
+  pthread_cond_signal(&notEmpty);
+  pthread_mutex_unlock(&mutex);
+  return TRUE;
+}
+
+/* Sends the data with as many calls to send() as it takes */
+static Bool Send(const char *buf, size_t len)
+{
+  while (len > 0) {
+    double t0 = gettime();
+    ssize_t n = send(wfd, buf, len, MSG_NOSIGNAL);
+    double t = gettime() - t0;
+
+    if (n < 0 && errno == EINTR) continue;
+    pthread_mutex_lock(&mutex);
+    stats.writes++;
+    stats.writerWait += t;
+    if (n > 0) {
+      stats.bytes += n;
+      bytesWritten += n;
+    }
+    pthread_mutex_unlock(&mutex);
+    if (n <= 0) {
+      if (!aborted) perror("Could not write to socket");
+      return FALSE;
+    }
+    buf += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+static Bool Flush(void)
+{
+  Bool ret = Send(wbuf, wlen);
+  wlen = 0;
+  return ret;
+}
+
+static Bool Append(const char *buf, size_t len)
+{
+  if (wlen + len > wsize) {
+    size_t newSize = wsize ? wsize : UPDATE_BUF_SIZE;
+    char *newBuf;
+    while (newSize < wlen + len) newSize *= 2;
+    if ((newBuf = (char *)realloc(wbuf, newSize)) == NULL) {
+      fprintf(stderr, "Could not allocate socket send buffer\n");
+      return FALSE;
+    }
+    wbuf = newBuf;
+    wsize = newSize;
+  }
+  memcpy(&wbuf[wlen], buf, len);
+  wlen += len;
+  return TRUE;
+}
+
+/* Adds data to the send buffer, or with rfbPipelineFlushChunk, sends it
+   right away (along with anything already in the buffer) */
+static Bool Buffer(const char *buf, size_t len)
+{
+  if (flush != rfbPipelineFlushChunk)
+    return Append(buf, len);
+  if (wlen == 0)
+    return Send(buf, len);
+  return Append(buf, len) && Flush();
+}
+
+/* The updates are framed as they would be by a server that doesn't know
+   the number of rectangles in advance: nRects is 0xFFFF, and a LastRect
+   pseudo-rectangle ends the update. */
+static Bool SocketWrite(const char *buf, int len)
+{
+  if (!writerInUpdate) {
+    rfbFramebufferUpdateMsg msg;
+    msg.type = rfbFramebufferUpdate;
+    msg.pad = 0;
+    msg.nRects = Swap16IfLE(0xFFFF);
+    if (!Append((char *)&msg, sz_rfbFramebufferUpdateMsg))
+      return FALSE;
+    writerInUpdate = TRUE;
+  }
+  return Buffer(buf, len);
+}
+
+static Bool SocketMark(int marker, double time)
+{
+  switch (marker) {
+  case rfbPipelineEndRect:
+    return flush == rfbPipelineFlushRect && wlen > 0 ? Flush() : TRUE;
+
+  case rfbPipelineEndUpdate:
+  {
+    rfbFramebufferUpdateRectHeader rh;
+
+    if (!writerInUpdate) return TRUE;
+    pthread_mutex_lock(&mutex);
+    if (ntimes == timesSize) {
+      int newSize = timesSize ? timesSize * 2 : 1024;
+      double *newTimes = (double *)realloc(times, newSize * sizeof(double));
+      if (!newTimes) {
+        pthread_mutex_unlock(&mutex);
+        fprintf(stderr, "Could not allocate update times\n");
+        return FALSE;
+      }
+      times = newTimes;
+      timesSize = newSize;
+    }
+    times[ntimes++] = time;
+    pthread_mutex_unlock(&mutex);
+
+    memset(&rh, 0, sz_rfbFramebufferUpdateRectHeader);
+    rh.encoding = Swap32IfLE(rfbEncodingLastRect);
+    writerInUpdate = FALSE;
+    return Buffer((char *)&rh, sz_rfbFramebufferUpdateRectHeader) &&
+      (wlen == 0 || Flush());
+  }
+
+  case rfbPipelineEnd:
+    if (wlen > 0 && !Flush())
+      return FALSE;
+    pthread_mutex_lock(&mutex);
+    stats.writerSystem = SystemTime() - writerSystem0;
+    pthread_mutex_unlock(&mutex);
+    shutdown(wfd, SHUT_WR);
+    return TRUE;
+  }
+  return TRUE;
+}
+
+Bool rfbPipelineWrite(const char *buf, int len)
+{
+  if (rfd >= 0)
+    return SocketWrite(buf, len);
+  while (len > 0) {
+    int n = len < UPDATE_BUF_SIZE ? len : UPDATE_BUF_SIZE;
+    if (!Put(rfbPipelineData, buf, n, 0.0))
+      return FALSE;
+    buf += n;
+    len -= n;
+  }
+  return TRUE;
+}
+
+Bool rfbPipelineMark(int marker, double time)
+{
+  if (rfd >= 0)
+    return SocketMark(marker, time);
+  if (marker == rfbPipelineEndRect)
+    return TRUE;
+  if (marker == rfbPipelineEnd) {
+    pthread_mutex_lock(&mutex);
+    stats.writerSystem = SystemTime() - writerSystem0;
+    pthread_mutex_unlock(&mutex);
+  }
+  return Put(marker, NULL, 0, time);
+}
+
+/* The reader only waits for data once it has released everything that it
+   has read, so the ring is drained when the reader is idle.  With the
+   socket transport, the reader must also have received everything that has
+   been sent. */
+Bool rfbPipelineDrain(void)
+{
+  Bool ret;
+
+  if (rfd >= 0 && wlen > 0 && !Flush())
+    return FALSE;
+  pthread_mutex_lock(&mutex);
+  while (!(idle && bytesRead == bytesWritten) && !aborted)
+    pthread_cond_wait(&drained, &mutex);
+  ret = !aborted;
+  pthread_mutex_unlock(&mutex);
+  return ret;
+}
+
+/* Must be called with the mutex held */
+static void Release(void)
+{
+  head = (head + 1) % nchunks;
+  count--;
+  pthread_cond_signal(&notFull);
+}
+
+static void StartReader(void)
+{
+  if (!readerStarted) {
+    readerSystem0 = SystemTime();
+    readerStarted = TRUE;
+  }
+}
+
+static void StopReader(void)
+{
+  pthread_mutex_lock(&mutex);
+  stats.readerSystem = SystemTime() - readerSystem0;
+  pthread_mutex_unlock(&mutex);
+}
+
+/* Makes sure that at least n bytes are in the receive buffer.  Returns FALSE
+   at the end of the stream or if the pipeline has been aborted. */
+static Bool Receive(size_t n, Bool atBoundary)
+{
+  size_t avail = rend - rptr;
+
+  if (avail >= n)
+    return TRUE;
+  if (avail > 0 && rptr != rbuf)
+    memmove(rbuf, rptr, avail);
+  rptr = rbuf;
+  rend = rbuf + avail;
+
+  while ((size_t)(rend - rptr) < n) {
+    ssize_t bytes;
+    double t0, t;
+
+    /* The decoder has finished with everything it has received so far. */
+    pthread_mutex_lock(&mutex);
+    if (atBoundary && rend == rptr) {
+      idle = TRUE;
+      pthread_cond_signal(&drained);
+    }
+    pthread_mutex_unlock(&mutex);
+
+    t0 = gettime();
+    bytes = read(rfd, (char *)rend, RECEIVE_BUFFER_SIZE - (rend - rbuf));
+    t = gettime() - t0;
+    if (bytes < 0 && errno == EINTR) continue;
+
+    pthread_mutex_lock(&mutex);
+    idle = FALSE;
+    stats.reads++;
+    stats.readerWait += t;
+    if (bytes > 0) bytesRead += bytes;
+    pthread_mutex_unlock(&mutex);
+
+    if (bytes <= 0) {
+      if (bytes < 0 && !aborted) perror("Could not read from socket");
+      return FALSE;
+    }
+    rend += bytes;
+  }
+  return TRUE;
+}
+
+static int SocketNext(double *time)
+{
+  rfbFramebufferUpdateRectHeader rh;
+
+  StartReader();
+  if (!readerInUpdate) {
+    if (!Receive(sz_rfbFramebufferUpdateMsg, TRUE)) {
+      StopReader();
+      return aborted || rend != rptr ? rfbPipelineError : rfbPipelineEnd;
+    }
+    if (*rptr != rfbFramebufferUpdate) {
+      fprintf(stderr, "ERROR: unexpected message type %d on socket.\n",
+              *rptr);
+      return rfbPipelineError;
+    }
+    rptr += sz_rfbFramebufferUpdateMsg;
+    readerInUpdate = TRUE;
+  }
+  if (!Receive(sz_rfbFramebufferUpdateRectHeader, TRUE))
+    return rfbPipelineError;
+  memcpy(&rh, rptr, sz_rfbFramebufferUpdateRectHeader);
+  if (Swap32IfLE(rh.encoding) != rfbEncodingLastRect)
+    return rfbPipelineData;
+
+  rptr += sz_rfbFramebufferUpdateRectHeader;
+  readerInUpdate = FALSE;
+  pthread_mutex_lock(&mutex);
+  if (time) *time = timesRead < ntimes ? times[timesRead] : 0.0;
+  timesRead++;
+  pthread_mutex_unlock(&mutex);
+  return rfbPipelineEndUpdate;
+}
+
+int rfbPipelineNext(double *time)
+{
+  rfbPipelineChunk *chunk;
+  int type;
+
+  if (rfd >= 0)
+    return SocketNext(time);
+
+  if (reading && rptr < rend)
+    return rfbPipelineData;
+
+  StartReader();
+  pthread_mutex_lock(&mutex);
+  if (reading) {
+    Release();
+    reading = FALSE;
+  }
+  if (count == 0 && !aborted) {
+    double t0 = gettime();
+    idle = TRUE;
+    pthread_cond_signal(&drained);
+    while (count == 0 && !aborted)
+      pthread_cond_wait(&notEmpty, &mutex);
+    idle = FALSE;
+    stats.readerStalls++;
+    stats.readerWait += gettime() - t0;
+  }
+  if (aborted) {
+    pthread_mutex_unlock(&mutex);
+    return rfbPipelineError;
+  }
+  chunk = &ring[head];
+  if ((type = chunk->type) == rfbPipelineData) {
+    reading = TRUE;
+    rptr = chunk->data;
+    rend = chunk->data + chunk->len;
+  } else {
+    if (time) *time = chunk->time;
+    Release();
+  }
+  pthread_mutex_unlock(&mutex);
+  if (type == rfbPipelineEnd)
+    StopReader();
+  return type;
+}
+
+Bool rfbPipelineRead(char *out, unsigned int n)
+{
+  while (n > 0) {
+    unsigned int avail;
+
+    if (rfd >= 0) {
+      if (rptr == rend &&
+          !Receive(1, FALSE)) {
+        if (!aborted)
+          fprintf(stderr, "ERROR: incomplete decode of pipelined data.\n");
+        return FALSE;
+      }
+    } else if (!reading || rptr == rend) {
+      int type = rfbPipelineNext(NULL);
+      if (type != rfbPipelineData) {
+        if (type != rfbPipelineError)
+          fprintf(stderr, "ERROR: incomplete decode of pipelined data.\n");
+        return FALSE;
+      }
+    }
+    avail = (unsigned int)(rend - rptr);
+    if (avail > n) avail = n;
+    memcpy(out, rptr, avail);
+    rptr += avail;
+    out += avail;
+    n -= avail;
+  }
+  return TRUE;
+}
+
+void rfbPipelineAbort(void)
+{
+  pthread_mutex_lock(&mutex);
+  aborted = TRUE;
+  pthread_cond_broadcast(&notFull);
+  pthread_cond_broadcast(&notEmpty);
+  pthread_cond_broadcast(&drained);
+  pthread_mutex_unlock(&mutex);
+  /* Wake up a reader or writer that is blocked in the kernel */
+  if (wfd >= 0) shutdown(wfd, SHUT_RDWR);
+  if (rfd >= 0) shutdown(rfd, SHUT_RDWR);
+}
+
+void rfbPipelineGetStatistics(rfbPipelineStatistics *s)
+{
+  pthread_mutex_lock(&mutex);
+  *s = stats;
+  pthread_mutex_unlock(&mutex);
+}
@@ -0,0 +1,119 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/*
+ * pipeline.h - transport between the encoder and the decoder
+ *
+ * With -pipeline, the encoder and the decoder run in separate threads, like a
+ * server and a viewer connected by a socket.  rfbSendUpdateBuf() copies each
+ * flush of updateBuf into the next free chunk of a fixed-size ring, waiting
+ * for the decoder if the ring is full, and ReadFromRFBServer() reads from the
+ * oldest chunk, waiting for the encoder if the ring is empty.  The encoder
+ * can also insert markers (for instance, at the end of each framebuffer
+ * update), which the decoder receives from rfbPipelineNext() in order with
+ * the data.
+ *
+ * There is a single writer thread and a single reader thread.  The data in a
+ * chunk are copied outside of the lock, since the writer owns the free chunks
+ * and the reader owns the chunk that it is reading.
+ *
+ * With -socket, the ring is replaced by a loopback TCP connection or a
+ * Unix-domain socket pair, so that the encoder pays for the system calls and
+ * the copies into and out of the kernel, as a real server and viewer would.
+ * The data are framed as real FramebufferUpdate messages (with a LastRect
+ * pseudo-rectangle at the end of each update), and the encoder buffers them
+ * and calls send() at the end of each rfbSendUpdateBuf() flush, each
+ * rectangle, or each update, depending on the flush policy.
+ */
+
+#ifndef __PIPELINE_H__
+#define __PIPELINE_H__
+
+#include "rfb.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+  rfbPipelineError = -1,
+  rfbPipelineData,          /* The next chunk contains encoded data */
+  rfbPipelineEndUpdate,     /* End of a framebuffer update */
+  rfbPipelineEnd,           /* End of the pass */
+  rfbPipelineEndRect        /* End of a rectangle (encoder side only) */
+};
+
+/* Socket transports */
+enum {
+  rfbPipelineTCP,
+  rfbPipelineUnix
+};
+
+/* When the socket transport calls send() */
+enum {
+  rfbPipelineFlushChunk,    /* After each flush of updateBuf */
+  rfbPipelineFlushRect,     /* After each rectangle */
+  rfbPipelineFlushUpdate    /* After each framebuffer update */
+};
+
+/* TRUE between rfbPipelineOpen() or rfbPipelineOpenSocket() and
+   rfbPipelineClose() */
+extern Bool rfbPipelineActive;
+
+extern Bool rfbPipelineOpen(int nchunks);
+extern Bool rfbPipelineOpenSocket(int transport, int flush);
+extern void rfbPipelineClose(void);
+
+/* Encoder side.  These return FALSE if the pipeline has been aborted. */
+extern Bool rfbPipelineWrite(const char *buf, int len);
+extern Bool rfbPipelineMark(int marker, double time);
+
+/* Waits until the decoder has finished with everything that has been
+   written, for instance before the framebuffer is reallocated. */
+extern Bool rfbPipelineDrain(void);
+
+/* Decoder side.  rfbPipelineNext() waits until something is available and
+   returns rfbPipelineData if it is encoded data (which is then read with
+   rfbPipelineRead()), or else consumes the marker and returns its type and
+   the time that was passed to rfbPipelineMark(). */
+extern int rfbPipelineNext(double *time);
+extern Bool rfbPipelineRead(char *out, unsigned int n);
+
+/* Wakes up both sides and makes all further calls fail */
+extern void rfbPipelineAbort(void);
+
+/* How many times, and for how long in total, the encoder has had to wait for
+   a free chunk and the decoder has had to wait for data since
+   rfbPipelineOpen().  With the socket transport, the wait times are the
+   time spent in send() and read(), and the number of those calls and the
+   number of bytes sent are counted instead of the stalls.  The CPU time that
+   each side has spent in the kernel is known at the end of the pass. */
+typedef struct {
+  unsigned long long writerStalls, readerStalls;
+  double writerWait, readerWait;  /* Seconds */
+  unsigned long long writes, reads, bytes;
+  double writerSystem, readerSystem;  /* Seconds */
+} rfbPipelineStatistics;
+
+extern void rfbPipelineGetStatistics(rfbPipelineStatistics *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PIPELINE_H__ */
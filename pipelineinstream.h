@@ -0,0 +1,83 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * pipelineinstream.h - rdr::InStream that reads from the -pipeline ring
+ *
+ * The TigerVNC-derived decoders read from an rdr::InStream rather than
+ * calling ReadFromRFBServer(), so they normally wrap sendBuf in a
+ * MemInStream.  With -pipeline, the encoded data arrive in chunks from the
+ * encoder thread, so this class fills its buffer from rfbPipelineRead()
+ * instead.  It never reads more than the decoder has asked for, since the
+ * rectangle headers are read separately with ReadFromRFBServer().
+ *
+ * This header must be included after rdr/InStream.h and rdr/Exception.h from
+ * the variant's own tree.
+ */
+
+#ifndef __PIPELINEINSTREAM_H__
+#define __PIPELINEINSTREAM_H__
+
+#include <string.h>
+#include "pipeline.h"
+
+namespace rdr {
+
+  class PipelineInStream : public InStream {
+
+  public:
+
+    PipelineInStream(int bufSize_=16384) : bufSize(bufSize_), offset(0)
+    {
+      ptr = end = start = new U8[bufSize];
+    }
+
+    virtual ~PipelineInStream() { delete [] start; }
+
+    int pos() { return offset + ptr - start; }
+
+  private:
+
+    int overrun(int itemSize, int nItems, bool wait)
+    {
+      int avail = end - ptr, needed;
+
+      if (itemSize > bufSize)
+        throw Exception("PipelineInStream overrun: max itemSize exceeded");
+
+      if (avail > 0) memmove(start, ptr, avail);
+      offset += ptr - start;
+      ptr = start;
+      end = start + avail;
+
+      if (itemSize * nItems > bufSize)
+        nItems = bufSize / itemSize;
+      needed = itemSize * nItems - avail;
+      if (!rfbPipelineRead((char *)end, needed))
+        throw EndOfStream();
+      end += needed;
+
+      return nItems;
+    }
+
+    U8 *start;
+    int bufSize, offset;
+  };
+
+}
+
+#endif /* __PIPELINEINSTREAM_H__ */
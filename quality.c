@@ -0,0 +1,169 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* quality.c - objective quality of the decoded output (see quality.h) */
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include "quality.h"
+
+#define WINDOW_SIZE 8
+#define WINDOW_STEP 4
+
+/* The SSIM stabilizing constants for 8-bit components */
+#define C1 (0.01 * 255 * 0.01 * 255)
+#define C2 (0.03 * 255 * 0.03 * 255)
+
+static float *srcLuma = NULL, *dstLuma = NULL;
+static int lumaSize = 0;
+
+static CARD32 get_pixel(const char *p, int bpp)
+{
+  switch (bpp) {
+  case 8:   return *(const CARD8 *)p;
+  case 16:  return *(const CARD16 *)p;
+  default:  return *(const CARD32 *)p;
+  }
+}
+
+/* Scales a pixel component to 8 bits */
+static int component(CARD32 pixel, int shift, int max)
+{
+  return (int)(((pixel >> shift) & max) * 255 + max / 2) / max;
+}
+
+static double window_ssim(const float *a, const float *b, int pitch, int w,
+                          int h)
+{
+  double sa = 0., sb = 0., saa = 0., sbb = 0., sab = 0., n = w * h;
+  double ma, mb, va, vb, cov;
+  int x, y;
+
+  for (y = 0; y < h; y++, a += pitch, b += pitch) {
+    for (x = 0; x < w; x++) {
+      sa += a[x];  sb += b[x];
+      saa += a[x] * a[x];  sbb += b[x] * b[x];  sab += a[x] * b[x];
+    }
+  }
+  ma = sa / n;  mb = sb / n;
+  va = saa / n - ma * ma;  vb = sbb / n - mb * mb;
+  cov = sab / n - ma * mb;
+  return ((2. * ma * mb + C1) * (2. * cov + C2)) /
+    ((ma * ma + mb * mb + C1) * (va + vb + C2));
+}
+
+void rfbQualityReset(rfbQuality *q)
+{
+  memset(q, 0, sizeof(rfbQuality));
+  q->minPSNR = QUALITY_MAX_PSNR;
+  q->minSSIM = 1.0;
+}
+
+Bool rfbQualityCompareRect(rfbQuality *q, rfbQualitySum *rect,
+                           const char *src, const rfbPixelFormat *srcFormat,
+                           const char *dst, const rfbPixelFormat *dstFormat,
+                           int pitch, int w, int h)
+{
+  int srcBytes = srcFormat->bitsPerPixel / 8;
+  int dstBytes = dstFormat->bitsPerPixel / 8;
+  rfbQualitySum sum;
+  int x, y, ww, wh;
+
+  if (w < 1 || h < 1) return TRUE;
+  if (w * h > lumaSize) {
+    float *s = (float *)realloc(srcLuma, w * h * sizeof(float));
+    float *d = s ? (float *)realloc(dstLuma, w * h * sizeof(float)) : NULL;
+    if (s) srcLuma = s;
+    if (d) dstLuma = d;
+    if (!s || !d) {
+      rfbLog("rfbQualityCompareRect: out of memory\n");
+      return FALSE;
+    }
+    lumaSize = w * h;
+  }
+
+  memset(&sum, 0, sizeof(sum));
+  for (y = 0; y < h; y++) {
+    const char *s = &src[y * pitch], *d = &dst[y * pitch];
+    for (x = 0; x < w; x++, s += srcBytes, d += dstBytes) {
+      CARD32 sp = get_pixel(s, srcFormat->bitsPerPixel);
+      CARD32 dp = get_pixel(d, dstFormat->bitsPerPixel);
+      int sr = component(sp, srcFormat->redShift, srcFormat->redMax);
+      int sg = component(sp, srcFormat->greenShift, srcFormat->greenMax);
+      int sb = component(sp, srcFormat->blueShift, srcFormat->blueMax);
+      int dr = component(dp, dstFormat->redShift, dstFormat->redMax);
+      int dg = component(dp, dstFormat->greenShift, dstFormat->greenMax);
+      int db = component(dp, dstFormat->blueShift, dstFormat->blueMax);
+      sum.sse += (double)((sr - dr) * (sr - dr) + (sg - dg) * (sg - dg) +
+                          (sb - db) * (sb - db));
+      srcLuma[y * w + x] = 0.299f * sr + 0.587f * sg + 0.114f * sb;
+      dstLuma[y * w + x] = 0.299f * dr + 0.587f * dg + 0.114f * db;
+    }
+  }
+  sum.samples = (unsigned long long)w * h * 3;
+
+  ww = w < WINDOW_SIZE ? w : WINDOW_SIZE;
+  wh = h < WINDOW_SIZE ? h : WINDOW_SIZE;
+  for (y = 0; y + wh <= h; y += WINDOW_STEP) {
+    for (x = 0; x + ww <= w; x += WINDOW_STEP) {
+      sum.ssim += window_ssim(&srcLuma[y * w + x], &dstLuma[y * w + x], w,
+                              ww, wh);
+      sum.windows++;
+    }
+  }
+
+  q->update.sse += sum.sse;
+  q->update.samples += sum.samples;
+  q->update.ssim += sum.ssim;
+  q->update.windows += sum.windows;
+  if (rect) *rect = sum;
+  return TRUE;
+}
+
+void rfbQualityEndUpdate(rfbQuality *q)
+{
+  double psnr, ssim;
+
+  if (q->update.samples == 0) return;
+  psnr = rfbQualityPSNR(&q->update);
+  ssim = rfbQualitySSIM(&q->update);
+  q->updates++;
+  q->psnrSum += psnr;
+  q->ssimSum += ssim;
+  if (psnr < q->minPSNR) q->minPSNR = psnr;
+  if (ssim < q->minSSIM) q->minSSIM = ssim;
+  q->total.sse += q->update.sse;
+  q->total.samples += q->update.samples;
+  q->total.ssim += q->update.ssim;
+  q->total.windows += q->update.windows;
+  memset(&q->update, 0, sizeof(rfbQualitySum));
+}
+
+double rfbQualityPSNR(const rfbQualitySum *s)
+{
+  double psnr;
+
+  if (s->sse <= 0.) return QUALITY_MAX_PSNR;
+  psnr = 10. * log10(255. * 255. * (double)s->samples / s->sse);
+  return psnr < QUALITY_MAX_PSNR ? psnr : QUALITY_MAX_PSNR;
+}
+
+double rfbQualitySSIM(const rfbQualitySum *s)
+{
+  return s->windows ? s->ssim / (double)s->windows : 1.0;
+}
@@ -0,0 +1,68 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * quality.h - objective quality of the decoded output
+ *
+ * In decompression mode, compare-encodings compares the pixels that a Tight
+ * decoder wrote to image with the source framebuffer after each update.  The
+ * PSNR is computed over the R, G, and B components, scaled to 8 bits, and the
+ * SSIM is computed over the BT.601 luma of 8x8 windows spaced 4 pixels apart,
+ * as x264 does.  Rectangles smaller than a window form a single window.
+ */
+
+#ifndef __QUALITY_H__
+#define __QUALITY_H__
+
+#include "rfb.h"
+
+/* Reported for identical images, so that the PSNR is always finite */
+#define QUALITY_MAX_PSNR 100.0
+
+typedef struct {
+  double sse;                    /* Sum of squared component errors */
+  unsigned long long samples;    /* Number of components compared */
+  double ssim;                   /* Sum of the window SSIMs */
+  unsigned long long windows;
+} rfbQualitySum;
+
+typedef struct {
+  rfbQualitySum total, update;
+  unsigned long updates;
+  double psnrSum, ssimSum;       /* Sums of the per-update values */
+  double minPSNR, minSSIM;       /* Worst update */
+} rfbQuality;
+
+extern void rfbQualityReset(rfbQuality *q);
+
+/* Compares a rectangle of the decoded framebuffer (dst) with the same
+   rectangle of the source framebuffer (src), both of which start at the
+   rectangle's top left pixel, and adds the result to the current update of q
+   and to rect (if not NULL).  Returns FALSE if memory couldn't be
+   allocated. */
+extern Bool rfbQualityCompareRect(rfbQuality *q, rfbQualitySum *rect,
+                                  const char *src,
+                                  const rfbPixelFormat *srcFormat,
+                                  const char *dst,
+                                  const rfbPixelFormat *dstFormat, int pitch,
+                                  int w, int h);
+extern void rfbQualityEndUpdate(rfbQuality *q);
+
+extern double rfbQualityPSNR(const rfbQualitySum *s);
+extern double rfbQualitySSIM(const rfbQualitySum *s);
+
+#endif /* __QUALITY_H__ */
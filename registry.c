@@ -0,0 +1,154 @@
+/*
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * registry.c - run-time registry of Tight encoder/decoder variants
+ *
+ * variants.h is generated by CMake and contains one TIGHT_ENCODER*() or
+ * TIGHT_DECODER() line for each variant that was selected at build time.
+ * It is included once to declare the prefixed entry points and build the
+ * per-variant descriptors, and then once more for each list.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "rfb.h"
+
+#define DECLARE_STATISTICS(p)                                              \
+  extern unsigned long long p##solidrect, p##solidpixels, p##monorect,     \
+    p##monopixels, p##ndxrect, p##ndxpixels, p##jpegrect, p##jpegpixels,   \
+    p##gradrect, p##gradpixels, p##fcrect, p##fcpixels;                    \
+  static const rfbTightStatistics p##stats = {                             \
+    &p##solidrect, &p##solidpixels, &p##monorect, &p##monopixels,          \
+    &p##ndxrect, &p##ndxpixels, &p##jpegrect, &p##jpegpixels,              \
+    &p##gradrect, &p##gradpixels, &p##fcrect, &p##fcpixels                 \
+  };
+
+#define TIGHT_ENCODER(p, name)                                             \
+  extern Bool p##rfbSendRectEncodingTight(rfbClientPtr, int, int, int,     \
+                                          int);                            \
+  extern void p##rfbSetTightLevels(int, int, int);                         \
+  DECLARE_STATISTICS(p)                                                    \
+  static const rfbTightEncoderVariant p##encoder = {                       \
+    name, p##rfbSendRectEncodingTight, NULL, &p##stats,                    \
+    p##rfbSetTightLevels                                                   \
+  };
+
+#define TIGHT_ENCODER_PHASES(p, name)                                      \
+  extern Bool p##rfbSendRectEncodingTight(rfbClientPtr, int, int, int,     \
+                                          int);                            \
+  extern void p##rfbSetTightLevels(int, int, int);                         \
+  extern int p##rfbGetTightPhases(rfbTightPhase *, int);                   \
+  extern void p##rfbResetTightPhases(void);                                \
+  DECLARE_STATISTICS(p)                                                    \
+  static const rfbTightEncoderVariant p##encoder = {                       \
+    name, p##rfbSendRectEncodingTight, NULL, &p##stats,                    \
+    p##rfbSetTightLevels, p##rfbGetTightPhases,                            \
+    p##rfbResetTightPhases                                                 \
+  };
+
+#define TIGHT_ENCODER_NOSTATS(p, name)                                     \
+  extern Bool p##rfbSendRectEncodingTight(rfbClientPtr, int, int, int,     \
+                                          int);                            \
+  static const rfbTightEncoderVariant p##encoder = {                       \
+    name, p##rfbSendRectEncodingTight, NULL, NULL                          \
+  };
+
+#define TIGHT_ENCODER_H264(p, name)                                        \
+  extern Bool p##rfbSendRectEncodingTight(rfbClientPtr, int, int, int,     \
+                                          int);                            \
+  extern Bool p##ResetH264Encoder(rfbClientPtr);                           \
+  DECLARE_STATISTICS(p)                                                    \
+  static const rfbTightEncoderVariant p##encoder = {                       \
+    name, p##rfbSendRectEncodingTight, p##ResetH264Encoder, &p##stats      \
+  };
+
+#define TIGHT_DECODER(p, name)                                             \
+  extern const rfbTightDecoderVariant p##rfbTightDecoder;
+
+#include "variants.h"
+
+#undef TIGHT_ENCODER
+#undef TIGHT_ENCODER_PHASES
+#undef TIGHT_ENCODER_NOSTATS
+#undef TIGHT_ENCODER_H264
+#undef TIGHT_DECODER
+
+#define TIGHT_ENCODER(p, name) &p##encoder,
+#define TIGHT_ENCODER_PHASES(p, name) &p##encoder,
+#define TIGHT_ENCODER_NOSTATS(p, name) &p##encoder,
+#define TIGHT_ENCODER_H264(p, name) &p##encoder,
+#define TIGHT_DECODER(p, name)
+
+const rfbTightEncoderVariant *rfbTightEncoders[] = {
+#include "variants.h"
+  NULL
+};
+
+#undef TIGHT_ENCODER
+#undef TIGHT_ENCODER_PHASES
+#undef TIGHT_ENCODER_NOSTATS
+#undef TIGHT_ENCODER_H264
+#undef TIGHT_DECODER
+
+#define TIGHT_ENCODER(p, name)
+#define TIGHT_ENCODER_PHASES(p, name)
+#define TIGHT_ENCODER_NOSTATS(p, name)
+#define TIGHT_ENCODER_H264(p, name)
+#define TIGHT_DECODER(p, name) &p##rfbTightDecoder,
+
+const rfbTightDecoderVariant *rfbTightDecoders[] = {
+#include "variants.h"
+  NULL
+};
+
+/* The JPEG quality of each TigerVNC/TurboVNC quality level */
+static const int jpegQuality[10] = {
+  15, 29, 41, 42, 62, 77, 79, 86, 92, 100
+};
+
+int rfbTightQualityLevel(int quality)
+{
+  int level;
+  if (quality < 0)
+    return -1;
+  for (level = 9; level > 0; level--) {
+    if (jpegQuality[level] <= quality)
+      break;
+  }
+  return level;
+}
+
+const rfbTightEncoderVariant *rfbFindTightEncoder(const char *name)
+{
+  int i;
+  for (i = 0; rfbTightEncoders[i]; i++) {
+    if (!strcmp(rfbTightEncoders[i]->name, name))
+      return rfbTightEncoders[i];
+  }
+  return NULL;
+}
+
+const rfbTightDecoderVariant *rfbFindTightDecoder(const char *name)
+{
+  int i;
+  for (i = 0; rfbTightDecoders[i]; i++) {
+    if (!strcmp(rfbTightDecoders[i]->name, name))
+      return rfbTightDecoders[i];
+  }
+  return NULL;
+}
@@ -0,0 +1,191 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/* results.c - machine-readable benchmark results (see results.h) */
+
+#include <stdio.h>
+#include <string.h>
+#include "results.h"
+
+static FILE *json = NULL, *csv = NULL;
+static int pass = 0;
+static Bool warmup = FALSE, firstPass = TRUE, firstRecord = TRUE;
+
+static const char *subencodingNames[rfbResultSubencodings] = {
+  "solid", "mono", "index", "jpeg", "grad", "raw"
+};
+
+Bool rfbResultsOpen(const char *jsonFile, const char *csvFile)
+{
+  int i;
+
+  if (jsonFile) {
+    if ((json = fopen(jsonFile, "w")) == NULL) {
+      perror("Cannot open JSON output file");
+      return FALSE;
+    }
+    fprintf(json, "{\n  \"passes\": [");
+  }
+  if (csvFile) {
+    if ((csv = fopen(csvFile, "w")) == NULL) {
+      perror("Cannot open CSV output file");
+      return FALSE;
+    }
+    fprintf(csv, "pass,warmup,record,update,rect,x,y,width,height,pixels,"
+            "codec,bytes,time");
+    for (i = 0; i < rfbResultSubencodings; i++)
+      fprintf(csv, ",%s_rects,%s_pixels", subencodingNames[i],
+              subencodingNames[i]);
+    fprintf(csv, ",psnr,ssim\n");
+  }
+  return TRUE;
+}
+
+Bool rfbResultsClose(void)
+{
+  Bool status = TRUE;
+
+  if (json) {
+    fprintf(json, "%s]\n}\n", firstPass ? "" : "\n  ");
+    if (ferror(json) || fclose(json) != 0) status = FALSE;
+    json = NULL;
+  }
+  if (csv) {
+    if (ferror(csv) || fclose(csv) != 0) status = FALSE;
+    csv = NULL;
+  }
+  if (!status)
+    fprintf(stderr, "Could not write results file\n");
+  return status;
+}
+
+void rfbResultsBeginPass(int passNumber, Bool isWarmup)
+{
+  pass = passNumber;
+  warmup = isWarmup;
+  if (json) {
+    fprintf(json, "%s\n    {\n      \"pass\": %d,\n      \"warmup\": %s,\n"
+            "      \"rects\": [", firstPass ? "" : ",", pass,
+            warmup ? "true" : "false");
+  }
+  firstPass = FALSE;
+  firstRecord = TRUE;
+}
+
+static void write_json_codecs(const rfbCodecResult *codecs, int ncodecs,
+                              const char *indent)
+{
+  int i, j;
+
+  fprintf(json, "\"codecs\": [");
+  for (i = 0; i < ncodecs; i++) {
+    const rfbCodecResult *r = &codecs[i];
+    fprintf(json, "%s\n%s  {\"codec\": \"%s\", \"bytes\": %llu, "
+            "\"time\": %.9f", i ? "," : "", indent, r->codec, r->bytes,
+            r->time);
+    if (r->hasStats) {
+      fprintf(json, ", \"subencodings\": {");
+      for (j = 0; j < rfbResultSubencodings; j++)
+        fprintf(json, "%s\"%s\": {\"rects\": %llu, \"pixels\": %llu}",
+                j ? ", " : "", subencodingNames[j], r->subrects[j],
+                r->subpixels[j]);
+      fprintf(json, "}");
+    }
+    if (r->hasQuality)
+      fprintf(json, ", \"psnr\": %.4f, \"ssim\": %.6f", r->psnr, r->ssim);
+    fprintf(json, "}");
+  }
+  fprintf(json, "\n%s]", indent);
+}
+
+static void write_csv_codecs(const char *record, unsigned long long update,
+                             unsigned long long rect, const char *geometry,
+                             unsigned long long pixels,
+                             const rfbCodecResult *codecs, int ncodecs)
+{
+  int i, j;
+
+  for (i = 0; i < ncodecs; i++) {
+    const rfbCodecResult *r = &codecs[i];
+    fprintf(csv, "%d,%d,%s,%llu,%llu,%s,%llu,%s,%llu,%.9f", pass, warmup,
+            record, update, rect, geometry, pixels, r->codec, r->bytes,
+            r->time);
+    for (j = 0; j < rfbResultSubencodings; j++) {
+      if (r->hasStats)
+        fprintf(csv, ",%llu,%llu", r->subrects[j], r->subpixels[j]);
+      else
+        fprintf(csv, ",,");
+    }
+    if (r->hasQuality)
+      fprintf(csv, ",%.4f,%.6f\n", r->psnr, r->ssim);
+    else
+      fprintf(csv, ",,\n");
+  }
+}
+
+void rfbResultsWriteRect(int update, int rect, int x, int y, int w, int h,
+                         const rfbCodecResult *codecs, int ncodecs)
+{
+  if (json) {
+    fprintf(json, "%s\n        {\"update\": %d, \"rect\": %d, \"x\": %d, "
+            "\"y\": %d, \"width\": %d, \"height\": %d, ",
+            firstRecord ? "" : ",", update, rect, x, y, w, h);
+    write_json_codecs(codecs, ncodecs, "        ");
+    fprintf(json, "}");
+  }
+  if (csv) {
+    char geometry[48];
+    snprintf(geometry, sizeof(geometry), "%d,%d,%d,%d", x, y, w, h);
+    write_csv_codecs("rect", update, rect, geometry,
+                     (unsigned long long)w * h, codecs, ncodecs);
+  }
+  firstRecord = FALSE;
+}
+
+void rfbResultsEndPass(unsigned long long updates, unsigned long long rects,
+                       unsigned long long pixels,
+                       const rfbCodecResult *codecs, int ncodecs)
+{
+  if (json) {
+    fprintf(json, "%s],\n      \"totals\": {\"updates\": %llu, "
+            "\"rects\": %llu, \"pixels\": %llu, ",
+            firstRecord ? "" : "\n      ", updates, rects, pixels);
+    write_json_codecs(codecs, ncodecs, "      ");
+    fprintf(json, "}\n    }");
+  }
+  if (csv)
+    write_csv_codecs("total", updates, rects, ",,,", pixels, codecs, ncodecs);
+}
+
+void rfbResultsGetStatistics(rfbCodecResult *r,
+                             const rfbTightStatistics *stats)
+{
+  r->hasStats = TRUE;
+  r->subrects[rfbResultSolid] = *stats->solidrect;
+  r->subpixels[rfbResultSolid] = *stats->solidpixels;
+  r->subrects[rfbResultMono] = *stats->monorect;
+  r->subpixels[rfbResultMono] = *stats->monopixels;
+  r->subrects[rfbResultIndexed] = *stats->ndxrect;
+  r->subpixels[rfbResultIndexed] = *stats->ndxpixels;
+  r->subrects[rfbResultJpeg] = *stats->jpegrect;
+  r->subpixels[rfbResultJpeg] = *stats->jpegpixels;
+  r->subrects[rfbResultGradient] = *stats->gradrect;
+  r->subpixels[rfbResultGradient] = *stats->gradpixels;
+  r->subrects[rfbResultRaw] = *stats->fcrect;
+  r->subpixels[rfbResultRaw] = *stats->fcpixels;
+}
@@ -0,0 +1,66 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/*
+ * results.h - machine-readable benchmark results
+ *
+ * compare-encodings can write a record for each rectangle (the bytes and time
+ * spent by each codec, and for the Tight variants, the number of subrectangles
+ * of each subencoding and the quality of the decoded output) and for the grand
+ * totals of each pass, as JSON and/or as CSV.  The CSV file has one row per codec per record.  In "total" rows,
+ * the update and rect columns hold the number of updates and rectangles in
+ * the pass.
+ */
+
+#ifndef __RESULTS_H__
+#define __RESULTS_H__
+
+#include "rfb.h"
+
+enum {
+  rfbResultSolid, rfbResultMono, rfbResultIndexed, rfbResultJpeg,
+  rfbResultGradient, rfbResultRaw, rfbResultSubencodings
+};
+
+typedef struct {
+  const char *codec;
+  unsigned long long bytes;
+  double time;                  /* Seconds */
+  Bool hasStats;                /* Whether subrects and subpixels are valid */
+  unsigned long long subrects[rfbResultSubencodings];
+  unsigned long long subpixels[rfbResultSubencodings];
+  Bool hasQuality;              /* Whether psnr and ssim are valid */
+  double psnr, ssim;            /* See quality.h */
+} rfbCodecResult;
+
+extern Bool rfbResultsOpen(const char *jsonFile, const char *csvFile);
+extern Bool rfbResultsClose(void);
+extern void rfbResultsBeginPass(int pass, Bool warmup);
+extern void rfbResultsWriteRect(int update, int rect, int x, int y, int w,
+                                int h, const rfbCodecResult *codecs,
+                                int ncodecs);
+extern void rfbResultsEndPass(unsigned long long updates,
+                              unsigned long long rects,
+                              unsigned long long pixels,
+                              const rfbCodecResult *codecs, int ncodecs);
+
+/* Copy a Tight variant's statistics counters into a result */
+extern void rfbResultsGetStatistics(rfbCodecResult *r,
+                                    const rfbTightStatistics *stats);
+
+#endif /* __RESULTS_H__ */
@@ -59,7 +59,7 @@ typedef struct
     int height;
     int sizeInBytes;
     int bitsPerPixel;
-    char pfbMemory[1280*1024*4];
+    char *pfbMemory;
 } rfbScreenInfo, *rfbScreenInfoPtr;
 
 
@@ -171,11 +171,13 @@ extern int ublen;
 extern Bool rfbSendUpdateBuf(rfbClientPtr cl);
 
 /*
- * This must be big enough to hold a single 1280x1024 raw rectangle
+ * The send buffer is resized along with the framebuffer so that it can hold a
+ * single full-screen raw rectangle (see rfbResizeFramebuffer()), but it is
+ * never smaller than SEND_BUF_SIZE.
  */
 #define SEND_BUF_SIZE (5*1024*1024)
 extern char *sendBuf;
-extern int sblen, sbptr;
+extern int sblen, sbptr, sendBufSize;
 
 /* translate.c */
 
@@ -193,6 +195,10 @@ extern Bool rfbSendRectEncodingHextile(rfbClientPtr cl, int x, int y, int w,
 				       int h);
 
 /* zrle.c */
+/* rfbEncodingZYWRLE enables the wavelet transform, with a level based on
+   rfbZRLEQualityLevel (the JPEG quality level that a viewer would request) */
+extern int rfbZRLEPreferredEncoding;
+extern int rfbZRLEQualityLevel;
 extern Bool rfbSendRectEncodingZRLE(rfbClientPtr cl, int x, int y, int w,
                                     int h);
 void rfbFreeZrleData(rfbClientPtr cl);
@@ -211,6 +217,94 @@ void rfbFreeZrleData(rfbClientPtr cl);
 extern Bool rfbTightDisableGradient;
 
 extern Bool rfbSendRectEncodingTight(rfbClientPtr cl, int x,int y,int w,int h);
+extern void rfbSetTightLevels(int compress, int quality, int subsamp);
+
+
+/* registry.c */
+
+/*
+ * Each Tight/Turbo/Tiger encoder and decoder variant that was selected at
+ * build time is registered under its source file name (for instance,
+ * "turbo-1.1" or "tiger-1.4").  See variant.h.
+ */
+
+typedef struct {
+    unsigned long long *solidrect, *solidpixels, *monorect, *monopixels,
+      *ndxrect, *ndxpixels, *jpegrect, *jpegpixels, *gradrect, *gradpixels,
+      *fcrect, *fcpixels;
+} rfbTightStatistics;
+
+/*
+ * Time spent in, and bytes consumed and produced by, one of the encoder's hot
+ * paths.  Only turbo-1.1 maintains these, and only if it was built with
+ * TIGHT_PHASE_TIMERS.
+ */
+
+#define rfbTightMaxPhases 16
+#define rfbTightMaxPhaseThreads 32
+
+typedef struct {
+    const char *name;
+    unsigned long long calls, bytesIn, bytesOut;
+    /* Indexed by encoder thread */
+    double seconds[rfbTightMaxPhaseThreads];
+} rfbTightPhase;
+
+/*
+ * Encoder levels that can be changed at run time (see setLevels below.)  The
+ * subsampling levels are in the same order as TurboVNC's.
+ */
+
+#define rfbTightLevelDefault (-2)
+
+enum {
+    rfbTightSubsamp444, rfbTightSubsamp420, rfbTightSubsamp422,
+    rfbTightSubsampGray, rfbTightSubsampLevels
+};
+
+/* Returns the highest TigerVNC/TurboVNC quality level (0-9) whose JPEG
+   quality doesn't exceed the given JPEG quality, or -1 if quality is -1 */
+extern int rfbTightQualityLevel(int quality);
+
+typedef struct {
+    const char *name;
+    Bool (*sendRect)(rfbClientPtr cl, int x, int y, int w, int h);
+    /* Called at the end of each pass, or NULL */
+    Bool (*finish)(rfbClientPtr cl);
+    /* NULL if the variant doesn't maintain TIGHT_STATISTICS counters */
+    const rfbTightStatistics *stats;
+    /* Sets the compression level (0-9), the JPEG quality (1-100, or -1 to
+       disable JPEG), and the chroma subsampling (rfbTightSubsamp*).  Any of
+       them may be rfbTightLevelDefault to keep the variant's own setting.
+       Each variant maps these onto the levels that it supports.  NULL if the
+       variant's levels are fixed */
+    void (*setLevels)(int compress, int quality, int subsamp);
+    /* Fills in at most maxPhases phase timers and returns the number filled
+       in, or NULL if the variant wasn't built with phase timers */
+    int (*getPhases)(rfbTightPhase *phases, int maxPhases);
+    void (*resetPhases)(void);
+} rfbTightEncoderVariant;
+
+typedef struct {
+    const char *name;
+    /* Indexed by bits per pixel / 16 (8, 16, and 32 bpp) */
+    Bool (*handleRect[3])(int rx, int ry, int rw, int rh);
+    /* Called before and after decoding the rectangles from each encoder
+       invocation */
+    Bool (*begin)(void);
+    void (*end)(void);
+    /* Forget all zlib stream state before starting a new pass */
+    void (*reset)(void);
+    /* TRUE if the decoder writes the decoded pixels to image, so that they
+       can be compared with the source framebuffer (see quality.h) */
+    Bool writesImage;
+} rfbTightDecoderVariant;
+
+extern const rfbTightEncoderVariant *rfbTightEncoders[];
+extern const rfbTightDecoderVariant *rfbTightDecoders[];
+
+extern const rfbTightEncoderVariant *rfbFindTightEncoder(const char *name);
+extern const rfbTightDecoderVariant *rfbFindTightDecoder(const char *name);
 
 
 /* zlib.h */
@@ -236,7 +330,12 @@ extern Bool rfbSendRectEncodingZlib(rfbClientPtr cl, int x, int y, int w,
 extern Bool InterframeOn(rfbClientPtr cl);
 #endif
 
-extern void InitEverything (int color_depth);
+extern void InitEverything (int color_depth, int width, int height);
+
+extern Bool rfbResizeFramebuffer (int width, int height);
+
+/* Incremented whenever the framebuffers and the send buffer move */
+extern int rfbFramebufferGeneration;
 
 extern int rfbLog (char *fmt, ...);
 
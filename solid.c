@@ -0,0 +1,311 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/* solid.c - solid-color search kernels (see solid.h) */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "solid.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define SOLID_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * The kernels work on the bytes of one row.  The color is replicated into a
+ * 32-bit pattern (four 8-bit pixels, two 16-bit pixels, or one 32-bit pixel),
+ * and since every vector load starts at a multiple of the pixel size from the
+ * start of the row, byte i of a vector is always compared with byte i % 4 of
+ * the pattern.  A span kernel returns the number of bytes at the start of the
+ * row that match the pattern, and a reverse span kernel returns the number at
+ * the end.  The caller divides those by the pixel size, which discards a pixel
+ * that only partly matches.  The wider kernels hand the tail of the row off to
+ * the next narrower one.
+ */
+
+typedef size_t (*span_fn)(const unsigned char *p, size_t n,
+                          unsigned int pattern, int pixelBytes);
+
+typedef struct {
+  const char *name;
+  span_fn span, rspan;
+} kernel_set;
+
+static size_t SpanScalar(const unsigned char *p, size_t n,
+                         unsigned int pattern, int pixelBytes)
+{
+  size_t i;
+
+  switch (pixelBytes) {
+  case 4:
+    for (i = 0; i < n; i += 4)
+      if (*(const unsigned int *)&p[i] != pattern) return i;
+    return n;
+  case 2:
+    for (i = 0; i < n; i += 2)
+      if (*(const unsigned short *)&p[i] != (unsigned short)pattern)
+        return i;
+    return n;
+  default:
+    for (i = 0; i < n; i++)
+      if (p[i] != (unsigned char)pattern) return i;
+    return n;
+  }
+}
+
+static size_t RSpanScalar(const unsigned char *p, size_t n,
+                          unsigned int pattern, int pixelBytes)
+{
+  size_t i;
+
+  switch (pixelBytes) {
+  case 4:
+    for (i = n; i > 0; i -= 4)
+      if (*(const unsigned int *)&p[i - 4] != pattern) return n - i;
+    return n;
+  case 2:
+    for (i = n; i > 0; i -= 2)
+      if (*(const unsigned short *)&p[i - 2] != (unsigned short)pattern)
+        return n - i;
+    return n;
+  default:
+    for (i = n; i > 0; i--)
+      if (p[i - 1] != (unsigned char)pattern) return n - i;
+    return n;
+  }
+}
+
+#ifdef SOLID_X86
+
+__attribute__((target("sse2")))
+static size_t SpanSSE2(const unsigned char *p, size_t n, unsigned int pattern,
+                       int pixelBytes)
+{
+  __m128i c = _mm_set1_epi32((int)pattern);
+  size_t i;
+  unsigned int m;
+
+  for (i = 0; i + 16 <= n; i += 16) {
+    m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+          _mm_loadu_si128((const __m128i *)&p[i]), c));
+    if (m != 0xFFFF) return i + __builtin_ctz(~m);
+  }
+  return i + SpanScalar(&p[i], n - i, pattern, pixelBytes);
+}
+
+__attribute__((target("sse2")))
+static size_t RSpanSSE2(const unsigned char *p, size_t n,
+                        unsigned int pattern, int pixelBytes)
+{
+  __m128i c = _mm_set1_epi32((int)pattern);
+  size_t i;
+  unsigned int m;
+
+  for (i = n; i >= 16; i -= 16) {
+    m = _mm_movemask_epi8(_mm_cmpeq_epi8(
+          _mm_loadu_si128((const __m128i *)&p[i - 16]), c));
+    if (m != 0xFFFF) return n - i + __builtin_clz(~m & 0xFFFF) - 16;
+  }
+  return n - i + RSpanScalar(p, i, pattern, pixelBytes);
+}
+
+__attribute__((target("avx2")))
+static size_t SpanAVX2(const unsigned char *p, size_t n, unsigned int pattern,
+                       int pixelBytes)
+{
+  __m256i c = _mm256_set1_epi32((int)pattern);
+  size_t i;
+  unsigned int m;
+
+  for (i = 0; i + 32 <= n; i += 32) {
+    m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+          _mm256_loadu_si256((const __m256i *)&p[i]), c));
+    if (m != 0xFFFFFFFF) return i + __builtin_ctz(~m);
+  }
+  return i + SpanSSE2(&p[i], n - i, pattern, pixelBytes);
+}
+
+__attribute__((target("avx2")))
+static size_t RSpanAVX2(const unsigned char *p, size_t n,
+                        unsigned int pattern, int pixelBytes)
+{
+  __m256i c = _mm256_set1_epi32((int)pattern);
+  size_t i;
+  unsigned int m;
+
+  for (i = n; i >= 32; i -= 32) {
+    m = (unsigned int)_mm256_movemask_epi8(_mm256_cmpeq_epi8(
+          _mm256_loadu_si256((const __m256i *)&p[i - 32]), c));
+    if (m != 0xFFFFFFFF) return n - i + __builtin_clz(~m);
+  }
+  return n - i + RSpanSSE2(p, i, pattern, pixelBytes);
+}
+
+#endif
+
+/* From the widest to the narrowest */
+static const kernel_set kernelSets[] = {
+#ifdef SOLID_X86
+  { "avx2", SpanAVX2, RSpanAVX2 },
+  { "sse2", SpanSSE2, RSpanSSE2 },
+#endif
+  { "scalar", SpanScalar, RSpanScalar }
+};
+
+#define NKERNELSETS (int)(sizeof(kernelSets) / sizeof(kernel_set))
+
+static const kernel_set *kernels = &kernelSets[NKERNELSETS - 1];
+
+static int Supported(const kernel_set *k)
+{
+#ifdef SOLID_X86
+  if (!strcmp(k->name, "avx2"))
+    return __builtin_cpu_supports("avx2");
+  if (!strcmp(k->name, "sse2"))
+    return __builtin_cpu_supports("sse2");
+#endif
+  return 1;
+}
+
+/* This runs before main(), so the functions below can use the kernels
+   without checking whether they have been chosen yet. */
+
+#ifdef __GNUC__
+__attribute__((constructor))
+#endif
+static void SelectKernels(void)
+{
+  const char *env = getenv("RFB_SOLID_KERNELS");
+  int i, requested = -1;
+
+  if (env && strlen(env) > 0) {
+    for (i = 0; i < NKERNELSETS; i++)
+      if (!strcmp(env, kernelSets[i].name)) requested = i;
+    if (requested < 0)
+      fprintf(stderr, "Unknown solid-tile kernels %s.  Using the default.\n",
+              env);
+  }
+
+  /* A set that the CPU doesn't support is never used, even if it was
+     requested. */
+  for (i = requested < 0 ? 0 : requested; i < NKERNELSETS; i++) {
+    if (Supported(&kernelSets[i])) {
+      kernels = &kernelSets[i];
+      break;
+    }
+  }
+}
+
+/* Replicates the color into the 32-bit pattern, or returns 0 if it can't
+   match a pixel of the given size */
+
+static int Pattern(int bpp, unsigned int color, unsigned int *pattern)
+{
+  switch (bpp) {
+  case 32:
+    *pattern = color;
+    return 1;
+  case 16:
+    if (color > 0xFFFF) return 0;
+    *pattern = color | (color << 16);
+    return 1;
+  default:
+    if (color > 0xFF) return 0;
+    *pattern = color * 0x01010101U;
+    return 1;
+  }
+}
+
+int rfbSolidTopRows(const void *buf, int pitch, int w, int h, int bpp,
+                    unsigned int color)
+{
+  const kernel_set *k = kernels;
+  const unsigned char *row = (const unsigned char *)buf;
+  int y, pixelBytes = bpp / 8;
+  size_t n = (size_t)w * pixelBytes;
+  unsigned int pattern;
+
+  if (!Pattern(bpp, color, &pattern)) return 0;
+  for (y = 0; y < h; y++, row += pitch)
+    if (k->span(row, n, pattern, pixelBytes) != n) break;
+  return y;
+}
+
+int rfbSolidBottomRows(const void *buf, int pitch, int w, int h, int bpp,
+                       unsigned int color)
+{
+  const kernel_set *k = kernels;
+  const unsigned char *row;
+  int y, pixelBytes = bpp / 8;
+  size_t n = (size_t)w * pixelBytes;
+  unsigned int pattern;
+
+  if (!Pattern(bpp, color, &pattern) || h < 1) return 0;
+  row = (const unsigned char *)buf + (ptrdiff_t)pitch * (h - 1);
+  for (y = 0; y < h; y++, row -= pitch)
+    if (k->span(row, n, pattern, pixelBytes) != n) break;
+  return y;
+}
+
+int rfbSolidLeftColumns(const void *buf, int pitch, int w, int h, int bpp,
+                        unsigned int color)
+{
+  const kernel_set *k = kernels;
+  const unsigned char *row = (const unsigned char *)buf;
+  int y, cols = w, pixelBytes = bpp / 8;
+  unsigned int pattern;
+
+  if (!Pattern(bpp, color, &pattern) || w < 1) return 0;
+  for (y = 0; y < h && cols > 0; y++, row += pitch) {
+    int n = (int)(k->span(row, (size_t)cols * pixelBytes, pattern,
+                          pixelBytes) / pixelBytes);
+    if (n < cols) cols = n;
+  }
+  return cols;
+}
+
+int rfbSolidRightColumns(const void *buf, int pitch, int w, int h, int bpp,
+                         unsigned int color)
+{
+  const kernel_set *k = kernels;
+  const unsigned char *row = (const unsigned char *)buf;
+  int y, cols = w, pixelBytes = bpp / 8;
+  unsigned int pattern;
+
+  if (!Pattern(bpp, color, &pattern) || w < 1) return 0;
+  for (y = 0; y < h && cols > 0; y++, row += pitch) {
+    int n = (int)(k->rspan(&row[(size_t)(w - cols) * pixelBytes],
+                           (size_t)cols * pixelBytes, pattern,
+                           pixelBytes) / pixelBytes);
+    if (n < cols) cols = n;
+  }
+  return cols;
+}
+
+int rfbSolidRun(const void *buf, int n, int bpp, unsigned int color)
+{
+  int pixelBytes = bpp / 8;
+  unsigned int pattern;
+
+  if (!Pattern(bpp, color, &pattern) || n < 1) return 0;
+  return (int)(kernels->span((const unsigned char *)buf,
+                             (size_t)n * pixelBytes, pattern, pixelBytes) /
+               pixelBytes);
+}
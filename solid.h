@@ -0,0 +1,99 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+/*
+ * solid.h - solid-color search kernels shared by the encoders
+ *
+ * These find out whether a block of pixels is all one color, and how many
+ * rows or columns at one edge of a block are.  buf points to the top left
+ * pixel of the block, pitch is the distance between rows in bytes, bpp is 8,
+ * 16, or 32, and the color is compared against the pixels as they are stored
+ * in the framebuffer (in host byte order), so a color with bits set above bpp
+ * never matches.
+ *
+ * Except in rfbSolidCheck(), the pixels of each row are compared with the
+ * widest SIMD instructions that the CPU supports (AVX2 or SSE2 on x86, with a
+ * scalar fallback elsewhere), which are chosen when the program starts.
+ * Setting the RFB_SOLID_KERNELS environment variable to avx2, sse2, or scalar
+ * chooses a narrower set instead, which is useful for comparing them.  There
+ * is no AVX-512 set:  the rows that the encoders check are rarely longer than
+ * 64 bytes, and using 512-bit instructions at all slowed the encoders down by
+ * nearly half.  Counting whole columns also works one row at a time, so it
+ * never walks the framebuffer with a stride of one row per pixel.
+ */
+
+#ifndef __SOLID_H__
+#define __SOLID_H__
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Returns nonzero if every pixel in the block is the given color.  This is
+   meant for the tiles of the solid-area search, whose rows are too short to
+   be worth a call to a SIMD kernel, so it is inline, and it checks each row
+   without branching (which the compiler can vectorize.) */
+static inline int rfbSolidCheck(const void *buf, int pitch, int w, int h,
+                                int bpp, unsigned int color)
+{
+  const unsigned char *row = (const unsigned char *)buf;
+  unsigned int diff;
+  int x, y;
+
+  for (y = 0; y < h; y++, row += pitch) {
+    diff = 0;
+    switch (bpp) {
+    case 32:
+      for (x = 0; x < w; x++)
+        diff |= ((const unsigned int *)row)[x] ^ color;
+      break;
+    case 16:
+      for (x = 0; x < w; x++)
+        diff |= ((const unsigned short *)row)[x] ^ color;
+      break;
+    default:
+      for (x = 0; x < w; x++)
+        diff |= row[x] ^ color;
+    }
+    if (diff) return 0;
+  }
+  return 1;
+}
+
+/* Return the number of rows, counting from the top or the bottom of the
+   block, that are all the given color */
+extern int rfbSolidTopRows(const void *buf, int pitch, int w, int h, int bpp,
+                           unsigned int color);
+extern int rfbSolidBottomRows(const void *buf, int pitch, int w, int h,
+                              int bpp, unsigned int color);
+
+/* Return the number of columns, counting from the left or the right edge of
+   the block, that are all the given color */
+extern int rfbSolidLeftColumns(const void *buf, int pitch, int w, int h,
+                               int bpp, unsigned int color);
+extern int rfbSolidRightColumns(const void *buf, int pitch, int w, int h,
+                                int bpp, unsigned int color);
+
+/* Returns the number of pixels, counting from the start of a run of n
+   pixels, that are the given color */
+extern int rfbSolidRun(const void *buf, int n, int bpp, unsigned int color);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SOLID_H__ */
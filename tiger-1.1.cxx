@@ -16,6 +16,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
  * USA.
  */
+#include <stdio.h>
 #include <rfb/encodings.h>
 #include <rfb/TightEncoder.h>
 #include <rdr/ZlibOutStream.h>
@@ -77,8 +78,13 @@ static const TIGHT_CONF conf[10] = {
   { 65536, 2048,  32, 9, 9, 9,  96,100, SUBSAMP_NONE }  // 9
 };
 
-static const int compressLevel = 6;
-static const int qualityLevel = 8;
+static int compressLevel = 6;
+static int qualityLevel = 8;
+// If >= 0, these override the JPEG quality and subsampling of qualityLevel
+static int fineQualityLevel = -1;
+static int subsampling = -1;
+
+static TIGHT_CONF jconf;
 
 static const TIGHT_CONF* s_pconf;
 static const TIGHT_CONF* s_pjconf;
@@ -88,9 +94,9 @@ static rfbClientPtr cl = NULL;
 static rdr::U8* imageBuf = NULL;
 static int imageBufSize = 0;
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 
 //
 // Including BPP-dependent implementation of the encoder.
@@ -132,7 +138,12 @@ bool writeRect(const Rect& r, const PixelFormat& pf)
 
   // Copy members of current TightEncoder instance to static variables.
   s_pconf = pconf = &conf[compressLevel];
-  if (qualityLevel >= 0) s_pjconf = &conf[qualityLevel];
+  if (qualityLevel >= 0) {
+    jconf = conf[qualityLevel];
+    if (fineQualityLevel >= 0) jconf.jpegQuality = fineQualityLevel;
+    if (subsampling >= 0) jconf.jpegSubSample = (subsampEnum)subsampling;
+    s_pjconf = &jconf;
+  } else s_pjconf = NULL;
 
   // Encode small rects as is.
   bool rectTooBig = w > pconf->maxRectWidth || w * h > pconf->maxRectSize;
@@ -209,6 +220,22 @@ void writeSubrect(const Rect& r, const PixelFormat& pf)
   cl->rfbBytesSent[rfbEncodingTight] += compressedLen;
 }
 
+// This version has no grayscale JPEG, so that subsampling level is ignored.
+void rfbSetTightLevels(int compress, int quality, int subsamp)
+{
+  static const int subsampLevel2subsamp[rfbTightSubsampLevels] = {
+    SUBSAMP_NONE, SUBSAMP_420, SUBSAMP_422, -1
+  };
+
+  if (compress != rfbTightLevelDefault) compressLevel = compress;
+  if (quality != rfbTightLevelDefault) {
+    qualityLevel = rfbTightQualityLevel(quality);
+    fineQualityLevel = quality;
+  }
+  if (subsamp != rfbTightLevelDefault)
+    subsampling = subsampLevel2subsamp[subsamp];
+}
+
 Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
 {
   try {
@@ -32,6 +32,7 @@ using namespace rfb;
 #include <rfb/PixelFormat.h>
 #include <rfb/PixelBuffer.h>
 #include <rdr/MemInStream.h>
+#include "pipelineinstream.h"
 
 #define TIGHT_MAX_WIDTH 2048
 
@@ -142,7 +143,9 @@ JpegSetSrcManager(j_decompress_ptr cinfo, char *compressedData, int compressedLe
 
 static TightDecoder *td = NULL;
 extern XImage *image;
-static rdr::MemInStream *is = NULL;
+static rdr::MemInStream *mis = NULL;
+static rdr::PipelineInStream *pis = NULL;
+static int fbGeneration = -1;
 
 #endif
 
@@ -165,21 +168,36 @@ static Bool HandleTightBPP(int rx, int ry, int rw, int rh)
     if (i == 4) {
       if (td) { delete td;  td = NULL; }
       if (pb) { delete pb;  pb = NULL; }
-      if (is) { delete is;  is = NULL; }
+      if (mis) { delete mis;  mis = NULL; }
+      if (pis) { delete pis;  pis = NULL; }
+    }
+    if (fbGeneration != rfbFramebufferGeneration) {
+      if (pb) { delete pb;  pb = NULL; }
+      if (mis) { delete mis;  mis = NULL; }
+      if (pis) { delete pis;  pis = NULL; }
+      fbGeneration = rfbFramebufferGeneration;
     }
     if (!td) td = new TightDecoder;
-    if (!pb) pb = new FullFramePixelBuffer(pf, image->width, image->height,
+    /* This version of FullFramePixelBuffer assumes that the stride is equal
+       to the width. */
+    if (!pb) pb = new FullFramePixelBuffer(pf,
+      image->bytes_per_line / (image->bits_per_pixel / 8), image->height,
       (rdr::U8 *)image->data, NULL);
-    if (!is) {
-      is = new rdr::MemInStream(sendBuf, SEND_BUF_SIZE);
+    rdr::InStream *is;
+    if (rfbPipelineActive) {
+      if (!pis) pis = new rdr::PipelineInStream;
+      is = pis;
+    } else {
+      if (!mis) mis = new rdr::MemInStream(sendBuf, sendBufSize);
+      mis->reposition(sbptr);
+      is = mis;
     }
 
     /* Uncompressed RGB24 JPEG data, before translated, can be up to 3
        times larger, if VNC bpp is 8. */
     rdr::U8* buf = getImageBuf(r.area()*3, pf);
-    is->reposition(sbptr);
     TIGHT_DECODE (r, is, td->zis, (PIXEL_T *) buf, pf);
-    sbptr = is->pos();
+    if (!rfbPipelineActive) sbptr = mis->pos();
   }
   catch(rdr::Exception e) {
     fprintf(stderr, "ERROR: %s\n", e.str());
@@ -16,25 +16,28 @@
  * USA.
  */
 
+#include <stdio.h>
 #include <rdr/Exception.h>
 #include <rfb/ComparingUpdateTracker.h>
 #include <rdr/RFBOutStream.h>
 #include <rfb/TightEncoder.h>
 #include "rfb.h"
 
+using namespace rfb;
+
 static int compressLevel = 1;
 static int qualityLevel = 8;
-
-using namespace rfb;
+static int fineQualityLevel = -1;
+static JPEG_SUBSAMP subsampling = SUBSAMP_UNDEFINED;
 
 rfbClientPtr cl = NULL;
 rdr::RFBOutStream rfbos;
 static rdr::U8* imageBuf = NULL;
 static int imageBufSize = 0;
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-  ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-  gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+  ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+  gradrect=0, gradpixels=0;
 
 rdr::U8* getImageBuf(int required, const PixelFormat& pf)
 {
@@ -58,6 +61,22 @@ Bool compareFB = FALSE;
 
 static ComparingUpdateTracker *cut = NULL;
 static FullFramePixelBuffer *fb = NULL;
+static int fbGeneration = -1;
+
+void rfbSetTightLevels(int compress, int quality, int subsamp)
+{
+  static const JPEG_SUBSAMP subsampLevel2subsamp[rfbTightSubsampLevels] = {
+    SUBSAMP_NONE, SUBSAMP_420, SUBSAMP_422, SUBSAMP_GRAY
+  };
+
+  if (compress != rfbTightLevelDefault) compressLevel = compress;
+  if (quality != rfbTightLevelDefault) {
+    qualityLevel = rfbTightQualityLevel(quality);
+    fineQualityLevel = quality;
+  }
+  if (subsamp != rfbTightLevelDefault)
+    subsampling = subsampLevel2subsamp[subsamp];
+}
 
 Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
 {
@@ -75,6 +94,8 @@ Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
 
     te->setCompressLevel(compressLevel);
     te->setQualityLevel(qualityLevel);
+    if (qualityLevel >= 0)
+      te->setFineQualityLevel(fineQualityLevel, subsampling);
 
     PixelFormat serverPF(rfbServerFormat.bitsPerPixel, rfbServerFormat.depth,
       rfbServerFormat.bigEndian==1, rfbServerFormat.trueColour==1,
@@ -88,7 +109,15 @@ Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
       cl->format.greenShift, cl->format.blueShift);
     clientPF = cpf;
 
-    if (!fb) fb = new FullFramePixelBuffer(serverPF, rfbScreen.width,
+    if (fbGeneration != rfbFramebufferGeneration) {
+      if (fb) { delete fb;  fb = NULL; }
+      if (cut) { delete cut;  cut = NULL; }
+      fbGeneration = rfbFramebufferGeneration;
+    }
+    /* This version of FullFramePixelBuffer assumes that the stride is equal
+       to the width. */
+    if (!fb) fb = new FullFramePixelBuffer(serverPF,
+      rfbScreen.paddedWidthInBytes / (rfbScreen.bitsPerPixel / 8),
       rfbScreen.height, (rdr::U8 *)rfbScreen.pfbMemory, NULL);
 
     image_getter.init(fb, clientPF, NULL);
@@ -29,8 +29,9 @@
 #include <assert.h>
 
 extern rdr::U8* getImageBuf(int, const PixelFormat&);
-extern unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect,
-  ndxpixels, jpegrect, jpegpixels, fcrect, fcpixels, gradrect, gradpixels;
+extern unsigned long long solidrect, solidpixels, monorect, monopixels,
+  ndxrect, ndxpixels, jpegrect, jpegpixels, fcrect, fcpixels, gradrect,
+  gradpixels;
 
 namespace rfb {
 
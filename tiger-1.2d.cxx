@@ -29,6 +29,7 @@ using namespace rfb;
 #include <rfb/PixelFormat.h>
 #include <rfb/PixelBuffer.h>
 #include <rdr/MemInStream.h>
+#include "pipelineinstream.h"
 
 #define TIGHT_MAX_WIDTH 2048
 
@@ -66,6 +67,7 @@ TightDecoder::~TightDecoder()
 }
 
 static rdr::MemInStream *mis = NULL;
+static rdr::PipelineInStream *pis = NULL;
 
 class FrameBuffer : public CMsgHandler
 {
@@ -113,7 +115,8 @@ class FrameBuffer : public CMsgHandler
 
 void TightDecoder::readRect(const Rect& r, CMsgHandler* handler)
 {
-  is = mis;
+  if (rfbPipelineActive) is = pis;
+  else is = mis;
   this->handler = handler;
   clientpf = handler->getPreferredPF();
   PixelFormat spf(rfbServerFormat.bitsPerPixel, rfbServerFormat.depth,
@@ -144,6 +147,7 @@ void TightDecoder::readRect(const Rect& r, CMsgHandler* handler)
 static TightDecoder *td = NULL;
 static FrameBuffer *fb = NULL;
 extern XImage *image;
+static int fbGeneration = -1;
 
 #endif
 
@@ -162,17 +166,29 @@ static Bool HandleTightBPP(int rx, int ry, int rw, int rh)
       if (td) { delete td;  td = NULL; }
       if (fb) { delete fb;  fb = NULL; }
       if (mis) { delete mis; mis = NULL; }
+      if (pis) { delete pis; pis = NULL; }
+    }
+    if (fbGeneration != rfbFramebufferGeneration) {
+      if (fb) { delete fb;  fb = NULL; }
+      if (mis) { delete mis; mis = NULL; }
+      if (pis) { delete pis; pis = NULL; }
+      fbGeneration = rfbFramebufferGeneration;
     }
     if (!td) td = new TightDecoder;
-    if (!fb) fb = new FrameBuffer(image->width, image->height,
+    /* This version of FullFramePixelBuffer assumes that the stride is equal
+       to the width. */
+    if (!fb) fb = new FrameBuffer(
+      image->bytes_per_line / (image->bits_per_pixel / 8), image->height,
       (rdr::U8 *)image->data);
-    if (!mis) {
-      mis = new rdr::MemInStream(sendBuf, SEND_BUF_SIZE);
+    if (rfbPipelineActive) {
+      if (!pis) pis = new rdr::PipelineInStream;
+      td->readRect(r, fb);
+    } else {
+      if (!mis) mis = new rdr::MemInStream(sendBuf, sendBufSize);
+      mis->reposition(sbptr);
+      td->readRect(r, fb);
+      sbptr = mis->pos();
     }
-
-    mis->reposition(sbptr);
-    td->readRect(r, fb);
-    sbptr = mis->pos();
   }
   catch(Exception e) {
     fprintf(stderr, "ERROR: %s\n", e.str());
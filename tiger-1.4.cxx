@@ -16,10 +16,12 @@
  * USA.
  */
 
+#include <stdio.h>
 #include <rdr/Exception.h>
 #include <rdr/RFBOutStream.h>
 #include <rfb/ComparingUpdateTracker.h>
 #include <rfb/EncodeManager.h>
+#include <rfb/ConnParams.h>
 #include "rfb.h"
 
 int compressLevel = 1;
@@ -32,18 +34,36 @@ using namespace rfb;
 rfbClientPtr cl = NULL;
 rdr::RFBOutStream rfbos;
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-  ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-  gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+  ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+  gradrect=0, gradpixels=0;
 
 Bool compareFB = FALSE;
 
 static EncodeManager *em = NULL;
 static ComparingUpdateTracker *cut = NULL;
 static FullFramePixelBuffer *fb = NULL;
+static int fbGeneration = -1;
 
 PixelFormat clientPF;
 
+void rfbSetTightLevels(int compress, int quality, int subsamp)
+{
+  static const int subsampLevel2subsamp[rfbTightSubsampLevels] = {
+    subsampleNone, subsample4X, subsample2X, subsampleGray
+  };
+
+  if (compress != rfbTightLevelDefault) compressLevel = compress;
+  if (quality != rfbTightLevelDefault) {
+    qualityLevel = rfbTightQualityLevel(quality);
+    fineQualityLevel = quality;
+  }
+  if (subsamp != rfbTightLevelDefault)
+    subsampling = subsampLevel2subsamp[subsamp];
+  // Any subsampling level enables JPEG in this version.
+  if (qualityLevel < 0) subsampling = -1;
+}
+
 Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
 {
   try {
@@ -72,8 +92,14 @@ Bool rfbSendRectEncodingTight(rfbClientPtr _cl, int x, int y, int w, int h)
       cl->format.greenShift, cl->format.blueShift);
     clientPF = cpf;
 
+    if (fbGeneration != rfbFramebufferGeneration) {
+      if (fb) { delete fb;  fb = NULL; }
+      if (cut) { delete cut;  cut = NULL; }
+      fbGeneration = rfbFramebufferGeneration;
+    }
     if (!fb) fb = new FullFramePixelBuffer(serverPF, rfbScreen.width,
-      rfbScreen.height, (rdr::U8 *)rfbScreen.pfbMemory, rfbScreen.width);
+      rfbScreen.height, (rdr::U8 *)rfbScreen.pfbMemory,
+      rfbScreen.paddedWidthInBytes / (rfbScreen.bitsPerPixel / 8));
 
     if (compareFB) {
       if (!cut) cut = new ComparingUpdateTracker(fb);
@@ -28,6 +28,8 @@
 #include <rfb/TightEncoder.h>
 #include <rfb/TightJPEGEncoder.h>
 
+#include "solid.h"
+
 extern int compressLevel, qualityLevel, fineQualityLevel, subsampling;
 extern rdr::RFBOutStream rfbos;
 
@@ -582,40 +584,58 @@ void EncodeManager::extendSolidAreaByPixel(const Rect& r, const Rect& sr,
                                            const rdr::U8* colourValue,
                                            const PixelBuffer *pb, Rect* er)
 {
-  int cx, cy;
+  int bpp = pb->getPF().bpp;
+  unsigned int colour;
+  const rdr::U8* buffer;
+  int stride;
   Rect tr;
 
+  switch (bpp) {
+  case 32:
+    colour = *(const rdr::U32*)colourValue;
+    break;
+  case 16:
+    colour = *(const rdr::U16*)colourValue;
+    break;
+  default:
+    colour = *(const rdr::U8*)colourValue;
+  }
+
   // Try to extend the area upwards.
-  for (cy = sr.tl.y - 1; cy >= r.tl.y; cy--) {
-    tr.setXYWH(sr.tl.x, cy, sr.width(), 1);
-    if (!checkSolidTile(tr, colourValue, pb))
-      break;
+  er->tl.y = sr.tl.y;
+  if (sr.tl.y > r.tl.y) {
+    tr.setXYWH(sr.tl.x, r.tl.y, sr.width(), sr.tl.y - r.tl.y);
+    buffer = pb->getBuffer(tr, &stride);
+    er->tl.y -= rfbSolidBottomRows(buffer, stride * (bpp / 8), tr.width(),
+                                   tr.height(), bpp, colour);
   }
-  er->tl.y = cy + 1;
 
   // ... downwards.
-  for (cy = sr.br.y; cy < r.br.y; cy++) {
-    tr.setXYWH(sr.tl.x, cy, sr.width(), 1);
-    if (!checkSolidTile(tr, colourValue, pb))
-      break;
+  er->br.y = sr.br.y;
+  if (sr.br.y < r.br.y) {
+    tr.setXYWH(sr.tl.x, sr.br.y, sr.width(), r.br.y - sr.br.y);
+    buffer = pb->getBuffer(tr, &stride);
+    er->br.y += rfbSolidTopRows(buffer, stride * (bpp / 8), tr.width(),
+                                tr.height(), bpp, colour);
   }
-  er->br.y = cy;
 
-  // ... to the left.
-  for (cx = sr.tl.x - 1; cx >= r.tl.x; cx--) {
-    tr.setXYWH(cx, er->tl.y, 1, er->height());
-    if (!checkSolidTile(tr, colourValue, pb))
-      break;
+  // ... to the left.  The columns are scanned a row at a time.
+  er->tl.x = sr.tl.x;
+  if (sr.tl.x > r.tl.x) {
+    tr.setXYWH(r.tl.x, er->tl.y, sr.tl.x - r.tl.x, er->height());
+    buffer = pb->getBuffer(tr, &stride);
+    er->tl.x -= rfbSolidRightColumns(buffer, stride * (bpp / 8), tr.width(),
+                                     tr.height(), bpp, colour);
   }
-  er->tl.x = cx + 1;
 
   // ... to the right.
-  for (cx = sr.br.x; cx < r.br.x; cx++) {
-    tr.setXYWH(cx, er->tl.y, 1, er->height());
-    if (!checkSolidTile(tr, colourValue, pb))
-      break;
+  er->br.x = sr.br.x;
+  if (sr.br.x < r.br.x) {
+    tr.setXYWH(sr.br.x, er->tl.y, r.br.x - sr.br.x, er->height());
+    buffer = pb->getBuffer(tr, &stride);
+    er->br.x += rfbSolidLeftColumns(buffer, stride * (bpp / 8), tr.width(),
+                                    tr.height(), bpp, colour);
   }
-  er->br.x = cx;
 }
 
 PixelBuffer* EncodeManager::preparePixelBuffer(const Rect& rect,
@@ -27,53 +27,35 @@ inline bool EncodeManager::checkSolidTile(const Rect& r,
                                           rdr::UBPP colourValue,
                                           const PixelBuffer *pb)
 {
-  int w, h;
-  const rdr::UBPP* buffer;
-  int stride, pad;
+  const rdr::U8* buffer;
+  int stride;
 
-  w = r.width();
-  h = r.height();
+  buffer = pb->getBuffer(r, &stride);
 
-  buffer = (const rdr::UBPP*)pb->getBuffer(r, &stride);
-  pad = stride - w;
-
-  while (h--) {
-    int w_ = w;
-    while (w_--) {
-      if (*buffer != colourValue)
-        return false;
-      buffer++;
-    }
-    buffer += pad;
-  }
-
-  return true;
+  return rfbSolidCheck(buffer, stride * (BPP / 8), r.width(), r.height(),
+                       BPP, colourValue);
 }
 
 inline bool EncodeManager::analyseRect(int width, int height,
                                        const rdr::UBPP* buffer, int stride,
                                        struct RectInfo *info, int maxColours)
 {
-  int pad;
-
   rdr::UBPP colour;
   int count;
 
-  rdr::UBPP c0, c1, ci = 0;
-  int i, n0, n1, ni;
-
   info->rleRuns = 0;
   info->palette.clear();
 
-  pad = stride - width;
-
-  // For efficiency, we only update the palette on changes in colour
+  // For efficiency, we only update the palette on changes in colour, and
+  // the rest of each run is skipped with the vector kernels.
   colour = buffer[0];
   count = 0;
   while (height--) {
-    int w_ = width;
-    while (w_--) {
-      if (*buffer != colour) {
+    int x = 0;
+    while (x < width) {
+      int n;
+
+      if (buffer[x] != colour) {
         if (!info->palette.insert(colour, count))
           return false;
         if (info->palette.size() > maxColours)
@@ -82,13 +64,14 @@ inline bool EncodeManager::analyseRect(int width, int height,
         // FIXME: This doesn't account for switching lines
         info->rleRuns++;
 
-        colour = *buffer;
+        colour = buffer[x];
         count = 0;
       }
-      buffer++;
-      count++;
+      n = rfbSolidRun(&buffer[x], width - x, BPP, colour);
+      x += n;
+      count += n;
     }
-    buffer += pad;
+    buffer += stride;
   }
 
   // Make sure the final pixels also get counted
@@ -22,7 +22,7 @@
 #include <rfb/PixelBuffer.h>
 #include <rfb/Palette.h>
 
-extern int solidrect, solidpixels;
+extern unsigned long long solidrect, solidpixels;
 
 using namespace rfb;
 
@@ -25,15 +25,19 @@
 
 #include <rdr/types.h>
 
+#include "palettehash.h"
+
 namespace rfb {
+  // A thin wrapper around the palette shared with the other Tight encoders
+  // (see palettehash.h)
   class Palette {
   public:
-    Palette() { clear(); }
+    Palette() { memset(&palette, 0, sizeof(palette)); }
     ~Palette() {}
 
-    int size() const { return numColours; }
+    int size() const { return palette.numColors; }
 
-    void clear() { numColours = 0; memset(hash, 0, sizeof(hash)); }
+    void clear() { rfbPaletteReset(&palette); }
 
     inline bool insert(rdr::U32 colour, int numPixels);
     inline unsigned char lookup(rdr::U32 colour) const;
@@ -41,150 +45,35 @@ namespace rfb {
     inline int getCount(unsigned char index) const;
 
   protected:
-    inline unsigned char genHash(rdr::U32 colour) const;
-
-  protected:
-    int numColours;
-
-    struct PaletteListNode {
-      PaletteListNode *next;
-      unsigned char idx;
-      rdr::U32 colour;
-    };
-
-    struct PaletteEntry {
-      PaletteListNode *listNode;
-      int numPixels;
-    };
-
-    // This is the raw list of colours, allocated from 0 and up
-    PaletteListNode list[256];
-    // Hash table for quick lookup into the list above
-    PaletteListNode *hash[256];
     // Occurances of each colour, where the 0:th entry is the most common.
-    // Indices also refer to this array.
-    PaletteEntry entry[256];
+    rfbPalette palette;
   };
 }
 
 inline bool rfb::Palette::insert(rdr::U32 colour, int numPixels)
 {
-  PaletteListNode* pnode;
-  PaletteListNode* prev_pnode;
-  unsigned char hash_key, idx;
-
-  hash_key = genHash(colour);
-
-  pnode = hash[hash_key];
-  prev_pnode = NULL;
-
-  // Do we already have an entry for this colour?
-  while (pnode != NULL) {
-    if (pnode->colour == colour) {
-      // Yup
-
-      idx = pnode->idx;
-      numPixels = entry[idx].numPixels + numPixels;
-
-      // The extra pixels might mean we have to adjust the sort list
-      while (idx > 0) {
-        if (entry[idx-1].numPixels >= numPixels)
-          break;
-        entry[idx] = entry[idx-1];
-        entry[idx].listNode->idx = idx;
-        idx--;
-      }
-
-      if (idx != pnode->idx) {
-        entry[idx].listNode = pnode;
-        pnode->idx = idx;
-      }
-
-      entry[idx].numPixels = numPixels;
-
-      return true;
-    }
-
-    prev_pnode = pnode;
-    pnode = pnode->next;
-  }
-
-  // Check if palette is full.
-  if (numColours == 256)
-    return false;
-
-  // Create a new colour entry
-  pnode = &list[numColours];
-  pnode->next = NULL;
-  pnode->idx = 0;
-  pnode->colour = colour;
-
-  // Add it to the hash table
-  if (prev_pnode != NULL)
-    prev_pnode->next = pnode;
-  else
-    hash[hash_key] = pnode;
-
-  // Move palette entries with lesser pixel counts.
-  idx = numColours;
-  while (idx > 0) {
-    if (entry[idx-1].numPixels >= numPixels)
-      break;
-    entry[idx] = entry[idx-1];
-    entry[idx].listNode->idx = idx;
-    idx--;
-  }
-
-  // And add it into the freed slot.
-  pnode->idx = idx;
-  entry[idx].listNode = pnode;
-  entry[idx].numPixels = numPixels;
-
-  numColours++;
-
-  return true;
+  return rfbPaletteInsert(&palette, colour, numPixels,
+                          RFB_PALETTE_MAX_COLORS) != 0;
 }
 
 inline unsigned char rfb::Palette::lookup(rdr::U32 colour) const
 {
-  unsigned char hash_key;
-  PaletteListNode* pnode;
-
-  hash_key = genHash(colour);
-  pnode = hash[hash_key];
-
-  while (pnode != NULL) {
-    if (pnode->colour == colour)
-      return pnode->idx;
-    pnode = pnode->next;
-  }
+  int idx = rfbPaletteLookup(&palette, colour);
 
   // We are being fed a bad colour
-  assert(false);
+  assert(idx >= 0);
 
-  return 0;
+  return idx >= 0 ? idx : 0;
 }
 
 inline rdr::U32 rfb::Palette::getColour(unsigned char index) const
 {
-  return entry[index].listNode->colour;
+  return palette.entry[index].color;
 }
 
 inline int rfb::Palette::getCount(unsigned char index) const
 {
-  return entry[index].numPixels;
-}
-
-inline unsigned char rfb::Palette::genHash(rdr::U32 colour) const
-{
-  unsigned char hash_key;
-
-  // djb2 hash function
-  hash_key = 5; // 5381 & 0xff
-  for (int i = 0; i < 32; i += 8)
-    hash_key = ((hash_key << 5) + hash_key) ^ (colour >> i);
-
-  return hash_key;
+  return palette.entry[index].numPixels;
 }
 
 #endif
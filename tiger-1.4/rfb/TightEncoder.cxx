@@ -28,8 +28,8 @@
 #include <rfb/TightConstants.h>
 
 extern rdr::RFBOutStream rfbos;
-extern unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect,
-  ndxpixels, fcrect, fcpixels;
+extern unsigned long long solidrect, solidpixels, monorect, monopixels,
+  ndxrect, ndxpixels, fcrect, fcpixels;
 
 using namespace rfb;
 
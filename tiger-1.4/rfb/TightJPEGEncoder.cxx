@@ -26,7 +26,7 @@
 
 extern int compressLevel, qualityLevel, fineQualityLevel, subsampling;
 extern rdr::RFBOutStream rfbos;
-extern int jpegrect, jpegpixels;
+extern unsigned long long jpegrect, jpegpixels;
 
 using namespace rfb;
 
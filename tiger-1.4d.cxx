@@ -28,6 +28,7 @@ using namespace rfb;
 #include <rfb/PixelFormat.h>
 #include <rfb/PixelBuffer.h>
 #include <rdr/MemInStream.h>
+#include "pipelineinstream.h"
 
 static rdr::U8* imageBuf = NULL;
 static int imageBufSize = 0;
@@ -46,9 +47,11 @@ rdr::U8* getImageBuf(int required, const PixelFormat& pf)
 }
 
 static rdr::MemInStream *mis = NULL;
+static rdr::PipelineInStream *pis = NULL;
 static TightDecoder *td = NULL;
 static FullFramePixelBuffer *fb = NULL;
 extern XImage *image;
+static int fbGeneration = -1;
 
 #endif
 
@@ -67,6 +70,13 @@ static Bool HandleTightBPP(int rx, int ry, int rw, int rh)
       if (td) { delete td;  td = NULL; }
       if (fb) { delete fb;  fb = NULL; }
       if (mis) { delete mis; mis = NULL; }
+      if (pis) { delete pis; pis = NULL; }
+    }
+    if (fbGeneration != rfbFramebufferGeneration) {
+      if (fb) { delete fb;  fb = NULL; }
+      if (mis) { delete mis; mis = NULL; }
+      if (pis) { delete pis; pis = NULL; }
+      fbGeneration = rfbFramebufferGeneration;
     }
     if (!td) td = new TightDecoder;
 
@@ -75,14 +85,17 @@ static Bool HandleTightBPP(int rx, int ry, int rw, int rh)
       myFormat.greenMax, myFormat.blueMax, myFormat.redShift,
       myFormat.greenShift, myFormat.blueShift);
     if (!fb) fb = new FullFramePixelBuffer(clientPF, image->width,
-      image->height, (rdr::U8 *)image->data, image->bytes_per_line);
-    if (!mis) {
-      mis = new rdr::MemInStream(sendBuf, SEND_BUF_SIZE);
+      image->height, (rdr::U8 *)image->data,
+      image->bytes_per_line / (image->bits_per_pixel / 8));
+    if (rfbPipelineActive) {
+      if (!pis) pis = new rdr::PipelineInStream;
+      td->readRect(r, fb, pis);
+    } else {
+      if (!mis) mis = new rdr::MemInStream(sendBuf, sendBufSize);
+      mis->reposition(sbptr);
+      td->readRect(r, fb, mis);
+      sbptr = mis->pos();
     }
-
-    mis->reposition(sbptr);
-    td->readRect(r, fb, mis);
-    sbptr = mis->pos();
   }
   catch(rdr::Exception e) {
     fprintf(stderr, "ERROR: %s\n", e.str());
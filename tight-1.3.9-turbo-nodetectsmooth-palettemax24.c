@@ -159,9 +159,9 @@ static void EncodeMonoRect32(CARD8 *buf, int w, int h);
 static Bool SendJpegRect(rfbClientPtr cl, int x, int y, int w, int h,
                          int quality);
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 
 /*
  * Tight encoding implementation.
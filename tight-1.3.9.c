@@ -28,6 +28,8 @@
 #include <stdlib.h>
 #include <string.h>
 #include "rfb.h"
+#include "solid.h"
+#include "palettehash.h"
 #include <jpeglib.h>
 
 
@@ -39,6 +41,11 @@
 #define MIN_SOLID_SUBRECT_SIZE  2048
 #define MAX_SPLIT_TILE_SIZE       16
 
+/* The address of pixel (x, y) in the framebuffer */
+#define FB_PTR(x, y)                                                          \
+    (&rfbScreen.pfbMemory[(y) * rfbScreen.paddedWidthInBytes +                \
+                          (x) * (rfbServerFormat.bitsPerPixel / 8)])
+
 /* May be set to TRUE with "-lazytight" Xvnc option. */
 Bool rfbTightDisableGradient = FALSE;
 
@@ -76,28 +83,9 @@ static TIGHT_CONF tightConf[10] = {
 static int compressLevel = 9;
 static int qualityLevel = -1;
 
-/* Stuff dealing with palettes. */
-
-typedef struct COLOR_LIST_s {
-    struct COLOR_LIST_s *next;
-    int idx;
-    CARD32 rgb;
-} COLOR_LIST;
-
-typedef struct PALETTE_ENTRY_s {
-    COLOR_LIST *listNode;
-    int numPixels;
-} PALETTE_ENTRY;
-
-typedef struct PALETTE_s {
-    PALETTE_ENTRY entry[256];
-    COLOR_LIST *hash[256];
-    COLOR_LIST list[256];
-} PALETTE;
-
 static int paletteNumColors, paletteMaxColors;
 static CARD32 monoBackground, monoForeground;
-static PALETTE palette;
+static rfbPalette palette;
 
 /* Pointers to dynamically-allocated buffers. */
 
@@ -119,12 +107,6 @@ static void ExtendSolidArea   (int x, int y, int w, int h,
                                int *x_ptr, int *y_ptr, int *w_ptr, int *h_ptr);
 static Bool CheckSolidTile    (int x, int y, int w, int h,
                                CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile8   (int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile16  (int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile32  (int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
 
 static Bool SendRectSimple    (rfbClientPtr cl, int x, int y, int w, int h);
 static Bool SendSubrect       (rfbClientPtr cl, int x, int y, int w, int h);
@@ -145,7 +127,7 @@ static void FillPalette16(int count);
 static void FillPalette32(int count);
 
 static void PaletteReset(void);
-static int PaletteInsert(CARD32 rgb, int numPixels, int bpp);
+static int PaletteInsert(CARD32 rgb, int numPixels);
 
 static void Pack24(char *buf, rfbPixelFormat *fmt, int count);
 
@@ -177,9 +159,9 @@ static boolean JpegEmptyOutputBuffer(j_compress_ptr cinfo);
 static void JpegTermDestination(j_compress_ptr cinfo);
 static void JpegSetDstManager(j_compress_ptr cinfo);
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 
 /*
  * Tight encoding implementation.
@@ -211,6 +193,31 @@ rfbNumCodedRectsTight(cl, x, y, w, h)
     }
 }
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)  The JPEG quality is mapped
+ * to the highest quality level that doesn't exceed it.  This version has no
+ * separate subsampling setting.
+ */
+
+void
+rfbSetTightLevels(compress, quality, subsamp)
+    int compress, quality, subsamp;
+{
+    if (compress != rfbTightLevelDefault)
+        compressLevel = compress;
+    if (quality == rfbTightLevelDefault)
+        return;
+    if (quality < 0) {
+        qualityLevel = -1;
+        return;
+    }
+    for (qualityLevel = 9; qualityLevel > 0; qualityLevel--) {
+        if (tightConf[qualityLevel].jpegQuality <= quality)
+            break;
+    }
+}
+
+
 Bool
 rfbSendRectEncodingTight(cl, x, y, w, h)
     rfbClientPtr cl;
@@ -394,35 +401,31 @@ ExtendSolidArea(x, y, w, h, colorValue, x_ptr, y_ptr, w_ptr, h_ptr)
     CARD32 colorValue;
     int *x_ptr, *y_ptr, *w_ptr, *h_ptr;
 {
-    int cx, cy;
+    int bpp = rfbServerFormat.bitsPerPixel;
+    int pitch = rfbScreen.paddedWidthInBytes, n;
 
     /* Try to extend the area upwards. */
-    for ( cy = *y_ptr - 1;
-          cy >= y && CheckSolidTile(*x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
-          cy-- );
-    *h_ptr += *y_ptr - (cy + 1);
-    *y_ptr = cy + 1;
+    n = rfbSolidBottomRows(FB_PTR(*x_ptr, y), pitch, *w_ptr, *y_ptr - y,
+                           bpp, colorValue);
+    *y_ptr -= n;
+    *h_ptr += n;
 
     /* ... downwards. */
-    for ( cy = *y_ptr + *h_ptr;
-          cy < y + h &&
-              CheckSolidTile(*x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
-          cy++ );
-    *h_ptr += cy - (*y_ptr + *h_ptr);
+    n = rfbSolidTopRows(FB_PTR(*x_ptr, *y_ptr + *h_ptr), pitch, *w_ptr,
+                        y + h - (*y_ptr + *h_ptr), bpp, colorValue);
+    *h_ptr += n;
 
     /* ... to the left. */
-    for ( cx = *x_ptr - 1;
-          cx >= x && CheckSolidTile(cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-          cx-- );
-    *w_ptr += *x_ptr - (cx + 1);
-    *x_ptr = cx + 1;
+    n = rfbSolidRightColumns(FB_PTR(x, *y_ptr), pitch, *x_ptr - x, *h_ptr,
+                             bpp, colorValue);
+    *x_ptr -= n;
+    *w_ptr += n;
 
     /* ... to the right. */
-    for ( cx = *x_ptr + *w_ptr;
-          cx < x + w &&
-              CheckSolidTile(cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-          cx++ );
-    *w_ptr += cx - (*x_ptr + *w_ptr);
+    n = rfbSolidLeftColumns(FB_PTR(*x_ptr + *w_ptr, *y_ptr), pitch,
+                            x + w - (*x_ptr + *w_ptr), *h_ptr, bpp,
+                            colorValue);
+    *w_ptr += n;
 }
 
 /*
@@ -438,50 +441,31 @@ CheckSolidTile(x, y, w, h, colorPtr, needSameColor)
     CARD32 *colorPtr;
     Bool needSameColor;
 {
-    switch(rfbServerFormat.bitsPerPixel) {
+    int bpp = rfbServerFormat.bitsPerPixel;
+    char *fbptr = FB_PTR(x, y);
+    CARD32 colorValue;
+
+    switch (bpp) {
     case 32:
-        return CheckSolidTile32(x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD32 *)fbptr;
+        break;
     case 16:
-        return CheckSolidTile16(x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD16 *)fbptr;
+        break;
     default:
-        return CheckSolidTile8(x, y, w, h, colorPtr, needSameColor);
+        bpp = 8;
+        colorValue = *(CARD8 *)fbptr;
     }
-}
+    if (needSameColor && colorValue != *colorPtr)
+        return FALSE;
 
-#define DEFINE_CHECK_SOLID_FUNCTION(bpp)                                      \
-                                                                              \
-static Bool                                                                   \
-CheckSolidTile##bpp(x, y, w, h, colorPtr, needSameColor)                      \
-    int x, y;                                                                 \
-    CARD32 *colorPtr;                                                         \
-    Bool needSameColor;                                                       \
-{                                                                             \
-    CARD##bpp *fbptr;                                                         \
-    CARD##bpp colorValue;                                                     \
-    int dx, dy;                                                               \
-                                                                              \
-    fbptr = (CARD##bpp *)                                                     \
-        &rfbScreen.pfbMemory[y * rfbScreen.paddedWidthInBytes + x * (bpp/8)]; \
-                                                                              \
-    colorValue = *fbptr;                                                      \
-    if (needSameColor && (CARD32)colorValue != *colorPtr)                     \
-        return FALSE;                                                         \
-                                                                              \
-    for (dy = 0; dy < h; dy++) {                                              \
-        for (dx = 0; dx < w; dx++) {                                          \
-            if (colorValue != fbptr[dx])                                      \
-                return FALSE;                                                 \
-        }                                                                     \
-        fbptr = (CARD##bpp *)((CARD8 *)fbptr + rfbScreen.paddedWidthInBytes); \
-    }                                                                         \
-                                                                              \
-    *colorPtr = (CARD32)colorValue;                                           \
-    return TRUE;                                                              \
-}
+    if (!rfbSolidCheck(fbptr, rfbScreen.paddedWidthInBytes, w, h, bpp,
+                       colorValue))
+        return FALSE;
 
-DEFINE_CHECK_SOLID_FUNCTION(8)
-DEFINE_CHECK_SOLID_FUNCTION(16)
-DEFINE_CHECK_SOLID_FUNCTION(32)
+    *colorPtr = colorValue;
+    return TRUE;
+}
 
 static Bool
 SendRectSimple(cl, x, y, w, h)
@@ -769,7 +753,7 @@ SendIndexedRect(cl, w, h)
 
         for (i = 0; i < paletteNumColors; i++) {
             ((CARD32 *)tightAfterBuf)[i] =
-                palette.entry[i].listNode->rgb;
+                palette.entry[i].color;
         }
         if (usePixelFormat24) {
             Pack24(tightAfterBuf, &cl->format, paletteNumColors);
@@ -787,7 +771,7 @@ SendIndexedRect(cl, w, h)
 
         for (i = 0; i < paletteNumColors; i++) {
             ((CARD16 *)tightAfterBuf)[i] =
-                (CARD16)palette.entry[i].listNode->rgb;
+                (CARD16)palette.entry[i].color;
         }
 
         memcpy(&updateBuf[ublen], tightAfterBuf, paletteNumColors * 2);
@@ -1019,10 +1003,10 @@ FillPalette##bpp(count)                                                 \
 {                                                                       \
     CARD##bpp *data = (CARD##bpp *)tightBeforeBuf;                      \
     CARD##bpp c0, c1, ci;                                               \
-    int i, n0, n1, ni;                                                  \
+    int i, n, n0, n1, ni;                                               \
                                                                         \
     c0 = data[0];                                                       \
-    for (i = 1; i < count && data[i] == c0; i++);                       \
+    i = 1 + rfbSolidRun(&data[1], count - 1, bpp, c0);                  \
     if (i >= count) {                                                   \
         paletteNumColors = 1;   /* Solid rectangle */                   \
         return;                                                         \
@@ -1058,21 +1042,22 @@ FillPalette##bpp(count)                                                 \
     }                                                                   \
                                                                         \
     PaletteReset();                                                     \
-    PaletteInsert (c0, (CARD32)n0, bpp);                                \
-    PaletteInsert (c1, (CARD32)n1, bpp);                                \
+    PaletteInsert (c0, (CARD32)n0);                                     \
+    PaletteInsert (c1, (CARD32)n1);                                     \
                                                                         \
     ni = 1;                                                             \
     for (i++; i < count; i++) {                                         \
         if (data[i] == ci) {                                            \
-            ni++;                                                       \
+            n = rfbSolidRun(&data[i], count - i, bpp, ci);              \
+            ni += n;  i += n - 1;                                       \
         } else {                                                        \
-            if (!PaletteInsert (ci, (CARD32)ni, bpp))                   \
+            if (!PaletteInsert (ci, (CARD32)ni))                        \
                 return;                                                 \
             ci = data[i];                                               \
             ni = 1;                                                     \
         }                                                               \
     }                                                                   \
-    PaletteInsert (ci, (CARD32)ni, bpp);                                \
+    PaletteInsert (ci, (CARD32)ni);                                     \
 }
 
 DEFINE_FILL_PALETTE_FUNCTION(16)
@@ -1083,80 +1068,21 @@ DEFINE_FILL_PALETTE_FUNCTION(32)
  * Functions to operate with palette structures.
  */
 
-#define HASH_FUNC16(rgb) ((int)((((rgb) >> 8) + (rgb)) & 0xFF))
-#define HASH_FUNC32(rgb) ((int)((((rgb) >> 16) + ((rgb) >> 8)) & 0xFF))
-
 static void
 PaletteReset(void)
 {
     paletteNumColors = 0;
-    memset(palette.hash, 0, 256 * sizeof(COLOR_LIST *));
+    rfbPaletteReset(&palette);
 }
 
 static int
-PaletteInsert(rgb, numPixels, bpp)
+PaletteInsert(rgb, numPixels)
     CARD32 rgb;
     int numPixels;
-    int bpp;
 {
-    COLOR_LIST *pnode;
-    COLOR_LIST *prev_pnode = NULL;
-    int hash_key, idx, new_idx, count;
-
-    hash_key = (bpp == 16) ? HASH_FUNC16(rgb) : HASH_FUNC32(rgb);
-
-    pnode = palette.hash[hash_key];
-
-    while (pnode != NULL) {
-        if (pnode->rgb == rgb) {
-            /* Such palette entry already exists. */
-            new_idx = idx = pnode->idx;
-            count = palette.entry[idx].numPixels + numPixels;
-            if (new_idx && palette.entry[new_idx-1].numPixels < count) {
-                do {
-                    palette.entry[new_idx] = palette.entry[new_idx-1];
-                    palette.entry[new_idx].listNode->idx = new_idx;
-                    new_idx--;
-                }
-                while (new_idx && palette.entry[new_idx-1].numPixels < count);
-                palette.entry[new_idx].listNode = pnode;
-                pnode->idx = new_idx;
-            }
-            palette.entry[new_idx].numPixels = count;
-            return paletteNumColors;
-        }
-        prev_pnode = pnode;
-        pnode = pnode->next;
-    }
-
-    /* Check if palette is full. */
-    if (paletteNumColors == 256 || paletteNumColors == paletteMaxColors) {
-        paletteNumColors = 0;
-        return 0;
-    }
-
-    /* Move palette entries with lesser pixel counts. */
-    for ( idx = paletteNumColors;
-          idx > 0 && palette.entry[idx-1].numPixels < numPixels;
-          idx-- ) {
-        palette.entry[idx] = palette.entry[idx-1];
-        palette.entry[idx].listNode->idx = idx;
-    }
-
-    /* Add new palette entry into the freed slot. */
-    pnode = &palette.list[paletteNumColors];
-    if (prev_pnode != NULL) {
-        prev_pnode->next = pnode;
-    } else {
-        palette.hash[hash_key] = pnode;
-    }
-    pnode->next = NULL;
-    pnode->idx = idx;
-    pnode->rgb = rgb;
-    palette.entry[idx].listNode = pnode;
-    palette.entry[idx].numPixels = numPixels;
-
-    return (++paletteNumColors);
+    paletteNumColors = rfbPaletteInsert(&palette, rgb, numPixels,
+                                        paletteMaxColors);
+    return paletteNumColors;
 }
 
 
@@ -1207,30 +1133,19 @@ EncodeIndexedRect##bpp(buf, count)                                      \
     CARD8 *buf;                                                         \
     int count;                                                          \
 {                                                                       \
-    COLOR_LIST *pnode;                                                  \
     CARD##bpp *src;                                                     \
     CARD##bpp rgb;                                                      \
-    int rep = 0;                                                        \
+    int rep;                                                            \
                                                                         \
     src = (CARD##bpp *) buf;                                            \
                                                                         \
+    /* The indices are written over the pixels that have been read. */  \
     while (count--) {                                                   \
         rgb = *src++;                                                   \
-        while (count && *src == rgb) {                                  \
-            rep++, src++, count--;                                      \
-        }                                                               \
-        pnode = palette.hash[HASH_FUNC##bpp(rgb)];                      \
-        while (pnode != NULL) {                                         \
-            if ((CARD##bpp)pnode->rgb == rgb) {                         \
-                *buf++ = (CARD8)pnode->idx;                             \
-                while (rep) {                                           \
-                    *buf++ = (CARD8)pnode->idx;                         \
-                    rep--;                                              \
-                }                                                       \
-                break;                                                  \
-            }                                                           \
-            pnode = pnode->next;                                        \
-        }                                                               \
+        rep = (count && *src == rgb) ? rfbSolidRun(src, count, bpp, rgb) : 0;\
+        src += rep;  count -= rep;                                      \
+        memset(buf, rfbPaletteLookup(&palette, rgb), rep + 1);          \
+        buf += rep + 1;                                                 \
     }                                                                   \
 }
 
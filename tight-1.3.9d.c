@@ -29,6 +29,17 @@
 
 #define TIGHT_MIN_TO_COMPRESS 12
 
+#ifndef __TIGHTD_STATE__
+#define __TIGHTD_STATE__
+
+/* Decoder state that tightdecoder.c doesn't provide */
+
+static char zlib_buffer[ZLIB_BUFFER_SIZE];
+static int rectWidth, rectColors;
+static char tightPalette[256*4];
+
+#endif
+
 #define CARDBPP CONCAT2E(CARD,BPP)
 #define filterPtrBPP CONCAT2E(filterPtr,BPP)
 
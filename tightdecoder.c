@@ -0,0 +1,229 @@
+/*
+ *  Copyright (C) 2000 Const Kaplinsky <const@ce.cctpu.edu.ru>
+ *  Copyright (C) 2008 Sun Microsystems, Inc.
+ *
+ *  This program is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This program is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this program; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ */
+
+/*
+ * tightdecoder.c - wrap one Tight decoder variant
+ *
+ * This file shouldn't be compiled directly.  CMake generates a small source
+ * file for each decoder variant (see tightd.c.in) that defines TIGHTD_SOURCE
+ * and then includes this file.  This file provides the state that the
+ * variant expects from its includer, includes the variant once for each BPP,
+ * and registers the result as rfbTightDecoder (which variant.h prefixes with
+ * the variant name.)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+
+#include "rfb.h"
+
+#ifndef min
+ #define min(a,b) ((a)<(b)?(a):(b))
+#endif
+
+#define BUFFER_SIZE (1024*512)
+
+/* Separate buffer for compressed data. */
+#define ZLIB_BUFFER_SIZE 512
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+Bool zlibStreamActive[4] = {
+  False, False, False, False
+};
+#ifdef __cplusplus
+}
+#endif
+
+#ifndef TIGERD
+
+/*
+ * Variables for the ``tight'' encoding implementation.  The TigerVNC decoders
+ * keep their own state, and the variants keep any state that only some of
+ * them use (zlib_buffer, tightPalette, and so on.)
+ */
+
+static char buffer[BUFFER_SIZE];
+
+/* Four independent compression streams for zlib library. */
+static z_stream zlibStream[4];
+
+/* Filter stuff. Should be initialized by filter initialization code. */
+static Bool cutZeros;
+static CARD8 tightPrevRow[2048*3*sizeof(CARD16)];
+
+#include <jpeglib.h>
+#ifdef TURBOD
+#include <turbojpeg.h>
+#else
+/* JPEG decoder state. */
+
+static Bool jpegError;
+
+/*
+ * JPEG source manager functions for JPEG decompression in Tight decoder.
+ */
+
+static struct jpeg_source_mgr jpegSrcManager;
+static JOCTET *jpegBufferPtr;
+static size_t jpegBufferLen;
+
+static void
+JpegInitSource(j_decompress_ptr cinfo)
+{
+  jpegError = False;
+}
+
+static boolean
+JpegFillInputBuffer(j_decompress_ptr cinfo)
+{
+  jpegError = True;
+  jpegSrcManager.bytes_in_buffer = jpegBufferLen;
+  jpegSrcManager.next_input_byte = (JOCTET *)jpegBufferPtr;
+
+  return TRUE;
+}
+
+static void
+JpegSkipInputData(j_decompress_ptr cinfo, long num_bytes)
+{
+  if (num_bytes < 0 || num_bytes > jpegSrcManager.bytes_in_buffer) {
+    jpegError = True;
+    jpegSrcManager.bytes_in_buffer = jpegBufferLen;
+    jpegSrcManager.next_input_byte = (JOCTET *)jpegBufferPtr;
+  } else {
+    jpegSrcManager.next_input_byte += (size_t) num_bytes;
+    jpegSrcManager.bytes_in_buffer -= (size_t) num_bytes;
+  }
+}
+
+static void
+JpegTermSource(j_decompress_ptr cinfo)
+{
+  /* No work necessary here. */
+}
+
+static void
+JpegSetSrcManager(j_decompress_ptr cinfo, CARD8 *compressedData,
+		  int compressedLen)
+{
+  jpegBufferPtr = (JOCTET *)compressedData;
+  jpegBufferLen = (size_t)compressedLen;
+
+  jpegSrcManager.init_source = JpegInitSource;
+  jpegSrcManager.fill_input_buffer = JpegFillInputBuffer;
+  jpegSrcManager.skip_input_data = JpegSkipInputData;
+  jpegSrcManager.resync_to_restart = jpeg_resync_to_restart;
+  jpegSrcManager.term_source = JpegTermSource;
+  jpegSrcManager.next_input_byte = jpegBufferPtr;
+  jpegSrcManager.bytes_in_buffer = jpegBufferLen;
+
+  cinfo->src = &jpegSrcManager;
+}
+
+#endif
+
+static long
+ReadCompactLen (void)
+{
+  long len;
+  CARD8 b;
+
+  if (!ReadFromRFBServer((char *)&b, 1))
+    return -1;
+  len = (int)b & 0x7F;
+  if (b & 0x80) {
+    if (!ReadFromRFBServer((char *)&b, 1))
+      return -1;
+    len |= ((int)b & 0x7F) << 7;
+    if (b & 0x80) {
+      if (!ReadFromRFBServer((char *)&b, 1))
+	return -1;
+      len |= ((int)b & 0xFF) << 14;
+    }
+  }
+  return len;
+}
+
+#endif
+
+#define myFormat rfbClient.format
+#define BPP 8
+#include TIGHTD_SOURCE
+#undef BPP
+#define BPP 16
+#include TIGHTD_SOURCE
+#undef BPP
+#define BPP 32
+#include TIGHTD_SOURCE
+#undef BPP
+
+static Bool
+BeginTightDecode (void)
+{
+#ifdef __TURBOD_MT__
+  if (!threadInit) {
+    InitThreads();
+    if (!threadInit) return False;
+  }
+#endif
+  return True;
+}
+
+static void
+EndTightDecode (void)
+{
+#ifdef __TURBOD_MT__
+  int i;
+  for (i = 1; i < nt; i++) {
+    pthread_mutex_lock(&tparam[i].done);
+    pthread_mutex_unlock(&tparam[i].done);
+  }
+#endif
+}
+
+static void
+ResetTightDecoder (void)
+{
+  int i;
+  for (i = 0; i < 4; i++) zlibStreamActive[i] = False;
+}
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+/* The declaration gives the definition below external linkage in C++ */
+extern const rfbTightDecoderVariant rfbTightDecoder;
+const rfbTightDecoderVariant rfbTightDecoder = {
+  TIGHTD_NAME,
+  { HandleTight8, HandleTight16, HandleTight32 },
+  BeginTightDecode, EndTightDecode, ResetTightDecoder,
+#if defined(TIGERD) || defined(TIGHTD_WRITES_IMAGE)
+  True
+#else
+  False
+#endif
+};
+#ifdef __cplusplus
+}
+#endif
@@ -30,13 +30,6 @@ static Bool rfbSetClientColourMapBGR233();
 
 Bool rfbEconomicTranslate = FALSE;
 
-/*
- * Structure representing pixel format for RFB server (i.e. us).
- */
-
-rfbPixelFormat rfbServerFormat;
-
-
 /*
  * Some standard pixel formats.
  */
@@ -127,9 +127,9 @@ static void Pack24(char *buf, rfbPixelFormat *fmt, int count);
 static Bool SendJpegRect(rfbClientPtr cl, int x, int y, int w, int h,
                          int quality);
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 
 /*
  * Tight encoding implementation.
@@ -161,6 +161,23 @@ rfbNumCodedRectsTight(cl, x, y, w, h)
     }
 }
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)  This version has only one
+ * compression level, and it uses the compression level to select the
+ * subsampling level instead.
+ */
+
+void
+rfbSetTightLevels(compress, quality, subsamp)
+    int compress, quality, subsamp;
+{
+    if (quality != rfbTightLevelDefault)
+        qualityLevel = quality;
+    if (subsamp != rfbTightLevelDefault)
+        compressLevel = subsamp;
+}
+
+
 Bool
 rfbSendRectEncodingTight(cl, x, y, w, h)
     rfbClientPtr cl;
@@ -165,9 +165,9 @@ static void EncodeMonoRect32(CARD8 *buf, int w, int h);
 static Bool SendJpegRect(rfbClientPtr cl, int x, int y, int w, int h,
                          int quality);
 
-unsigned long solidrect=0, solidpixels=0, monorect=0, monopixels=0, ndxrect=0,
-	ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0, gradrect=0,
-	gradpixels=0;
+unsigned long long solidrect=0, solidpixels=0, monorect=0, monopixels=0,
+	ndxrect=0, ndxpixels=0, jpegrect=0, jpegpixels=0, fcrect=0, fcpixels=0,
+	gradrect=0, gradpixels=0;
 
 /*
  * Tight encoding implementation.
@@ -199,6 +199,24 @@ rfbNumCodedRectsTight(cl, x, y, w, h)
     }
 }
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)  This version only has
+ * compression levels 0 and 1.
+ */
+
+void
+rfbSetTightLevels(compress, quality, subsamp)
+    int compress, quality, subsamp;
+{
+    if (compress != rfbTightLevelDefault)
+        compressLevel = compress > 1 ? 1 : compress;
+    if (quality != rfbTightLevelDefault)
+        qualityLevel = quality;
+    if (subsamp != rfbTightLevelDefault)
+        subsampLevel = subsamp;
+}
+
+
 Bool
 rfbSendRectEncodingTight(cl, x, y, w, h)
     rfbClientPtr cl;
@@ -31,6 +31,22 @@
 
 #define TIGHT_MIN_TO_COMPRESS 12
 
+#ifndef __TIGHTD_STATE__
+#define __TIGHTD_STATE__
+
+/* Decoder state that tightdecoder.c doesn't provide */
+
+static char *compressedData = NULL;
+static char *uncompressedData = NULL;
+static int rectWidth, rectColors;
+static char tightPalette[256*4];
+static tjhandle tjhnd=NULL;
+
+#endif
+
+/* Every subencoding is decoded to image (see tightdecoder.c) */
+#define TIGHTD_WRITES_IMAGE
+
 #define CARDBPP CONCAT2E(CARD,BPP)
 #define filterPtrBPP CONCAT2E(filterPtr,BPP)
 
@@ -146,6 +162,14 @@ HandleTightBPP (int rx, int ry, int rw, int rh)
 #endif
 
 /*    FillRectangle(&gcv, rx, ry, rw, rh); */
+    {
+      CARDBPP *dst = (CARDBPP *)&image->data[ry * image->bytes_per_line
+                                             + rx * image->bits_per_pixel/8];
+      int dstw = image->bytes_per_line / (image->bits_per_pixel / 8);
+      int i, j;
+      for (j = 0; j < rh; j++, dst += dstw)
+        for (i = 0; i < rw; i++) dst[i] = fill_colour;
+    }
     return True;
   }
 
@@ -137,7 +137,7 @@ typedef struct _threadparam {
     int streamId, baseStreamId, nStreams;
     pthread_mutex_t ready, done;
     Bool status, deadyet;
-    unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect,
+    unsigned long long solidrect, solidpixels, monorect, monopixels, ndxrect,
         ndxpixels, jpegrect, jpegpixels, fcrect, fcpixels;
 } threadparam;
 
@@ -203,9 +203,9 @@ static Bool CheckUpdateBuf(threadparam *t, int bytes);
 static int nthreads(void);
 
 
-unsigned long solidrect = 0, solidpixels = 0, monorect = 0, monopixels = 0,
-    ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0, fcrect = 0,
-    fcpixels = 0, gradrect = 0, gradpixels = 0;
+unsigned long long solidrect = 0, solidpixels = 0, monorect = 0,
+    monopixels = 0, ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0,
+    fcrect = 0, fcpixels = 0, gradrect = 0, gradpixels = 0;
 
 
 /*
@@ -354,6 +354,24 @@ CheckUpdateBuf(t, bytes)
 }
 
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)  This version only has
+ * compression levels 0 and 1.
+ */
+
+void
+rfbSetTightLevels(compress, quality, subsamp)
+    int compress, quality, subsamp;
+{
+    if (compress != rfbTightLevelDefault)
+        compressLevel = compress > 1 ? 1 : compress;
+    if (quality != rfbTightLevelDefault)
+        qualityLevel = quality;
+    if (subsamp != rfbTightLevelDefault)
+        subsampLevel = subsamp;
+}
+
+
 Bool
 rfbSendRectEncodingTight(cl, x, y, w, h)
     rfbClientPtr cl;
@@ -422,7 +440,7 @@ rfbSendRectEncodingTight(cl, x, y, w, h)
         }
         for (i = 1; i < nt; i++) {
             if ((*tparam[i].ublen) > 0 && decompress) {
-                if ((*tparam[i].ublen) + sblen > SEND_BUF_SIZE) {
+                if ((*tparam[i].ublen) + sblen > sendBufSize) {
                     rfbLog("ERROR: Send buffer overrun.\n");
                     return FALSE;
                 }
@@ -149,6 +149,9 @@ ShutdownThreads(void)
 
 #define TIGHT_MIN_TO_COMPRESS 12
 
+/* Every subencoding is decoded to image (see tightdecoder.c) */
+#define TIGHTD_WRITES_IMAGE
+
 #define CARDBPP CONCAT2E(CARD,BPP)
 #define filterPtrBPP CONCAT2E(filterPtr,BPP)
 
@@ -270,6 +273,14 @@ HandleTightBPP (int rx, int ry, int rw, int rh)
 #endif
 
 /*    FillRectangle(&gcv, rx, ry, rw, rh); */
+    {
+      CARDBPP *dst = (CARDBPP *)&image->data[ry * image->bytes_per_line
+                                             + rx * image->bits_per_pixel/8];
+      int dstw = image->bytes_per_line / (image->bits_per_pixel / 8);
+      int i, j;
+      for (j = 0; j < rh; j++, dst += dstw)
+        for (i = 0; i < rw; i++) dst[i] = fill_colour;
+    }
     return True;
   }
 
@@ -34,12 +34,23 @@
 #include <errno.h>
 #include <unistd.h>
 #include "rfb.h"
+#include "solid.h"
+#include "palettehash.h"
 #include "turbojpeg.h"
+#ifdef TIGHT_PHASE_TIMERS
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#include <time.h>
+#endif
 
 
 #ifndef min
  #define min(a,b) ((a)<(b)?(a):(b))
 #endif
+#ifndef max
+ #define max(a,b) ((a)>(b)?(a):(b))
+#endif
 
 static int enableLastRectEncoding = 1;
 extern int decompress, ublen;
@@ -53,6 +64,11 @@ extern int decompress, ublen;
 #define MIN_SOLID_SUBRECT_SIZE  2048
 #define MAX_SPLIT_TILE_SIZE       16
 
+/* The address of pixel (x, y) in the framebuffer */
+#define FB_PTR(cl, x, y)                                                      \
+    (&(cl)->fb[(y) * rfbScreen.paddedWidthInBytes +                           \
+               (x) * (rfbServerFormat.bitsPerPixel / 8)])
+
 /* This variable is set on every rfbSendRectEncodingTight() call. */
 static Bool usePixelFormat24;
 
@@ -85,37 +101,134 @@ static const int subsampLevel2tjsubsamp[TVNC_SAMPOPT] = {
 };
 
 
-/* Stuff dealing with palettes. */
+/* Phase timers.  When built with TIGHT_PHASE_TIMERS, each encoder thread
+   accumulates the time spent in the hot paths below, along with the number of
+   bytes that each phase consumed and produced.  The time is read from the TSC,
+   where available, and is converted to seconds when the totals are
+   retrieved. */
+
+#ifdef TIGHT_PHASE_TIMERS
+
+enum {
+    PHASE_CHECKSOLID, PHASE_FINDSOLID, PHASE_EXTENDSOLID, PHASE_FASTPALETTE,
+    PHASE_PALETTE, PHASE_TRANSLATE, PHASE_PACK24, PHASE_DEFLATE, PHASE_JPEG,
+    NPHASES
+};
+
+static const char *phaseName[NPHASES] = {
+    "CheckSolidTile", "FindBestSolidArea", "ExtendSolidArea",
+    "FastFillPalette", "FillPalette", "translateFn", "Pack24", "deflate",
+    "tjCompress"
+};
+
+typedef struct PHASE_TIMER_s {
+    unsigned long long ticks, calls, bytesIn, bytesOut;
+} PHASE_TIMER;
+
+#if defined(__x86_64__) || defined(__i386__)
+#define ReadTicks() __rdtsc()
+#else
+static unsigned long long ReadTicks(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+#endif
+
+/* Phases must not nest, since each thread has only one start time. */
+#define PHASE_START(t) ((t)->phaseStart = ReadTicks())
+#define PHASE_END(t, p, in, out) {                                          \
+    PHASE_TIMER *_timer = &(t)->phase[p];                                   \
+    _timer->ticks += ReadTicks() - (t)->phaseStart;                         \
+    _timer->calls++;                                                        \
+    _timer->bytesIn += (in);  _timer->bytesOut += (out);                    \
+}
 
-typedef struct COLOR_LIST_s {
-    struct COLOR_LIST_s *next;
-    int idx;
-    CARD32 rgb;
-} COLOR_LIST;
+#else
 
-typedef struct PALETTE_ENTRY_s {
-    COLOR_LIST *listNode;
-    int numPixels;
-} PALETTE_ENTRY;
+#define PHASE_START(t)
+#define PHASE_END(t, p, in, out)
 
-typedef struct PALETTE_s {
-    PALETTE_ENTRY entry[256];
-    COLOR_LIST *hash[256];
-    COLOR_LIST list[256];
-} PALETTE;
+#endif
 
 
 /* Globals for multi-threading */
 
-#define TVNC_MAXTHREADS 8
+#define TVNC_MAXTHREADS 32
 
 static Bool threadInit = FALSE;
 static int _nt;
-static pthread_t thnd[TVNC_MAXTHREADS] = {0, 0, 0, 0, 0, 0, 0, 0};
+static pthread_t thnd[TVNC_MAXTHREADS];
+
+/*
+ * Work-stealing tile scheduler
+ *
+ * With more than one thread, a rectangle is cut into about TILES_PER_THREAD
+ * tiles per thread, and each thread gets a deque holding a contiguous run of
+ * them.  The rectangle is cut into bands first, and if that doesn't yield
+ * enough tiles (a short rectangle, or many threads), then the bands are cut
+ * into columns as well, down to TILE_MIN_WIDTH pixels.  The tiles are
+ * numbered in row order, so a deque's run of tiles stays close together.  A
+ * thread takes tiles from the front of its own deque, and when that is empty,
+ * it steals from the deque with the most tiles left.
+ *
+ * Encoding a tile is split into two stages.  The analysis stage does
+ * everything but the zlib compression (solid-area detection, palette
+ * analysis, mono and indexed packing, and JPEG), and any thread can analyze
+ * any tile at any time.  The data that would have been compressed is left in
+ * the tile's buffer, along with a list of deflate jobs.  The deflate stage
+ * then compresses each tile's data in protocol order, which the zlib streams
+ * require.  The tiles are divided into up to four lanes, each with a
+ * contiguous run of tiles and its own share of the four streams, and the
+ * deflate stage of each lane is run by one thread (thread i runs lane i.)
+ * Thus, every tile is compressed, regardless of the number of threads.  A
+ * lane's thread deflates the tiles that are ready whenever it finishes
+ * analyzing a tile, and it waits for the rest once there are no tiles left
+ * to analyze.  The tiles are sent in protocol order once they are all done.
+ */
+
+#define TILES_PER_THREAD 4
+#define TILE_MIN_WIDTH 64
+#define TVNC_MAXLANES 4
+
+typedef struct _deflatejob {
+    int offset, len;            /* Where the data is in the tile's buffer */
+    int streamId, zlibLevel, zlibStrategy;
+} deflatejob;
+
+typedef struct _tile {
+    int x, y, w, h, lane;
+    char *buf;                  /* Output of the analysis stage */
+    int len, size;
+    deflatejob *jobs;
+    int nJobs, maxJobs;
+    char *out;                  /* Output of the deflate stage */
+    int outLen, outSize;
+    Bool analyzed, status;
+} tile;
+
+typedef struct _tilelane {
+    int baseStreamId, nStreams;
+    int next, end;              /* The tiles in [next, end) are not yet
+                                   deflated */
+} tilelane;
+
+typedef struct _tiledeque {
+    pthread_mutex_t mutex;
+    int head, tail;             /* The tiles in [head, tail) are waiting */
+} tiledeque;
+
+static tile *tiles = NULL;
+static int nTiles = 0, maxTiles = 0, nWorkers = 0, nLanes = 0;
+static tilelane lanes[TVNC_MAXLANES];
+static tiledeque deques[TVNC_MAXTHREADS];
+static pthread_mutex_t tileMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t tileCond = PTHREAD_COND_INITIALIZER;
 
 typedef struct _threadparam {
     rfbClientPtr cl;
-    int x, y, w, h, id, _ublen, *ublen;
+    int id, _ublen, *ublen;
     char *tightBeforeBuf;
     int tightBeforeBufSize;
     char *tightAfterBuf;
@@ -124,18 +237,32 @@ typedef struct _threadparam {
     int updateBufSize;
     int paletteNumColors, paletteMaxColors;
     CARD32 monoBackground, monoForeground;
-    PALETTE palette;
+    rfbPalette palette;
     tjhandle j;
     int bytessent, rectsent;
     int streamId, baseStreamId, nStreams;
+    tile *curTile;              /* The tile being analyzed, if any */
     pthread_mutex_t ready, done;
     Bool status, deadyet;
-    unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect,
+    unsigned long long solidrect, solidpixels, monorect, monopixels, ndxrect,
         ndxpixels, jpegrect, jpegpixels, fcrect, fcpixels;
+#ifdef TIGHT_PHASE_TIMERS
+    unsigned long long phaseStart;
+    PHASE_TIMER phase[NPHASES];
+#endif
 } threadparam;
 
 static threadparam tparam[TVNC_MAXTHREADS];
 
+#ifdef TIGHT_PHASE_TIMERS
+/* Per-thread totals since the last call to rfbResetTightPhases(), along with
+   the TSC and monotonic clock readings used to calibrate the TSC */
+static PHASE_TIMER phaseTotals[TVNC_MAXTHREADS][NPHASES];
+static unsigned long long phaseTicks0;
+static double phaseTime0 = -1.0;
+extern double gettime(void);
+#endif
+
 
 /* Prototypes for static functions. */
 
@@ -146,12 +273,6 @@ static void ExtendSolidArea   (rfbClientPtr cl, int x, int y, int w, int h,
                                int *x_ptr, int *y_ptr, int *w_ptr, int *h_ptr);
 static Bool CheckSolidTile    (rfbClientPtr cl, int x, int y, int w, int h,
                                CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile8   (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile16  (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile32  (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
 
 static Bool SendRectSimple    (threadparam *t, int x, int y, int w, int h);
 static Bool SendSubrect       (threadparam *t, int x, int y, int w, int h);
@@ -164,6 +285,10 @@ static Bool SendFullColorRect (threadparam *t, int w, int h);
 
 static Bool CompressData (threadparam *t, int streamId, int dataLen,
                           int zlibLevel, int zlibStrategy);
+static Bool DeferData (threadparam *t, int streamId, int dataLen,
+                       int zlibLevel, int zlibStrategy);
+static Bool DeflateData (threadparam *t, int streamId, char *data,
+                         int dataLen, int zlibLevel, int zlibStrategy);
 static Bool SendCompressedData (threadparam *t, char *buf, int compressedLen);
 
 static void FillPalette8 (threadparam *t, int count);
@@ -175,7 +300,7 @@ static void FastFillPalette32 (threadparam *t, CARD32 *data, int w, int pitch,
                                int h);
 
 static void PaletteReset (threadparam *t);
-static int PaletteInsert (threadparam *t, CARD32 rgb, int numPixels, int bpp);
+static int PaletteInsert (threadparam *t, CARD32 rgb, int numPixels);
 
 static void Pack24 (char *buf, rfbPixelFormat *fmt, int count);
 
@@ -192,13 +317,18 @@ static Bool SendJpegRect(threadparam *t, int x, int y, int w, int h,
 static Bool SendRectEncodingTight(threadparam *t, int x, int y, int w, int h);
 
 static void *TightThreadFunc(void *param);
+static Bool ScheduleTiles(int x, int y, int w, int h, int nt);
+static Bool RunTiles(threadparam *t);
+static Bool DeflateLane(threadparam *t, Bool wait);
+static Bool DeflateTile(threadparam *t, tile *tl);
+static Bool SendTile(rfbClientPtr cl, tile *tl);
 static Bool CheckUpdateBuf(threadparam *t, int bytes);
 static int nthreads(void);
 
 
-unsigned long solidrect = 0, solidpixels = 0, monorect = 0, monopixels = 0,
-    ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0, fcrect = 0,
-    fcpixels = 0, gradrect = 0, gradpixels = 0;
+unsigned long long solidrect = 0, solidpixels = 0, monorect = 0,
+    monopixels = 0, ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0,
+    fcrect = 0, fcpixels = 0, gradrect = 0, gradpixels = 0;
 
 
 /*
@@ -230,6 +360,50 @@ rfbNumCodedRectsTight(rfbClientPtr cl, int x, int y, int w, int h)
 }
 
 
+#ifdef TIGHT_PHASE_TIMERS
+
+void
+rfbResetTightPhases(void)
+{
+    memset(phaseTotals, 0, sizeof(phaseTotals));
+    phaseTicks0 = ReadTicks();
+    phaseTime0 = gettime();
+}
+
+
+int
+rfbGetTightPhases(rfbTightPhase *phases, int maxPhases)
+{
+    double ticksPerSecond = 1000000000.0;
+    int i, p, nPhases = min(maxPhases, NPHASES);
+
+    /* Calibrate the TSC against the monotonic clock over the interval since
+       the timers were last reset. */
+#if defined(__x86_64__) || defined(__i386__)
+    if (phaseTime0 >= 0.0) {
+        double elapsed = gettime() - phaseTime0;
+        if (elapsed > 0.0)
+            ticksPerSecond = (double)(ReadTicks() - phaseTicks0) / elapsed;
+    }
+#endif
+
+    for (p = 0; p < nPhases; p++) {
+        memset(&phases[p], 0, sizeof(rfbTightPhase));
+        phases[p].name = phaseName[p];
+        for (i = 0; i < min(TVNC_MAXTHREADS, rfbTightMaxPhaseThreads); i++) {
+            phases[p].calls += phaseTotals[i][p].calls;
+            phases[p].bytesIn += phaseTotals[i][p].bytesIn;
+            phases[p].bytesOut += phaseTotals[i][p].bytesOut;
+            phases[p].seconds[i] =
+                (double)phaseTotals[i][p].ticks / ticksPerSecond;
+        }
+    }
+    return nPhases;
+}
+
+#endif
+
+
 static int
 nthreads(void)
 {
@@ -262,11 +436,9 @@ InitThreads(void)
     rfbLog("Using %d thread%s for Tight encoding\n", _nt,
            _nt == 1 ? "" : "s");
     if (_nt > 1) {
+        for (i = 0; i < _nt; i++)
+            pthread_mutex_init(&deques[i].mutex, NULL);
         for (i = 1; i < _nt; i++) {
-            if (!tparam[i].updateBuf) {
-                tparam[i].updateBufSize = UPDATE_BUF_SIZE;
-                tparam[i].updateBuf = (char *)malloc(tparam[i].updateBufSize);
-            }
             pthread_mutex_init(&tparam[i].ready, NULL);
             pthread_mutex_lock(&tparam[i].ready);
             pthread_mutex_init(&tparam[i].done, NULL);
@@ -298,14 +470,23 @@ ShutdownTightThreads(void)
                 pthread_mutex_destroy(&tparam[i].done);
             }
         }
+        for (i = 0; i < _nt; i++)
+            pthread_mutex_destroy(&deques[i].mutex);
     }
     for (i = 0; i < _nt; i++) {
         if (tparam[i].tightAfterBuf) free(tparam[i].tightAfterBuf);
         if (tparam[i].tightBeforeBuf) free(tparam[i].tightBeforeBuf);
-        if (i != 0 && tparam[i].updateBuf) free(tparam[i].updateBuf);
         if (tparam[i].j) tjDestroy(tparam[i].j);
         memset(&tparam[i], 0, sizeof(threadparam));
     }
+    for (i = 0; i < maxTiles; i++) {
+        free(tiles[i].buf);
+        free(tiles[i].out);
+        free(tiles[i].jobs);
+    }
+    free(tiles);
+    tiles = NULL;
+    nTiles = maxTiles = 0;
     threadInit = FALSE;
 }
 
@@ -316,18 +497,245 @@ TightThreadFunc(void *param)
     while (!t->deadyet) {
         pthread_mutex_lock(&t->ready);
         if (t->deadyet) break;
-        t->status = SendRectEncodingTight(t, t->x, t->y, t->w, t->h);
+        t->status = RunTiles(t);
         pthread_mutex_unlock(&t->done);
     }
     return NULL;
 }
 
 
+static Bool
+ScheduleTiles(int x, int y, int w, int h, int nt)
+{
+    int i, target = nt * TILES_PER_THREAD, rows, cols, nRows, nCols, n;
+
+    /* The tiles line up with those of the solid-area search. */
+    rows = (h + target - 1) / target;
+    rows = (rows + MAX_SPLIT_TILE_SIZE - 1) / MAX_SPLIT_TILE_SIZE *
+           MAX_SPLIT_TILE_SIZE;
+    nRows = (h + rows - 1) / rows;
+    nCols = max((target + nRows / 2) / nRows, 1);
+    cols = (w + nCols - 1) / nCols;
+    cols = (cols + MAX_SPLIT_TILE_SIZE - 1) / MAX_SPLIT_TILE_SIZE *
+           MAX_SPLIT_TILE_SIZE;
+    cols = max(cols, TILE_MIN_WIDTH);
+    nCols = (w + cols - 1) / cols;
+    n = nRows * nCols;
+
+    if (n > maxTiles) {
+        tile *newTiles = (tile *)realloc(tiles, n * sizeof(tile));
+        if (!newTiles) return FALSE;
+        tiles = newTiles;
+        for (; maxTiles < n; maxTiles++) {
+            memset(&tiles[maxTiles], 0, sizeof(tile));
+            tiles[maxTiles].size = tiles[maxTiles].outSize = UPDATE_BUF_SIZE;
+            if ((tiles[maxTiles].buf = (char *)malloc(UPDATE_BUF_SIZE))
+                == NULL ||
+                (tiles[maxTiles].out = (char *)malloc(UPDATE_BUF_SIZE))
+                == NULL) {
+                free(tiles[maxTiles].buf);
+                return FALSE;
+            }
+        }
+    }
+
+    nLanes = min(nt, TVNC_MAXLANES);
+    for (i = 0; i < n; i++) {
+        int col = i % nCols, row = i / nCols;
+        tiles[i].x = x + cols * col;
+        tiles[i].y = y + rows * row;
+        tiles[i].w = min(cols, w - cols * col);
+        tiles[i].h = min(rows, h - rows * row);
+        tiles[i].lane = i * nLanes / n;
+        tiles[i].nJobs = 0;
+        tiles[i].analyzed = FALSE;
+        tiles[i].status = TRUE;
+    }
+    nTiles = n;
+    nWorkers = nt;
+
+    /* Tile i belongs to lane i * nLanes / n, so the tiles of lane i start at
+       ceil(i * n / nLanes).  The same goes for the deques. */
+    for (i = 0; i < nLanes; i++) {
+        tilelane *lane = &lanes[i];
+        lane->baseStreamId = 4 / nLanes * i;
+        if (i == nLanes - 1) lane->nStreams = 4 - lane->baseStreamId;
+        else lane->nStreams = 4 / nLanes;
+        lane->next = (i * n + nLanes - 1) / nLanes;
+        lane->end = ((i + 1) * n + nLanes - 1) / nLanes;
+    }
+    for (i = 0; i < nt; i++) {
+        deques[i].head = (i * n + nt - 1) / nt;
+        deques[i].tail = ((i + 1) * n + nt - 1) / nt;
+    }
+    return TRUE;
+}
+
+static int
+NextTile(int self)
+{
+    int i, index = -1;
+
+    pthread_mutex_lock(&deques[self].mutex);
+    if (deques[self].head < deques[self].tail)
+        index = deques[self].head++;
+    pthread_mutex_unlock(&deques[self].mutex);
+
+    while (index < 0) {
+        int victim = -1, most = 0;
+        for (i = 0; i < nWorkers; i++) {
+            int left;
+            pthread_mutex_lock(&deques[i].mutex);
+            left = deques[i].tail - deques[i].head;
+            pthread_mutex_unlock(&deques[i].mutex);
+            if (left > most) {
+                most = left;
+                victim = i;
+            }
+        }
+        if (victim < 0) break;
+        pthread_mutex_lock(&deques[victim].mutex);
+        if (deques[victim].head < deques[victim].tail)
+            index = deques[victim].head++;
+        pthread_mutex_unlock(&deques[victim].mutex);
+    }
+    return index;
+}
+
+/* Analyzes tiles until there are none left, then finishes the deflate stage
+   of this thread's lane, if it has one.  A tile that fails is still marked
+   as analyzed, so the lane's thread doesn't wait for it forever. */
+
+static Bool
+RunTiles(threadparam *t)
+{
+    char *updateBuf = t->updateBuf;
+    int updateBufSize = t->updateBufSize, *ublen = t->ublen, index;
+    Bool status = TRUE;
+
+    t->ublen = &t->_ublen;
+    while ((index = NextTile(t->id)) >= 0) {
+        tile *tl = &tiles[index];
+        tilelane *lane = &lanes[tl->lane];
+
+        t->updateBuf = tl->buf;
+        t->updateBufSize = tl->size;
+        t->_ublen = 0;
+        t->curTile = tl;
+        t->baseStreamId = t->streamId = lane->baseStreamId;
+        t->nStreams = lane->nStreams;
+
+        if (!SendRectEncodingTight(t, tl->x, tl->y, tl->w, tl->h))
+            tl->status = FALSE;
+        t->curTile = NULL;
+        tl->buf = t->updateBuf;
+        tl->size = t->updateBufSize;
+        tl->len = t->_ublen;
+
+        pthread_mutex_lock(&tileMutex);
+        tl->analyzed = TRUE;
+        pthread_cond_broadcast(&tileCond);
+        pthread_mutex_unlock(&tileMutex);
+
+        if (t->id < nLanes && !DeflateLane(t, FALSE))
+            status = FALSE;
+    }
+    if (t->id < nLanes && !DeflateLane(t, TRUE))
+        status = FALSE;
+    t->updateBuf = updateBuf;
+    t->updateBufSize = updateBufSize;
+    t->ublen = ublen;
+    return status;
+}
+
+/* Deflates the tiles of this thread's lane, in order, until it reaches one
+   that hasn't been analyzed yet.  If wait is TRUE, then it waits for the
+   rest of the tiles instead. */
+
+static Bool
+DeflateLane(threadparam *t, Bool wait)
+{
+    tilelane *lane = &lanes[t->id];
+    Bool status = TRUE;
+
+    while (lane->next < lane->end) {
+        tile *tl = &tiles[lane->next];
+        Bool analyzed;
+
+        pthread_mutex_lock(&tileMutex);
+        while (wait && !tl->analyzed)
+            pthread_cond_wait(&tileCond, &tileMutex);
+        analyzed = tl->analyzed;
+        pthread_mutex_unlock(&tileMutex);
+        if (!analyzed) break;
+
+        if (tl->status && !DeflateTile(t, tl)) {
+            tl->status = FALSE;
+            status = FALSE;
+        }
+        lane->next++;
+    }
+    return status;
+}
+
+/* Copies the output of the tile's analysis stage into its output buffer,
+   compressing the data of each deflate job along the way */
+
+static Bool
+DeflateTile(threadparam *t, tile *tl)
+{
+    int i, offset = 0;
+    Bool status = TRUE;
+
+    t->updateBuf = tl->out;
+    t->updateBufSize = tl->outSize;
+    t->_ublen = 0;
+
+    for (i = 0; i <= tl->nJobs && status; i++) {
+        int end = (i < tl->nJobs) ? tl->jobs[i].offset : tl->len;
+
+        if (!CheckUpdateBuf(t, end - offset)) {
+            status = FALSE;
+            break;
+        }
+        memcpy(&t->updateBuf[t->_ublen], &tl->buf[offset], end - offset);
+        t->_ublen += end - offset;
+        if (i < tl->nJobs) {
+            deflatejob *job = &tl->jobs[i];
+            status = DeflateData(t, job->streamId, &tl->buf[job->offset],
+                                 job->len, job->zlibLevel, job->zlibStrategy);
+            offset = job->offset + job->len;
+        }
+    }
+
+    tl->out = t->updateBuf;
+    tl->outSize = t->updateBufSize;
+    tl->outLen = t->_ublen;
+    return status;
+}
+
+static Bool
+SendTile(rfbClientPtr cl, tile *tl)
+{
+    int offset = 0;
+
+    while (offset < tl->outLen) {
+        int n = min(tl->outLen - offset, UPDATE_BUF_SIZE - ublen);
+        memcpy(&updateBuf[ublen], &tl->out[offset], n);
+        ublen += n;
+        offset += n;
+        if (ublen >= UPDATE_BUF_SIZE && !rfbSendUpdateBuf(cl))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+
 static Bool
 CheckUpdateBuf(threadparam *t, int bytes)
 {
     rfbClientPtr cl = t->cl;
-    if (t->id == 0) {
+    if (t->ublen == &ublen) {
         if (ublen + bytes > UPDATE_BUF_SIZE) {
             if (!rfbSendUpdateBuf(cl))
                 return FALSE;
@@ -335,13 +743,33 @@ CheckUpdateBuf(threadparam *t, int bytes)
     }
     else {
         if ((*t->ublen) + bytes > t->updateBufSize) {
-            t->updateBufSize += UPDATE_BUF_SIZE;
-            t->updateBuf = (char *)realloc(t->updateBuf, t->updateBufSize);
+            char *newBuf;
+            while ((*t->ublen) + bytes > t->updateBufSize)
+                t->updateBufSize += UPDATE_BUF_SIZE;
+            newBuf = (char *)realloc(t->updateBuf, t->updateBufSize);
+            if (!newBuf) return FALSE;
+            t->updateBuf = newBuf;
         }
     }
     return TRUE;
 }
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)
+ */
+
+void
+rfbSetTightLevels(int compress, int quality, int subsamp)
+{
+    if (compress != rfbTightLevelDefault)
+        compressLevel = compress;
+    if (quality != rfbTightLevelDefault)
+        qualityLevel = quality;
+    if (subsamp != rfbTightLevelDefault)
+        subsampLevel = subsamp;
+}
+
+
 
 Bool
 rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
@@ -353,6 +781,9 @@ rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
         InitThreads();
         if (!threadInit) return FALSE;
     }
+#ifdef TIGHT_PHASE_TIMERS
+    if (phaseTime0 < 0.0) rfbResetTightPhases();
+#endif
 
     /* CL 9 (which maps internally to CL 3) is included mainly for backward
        compatibility with TightVNC Compression Levels 5-9.  It should be used
@@ -392,59 +823,45 @@ rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
     for (i = 0; i < nt; i++) {
         tparam[i].status = TRUE;
         tparam[i].cl = cl;
-        tparam[i].x = x;
-        tparam[i].y = h / nt * i + y;
-        tparam[i].w = w;
-        tparam[i].h = (i == nt - 1) ? (h - (h / nt * i)) : h / nt;
         tparam[i].bytessent = tparam[i].rectsent = 0;
-        if (i < 4) {
-            int n = min(nt, 4);
-            tparam[i].baseStreamId = 4 / n * i;
-            if (i == n - 1) tparam[i].nStreams = 4 - tparam[i].baseStreamId;
-            else tparam[i].nStreams = 4 / n;
-            tparam[i].streamId = tparam[i].baseStreamId;
-        }
         tparam[i].solidrect = tparam[i].solidpixels = 0;
         tparam[i].monorect = tparam[i].monopixels = 0;
         tparam[i].ndxrect = tparam[i].ndxpixels = 0;
         tparam[i].jpegrect = tparam[i].jpegpixels = 0;
         tparam[i].fcrect = tparam[i].fcpixels = 0;
-    }
-    if (nt > 1) {
-        for (i = 1; i < nt; i++) pthread_mutex_unlock(&tparam[i].ready);
+#ifdef TIGHT_PHASE_TIMERS
+        memset(tparam[i].phase, 0, sizeof(tparam[i].phase));
+#endif
     }
 
-    status &= SendRectEncodingTight(&tparam[0], tparam[0].x, tparam[0].y,
-                                    tparam[0].w, tparam[0].h);
-    if (!status) return FALSE;
-    cl->rfbBytesSent[rfbEncodingTight] += tparam[0].bytessent;
-    cl->rfbRectanglesSent[rfbEncodingTight] += tparam[0].rectsent;
-
-    if (nt > 1) {
+    if (nt == 1) {
+        tparam[0].baseStreamId = tparam[0].streamId = 0;
+        tparam[0].nStreams = 4;
+        status = SendRectEncodingTight(&tparam[0], x, y, w, h);
+        if (!status) return FALSE;
+    } else {
+        if (!ScheduleTiles(x, y, w, h, nt)) {
+            rfbLog("ERROR: Could not allocate tiles.\n");
+            return FALSE;
+        }
+        for (i = 1; i < nt; i++) pthread_mutex_unlock(&tparam[i].ready);
+        status = RunTiles(&tparam[0]);
         for (i = 1; i < nt; i++) {
-            pthread_mutex_lock (&tparam[i].done);
+            pthread_mutex_lock(&tparam[i].done);
             status &= tparam[i].status;
         }
+        for (i = 0; i < nTiles; i++)
+            status &= tiles[i].status;
         if (status == FALSE) return FALSE;
-        if (ublen > 0) {
-            if (!rfbSendUpdateBuf(cl)) {
+        for (i = 0; i < nTiles; i++) {
+            if (!SendTile(cl, &tiles[i]))
                 return FALSE;
-            }
-        }
-        for (i = 1; i < nt; i++) {
-            if ((*tparam[i].ublen) > 0 && decompress) {
-                if ((*tparam[i].ublen) + sblen > SEND_BUF_SIZE) {
-                    rfbLog("ERROR: Send buffer overrun.\n");
-                    return FALSE;
-                }
-                memcpy(&sendBuf[sblen], tparam[i].updateBuf, *tparam[i].ublen);
-                sblen += (*tparam[i].ublen);
-            }
-            (*tparam[i].ublen) = 0;
-            cl->rfbBytesSent[rfbEncodingTight] += tparam[i].bytessent;
-            cl->rfbRectanglesSent[rfbEncodingTight] += tparam[i].rectsent;
         }
     }
+    for (i = 0; i < nt; i++) {
+        cl->rfbBytesSent[rfbEncodingTight] += tparam[i].bytessent;
+        cl->rfbRectanglesSent[rfbEncodingTight] += tparam[i].rectsent;
+    }
     for (i = 0; i < nt; i++) {
         solidrect += tparam[i].solidrect;
         solidpixels += tparam[i].solidpixels;
@@ -456,6 +873,17 @@ rfbSendRectEncodingTight(rfbClientPtr cl, int x, int y, int w, int h)
         jpegpixels += tparam[i].jpegpixels;
         fcrect += tparam[i].fcrect;
         fcpixels += tparam[i].fcpixels;
+#ifdef TIGHT_PHASE_TIMERS
+        {
+            int p;
+            for (p = 0; p < NPHASES; p++) {
+                phaseTotals[i][p].ticks += tparam[i].phase[p].ticks;
+                phaseTotals[i][p].calls += tparam[i].phase[p].calls;
+                phaseTotals[i][p].bytesIn += tparam[i].phase[p].bytesIn;
+                phaseTotals[i][p].bytesOut += tparam[i].phase[p].bytesOut;
+            }
+        }
+#endif
     }
 
     return status;
@@ -470,6 +898,7 @@ SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
     int dx, dy, dw, dh;
     int x_best, y_best, w_best, h_best;
     char *fbptr;
+    Bool solid;
     rfbClientPtr cl = t->cl;
 
     if (!enableLastRectEncoding || w * h < MIN_SPLIT_RECT_SIZE)
@@ -518,7 +947,12 @@ SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
             dw = (dx + MAX_SPLIT_TILE_SIZE <= x + w) ?
                  MAX_SPLIT_TILE_SIZE : (x + w - dx);
 
-            if (CheckSolidTile(cl, dx, dy, dw, dh, &colorValue, FALSE)) {
+            PHASE_START(t);
+            solid = CheckSolidTile(cl, dx, dy, dw, dh, &colorValue, FALSE);
+            PHASE_END(t, PHASE_CHECKSOLID,
+                      dw * dh * rfbScreen.bitsPerPixel / 8, 0);
+
+            if (solid) {
 
                 if (subsampLevel == TJ_GRAYSCALE && qualityLevel != -1) {
                     CARD32 r = (colorValue >> 16) & 0xFF;
@@ -531,8 +965,11 @@ SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
 
                 /* Get dimensions of solid-color area. */
 
+                PHASE_START(t);
                 FindBestSolidArea(cl, dx, dy, w - (dx - x), h - (dy - y),
                                   colorValue, &w_best, &h_best);
+                PHASE_END(t, PHASE_FINDSOLID,
+                          w_best * h_best * rfbScreen.bitsPerPixel / 8, 0);
 
                 /* Make sure a solid rectangle is large enough
                    (or the whole rectangle is of the same color). */
@@ -544,8 +981,11 @@ SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
                 /* Try to extend solid rectangle to maximum size. */
 
                 x_best = dx; y_best = dy;
+                PHASE_START(t);
                 ExtendSolidArea(cl, x, y, w, h, colorValue,
                                 &x_best, &y_best, &w_best, &h_best);
+                PHASE_END(t, PHASE_EXTENDSOLID,
+                          w_best * h_best * rfbScreen.bitsPerPixel / 8, 0);
 
                 /* Send rectangles at top and left to solid-color area. */
 
@@ -566,9 +1006,12 @@ SendRectEncodingTight(threadparam *t, int x, int y, int w, int h)
                          (rfbScreen.paddedWidthInBytes * y_best) +
                          (x_best * (rfbScreen.bitsPerPixel / 8)));
 
+                PHASE_START(t);
                 (*cl->translateFn)(cl->translateLookupTable, &rfbServerFormat,
                                    &cl->format, fbptr, t->tightBeforeBuf,
                                    rfbScreen.paddedWidthInBytes, 1, 1);
+                PHASE_END(t, PHASE_TRANSLATE, rfbScreen.bitsPerPixel / 8,
+                          cl->format.bitsPerPixel / 8);
 
                 t->solidrect++;  t->solidpixels += w_best * h_best;
                 if (!SendSolidRect(t))
@@ -644,37 +1087,31 @@ static void
 ExtendSolidArea(rfbClientPtr cl, int x, int y, int w, int h, CARD32 colorValue,
                 int *x_ptr, int *y_ptr, int *w_ptr, int *h_ptr)
 {
-    int cx, cy;
+    int bpp = rfbServerFormat.bitsPerPixel;
+    int pitch = rfbScreen.paddedWidthInBytes, n;
 
     /* Try to extend the area upwards. */
-    for (cy = *y_ptr - 1;
-         cy >= y && CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue,
-                                   TRUE);
-         cy--);
-    *h_ptr += *y_ptr - (cy + 1);
-    *y_ptr = cy + 1;
+    n = rfbSolidBottomRows(FB_PTR(cl, *x_ptr, y), pitch, *w_ptr, *y_ptr - y,
+                           bpp, colorValue);
+    *y_ptr -= n;
+    *h_ptr += n;
 
     /* ... downwards. */
-    for (cy = *y_ptr + *h_ptr;
-         cy < y + h &&
-             CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
-         cy++);
-    *h_ptr += cy - (*y_ptr + *h_ptr);
+    n = rfbSolidTopRows(FB_PTR(cl, *x_ptr, *y_ptr + *h_ptr), pitch, *w_ptr,
+                        y + h - (*y_ptr + *h_ptr), bpp, colorValue);
+    *h_ptr += n;
 
     /* ... to the left. */
-    for (cx = *x_ptr - 1;
-         cx >= x && CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue,
-                                   TRUE);
-         cx--);
-    *w_ptr += *x_ptr - (cx + 1);
-    *x_ptr = cx + 1;
+    n = rfbSolidRightColumns(FB_PTR(cl, x, *y_ptr), pitch, *x_ptr - x, *h_ptr,
+                             bpp, colorValue);
+    *x_ptr -= n;
+    *w_ptr += n;
 
     /* ... to the right. */
-    for (cx = *x_ptr + *w_ptr;
-         cx < x + w &&
-             CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-         cx++);
-    *w_ptr += cx - (*x_ptr + *w_ptr);
+    n = rfbSolidLeftColumns(FB_PTR(cl, *x_ptr + *w_ptr, *y_ptr), pitch,
+                            x + w - (*x_ptr + *w_ptr), *h_ptr, bpp,
+                            colorValue);
+    *w_ptr += n;
 }
 
 
@@ -689,53 +1126,32 @@ static Bool
 CheckSolidTile(rfbClientPtr cl, int x, int y, int w, int h, CARD32 *colorPtr,
                Bool needSameColor)
 {
-    switch(rfbServerFormat.bitsPerPixel) {
+    int bpp = rfbServerFormat.bitsPerPixel;
+    char *fbptr = FB_PTR(cl, x, y);
+    CARD32 colorValue;
+
+    switch (bpp) {
     case 32:
-        return CheckSolidTile32(cl, x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD32 *)fbptr;
+        break;
     case 16:
-        return CheckSolidTile16(cl, x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD16 *)fbptr;
+        break;
     default:
-        return CheckSolidTile8(cl, x, y, w, h, colorPtr, needSameColor);
+        bpp = 8;
+        colorValue = *(CARD8 *)fbptr;
     }
-}
+    if (needSameColor && colorValue != *colorPtr)
+        return FALSE;
 
+    if (!rfbSolidCheck(fbptr, rfbScreen.paddedWidthInBytes, w, h, bpp,
+                       colorValue))
+        return FALSE;
 
-#define DEFINE_CHECK_SOLID_FUNCTION(bpp)                                      \
-                                                                              \
-static Bool                                                                   \
-CheckSolidTile##bpp(cl, x, y, w, h, colorPtr, needSameColor)                  \
-    rfbClientPtr cl;                                                          \
-    int x, y, w, h;                                                           \
-    CARD32 *colorPtr;                                                         \
-    Bool needSameColor;                                                       \
-{                                                                             \
-    CARD##bpp *fbptr;                                                         \
-    CARD##bpp colorValue;                                                     \
-    int dx, dy;                                                               \
-                                                                              \
-    fbptr = (CARD##bpp *)                                                     \
-        &cl->fb[y * rfbScreen.paddedWidthInBytes + x * (bpp/8)];              \
-                                                                              \
-    colorValue = *fbptr;                                                      \
-    if (needSameColor && (CARD32)colorValue != *colorPtr)                     \
-        return FALSE;                                                         \
-                                                                              \
-    for (dy = 0; dy < h; dy++) {                                              \
-        for (dx = 0; dx < w; dx++) {                                          \
-            if (colorValue != fbptr[dx])                                      \
-                return FALSE;                                                 \
-        }                                                                     \
-        fbptr = (CARD##bpp *)((CARD8 *)fbptr + rfbScreen.paddedWidthInBytes); \
-    }                                                                         \
-                                                                              \
-    *colorPtr = (CARD32)colorValue;                                           \
-    return TRUE;                                                              \
+    *colorPtr = colorValue;
+    return TRUE;
 }
 
-DEFINE_CHECK_SOLID_FUNCTION(8)
-DEFINE_CHECK_SOLID_FUNCTION(16)
-DEFINE_CHECK_SOLID_FUNCTION(32)
-
 
 static Bool
 SendRectSimple(threadparam *t, int x, int y, int w, int h)
@@ -833,6 +1249,7 @@ SendSubrect(threadparam *t, int x, int y, int w, int h)
 
         /* This is so we can avoid translating the pixels when compressing
            with JPEG, since it is unnecessary */
+        PHASE_START(t);
         switch (cl->format.bitsPerPixel) {
         case 16:
             FastFillPalette16(t, (CARD16 *)fbptr, w,
@@ -842,18 +1259,28 @@ SendSubrect(threadparam *t, int x, int y, int w, int h)
             FastFillPalette32(t, (CARD32 *)fbptr, w,
                               rfbScreen.paddedWidthInBytes/4, h);
         }
+        PHASE_END(t, PHASE_FASTPALETTE, w * h * cl->format.bitsPerPixel / 8,
+                  0);
 
         if (t->paletteNumColors != 0 || qualityLevel == -1) {
+            PHASE_START(t);
             (*cl->translateFn)(cl->translateLookupTable, &rfbServerFormat,
                                &cl->format, fbptr, t->tightBeforeBuf,
                                rfbScreen.paddedWidthInBytes, w, h);
+            PHASE_END(t, PHASE_TRANSLATE,
+                      w * h * rfbServerFormat.bitsPerPixel / 8,
+                      w * h * cl->format.bitsPerPixel / 8);
         }
     }
     else {
+        PHASE_START(t);
         (*cl->translateFn)(cl->translateLookupTable, &rfbServerFormat,
                            &cl->format, fbptr, t->tightBeforeBuf,
                            rfbScreen.paddedWidthInBytes, w, h);
+        PHASE_END(t, PHASE_TRANSLATE, w * h * rfbServerFormat.bitsPerPixel / 8,
+                  w * h * cl->format.bitsPerPixel / 8);
 
+        PHASE_START(t);
         switch (cl->format.bitsPerPixel) {
         case 8:
             FillPalette8(t, w * h);
@@ -864,6 +1291,7 @@ SendSubrect(threadparam *t, int x, int y, int w, int h)
         default:
             FillPalette32(t, w * h);
         }
+        PHASE_END(t, PHASE_PALETTE, w * h * cl->format.bitsPerPixel / 8, 0);
     }
 
     switch (t->paletteNumColors) {
@@ -928,7 +1356,9 @@ SendSolidRect(threadparam *t)
     rfbClientPtr cl = t->cl;
 
     if (usePixelFormat24) {
+        PHASE_START(t);
         Pack24(t->tightBeforeBuf, &cl->format, 1);
+        PHASE_END(t, PHASE_PACK24, 4, 3);
         len = 3;
     } else
         len = cl->format.bitsPerPixel / 8;
@@ -949,7 +1379,7 @@ SendSolidRect(threadparam *t)
 static Bool
 SendMonoRect(threadparam *t, int w, int h)
 {
-    int streamId = t->streamId;
+    int streamId;
     int paletteLen, dataLen;
     rfbClientPtr cl = t->cl;
 
@@ -959,6 +1389,7 @@ SendMonoRect(threadparam *t, int w, int h)
                         2 * cl->format.bitsPerPixel / 8))
         return FALSE;
 
+    streamId = t->streamId;
     if (t->nStreams > 0) {
         t->streamId++;
         if (t->streamId >= t->baseStreamId + t->nStreams)
@@ -969,7 +1400,7 @@ SendMonoRect(threadparam *t, int w, int h)
     dataLen = (w + 7) / 8;
     dataLen *= h;
 
-    if (tightConf[compressLevel].monoZlibLevel == 0 || t->id > 3)
+    if (tightConf[compressLevel].monoZlibLevel == 0)
         t->updateBuf[(*t->ublen)++] =
             (char)((rfbTightNoZlib | rfbTightExplicitFilter) << 4);
     else
@@ -986,7 +1417,9 @@ SendMonoRect(threadparam *t, int w, int h)
         ((CARD32 *)t->tightAfterBuf)[0] = t->monoBackground;
         ((CARD32 *)t->tightAfterBuf)[1] = t->monoForeground;
         if (usePixelFormat24) {
+            PHASE_START(t);
             Pack24(t->tightAfterBuf, &cl->format, 2);
+            PHASE_END(t, PHASE_PACK24, 8, 6);
             paletteLen = 6;
         } else
             paletteLen = 8;
@@ -1024,7 +1457,7 @@ SendMonoRect(threadparam *t, int w, int h)
 static Bool
 SendIndexedRect(threadparam *t, int w, int h)
 {
-    int streamId = t->streamId;
+    int streamId;
     int i, entryLen;
     rfbClientPtr cl = t->cl;
 
@@ -1034,6 +1467,7 @@ SendIndexedRect(threadparam *t, int w, int h)
         t->paletteNumColors * cl->format.bitsPerPixel / 8))
         return FALSE;
 
+    streamId = t->streamId;
     if (t->nStreams > 0) {
         t->streamId++;
         if (t->streamId >= t->baseStreamId + t->nStreams)
@@ -1041,7 +1475,7 @@ SendIndexedRect(threadparam *t, int w, int h)
     }
 
     /* Prepare tight encoding header. */
-    if (tightConf[compressLevel].idxZlibLevel == 0 || t->id > 3)
+    if (tightConf[compressLevel].idxZlibLevel == 0)
         t->updateBuf[(*t->ublen)++] =
             (char)((rfbTightNoZlib | rfbTightExplicitFilter) << 4);
     else
@@ -1057,10 +1491,13 @@ SendIndexedRect(threadparam *t, int w, int h)
 
         for (i = 0; i < t->paletteNumColors; i++) {
             ((CARD32 *)t->tightAfterBuf)[i] =
-                t->palette.entry[i].listNode->rgb;
+                t->palette.entry[i].color;
         }
         if (usePixelFormat24) {
+            PHASE_START(t);
             Pack24(t->tightAfterBuf, &cl->format, t->paletteNumColors);
+            PHASE_END(t, PHASE_PACK24, t->paletteNumColors * 4,
+                      t->paletteNumColors * 3);
             entryLen = 3;
         } else
             entryLen = 4;
@@ -1076,7 +1513,7 @@ SendIndexedRect(threadparam *t, int w, int h)
 
         for (i = 0; i < t->paletteNumColors; i++) {
             ((CARD16 *)t->tightAfterBuf)[i] =
-                (CARD16)t->palette.entry[i].listNode->rgb;
+                (CARD16)t->palette.entry[i].color;
         }
 
         memcpy(&t->updateBuf[*t->ublen], t->tightAfterBuf,
@@ -1098,7 +1535,7 @@ SendIndexedRect(threadparam *t, int w, int h)
 static Bool
 SendFullColorRect(threadparam *t, int w, int h)
 {
-    int streamId = t->streamId;
+    int streamId;
     int len;
     rfbClientPtr cl = t->cl;
 
@@ -1107,20 +1544,23 @@ SendFullColorRect(threadparam *t, int w, int h)
     if (!CheckUpdateBuf(t, TIGHT_MIN_TO_COMPRESS + 1))
         return FALSE;
 
+    streamId = t->streamId;
     if (t->nStreams > 0) {
         t->streamId++;
         if (t->streamId >= t->baseStreamId + t->nStreams)
             t->streamId = t->baseStreamId;
     }
 
-    if (tightConf[compressLevel].rawZlibLevel == 0 || t->id > 3)
+    if (tightConf[compressLevel].rawZlibLevel == 0)
         t->updateBuf[(*t->ublen)++] = (char)(rfbTightNoZlib << 4);
     else
         t->updateBuf[(*t->ublen)++] = streamId << 4;
     t->bytessent++;
 
     if (usePixelFormat24) {
+        PHASE_START(t);
         Pack24(t->tightBeforeBuf, &cl->format, w * h);
+        PHASE_END(t, PHASE_PACK24, w * h * 4, w * h * 3);
         len = 3;
     } else
         len = cl->format.bitsPerPixel / 8;
@@ -1135,10 +1575,6 @@ static Bool
 CompressData(threadparam *t, int streamId, int dataLen, int zlibLevel,
              int zlibStrategy)
 {
-    z_streamp pz;
-    int err;
-    rfbClientPtr cl = t->cl;
-
     if (dataLen < TIGHT_MIN_TO_COMPRESS) {
         memcpy(&t->updateBuf[*t->ublen], t->tightBeforeBuf, dataLen);
         (*t->ublen) += dataLen;
@@ -1146,16 +1582,72 @@ CompressData(threadparam *t, int streamId, int dataLen, int zlibLevel,
         return TRUE;
     }
 
+    if (zlibLevel == 0)
+        return SendCompressedData (t, t->tightBeforeBuf, dataLen);
+
     /* Tight encoding has only a limited number of Zlib streams (4).  The
        streams must all be left open as long as the client is connected, or
        performance suffers.  Thus, multiple threads can't use the same Zlib
-       stream.  We divide the pool of 4 evenly among the available threads (up
-       to the first 4 threads), and if each thread has more than one stream, it
-       cycles between them in a round-robin fashion.  If we have more than 4
-       threads, then threads 5 and beyond must encode their data without Zlib
-       compression. */
-    if (zlibLevel == 0 || t->id > 3)
-        return SendCompressedData (t, t->tightBeforeBuf, dataLen);
+       stream at the same time.  We divide the pool of 4 evenly among the
+       lanes of tiles (up to 4), and if each lane has more than one stream, it
+       cycles between them in a round-robin fashion.  The thread that analyzes
+       a tile only picks the streams, and the compression itself is left to
+       the lane's thread (see the tile scheduler above.) */
+    if (t->curTile)
+        return DeferData(t, streamId, dataLen, zlibLevel, zlibStrategy);
+
+    return DeflateData(t, streamId, t->tightBeforeBuf, dataLen, zlibLevel,
+                       zlibStrategy);
+}
+
+
+/* Leaves the data in the tile's buffer for the deflate stage */
+
+static Bool
+DeferData(threadparam *t, int streamId, int dataLen, int zlibLevel,
+          int zlibStrategy)
+{
+    tile *tl = t->curTile;
+    deflatejob *job;
+
+    if (tl->nJobs >= tl->maxJobs) {
+        int newMax = tl->maxJobs ? tl->maxJobs * 2 : 16;
+        deflatejob *newJobs = (deflatejob *)realloc(tl->jobs,
+                                                    newMax * sizeof(deflatejob));
+        if (!newJobs) return FALSE;
+        tl->jobs = newJobs;
+        tl->maxJobs = newMax;
+    }
+    if (!CheckUpdateBuf(t, dataLen))
+        return FALSE;
+
+    job = &tl->jobs[tl->nJobs++];
+    job->offset = *t->ublen;
+    job->len = dataLen;
+    job->streamId = streamId;
+    job->zlibLevel = zlibLevel;
+    job->zlibStrategy = zlibStrategy;
+    memcpy(&t->updateBuf[*t->ublen], t->tightBeforeBuf, dataLen);
+    (*t->ublen) += dataLen;
+    return TRUE;
+}
+
+
+static Bool
+DeflateData(threadparam *t, int streamId, char *data, int dataLen,
+            int zlibLevel, int zlibStrategy)
+{
+    z_streamp pz;
+    int err, maxAfterSize = dataLen + (dataLen + 99) / 100 + 12;
+    rfbClientPtr cl = t->cl;
+
+    /* The lane's thread may not have analyzed any tiles of this size. */
+    if (t->tightAfterBufSize < maxAfterSize) {
+        char *newBuf = (char *)realloc(t->tightAfterBuf, maxAfterSize);
+        if (!newBuf) return FALSE;
+        t->tightAfterBuf = newBuf;
+        t->tightAfterBufSize = maxAfterSize;
+    }
 
     pz = &cl->zsStruct[streamId];
 
@@ -1175,7 +1667,7 @@ CompressData(threadparam *t, int streamId, int dataLen, int zlibLevel,
     }
 
     /* Prepare buffer pointers. */
-    pz->next_in = (Bytef *)t->tightBeforeBuf;
+    pz->next_in = (Bytef *)data;
     pz->avail_in = dataLen;
     pz->next_out = (Bytef *)t->tightAfterBuf;
     pz->avail_out = t->tightAfterBufSize;
@@ -1189,8 +1681,11 @@ CompressData(threadparam *t, int streamId, int dataLen, int zlibLevel,
     }
 
     /* Actual compression. */
-    if (deflate(pz, Z_SYNC_FLUSH) != Z_OK ||
-        pz->avail_in != 0 || pz->avail_out == 0) {
+    PHASE_START(t);
+    err = deflate(pz, Z_SYNC_FLUSH);
+    PHASE_END(t, PHASE_DEFLATE, dataLen - pz->avail_in,
+              t->tightAfterBufSize - pz->avail_out);
+    if (err != Z_OK || pz->avail_in != 0 || pz->avail_out == 0) {
         return FALSE;
     }
 
@@ -1287,10 +1782,10 @@ FillPalette##bpp(t, count)                                              \
 {                                                                       \
     CARD##bpp *data = (CARD##bpp *)t->tightBeforeBuf;                   \
     CARD##bpp c0, c1, ci;                                               \
-    int i, n0, n1, ni;                                                  \
+    int i, n, n0, n1, ni;                                               \
                                                                         \
     c0 = data[0];                                                       \
-    for (i = 1; i < count && data[i] == c0; i++);                       \
+    i = 1 + rfbSolidRun(&data[1], count - 1, bpp, c0);                  \
     if (i >= count) {                                                   \
         t->paletteNumColors = 1;   /* Solid rectangle */                \
         return;                                                         \
@@ -1326,21 +1821,22 @@ FillPalette##bpp(t, count)                                              \
     }                                                                   \
                                                                         \
     PaletteReset(t);                                                    \
-    PaletteInsert(t, c0, (CARD32)n0, bpp);                              \
-    PaletteInsert(t, c1, (CARD32)n1, bpp);                              \
+    PaletteInsert(t, c0, (CARD32)n0);                                   \
+    PaletteInsert(t, c1, (CARD32)n1);                                   \
                                                                         \
     ni = 1;                                                             \
     for (i++; i < count; i++) {                                         \
         if (data[i] == ci) {                                            \
-            ni++;                                                       \
+            n = rfbSolidRun(&data[i], count - i, bpp, ci);              \
+            ni += n;  i += n - 1;                                       \
         } else {                                                        \
-            if (!PaletteInsert (t, ci, (CARD32)ni, bpp))                \
+            if (!PaletteInsert (t, ci, (CARD32)ni))                     \
                 return;                                                 \
             ci = data[i];                                               \
             ni = 1;                                                     \
         }                                                               \
     }                                                                   \
-    PaletteInsert(t, ci, (CARD32)ni, bpp);                              \
+    PaletteInsert(t, ci, (CARD32)ni);                                   \
 }
 
 DEFINE_FILL_PALETTE_FUNCTION(16)
@@ -1356,7 +1852,7 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     int w, pitch, h;                                                    \
 {                                                                       \
     CARD##bpp c0, c1, ci, mask, c0t, c1t, cit;                          \
-    int i, j, i2 = 0, j2, n0, n1, ni;                                   \
+    int i, j, i2 = 0, j2, n, n0, n1, ni;                                \
     rfbClientPtr cl = t->cl;                                            \
                                                                         \
     if (cl->translateFn != rfbTranslateNone) {                          \
@@ -1367,7 +1863,10 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
                                                                         \
     c0 = data[0] & mask;                                                \
     for (j = 0; j < h; j++) {                                           \
-        for (i = 0; i < w; i++) {                                       \
+        i = 0;                                                          \
+        if (mask == (CARD##bpp)~0)                                      \
+            i = rfbSolidRun(&data[j * pitch], w, bpp, c0);              \
+        for (; i < w; i++) {                                            \
             if ((data[j * pitch + i] & mask) != c0)                     \
                 goto done;                                              \
         }                                                               \
@@ -1418,21 +1917,25 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     }                                                                   \
                                                                         \
     PaletteReset(t);                                                    \
-    PaletteInsert(t, c0t, (CARD32)n0, bpp);                             \
-    PaletteInsert(t, c1t, (CARD32)n1, bpp);                             \
+    PaletteInsert(t, c0t, (CARD32)n0);                                  \
+    PaletteInsert(t, c1t, (CARD32)n1);                                  \
                                                                         \
     ni = 1;                                                             \
     i2++;  if (i2 >= w) {i2 = 0;  j2++;}                                \
     for (j = j2; j < h; j++) {                                          \
         for (i = i2; i < w; i++) {                                      \
             if ((data[j * pitch + i] & mask) == ci) {                   \
-                ni++;                                                   \
+                if (mask == (CARD##bpp)~0) {                            \
+                    n = rfbSolidRun(&data[j * pitch + i], w - i, bpp, ci);\
+                    ni += n;  i += n - 1;                               \
+                } else                                                  \
+                    ni++;                                               \
             } else {                                                    \
                 (*cl->translateFn)(cl->translateLookupTable,            \
                                    &rfbServerFormat, &cl->format,       \
                                    (char *)&ci, (char *)&cit, bpp/8,    \
                                    1, 1);                               \
-                if (!PaletteInsert (t, cit, (CARD32)ni, bpp))           \
+                if (!PaletteInsert (t, cit, (CARD32)ni))                \
                     return;                                             \
                 ci = data[j * pitch + i] & mask;                        \
                 ni = 1;                                                 \
@@ -1444,7 +1947,7 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     (*cl->translateFn)(cl->translateLookupTable, &rfbServerFormat,      \
                        &cl->format, (char *)&ci, (char *)&cit, bpp/8,   \
                        1, 1);                                           \
-    PaletteInsert(t, cit, (CARD32)ni, bpp);                             \
+    PaletteInsert(t, cit, (CARD32)ni);                                  \
 }
 
 DEFINE_FAST_FILL_PALETTE_FUNCTION(16)
@@ -1455,81 +1958,20 @@ DEFINE_FAST_FILL_PALETTE_FUNCTION(32)
  * Functions to operate with palette structures.
  */
 
-#define HASH_FUNC16(rgb) ((int)((((rgb) >> 8) + (rgb)) & 0xFF))
-#define HASH_FUNC32(rgb) ((int)((((rgb) >> 16) + ((rgb) >> 8)) & 0xFF))
-
-
 static void
 PaletteReset(threadparam *t)
 {
     t->paletteNumColors = 0;
-    memset(t->palette.hash, 0, 256 * sizeof(COLOR_LIST *));
+    rfbPaletteReset(&t->palette);
 }
 
 
 static int
-PaletteInsert(threadparam *t, CARD32 rgb, int numPixels, int bpp)
+PaletteInsert(threadparam *t, CARD32 rgb, int numPixels)
 {
-    COLOR_LIST *pnode;
-    COLOR_LIST *prev_pnode = NULL;
-    int hash_key, idx, new_idx, count;
-
-    hash_key = (bpp == 16) ? HASH_FUNC16(rgb) : HASH_FUNC32(rgb);
-
-    pnode = t->palette.hash[hash_key];
-
-    while (pnode != NULL) {
-        if (pnode->rgb == rgb) {
-            /* Such palette entry already exists. */
-            new_idx = idx = pnode->idx;
-            count = t->palette.entry[idx].numPixels + numPixels;
-            if (new_idx && t->palette.entry[new_idx-1].numPixels < count) {
-                do {
-                    t->palette.entry[new_idx] = t->palette.entry[new_idx-1];
-                    t->palette.entry[new_idx].listNode->idx = new_idx;
-                    new_idx--;
-                }
-                while (new_idx &&
-                       t->palette.entry[new_idx-1].numPixels < count);
-                t->palette.entry[new_idx].listNode = pnode;
-                pnode->idx = new_idx;
-            }
-            t->palette.entry[new_idx].numPixels = count;
-            return t->paletteNumColors;
-        }
-        prev_pnode = pnode;
-        pnode = pnode->next;
-    }
-
-    /* Check if palette is full. */
-    if (t->paletteNumColors == 256 ||
-        t->paletteNumColors == t->paletteMaxColors) {
-        t->paletteNumColors = 0;
-        return 0;
-    }
-
-    /* Move palette entries with lesser pixel counts. */
-    for (idx = t->paletteNumColors;
-         idx > 0 && t->palette.entry[idx-1].numPixels < numPixels;
-         idx--) {
-        t->palette.entry[idx] = t->palette.entry[idx-1];
-        t->palette.entry[idx].listNode->idx = idx;
-    }
-
-    /* Add new palette entry into the freed slot. */
-    pnode = &t->palette.list[t->paletteNumColors];
-    if (prev_pnode != NULL) {
-        prev_pnode->next = pnode;
-    } else {
-        t->palette.hash[hash_key] = pnode;
-    }
-    pnode->next = NULL;
-    pnode->idx = idx;
-    pnode->rgb = rgb;
-    t->palette.entry[idx].listNode = pnode;
-    t->palette.entry[idx].numPixels = numPixels;
-
-    return (++(t->paletteNumColors));
+    t->paletteNumColors = rfbPaletteInsert(&t->palette, rgb, numPixels,
+                                           t->paletteMaxColors);
+    return t->paletteNumColors;
 }
 
 
@@ -1578,30 +2020,19 @@ EncodeIndexedRect##bpp(t, buf, count)                                   \
     CARD8 *buf;                                                         \
     int count;                                                          \
 {                                                                       \
-    COLOR_LIST *pnode;                                                  \
     CARD##bpp *src;                                                     \
     CARD##bpp rgb;                                                      \
-    int rep = 0;                                                        \
+    int rep;                                                            \
                                                                         \
     src = (CARD##bpp *) buf;                                            \
                                                                         \
+    /* The indices are written over the pixels that have been read. */  \
     while (count--) {                                                   \
         rgb = *src++;                                                   \
-        while (count && *src == rgb) {                                  \
-            rep++, src++, count--;                                      \
-        }                                                               \
-        pnode = t->palette.hash[HASH_FUNC##bpp(rgb)];                   \
-        while (pnode != NULL) {                                         \
-            if ((CARD##bpp)pnode->rgb == rgb) {                         \
-                *buf++ = (CARD8)pnode->idx;                             \
-                while (rep) {                                           \
-                    *buf++ = (CARD8)pnode->idx;                         \
-                    rep--;                                              \
-                }                                                       \
-                break;                                                  \
-            }                                                           \
-            pnode = pnode->next;                                        \
-        }                                                               \
+        rep = (count && *src == rgb) ? rfbSolidRun(src, count, bpp, rgb) : 0;\
+        src += rep;  count -= rep;                                      \
+        memset(buf, rfbPaletteLookup(&t->palette, rgb), rep + 1);       \
+        buf += rep + 1;                                                 \
     }                                                                   \
 }
 
@@ -1679,7 +2110,7 @@ SendJpegRect(threadparam *t, int x, int y, int w, int h, int quality)
     int ps = rfbServerFormat.bitsPerPixel / 8;
     int subsamp = subsampLevel2tjsubsamp[subsampLevel];
     unsigned long size = 0;
-    int flags = 0, pitch;
+    int flags = 0, pitch, err;
     unsigned char *tmpbuf = NULL;
     unsigned long jpegDstDataLen;
     rfbClientPtr cl = t->cl;
@@ -1762,9 +2193,12 @@ SendJpegRect(threadparam *t, int x, int y, int w, int h, int quality)
         pitch = rfbScreen.paddedWidthInBytes;
     }
 
-    if (tjCompress(t->j, srcbuf, w, pitch, h, ps,
-                   (unsigned char *)t->tightAfterBuf, &size, subsamp, quality,
-                   flags) == -1) {
+    PHASE_START(t);
+    err = tjCompress(t->j, srcbuf, w, pitch, h, ps,
+                     (unsigned char *)t->tightAfterBuf, &size, subsamp,
+                     quality, flags);
+    PHASE_END(t, PHASE_JPEG, w * h * ps, size);
+    if (err == -1) {
       rfbLog("JPEG Error: %s\n", tjGetErrorStr());
       if (tmpbuf) { free(tmpbuf);  tmpbuf = NULL; }
       return 0;
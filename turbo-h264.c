@@ -35,6 +35,8 @@
 #include <unistd.h>
 #include <stdint.h>
 #include "rfb.h"
+#include "solid.h"
+#include "palettehash.h"
 #include "x264.h"
 #include "turbojpeg.h"
 
@@ -57,6 +59,11 @@ extern int decompress, ublen;
 #define MIN_SOLID_SUBRECT_SIZE  2048
 #define MAX_SPLIT_TILE_SIZE       16
 
+/* The address of pixel (x, y) in the framebuffer */
+#define FB_PTR(cl, x, y)                                                      \
+    (&(cl)->fb[(y) * rfbScreen.paddedWidthInBytes +                           \
+               (x) * (rfbServerFormat.bitsPerPixel / 8)])
+
 /* This variable is set on every rfbSendRectEncodingTight() call. */
 static Bool usePixelFormat24;
 
@@ -89,26 +96,6 @@ static const int subsampLevel2tjsubsamp[TVNC_SAMPOPT] = {
 };
 
 
-/* Stuff dealing with palettes. */
-
-typedef struct COLOR_LIST_s {
-    struct COLOR_LIST_s *next;
-    int idx;
-    CARD32 rgb;
-} COLOR_LIST;
-
-typedef struct PALETTE_ENTRY_s {
-    COLOR_LIST *listNode;
-    int numPixels;
-} PALETTE_ENTRY;
-
-typedef struct PALETTE_s {
-    PALETTE_ENTRY entry[256];
-    COLOR_LIST *hash[256];
-    COLOR_LIST list[256];
-} PALETTE;
-
-
 /* Globals for multi-threading */
 
 #define TVNC_MAXTHREADS 8
@@ -128,13 +115,13 @@ typedef struct _threadparam {
     int updateBufSize;
     int paletteNumColors, paletteMaxColors;
     CARD32 monoBackground, monoForeground;
-    PALETTE palette;
+    rfbPalette palette;
     tjhandle j;
     int bytessent, rectsent;
     int streamId, baseStreamId, nStreams;
     pthread_mutex_t ready, done;
     Bool status, deadyet;
-    unsigned long solidrect, solidpixels, monorect, monopixels, ndxrect,
+    unsigned long long solidrect, solidpixels, monorect, monopixels, ndxrect,
         ndxpixels, jpegrect, jpegpixels, fcrect, fcpixels;
 } threadparam;
 
@@ -150,12 +137,6 @@ static void ExtendSolidArea   (rfbClientPtr cl, int x, int y, int w, int h,
                                int *x_ptr, int *y_ptr, int *w_ptr, int *h_ptr);
 static Bool CheckSolidTile    (rfbClientPtr cl, int x, int y, int w, int h,
                                CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile8   (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile16  (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
-static Bool CheckSolidTile32  (rfbClientPtr cl, int x, int y, int w, int h,
-                               CARD32 *colorPtr, Bool needSameColor);
 
 static Bool SendRectSimple    (threadparam *t, int x, int y, int w, int h);
 static Bool SendSubrect       (threadparam *t, int x, int y, int w, int h);
@@ -179,7 +160,7 @@ static void FastFillPalette32 (threadparam *t, CARD32 *data, int w, int pitch,
                                int h);
 
 static void PaletteReset (threadparam *t);
-static int PaletteInsert (threadparam *t, CARD32 rgb, int numPixels, int bpp);
+static int PaletteInsert (threadparam *t, CARD32 rgb, int numPixels);
 
 static void Pack24 (char *buf, rfbPixelFormat *fmt, int count);
 
@@ -200,9 +181,9 @@ static Bool CheckUpdateBuf(threadparam *t, int bytes);
 static int nthreads(void);
 
 
-unsigned long solidrect = 0, solidpixels = 0, monorect = 0, monopixels = 0,
-    ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0, fcrect = 0,
-    fcpixels = 0, gradrect = 0, gradpixels = 0;
+unsigned long long solidrect = 0, solidpixels = 0, monorect = 0,
+    monopixels = 0, ndxrect = 0, ndxpixels = 0, jpegrect = 0, jpegpixels = 0,
+    fcrect = 0, fcpixels = 0, gradrect = 0, gradpixels = 0;
 
 
 /*
@@ -352,6 +333,23 @@ CheckUpdateBuf(t, bytes)
 }
 
 
+/*
+ * Set the encoder levels at run time (see rfb.h.)
+ */
+
+void
+rfbSetTightLevels(compress, quality, subsamp)
+    int compress, quality, subsamp;
+{
+    if (compress != rfbTightLevelDefault)
+        compressLevel = compress;
+    if (quality != rfbTightLevelDefault)
+        qualityLevel = quality;
+    if (subsamp != rfbTightLevelDefault)
+        subsampLevel = subsamp;
+}
+
+
 Bool
 rfbSendRectEncodingTight(cl, x, y, w, h)
     rfbClientPtr cl;
@@ -444,7 +442,7 @@ rfbSendRectEncodingTight(cl, x, y, w, h)
         }
         for (i = 1; i < nt; i++) {
             if ((*tparam[i].ublen) > 0 && decompress) {
-                if ((*tparam[i].ublen) + sblen > SEND_BUF_SIZE) {
+                if ((*tparam[i].ublen) + sblen > sendBufSize) {
                     rfbLog("ERROR: Send buffer overrun.\n");
                     return FALSE;
                 }
@@ -663,37 +661,31 @@ ExtendSolidArea(cl, x, y, w, h, colorValue, x_ptr, y_ptr, w_ptr, h_ptr)
     CARD32 colorValue;
     int *x_ptr, *y_ptr, *w_ptr, *h_ptr;
 {
-    int cx, cy;
+    int bpp = rfbServerFormat.bitsPerPixel;
+    int pitch = rfbScreen.paddedWidthInBytes, n;
 
     /* Try to extend the area upwards. */
-    for (cy = *y_ptr - 1;
-         cy >= y && CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue,
-                                   TRUE);
-         cy--);
-    *h_ptr += *y_ptr - (cy + 1);
-    *y_ptr = cy + 1;
+    n = rfbSolidBottomRows(FB_PTR(cl, *x_ptr, y), pitch, *w_ptr, *y_ptr - y,
+                           bpp, colorValue);
+    *y_ptr -= n;
+    *h_ptr += n;
 
     /* ... downwards. */
-    for (cy = *y_ptr + *h_ptr;
-         cy < y + h &&
-             CheckSolidTile(cl, *x_ptr, cy, *w_ptr, 1, &colorValue, TRUE);
-         cy++);
-    *h_ptr += cy - (*y_ptr + *h_ptr);
+    n = rfbSolidTopRows(FB_PTR(cl, *x_ptr, *y_ptr + *h_ptr), pitch, *w_ptr,
+                        y + h - (*y_ptr + *h_ptr), bpp, colorValue);
+    *h_ptr += n;
 
     /* ... to the left. */
-    for (cx = *x_ptr - 1;
-         cx >= x && CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue,
-                                   TRUE);
-         cx--);
-    *w_ptr += *x_ptr - (cx + 1);
-    *x_ptr = cx + 1;
+    n = rfbSolidRightColumns(FB_PTR(cl, x, *y_ptr), pitch, *x_ptr - x, *h_ptr,
+                             bpp, colorValue);
+    *x_ptr -= n;
+    *w_ptr += n;
 
     /* ... to the right. */
-    for (cx = *x_ptr + *w_ptr;
-         cx < x + w &&
-             CheckSolidTile(cl, cx, *y_ptr, 1, *h_ptr, &colorValue, TRUE);
-         cx++);
-    *w_ptr += cx - (*x_ptr + *w_ptr);
+    n = rfbSolidLeftColumns(FB_PTR(cl, *x_ptr + *w_ptr, *y_ptr), pitch,
+                            x + w - (*x_ptr + *w_ptr), *h_ptr, bpp,
+                            colorValue);
+    *w_ptr += n;
 }
 
 
@@ -711,53 +703,32 @@ CheckSolidTile(cl, x, y, w, h, colorPtr, needSameColor)
     CARD32 *colorPtr;
     Bool needSameColor;
 {
-    switch(rfbServerFormat.bitsPerPixel) {
+    int bpp = rfbServerFormat.bitsPerPixel;
+    char *fbptr = FB_PTR(cl, x, y);
+    CARD32 colorValue;
+
+    switch (bpp) {
     case 32:
-        return CheckSolidTile32(cl, x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD32 *)fbptr;
+        break;
     case 16:
-        return CheckSolidTile16(cl, x, y, w, h, colorPtr, needSameColor);
+        colorValue = *(CARD16 *)fbptr;
+        break;
     default:
-        return CheckSolidTile8(cl, x, y, w, h, colorPtr, needSameColor);
+        bpp = 8;
+        colorValue = *(CARD8 *)fbptr;
     }
-}
+    if (needSameColor && colorValue != *colorPtr)
+        return FALSE;
 
+    if (!rfbSolidCheck(fbptr, rfbScreen.paddedWidthInBytes, w, h, bpp,
+                       colorValue))
+        return FALSE;
 
-#define DEFINE_CHECK_SOLID_FUNCTION(bpp)                                      \
-                                                                              \
-static Bool                                                                   \
-CheckSolidTile##bpp(cl, x, y, w, h, colorPtr, needSameColor)                  \
-    rfbClientPtr cl;                                                          \
-    int x, y, w, h;                                                           \
-    CARD32 *colorPtr;                                                         \
-    Bool needSameColor;                                                       \
-{                                                                             \
-    CARD##bpp *fbptr;                                                         \
-    CARD##bpp colorValue;                                                     \
-    int dx, dy;                                                               \
-                                                                              \
-    fbptr = (CARD##bpp *)                                                     \
-        &cl->fb[y * rfbScreen.paddedWidthInBytes + x * (bpp/8)];              \
-                                                                              \
-    colorValue = *fbptr;                                                      \
-    if (needSameColor && (CARD32)colorValue != *colorPtr)                     \
-        return FALSE;                                                         \
-                                                                              \
-    for (dy = 0; dy < h; dy++) {                                              \
-        for (dx = 0; dx < w; dx++) {                                          \
-            if (colorValue != fbptr[dx])                                      \
-                return FALSE;                                                 \
-        }                                                                     \
-        fbptr = (CARD##bpp *)((CARD8 *)fbptr + rfbScreen.paddedWidthInBytes); \
-    }                                                                         \
-                                                                              \
-    *colorPtr = (CARD32)colorValue;                                           \
-    return TRUE;                                                              \
+    *colorPtr = colorValue;
+    return TRUE;
 }
 
-DEFINE_CHECK_SOLID_FUNCTION(8)
-DEFINE_CHECK_SOLID_FUNCTION(16)
-DEFINE_CHECK_SOLID_FUNCTION(32)
-
 
 static Bool
 SendRectSimple(t, x, y, w, h)
@@ -1094,7 +1065,7 @@ SendIndexedRect(t, w, h)
 
         for (i = 0; i < t->paletteNumColors; i++) {
             ((CARD32 *)t->tightAfterBuf)[i] =
-                t->palette.entry[i].listNode->rgb;
+                t->palette.entry[i].color;
         }
         if (usePixelFormat24) {
             Pack24(t->tightAfterBuf, &cl->format, t->paletteNumColors);
@@ -1113,7 +1084,7 @@ SendIndexedRect(t, w, h)
 
         for (i = 0; i < t->paletteNumColors; i++) {
             ((CARD16 *)t->tightAfterBuf)[i] =
-                (CARD16)t->palette.entry[i].listNode->rgb;
+                (CARD16)t->palette.entry[i].color;
         }
 
         memcpy(&t->updateBuf[*t->ublen], t->tightAfterBuf,
@@ -1332,10 +1303,10 @@ FillPalette##bpp(t, count)                                              \
 {                                                                       \
     CARD##bpp *data = (CARD##bpp *)t->tightBeforeBuf;                   \
     CARD##bpp c0, c1, ci;                                               \
-    int i, n0, n1, ni;                                                  \
+    int i, n, n0, n1, ni;                                               \
                                                                         \
     c0 = data[0];                                                       \
-    for (i = 1; i < count && data[i] == c0; i++);                       \
+    i = 1 + rfbSolidRun(&data[1], count - 1, bpp, c0);                  \
     if (i >= count) {                                                   \
         t->paletteNumColors = 1;   /* Solid rectangle */                \
         return;                                                         \
@@ -1371,21 +1342,22 @@ FillPalette##bpp(t, count)                                              \
     }                                                                   \
                                                                         \
     PaletteReset(t);                                                    \
-    PaletteInsert(t, c0, (CARD32)n0, bpp);                              \
-    PaletteInsert(t, c1, (CARD32)n1, bpp);                              \
+    PaletteInsert(t, c0, (CARD32)n0);                                   \
+    PaletteInsert(t, c1, (CARD32)n1);                                   \
                                                                         \
     ni = 1;                                                             \
     for (i++; i < count; i++) {                                         \
         if (data[i] == ci) {                                            \
-            ni++;                                                       \
+            n = rfbSolidRun(&data[i], count - i, bpp, ci);              \
+            ni += n;  i += n - 1;                                       \
         } else {                                                        \
-            if (!PaletteInsert (t, ci, (CARD32)ni, bpp))                \
+            if (!PaletteInsert (t, ci, (CARD32)ni))                     \
                 return;                                                 \
             ci = data[i];                                               \
             ni = 1;                                                     \
         }                                                               \
     }                                                                   \
-    PaletteInsert(t, ci, (CARD32)ni, bpp);                              \
+    PaletteInsert(t, ci, (CARD32)ni);                                   \
 }
 
 DEFINE_FILL_PALETTE_FUNCTION(16)
@@ -1401,7 +1373,7 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     int w, pitch, h;                                                    \
 {                                                                       \
     CARD##bpp c0, c1, ci, mask, c0t, c1t, cit;                          \
-    int i, j, i2, j2, n0, n1, ni;                                       \
+    int i, j, i2, j2, n, n0, n1, ni;                                    \
     rfbClientPtr cl = t->cl;                                            \
                                                                         \
     if (cl->translateFn != rfbTranslateNone) {                          \
@@ -1412,7 +1384,10 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
                                                                         \
     c0 = data[0] & mask;                                                \
     for (j = 0; j < h; j++) {                                           \
-        for (i = 0; i < w; i++) {                                       \
+        i = 0;                                                          \
+        if (mask == (CARD##bpp)~0)                                      \
+            i = rfbSolidRun(&data[j * pitch], w, bpp, c0);              \
+        for (; i < w; i++) {                                            \
             if ((data[j * pitch + i] & mask) != c0)                     \
                 goto done;                                              \
         }                                                               \
@@ -1463,21 +1438,25 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     }                                                                   \
                                                                         \
     PaletteReset(t);                                                    \
-    PaletteInsert(t, c0t, (CARD32)n0, bpp);                             \
-    PaletteInsert(t, c1t, (CARD32)n1, bpp);                             \
+    PaletteInsert(t, c0t, (CARD32)n0);                                  \
+    PaletteInsert(t, c1t, (CARD32)n1);                                  \
                                                                         \
     ni = 1;                                                             \
     i2++;  if (i2 >= w) {i2 = 0;  j2++;}                                \
     for (j = j2; j < h; j++) {                                          \
         for (i = i2; i < w; i++) {                                      \
             if ((data[j * pitch + i] & mask) == ci) {                   \
-                ni++;                                                   \
+                if (mask == (CARD##bpp)~0) {                            \
+                    n = rfbSolidRun(&data[j * pitch + i], w - i, bpp, ci);\
+                    ni += n;  i += n - 1;                               \
+                } else                                                  \
+                    ni++;                                               \
             } else {                                                    \
                 (*cl->translateFn)(cl->translateLookupTable,            \
                                    &rfbServerFormat, &cl->format,       \
                                    (char *)&ci, (char *)&cit, bpp/8,    \
                                    1, 1);                               \
-                if (!PaletteInsert (t, cit, (CARD32)ni, bpp))           \
+                if (!PaletteInsert (t, cit, (CARD32)ni))                \
                     return;                                             \
                 ci = data[j * pitch + i] & mask;                        \
                 ni = 1;                                                 \
@@ -1489,7 +1468,7 @@ FastFillPalette##bpp(t, data, w, pitch, h)                              \
     (*cl->translateFn)(cl->translateLookupTable, &rfbServerFormat,      \
                        &cl->format, (char *)&ci, (char *)&cit, bpp/8,   \
                        1, 1);                                           \
-    PaletteInsert(t, cit, (CARD32)ni, bpp);                             \
+    PaletteInsert(t, cit, (CARD32)ni);                                  \
 }
 
 DEFINE_FAST_FILL_PALETTE_FUNCTION(16)
@@ -1500,86 +1479,20 @@ DEFINE_FAST_FILL_PALETTE_FUNCTION(32)
  * Functions to operate with palette structures.
  */
 
-#define HASH_FUNC16(rgb) ((int)((((rgb) >> 8) + (rgb)) & 0xFF))
-#define HASH_FUNC32(rgb) ((int)((((rgb) >> 16) + ((rgb) >> 8)) & 0xFF))
-
-
 static void
-PaletteReset(t)
-    threadparam *t;
+PaletteReset(threadparam *t)
 {
     t->paletteNumColors = 0;
-    memset(t->palette.hash, 0, 256 * sizeof(COLOR_LIST *));
+    rfbPaletteReset(&t->palette);
 }
 
 
 static int
-PaletteInsert(t, rgb, numPixels, bpp)
-    threadparam *t;
-    CARD32 rgb;
-    int numPixels;
-    int bpp;
+PaletteInsert(threadparam *t, CARD32 rgb, int numPixels)
 {
-    COLOR_LIST *pnode;
-    COLOR_LIST *prev_pnode = NULL;
-    int hash_key, idx, new_idx, count;
-
-    hash_key = (bpp == 16) ? HASH_FUNC16(rgb) : HASH_FUNC32(rgb);
-
-    pnode = t->palette.hash[hash_key];
-
-    while (pnode != NULL) {
-        if (pnode->rgb == rgb) {
-            /* Such palette entry already exists. */
-            new_idx = idx = pnode->idx;
-            count = t->palette.entry[idx].numPixels + numPixels;
-            if (new_idx && t->palette.entry[new_idx-1].numPixels < count) {
-                do {
-                    t->palette.entry[new_idx] = t->palette.entry[new_idx-1];
-                    t->palette.entry[new_idx].listNode->idx = new_idx;
-                    new_idx--;
-                }
-                while (new_idx &&
-                       t->palette.entry[new_idx-1].numPixels < count);
-                t->palette.entry[new_idx].listNode = pnode;
-                pnode->idx = new_idx;
-            }
-            t->palette.entry[new_idx].numPixels = count;
-            return t->paletteNumColors;
-        }
-        prev_pnode = pnode;
-        pnode = pnode->next;
-    }
-
-    /* Check if palette is full. */
-    if (t->paletteNumColors == 256 ||
-        t->paletteNumColors == t->paletteMaxColors) {
-        t->paletteNumColors = 0;
-        return 0;
-    }
-
-    /* Move palette entries with lesser pixel counts. */
-    for (idx = t->paletteNumColors;
-         idx > 0 && t->palette.entry[idx-1].numPixels < numPixels;
-         idx--) {
-        t->palette.entry[idx] = t->palette.entry[idx-1];
-        t->palette.entry[idx].listNode->idx = idx;
-    }
-
-    /* Add new palette entry into the freed slot. */
-    pnode = &t->palette.list[t->paletteNumColors];
-    if (prev_pnode != NULL) {
-        prev_pnode->next = pnode;
-    } else {
-        t->palette.hash[hash_key] = pnode;
-    }
-    pnode->next = NULL;
-    pnode->idx = idx;
-    pnode->rgb = rgb;
-    t->palette.entry[idx].listNode = pnode;
-    t->palette.entry[idx].numPixels = numPixels;
-
-    return (++(t->paletteNumColors));
+    t->paletteNumColors = rfbPaletteInsert(&t->palette, rgb, numPixels,
+                                           t->paletteMaxColors);
+    return t->paletteNumColors;
 }
 
 
@@ -1631,30 +1544,19 @@ EncodeIndexedRect##bpp(t, buf, count)                                   \
     CARD8 *buf;                                                         \
     int count;                                                          \
 {                                                                       \
-    COLOR_LIST *pnode;                                                  \
     CARD##bpp *src;                                                     \
     CARD##bpp rgb;                                                      \
-    int rep = 0;                                                        \
+    int rep;                                                            \
                                                                         \
     src = (CARD##bpp *) buf;                                            \
                                                                         \
+    /* The indices are written over the pixels that have been read. */  \
     while (count--) {                                                   \
         rgb = *src++;                                                   \
-        while (count && *src == rgb) {                                  \
-            rep++, src++, count--;                                      \
-        }                                                               \
-        pnode = t->palette.hash[HASH_FUNC##bpp(rgb)];                   \
-        while (pnode != NULL) {                                         \
-            if ((CARD##bpp)pnode->rgb == rgb) {                         \
-                *buf++ = (CARD8)pnode->idx;                             \
-                while (rep) {                                           \
-                    *buf++ = (CARD8)pnode->idx;                         \
-                    rep--;                                              \
-                }                                                       \
-                break;                                                  \
-            }                                                           \
-            pnode = pnode->next;                                        \
-        }                                                               \
+        rep = (count && *src == rgb) ? rfbSolidRun(src, count, bpp, rgb) : 0;\
+        src += rep;  count -= rep;                                      \
+        memset(buf, rfbPaletteLookup(&t->palette, rgb), rep + 1);       \
+        buf += rep + 1;                                                 \
     }                                                                   \
 }
 
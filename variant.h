@@ -0,0 +1,106 @@
+/*
+ *  This is free software; you can redistribute it and/or modify
+ *  it under the terms of the GNU General Public License as published by
+ *  the Free Software Foundation; either version 2 of the License, or
+ *  (at your option) any later version.
+ *
+ *  This software is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *  GNU General Public License for more details.
+ *
+ *  You should have received a copy of the GNU General Public License
+ *  along with this software; if not, write to the Free Software
+ *  Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ *  USA.
+ */
+
+/*
+ * variant.h - symbol prefixing for Tight encoder/decoder variants
+ *
+ * Every Tight/Turbo/Tiger variant is built into the same compare-encodings
+ * executable, but the variants were written to be linked one at a time, so
+ * they all export the same global names.  The build system force-includes
+ * this header into each translation unit belonging to a variant (including
+ * the TigerVNC libraries) and defines TIGHT_VARIANT to a unique C identifier
+ * prefix, such as turbo_1_1_.  The macros below then rename every symbol that
+ * more than one variant defines, in the same way that zconf.h does for
+ * Z_PREFIX.  registry.c refers to the prefixed names.
+ */
+
+#ifndef __VARIANT_H__
+#define __VARIANT_H__
+
+#ifdef TIGHT_VARIANT
+
+#define TIGHT_VARIANT_CONCAT(a, b) a##b
+#define TIGHT_VARIANT_SYMBOL2(p, s) TIGHT_VARIANT_CONCAT(p, s)
+#define TIGHT_VARIANT_SYMBOL(s) TIGHT_VARIANT_SYMBOL2(TIGHT_VARIANT, s)
+
+/* Encoder entry points and settings */
+#define rfbSendRectEncodingTight TIGHT_VARIANT_SYMBOL(rfbSendRectEncodingTight)
+#define rfbNumCodedRectsTight TIGHT_VARIANT_SYMBOL(rfbNumCodedRectsTight)
+#define rfbTightDisableGradient TIGHT_VARIANT_SYMBOL(rfbTightDisableGradient)
+#define rfbTightDisableZlib TIGHT_VARIANT_SYMBOL(rfbTightDisableZlib)
+#define ShutdownTightThreads TIGHT_VARIANT_SYMBOL(ShutdownTightThreads)
+#define ResetH264Encoder TIGHT_VARIANT_SYMBOL(ResetH264Encoder)
+#define rfbSetTightLevels TIGHT_VARIANT_SYMBOL(rfbSetTightLevels)
+#define rfbGetTightPhases TIGHT_VARIANT_SYMBOL(rfbGetTightPhases)
+#define rfbResetTightPhases TIGHT_VARIANT_SYMBOL(rfbResetTightPhases)
+
+/* TIGHT_STATISTICS counters */
+#define solidrect TIGHT_VARIANT_SYMBOL(solidrect)
+#define solidpixels TIGHT_VARIANT_SYMBOL(solidpixels)
+#define monorect TIGHT_VARIANT_SYMBOL(monorect)
+#define monopixels TIGHT_VARIANT_SYMBOL(monopixels)
+#define ndxrect TIGHT_VARIANT_SYMBOL(ndxrect)
+#define ndxpixels TIGHT_VARIANT_SYMBOL(ndxpixels)
+#define jpegrect TIGHT_VARIANT_SYMBOL(jpegrect)
+#define jpegpixels TIGHT_VARIANT_SYMBOL(jpegpixels)
+#define gradrect TIGHT_VARIANT_SYMBOL(gradrect)
+#define gradpixels TIGHT_VARIANT_SYMBOL(gradpixels)
+#define fcrect TIGHT_VARIANT_SYMBOL(fcrect)
+#define fcpixels TIGHT_VARIANT_SYMBOL(fcpixels)
+
+/* Decoder state (see tightdecoder.c) */
+#define rfbTightDecoder TIGHT_VARIANT_SYMBOL(rfbTightDecoder)
+#define zlibStreamActive TIGHT_VARIANT_SYMBOL(zlibStreamActive)
+#define ShutdownThreads TIGHT_VARIANT_SYMBOL(ShutdownThreads)
+
+/* Xregion, which is bundled with TigerVNC 1.2 and later */
+#define XClipBox TIGHT_VARIANT_SYMBOL(XClipBox)
+#define XCreateRegion TIGHT_VARIANT_SYMBOL(XCreateRegion)
+#define XDestroyRegion TIGHT_VARIANT_SYMBOL(XDestroyRegion)
+#define XEmptyRegion TIGHT_VARIANT_SYMBOL(XEmptyRegion)
+#define XEqualRegion TIGHT_VARIANT_SYMBOL(XEqualRegion)
+#define XIntersectRegion TIGHT_VARIANT_SYMBOL(XIntersectRegion)
+#define XOffsetRegion TIGHT_VARIANT_SYMBOL(XOffsetRegion)
+#define XPointInRegion TIGHT_VARIANT_SYMBOL(XPointInRegion)
+#define XRectInRegion TIGHT_VARIANT_SYMBOL(XRectInRegion)
+#define XShrinkRegion TIGHT_VARIANT_SYMBOL(XShrinkRegion)
+#define XSubtractRegion TIGHT_VARIANT_SYMBOL(XSubtractRegion)
+#define XUnionRectWithRegion TIGHT_VARIANT_SYMBOL(XUnionRectWithRegion)
+#define XUnionRegion TIGHT_VARIANT_SYMBOL(XUnionRegion)
+#define XXorRegion TIGHT_VARIANT_SYMBOL(XXorRegion)
+
+#ifdef __cplusplus
+
+/* The TigerVNC namespaces, and the globals that the TigerVNC-based encoders
+   share with their libraries */
+#define rfb TIGHT_VARIANT_SYMBOL(rfb)
+#define rdr TIGHT_VARIANT_SYMBOL(rdr)
+#define cl TIGHT_VARIANT_SYMBOL(cl)
+#define rfbos TIGHT_VARIANT_SYMBOL(rfbos)
+#define clientPF TIGHT_VARIANT_SYMBOL(clientPF)
+#define compareFB TIGHT_VARIANT_SYMBOL(compareFB)
+#define compressLevel TIGHT_VARIANT_SYMBOL(compressLevel)
+#define qualityLevel TIGHT_VARIANT_SYMBOL(qualityLevel)
+#define fineQualityLevel TIGHT_VARIANT_SYMBOL(fineQualityLevel)
+#define subsampling TIGHT_VARIANT_SYMBOL(subsampling)
+#define getImageBuf TIGHT_VARIANT_SYMBOL(getImageBuf)
+
+#endif
+
+#endif /* TIGHT_VARIANT */
+
+#endif /* __VARIANT_H__ */
@@ -30,8 +30,8 @@
 #include <string.h>
 
 
-static int preferredEncoding = rfbEncodingZRLE;
-static int imageQualityLevel = 0;
+int rfbZRLEPreferredEncoding = rfbEncodingZRLE;
+int rfbZRLEQualityLevel = 0;
 
 
 #define GET_IMAGE_INTO_BUF(tx,ty,tw,th,buf)                                \
@@ -120,12 +120,12 @@ Bool rfbSendRectEncodingZRLE(rfbClientPtr cl, int x, int y, int w, int h)
   }
   zrleBeforeBuf = cl->zrleBeforeBuf;
 
-  if (preferredEncoding == rfbEncodingZYWRLE) {
-    if (imageQualityLevel < 0) {
+  if (rfbZRLEPreferredEncoding == rfbEncodingZYWRLE) {
+    if (rfbZRLEQualityLevel < 0) {
       cl->zywrleLevel = 1;
-    } else if (imageQualityLevel < 3) {
+    } else if (rfbZRLEQualityLevel < 3) {
       cl->zywrleLevel = 3;
-    } else if (imageQualityLevel < 6) {
+    } else if (rfbZRLEQualityLevel < 6) {
       cl->zywrleLevel = 2;
     } else {
       cl->zywrleLevel = 1;
@@ -207,7 +207,7 @@ Bool rfbSendRectEncodingZRLE(rfbClientPtr cl, int x, int y, int w, int h)
   rect.r.y = Swap16IfLE(y);
   rect.r.w = Swap16IfLE(w);
   rect.r.h = Swap16IfLE(h);
-  rect.encoding = Swap32IfLE(preferredEncoding);
+  rect.encoding = Swap32IfLE(rfbZRLEPreferredEncoding);
 
   memcpy(updateBuf + ublen, (char *)&rect,
          sz_rfbFramebufferUpdateRectHeader);
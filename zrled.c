@@ -0,0 +1,356 @@
+/*
+ * This is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This software is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this software; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301,
+ * USA.
+ */
+
+
+/*
+ * zrled.c - handle ZRLE and ZYWRLE encoding.
+ *
+ * This file shouldn't be compiled directly.  It is included multiple times by
+ * compare-encodings.c, each time with a different definition of the macro BPP.
+ * For each value of BPP, this file defines a function which handles a ZRLE or
+ * ZYWRLE encoded rectangle with BPP bits per pixel.
+ *
+ * ZYWRLE is ZRLE with a wavelet transform applied to the raw tiles, so the
+ * same function handles both.  The ZYWRLE level isn't sent over the wire (a
+ * viewer derives it from the quality level that it requested), so the level
+ * that the encoder used for the rectangle is taken from rfbClient.  The
+ * wavelet code assumes the little-endian pixel formats that InitEverything()
+ * sets up.  ZYWRLE isn't defined for 8 bpp.
+ */
+
+#ifndef ZRLED_ONCE
+#define ZRLED_ONCE
+
+#ifndef __RFB_CONCAT2E
+#define __RFB_CONCAT2(a,b) a##b
+#define __RFB_CONCAT2E(a,b) __RFB_CONCAT2(a,b)
+#endif
+
+#ifndef __RFB_CONCAT3E
+#define __RFB_CONCAT3(a,b,c) a##b##c
+#define __RFB_CONCAT3E(a,b,c) __RFB_CONCAT3(a,b,c)
+#endif
+
+#define ENDIAN_LITTLE 0
+#define ENDIAN_BIG 1
+
+/* Inflates the zlib-compressed data of a ZRLE rectangle into zrle_buffer,
+   which is grown as needed.  Returns the number of bytes inflated, or -1 if
+   an error occurred. */
+static int
+InflateZRLE (int sizeHint)
+{
+  rfbZRLEHeader hdr;
+  int remaining, toRead, inflateResult;
+
+  if (zrle_buffer_size < sizeHint) {
+    free(zrle_buffer);
+    zrle_buffer_size = sizeHint;
+    if ((zrle_buffer = (char *)malloc(zrle_buffer_size)) == NULL) {
+      fprintf(stderr, "Could not allocate ZRLE buffer\n");
+      zrle_buffer_size = 0;
+      return -1;
+    }
+  }
+
+  if (!ReadFromRFBServer((char *)&hdr, sz_rfbZRLEHeader))
+    return -1;
+
+  remaining = Swap32IfLE(hdr.length);
+
+  if ( zrleStreamInited == False ) {
+
+    inflateResult = inflateInit( &zrleStream );
+
+    if ( inflateResult != Z_OK ) {
+      fprintf(stderr,
+              "inflateInit returned error: %d, msg: %s\n",
+              inflateResult,
+              zrleStream.msg);
+      return -1;
+    }
+
+    zrleStreamInited = True;
+
+  }
+
+  zrleStream.next_out  = ( Bytef * )zrle_buffer;
+  zrleStream.avail_out = zrle_buffer_size;
+
+  while ( remaining > 0 ) {
+
+    toRead = min(remaining, BUFFER_SIZE);
+
+    if (!ReadFromRFBServer(buffer, toRead))
+      return -1;
+
+    zrleStream.next_in  = ( Bytef * )buffer;
+    zrleStream.avail_in = toRead;
+
+    /* The encoder flushes the stream at the end of each rectangle, so all of
+       the output is available once the input has been consumed. */
+    while ( zrleStream.avail_in > 0 || zrleStream.avail_out == 0 ) {
+
+      if ( zrleStream.avail_out == 0 ) {
+        int used = zrle_buffer_size;
+        char *newBuffer = (char *)realloc(zrle_buffer, zrle_buffer_size * 2);
+        if (newBuffer == NULL) {
+          fprintf(stderr, "Could not allocate ZRLE buffer\n");
+          return -1;
+        }
+        zrle_buffer = newBuffer;
+        zrle_buffer_size *= 2;
+        zrleStream.next_out  = ( Bytef * )zrle_buffer + used;
+        zrleStream.avail_out = zrle_buffer_size - used;
+      }
+
+      inflateResult = inflate( &zrleStream, Z_SYNC_FLUSH );
+
+      /* No more output can be produced from the input consumed so far */
+      if ( inflateResult == Z_BUF_ERROR || inflateResult == Z_STREAM_END )
+        break;
+
+      if ( inflateResult == Z_NEED_DICT ) {
+        fprintf(stderr,"zlib inflate needs a dictionary!\n");
+        return -1;
+      }
+      if ( inflateResult < 0 ) {
+        fprintf(stderr,
+                "zlib inflate returned error: %d, msg: %s\n",
+                inflateResult,
+                zrleStream.msg);
+        return -1;
+      }
+    }
+
+    remaining -= toRead;
+  }
+
+  return (int)(( char * )zrleStream.next_out - zrle_buffer);
+}
+
+#endif /* ZRLED_ONCE */
+
+#define HandleZRLEBPP CONCAT2E(HandleZRLE,BPP)
+#define HandleZRLETileBPP CONCAT2E(HandleZRLETile,BPP)
+#define CARDBPP CONCAT2E(CARD,BPP)
+
+#if BPP != 8
+#define PIXEL_T CARDBPP
+#undef END_FIX
+#define END_FIX LE
+#undef ZYWRLE_ENDIAN
+#define ZYWRLE_ENDIAN ENDIAN_LITTLE
+#define ZYWRLE_DECODE
+#include "zywrletemplate.c"
+#undef ZYWRLE_DECODE
+#undef PIXEL_T
+#endif
+
+/* At 32 bpp, pixels are sent as 3-byte "compressed pixels" if the colour
+   values fit into either the least significant or the most significant 3
+   bytes. */
+#if BPP == 32
+#define GET_CPIXEL(pix, ptr)                                               \
+  (cpixelSize == 4 ? memcpy(&(pix), (ptr), 4) :                            \
+   ((pix) = 0, memcpy((CARD8 *)&(pix) + cpixelOffset, (ptr), 3)),          \
+   (ptr) += cpixelSize)
+#else
+#define GET_CPIXEL(pix, ptr) (memcpy(&(pix), (ptr), BPP / 8), (ptr) += BPP / 8)
+#endif
+
+/* Decodes one w x h tile from the inflated data into tile, which is w pixels
+   wide.  Returns a pointer to the end of the tile data, or NULL if the tile
+   data is invalid or truncated. */
+static CARD8 *
+HandleZRLETileBPP (CARD8 *ptr, CARD8 *end, CARDBPP *tile, int w, int h,
+                   int cpixelSize, int cpixelOffset, int zywrleLevel)
+{
+  CARDBPP palette[128], pix, *dst = tile, *tileEnd = tile + w * h;
+  int type, paletteSize = 0, i, j;
+
+  if (ptr >= end)
+    return NULL;
+  type = *ptr++;
+
+  if (type == 0) {
+#if BPP != 8
+    /* The wavelet coefficients are encoded as another tile, using whichever
+       subencoding is smallest for them. */
+    if (zywrleLevel > 0) {
+      if ((ptr = HandleZRLETileBPP (ptr, end, tile, w, h, cpixelSize,
+                                    cpixelOffset, 0)) == NULL)
+        return NULL;
+      ZYWRLE_SYNTHESIZE (tile, tile, w, h, w, zywrleLevel, zywrleBuf);
+      return ptr;
+    }
+#endif
+    if (end - ptr < w * h * cpixelSize)
+      return NULL;
+    if (cpixelSize == sizeof(CARDBPP)) {
+      memcpy(tile, ptr, w * h * sizeof(CARDBPP));
+      ptr += w * h * sizeof(CARDBPP);
+    } else {
+      while (dst < tileEnd) {
+        GET_CPIXEL(pix, ptr);
+        *dst++ = pix;
+      }
+    }
+    return ptr;
+  }
+
+  if (type == 1) {
+    if (end - ptr < cpixelSize)
+      return NULL;
+    GET_CPIXEL(pix, ptr);
+    while (dst < tileEnd)
+      *dst++ = pix;
+    return ptr;
+  }
+
+  if (type <= 16)
+    paletteSize = type;
+  else if (type >= 130)
+    paletteSize = type - 128;
+  else if (type != 128)
+    return NULL;
+
+  if (end - ptr < paletteSize * cpixelSize)
+    return NULL;
+  for (i = 0; i < paletteSize; i++)
+    GET_CPIXEL(palette[i], ptr);
+
+  if (type <= 16) {
+
+    /* Packed palette indices, with each row padded to a whole byte */
+    int bppp = type > 4 ? 4 : type > 2 ? 2 : 1;
+    CARD8 mask = (1 << bppp) - 1;
+
+    if (end - ptr < (w * bppp + 7) / 8 * h)
+      return NULL;
+    for (j = 0; j < h; j++) {
+      int nbits = 0;
+      CARD8 byte = 0;
+      for (i = 0; i < w; i++) {
+        if (nbits == 0) {
+          byte = *ptr++;
+          nbits = 8;
+        }
+        nbits -= bppp;
+        *dst++ = palette[(byte >> nbits) & mask];
+      }
+    }
+    return ptr;
+  }
+
+  /* Plain RLE (type 128) or palette RLE.  A run length is encoded as a series
+     of bytes that add up to the length - 1, all but the last of which are
+     255. */
+  while (dst < tileEnd) {
+    int len = 1, b;
+
+    if (type == 128) {
+      if (end - ptr < cpixelSize)
+        return NULL;
+      GET_CPIXEL(pix, ptr);
+    } else {
+      if (ptr >= end)
+        return NULL;
+      b = *ptr++;
+      pix = palette[b & 127];
+      if (!(b & 128)) {
+        *dst++ = pix;
+        continue;
+      }
+    }
+    do {
+      if (ptr >= end)
+        return NULL;
+      b = *ptr++;
+      len += b;
+    } while (b == 255);
+
+    if (len > tileEnd - dst)
+      return NULL;
+    while (len--)
+      *dst++ = pix;
+  }
+
+  return ptr;
+}
+
+static Bool
+HandleZRLEBPP (int rx, int ry, int rw, int rh)
+{
+  CARDBPP tile[rfbZRLETileWidth * rfbZRLETileHeight];
+  CARD8 *ptr, *end;
+  int x, y, w, h, len;
+  int cpixelSize = BPP / 8, cpixelOffset = 0;
+
+#if BPP == 32
+  {
+    Bool fitsInLS3Bytes
+      = ((myFormat.redMax   << myFormat.redShift)   < (1<<24) &&
+         (myFormat.greenMax << myFormat.greenShift) < (1<<24) &&
+         (myFormat.blueMax  << myFormat.blueShift)  < (1<<24));
+
+    Bool fitsInMS3Bytes = (myFormat.redShift   > 7  &&
+                           myFormat.greenShift > 7  &&
+                           myFormat.blueShift  > 7);
+
+    if ((fitsInLS3Bytes && !myFormat.bigEndian) ||
+        (fitsInMS3Bytes && myFormat.bigEndian))
+      cpixelSize = 3;
+    else if ((fitsInLS3Bytes && myFormat.bigEndian) ||
+             (fitsInMS3Bytes && !myFormat.bigEndian)) {
+      cpixelSize = 3;
+      cpixelOffset = 1;
+    }
+  }
+#endif
+
+  if ((len = InflateZRLE (rw * rh * cpixelSize)) < 0)
+    return False;
+
+  ptr = (CARD8 *)zrle_buffer;
+  end = ptr + len;
+
+  for (y = ry; y < ry+rh; y += rfbZRLETileHeight) {
+    h = min(rfbZRLETileHeight, ry+rh - y);
+    for (x = rx; x < rx+rw; x += rfbZRLETileWidth) {
+      w = min(rfbZRLETileWidth, rx+rw - x);
+
+      if ((ptr = HandleZRLETileBPP (ptr, end, tile, w, h, cpixelSize,
+                                    cpixelOffset,
+                                    rfbClient.zywrleLevel)) == NULL) {
+        fprintf(stderr, "Invalid or truncated ZRLE tile data\n");
+        return False;
+      }
+
+/*      CopyDataToScreen((char *)tile, x, y, w, h); */
+    }
+  }
+
+  if (ptr != end) {
+    fprintf(stderr, "Extra data after the last ZRLE tile\n");
+    return False;
+  }
+
+  return True;
+}
+
+#undef GET_CPIXEL
@@ -20,29 +20,21 @@
 
 #include "zrlepalettehelper.h"
 #include <assert.h>
-#include <string.h>
-
-#define ZRLE_HASH(pix) (((pix) ^ ((pix) >> 17)) & 4095)
 
 void zrlePaletteHelperInit(zrlePaletteHelper *helper)
 {
-  memset(helper->palette, 0, sizeof(helper->palette));
-  memset(helper->index, 255, sizeof(helper->index));
-  memset(helper->key, 0, sizeof(helper->key));
+  rfbPaletteHashReset(&helper->hash);
   helper->size = 0;
 }
 
 void zrlePaletteHelperInsert(zrlePaletteHelper *helper, zrle_U32 pix)
 {
   if (helper->size < ZRLE_PALETTE_MAX_SIZE) {
-    int i = ZRLE_HASH(pix);
+    int slot = rfbPaletteHashFind(&helper->hash, pix);
 
-    while (helper->index[i] != 255 && helper->key[i] != pix)
-      i++;
-    if (helper->index[i] != 255) return;
+    if (slot >= 0) return;
 
-    helper->index[i] = helper->size;
-    helper->key[i] = pix;
+    rfbPaletteHashAdd(&helper->hash, slot, pix, helper->size);
     helper->palette[helper->size] = pix;
   }
   helper->size++;
@@ -50,13 +42,7 @@ void zrlePaletteHelperInsert(zrlePaletteHelper *helper, zrle_U32 pix)
 
 int zrlePaletteHelperLookup(zrlePaletteHelper *helper, zrle_U32 pix)
 {
-  int i = ZRLE_HASH(pix);
-
   assert(helper->size <= ZRLE_PALETTE_MAX_SIZE);
-  
-  while (helper->index[i] != 255 && helper->key[i] != pix)
-    i++;
-  if (helper->index[i] != 255) return helper->index[i];
 
-  return -1;
+  return rfbPaletteHashLookup(&helper->hash, pix);
 }
@@ -20,21 +20,22 @@
 
 /*
  * The PaletteHelper class helps us build up the palette from pixel data by
- * storing a reverse index using a simple hash-table
+ * storing a reverse index in a palette hash table (see palettehash.h.)
+ * zrlePaletteHelperInit() must be called before the helper is used.
  */
 
 #ifndef __ZRLE_PALETTE_HELPER_H__
 #define __ZRLE_PALETTE_HELPER_H__
 
 #include "zrletypes.h"
+#include "palettehash.h"
 
 #define ZRLE_PALETTE_MAX_SIZE 127
 
 typedef struct {
-  zrle_U32  palette[ZRLE_PALETTE_MAX_SIZE];
-  zrle_U8   index[ZRLE_PALETTE_MAX_SIZE + 4096];
-  zrle_U32  key[ZRLE_PALETTE_MAX_SIZE + 4096];
-  int       size;
+  zrle_U32       palette[ZRLE_PALETTE_MAX_SIZE];
+  rfbPaletteHash hash;
+  int            size;
 } zrlePaletteHelper;
 
 void zrlePaletteHelperInit  (zrlePaletteHelper *helper);